@@ -32,6 +32,8 @@ enum backing_store_flags {
 	BACKING_STORE_NONE = 0,
 	/** data is metadata */
 	BACKING_STORE_META = 1,
+	/** data is already in a compressed format */
+	BACKING_STORE_COMPRESSED = 2,
 };
 
 /**
@@ -75,7 +77,10 @@ struct gui_llcache_table {
 	 * @param[in] flags The flags to control how the object is stored.
 	 * @param[in] data The objects data.
 	 * @param[in] datalen The length of the \a data.
-	 * @return NSERROR_OK on success or error code on failure.
+	 * @return NSERROR_OK on success, NSERROR_NOSPACE if the store
+	 *         cannot accept the data at present or error code on
+	 *         failure. The caller retains ownership of \a data if
+	 *         an error is returned.
 	 */
 	nserror (*store)(struct nsurl *url, enum backing_store_flags flags,
 			 uint8_t *data, const size_t datalen);
@@ -53,7 +53,10 @@ const char * const content_status_name[] = {
 /**
  * All data has arrived, convert for display.
  *
- * Calls the convert function for the content.
+ * Calls the convert function for the content.  This happens from
+ * CONTENT_STATUS_LOADING or, if the content was made ready by
+ * content_set_ready_partial() while its data arrived, from
+ * CONTENT_STATUS_READY.
  *
  * - If the conversion succeeds, but there is still some processing required
  *   (eg. loading images), the content gets status CONTENT_STATUS_READY, and a
@@ -67,9 +70,11 @@ static void content_convert(struct content *c)
 {
 	assert(c);
 	assert(c->status == CONTENT_STATUS_LOADING ||
+	       c->status == CONTENT_STATUS_READY ||
 	       c->status == CONTENT_STATUS_ERROR);
 
-	if (c->status != CONTENT_STATUS_LOADING)
+	/* contents made ready while their data arrived are converted */
+	if (c->status == CONTENT_STATUS_ERROR)
 		return;
 
 	if (c->locked == true)
@@ -78,6 +83,8 @@ static void content_convert(struct content *c)
 	NSLOG(netsurf, INFO, "content "URL_FMT_SPC" (%p)",
 	      nsurl_access_log(llcache_handle_get_url(c->llcache)), c);
 
+	c->partial = false;
+
 	if (c->handler->data_complete != NULL) {
 		c->locked = true;
 		if (c->handler->data_complete(c) == false) {
@@ -233,6 +240,7 @@ content__init(struct content *c,
 	c->user_list = user_sentinel;
 	c->sub_status[0] = 0;
 	c->locked = false;
+	c->partial = false;
 	c->total_size = 0;
 	c->http_code = 0;
 
@@ -288,12 +296,31 @@ void content_set_ready(struct content *c)
 	assert(c->locked);
 	c->locked = false;
 
+	if (c->status == CONTENT_STATUS_READY) {
+		/* users were told when the data began to arrive */
+		return;
+	}
+
 	c->status = CONTENT_STATUS_READY;
 	content_update_status(c);
 	content_broadcast(c, CONTENT_MSG_READY, NULL);
 }
 
 
+/* exported interface documented in content/protected.h */
+void content_set_ready_partial(struct content *c)
+{
+	if (c->status != CONTENT_STATUS_LOADING) {
+		return;
+	}
+
+	c->status = CONTENT_STATUS_READY;
+	c->partial = true;
+	content_update_status(c);
+	content_broadcast(c, CONTENT_MSG_READY, NULL);
+}
+
+
 /* exported interface documented in content/protected.h */
 void content_set_done(struct content *c)
 {
@@ -1136,6 +1163,17 @@ content_status content__get_status(struct content *c)
 }
 
 
+/* exported interface documented in content/content.h */
+bool content__is_loading(struct content *c)
+{
+	if (c == NULL)
+		return false;
+
+	return (c->status == CONTENT_STATUS_LOADING) ||
+		((c->status == CONTENT_STATUS_READY) && c->partial);
+}
+
+
 /* exported interface documented in content/content.h */
 const char *content_get_status_message(hlcache_handle *h)
 {
@@ -1224,6 +1262,21 @@ const uint8_t *content__get_source_data(struct content *c, size_t *size)
 }
 
 
+/* exported interface documented in content/content_protected.h */
+const uint8_t *
+content__get_source_chunk(struct content *c, size_t offset, size_t *size)
+{
+	assert(size != NULL);
+
+	if (c == NULL) {
+		*size = 0;
+		return NULL;
+	}
+
+	return llcache_handle_get_source_chunk(c->llcache, offset, size);
+}
+
+
 /* exported interface documented in content/content.h */
 void content_invalidate_reuse_data(hlcache_handle *h)
 {
@@ -1436,6 +1489,7 @@ nserror content__clone(const struct content *c, struct content *nc)
 	memcpy(&(nc->sub_status), &(c->sub_status), 80);
 
 	nc->locked = c->locked;
+	nc->partial = c->partial;
 	nc->total_size = c->total_size;
 	nc->http_code = c->http_code;
 
@@ -477,6 +477,16 @@ content_status content_get_status(struct hlcache_handle *h);
  */
 content_status content__get_status(struct content *c);
 
+/**
+ * Find whether a content's data is still arriving
+ *
+ * A content may be ready for display before all its data has arrived.
+ *
+ * \param c Content to test.
+ * \return true if the content is yet to be converted, false otherwise.
+ */
+bool content__is_loading(struct content *c);
+
 
 /**
  * Retrieve status message associated with content
@@ -275,6 +275,11 @@ struct content {
 	 * inconsistent and content must not be redrawn or modified.
 	 */
 	bool locked;
+	/**
+	 * Content was made ready before all its data arrived and is
+	 * yet to be converted.
+	 */
+	bool partial;
 
 	/**
 	 * Total data size, 0 if unknown.
@@ -326,9 +331,20 @@ nserror content__clone(const struct content *c, struct content *nc);
 
 /**
  * Put a content in status CONTENT_STATUS_READY and unlock the content.
+ *
+ * A content already made ready while its data arrived is only unlocked.
  */
 void content_set_ready(struct content *c);
 
+/**
+ * Put a content in status CONTENT_STATUS_READY before all its data has arrived.
+ *
+ * Handlers able to display partial data call this while processing
+ * data, once the content dimensions are known.  Conversion still
+ * happens once all the data has arrived.
+ */
+void content_set_ready_partial(struct content *c);
+
 /**
  * Put a content in status CONTENT_STATUS_DONE.
  */
@@ -468,6 +484,17 @@ int content__get_available_width(struct content *c);
  */
 const uint8_t *content__get_source_data(struct content *c, size_t *size);
 
+/**
+ * Retrieve a chunk of the source of content.
+ *
+ * \param c      Content to retrieve source of.
+ * \param offset Byte offset of the chunk within the source.
+ * \param size   Pointer to location to receive byte size of chunk.
+ * \return Pointer to chunk data, or NULL when there is no more source.
+ */
+const uint8_t *content__get_source_chunk(struct content *c,
+		size_t offset, size_t *size);
+
 /**
  * Invalidate content reuse data.
  *
@@ -28,12 +28,14 @@
  * Active fetches are held in the circular linked list ::fetch_ring. There may
  * be at most nsoption max_fetchers_per_host active requests per Host: header.
  * There may be at most nsoption max_fetchers active requests overall. Inactive
- * fetches are stored in the ::queue_ring waiting for use.
+ * fetches are stored in the ::queue_ring waiting for use and are dispatched
+ * in order of their priority, spread fairly across hosts.
  */
 
 #include <stdlib.h>
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <string.h>
 #include <strings.h>
@@ -73,6 +75,26 @@
 /** The fdset timeout in ms */
 #define FDSET_TIMEOUT 1000
 
+/**
+ * Weight of each fetch priority when choosing the next queued fetch.
+ *
+ * A queued fetch costs the number of fetches active to its host, plus
+ * one, divided by its weight. The cheapest is dispatched first so
+ * urgent fetches go ahead while busy hosts yield to idle ones.
+ */
+static const unsigned int fetch_priority_weight[FETCH_PRIORITY_COUNT] = {
+	64, /* FETCH_PRIORITY_BLOCKING */
+	8,  /* FETCH_PRIORITY_HIGH */
+	4,  /* FETCH_PRIORITY_NORMAL */
+	1,  /* FETCH_PRIORITY_LOW */
+};
+
+/**
+ * Divisor of max_fetchers giving the slots kept free of low priority
+ * fetches, so render blocking fetches found later start at once.
+ */
+#define FETCH_LOW_PRIORITY_RESERVE 4
+
 /**
  * Information about a fetcher for a given scheme.
  */
@@ -98,6 +120,7 @@ struct fetch {
 	int fetcherd;           /**< Fetcher descriptor for this fetch */
 	void *fetcher_handle;	/**< The handle for the fetcher. */
 	bool fetch_is_active;	/**< This fetch is active. */
+	fetch_priority priority;/**< Priority of this fetch. */
 	fetch_msg_type last_msg;/**< The last message sent for this fetch */
 	struct fetch *r_prev;	/**< Previous active fetch in ::fetch_ring. */
 	struct fetch *r_next;	/**< Next active fetch in ::fetch_ring. */
@@ -168,37 +191,55 @@ static bool fetch_dispatch_job(struct fetch *fetch)
  * Choose and dispatch a single job. Return false if we failed to dispatch
  * anything.
  *
+ * The queued fetch with the lowest weighted cost whose host has room
+ * is chosen, the earliest queued winning ties.
+ *
  * We don't check the overall dispatch size here because we're not called unless
  * there is room in the fetch queue for us.
+ *
+ * \param free_slots The number of fetches which may still be started.
  */
-static bool fetch_choose_and_dispatch(void)
+static bool fetch_choose_and_dispatch(int free_slots)
 {
-	bool same_host;
 	struct fetch *queueitem;
+	struct fetch *best = NULL;
+	unsigned int best_cost = UINT_MAX;
+	bool allow_low;
+
+	allow_low = (free_slots >
+		     (nsoption_int(max_fetchers) / FETCH_LOW_PRIORITY_RESERVE));
+
 	queueitem = queue_ring;
 	do {
-		/* We can dispatch the selected item if there is room in the
-		 * fetch ring
-		 */
 		int countbyhost;
+		unsigned int cost;
+
+		if ((queueitem->priority == FETCH_PRIORITY_LOW) &&
+		    (allow_low == false)) {
+			queueitem = queueitem->r_next;
+			continue;
+		}
+
 		RING_COUNTBYLWCHOST(struct fetch, fetch_ring, countbyhost,
 				    queueitem->host);
 		if (countbyhost < nsoption_int(max_fetchers_per_host)) {
 			/* We can dispatch this item in theory */
-			return fetch_dispatch_job(queueitem);
-		}
-		/* skip over other items with the same host */
-		same_host = true;
-		while (same_host == true && queueitem->r_next != queue_ring) {
-			if (lwc_string_isequal(queueitem->host,
-					       queueitem->r_next->host, &same_host) ==
-			    lwc_error_ok && same_host == true) {
-				queueitem = queueitem->r_next;
+			cost = ((countbyhost + 1) *
+				fetch_priority_weight[FETCH_PRIORITY_BLOCKING]) /
+				fetch_priority_weight[queueitem->priority];
+			if (cost < best_cost) {
+				best = queueitem;
+				best_cost = cost;
 			}
 		}
 		queueitem = queueitem->r_next;
 	} while (queueitem != queue_ring);
-	return false;
+
+	if (best == NULL) {
+		return false;
+	}
+
+	return fetch_dispatch_job(best);
 }
 
 static void dump_rings(void)
@@ -224,6 +265,34 @@ static void dump_rings(void)
 	}
 }
 
+/**
+ * Determine if the fetchers must be polled to make progress.
+ *
+ * Fetchers driven by file descriptor watches do not need polling. Queued
+ * fetches are dispatched as active fetches complete, but if nothing is
+ * active they must be retried by polling.
+ *
+ * @return true if the fetchers should be polled else false.
+ */
+static bool fetch_poll_required(void)
+{
+	struct fetch *f;
+
+	if (fetch_ring == NULL) {
+		return (queue_ring != NULL);
+	}
+
+	f = fetch_ring;
+	do {
+		if (fetchers[f->fetcherd].ops.fdready == NULL) {
+			return true;
+		}
+		f = f->r_next;
+	} while (f != fetch_ring);
+
+	return false;
+}
+
 /**
  * Dispatch as many jobs as we have room to dispatch.
  *
@@ -245,7 +314,7 @@ static bool fetch_dispatch_jobs(void)
 
 	while ((all_queued != 0) &&
 	       (all_active < nsoption_int(max_fetchers)) &&
-	       fetch_choose_and_dispatch()) {
+	       fetch_choose_and_dispatch(nsoption_int(max_fetchers) - all_active)) {
 			all_queued--;
 			all_active++;
 			NSLOG(fetch, DEBUG,
@@ -272,8 +341,10 @@ static void fetcher_poll(void *unused)
 				fetchers[fetcherd].ops.poll(fetchers[fetcherd].scheme);
 			}
 		}
+	}
 
-		/* schedule active fetchers to run again in 10ms */
+	if (fetch_poll_required()) {
+		/* schedule fetchers to run again in 10ms */
 		guit->misc->schedule(SCHEDULE_TIME, fetcher_poll, NULL);
 	}
 }
@@ -445,6 +516,37 @@ fetch_fdset(fd_set *read_fd_set,
 	return NSERROR_OK;
 }
 
+/* exported interface documented in content/fetch.h */
+nserror fetch_fd_ready(int fd, enum fetch_fd_events events)
+{
+	int fetcherd; /* fetcher index */
+	int prev; /* previous fetcher index */
+
+	for (fetcherd = 0; fetcherd < MAX_FETCHERS; fetcherd++) {
+		if ((fetchers[fetcherd].refcount == 0) ||
+		    (fetchers[fetcherd].ops.fdready == NULL)) {
+			continue;
+		}
+
+		/* a fetcher registered for several schemes shares
+		 * its operations so only notify it once.
+		 */
+		for (prev = 0; prev < fetcherd; prev++) {
+			if ((fetchers[prev].refcount > 0) &&
+			    (fetchers[prev].ops.fdready ==
+			     fetchers[fetcherd].ops.fdready)) {
+				break;
+			}
+		}
+		if (prev == fetcherd) {
+			fetchers[fetcherd].ops.fdready(
+				fetchers[fetcherd].scheme, fd, events);
+		}
+	}
+
+	return NSERROR_OK;
+}
+
 /* exported interface documented in content/fetch.h */
 nserror
 fetch_start(nsurl *url,
@@ -457,6 +559,7 @@ fetch_start(nsurl *url,
 	    bool verifiable,
 	    bool downgrade_tls,
 	    const char *headers[],
+	    fetch_priority priority,
 	    struct fetch **fetch_out)
 {
 	struct fetch *fetch;
@@ -488,6 +591,7 @@ fetch_start(nsurl *url,
 	fetch->verifiable = verifiable;
 	fetch->p = p;
 	fetch->host = nsurl_get_component(url, NSURL_HOST);
+	fetch->priority = priority;
 
 	if (referer != NULL) {
 		lwc_string *ref_scheme;
@@ -564,16 +668,30 @@ fetch_start(nsurl *url,
 	RING_INSERT(queue_ring, fetch);
 
 	/* Ask the queue to run. */
-	if (fetch_dispatch_jobs()) {
+	fetch_dispatch_jobs();
+	if (fetch_poll_required()) {
 		NSLOG(fetch, DEBUG, "scheduling poll");
-		/* schedule active fetchers to run again in 10ms */
-		guit->misc->schedule(10, fetcher_poll, NULL);
+		/* schedule fetchers to run again in 10ms */
+		guit->misc->schedule(SCHEDULE_TIME, fetcher_poll, NULL);
 	}
 
 	*fetch_out = fetch;
 	return NSERROR_OK;
 }
 
+/* exported interface documented in content/fetch.h */
+void fetch_set_priority(struct fetch *fetch, fetch_priority priority)
+{
+	assert(priority < FETCH_PRIORITY_COUNT);
+
+	if (fetch->priority != priority) {
+		NSLOG(fetch, DEBUG, "fetch %p priority %d -> %d, url '%s'",
+		      fetch, fetch->priority, priority,
+		      nsurl_access(fetch->url));
+		fetch->priority = priority;
+	}
+}
+
 /* exported interface documented in content/fetch.h */
 void fetch_abort(struct fetch *f)
 {
@@ -828,6 +946,11 @@ void fetch_remove_from_queues(struct fetch *fetch)
 
 	NSLOG(fetch, DEBUG, "Fetch ring is now %d elements.", all_active);
 	NSLOG(fetch, DEBUG, "Queue ring is now %d elements.", all_queued);
+
+	if (all_queued > 0) {
+		/* a fetch slot may now be free for a queued fetch */
+		guit->misc->schedule(0, fetcher_poll, NULL);
+	}
 }
 
 
@@ -29,6 +29,7 @@
 #include "utils/nsurl.h"
 #include "utils/inet.h"
 #include "netsurf/ssl_certs.h"
+#include "netsurf/fetch.h"
 
 struct content;
 struct fetch;
@@ -106,6 +107,22 @@ struct fetch_multipart_data {
 	bool file; /**< Item is a file */
 };
 
+/**
+ * Fetch priorities, most urgent first.
+ */
+typedef enum fetch_priority {
+	/** Blocks rendering e.g. documents, stylesheets and sync scripts */
+	FETCH_PRIORITY_BLOCKING = 0,
+	/** Needed soon e.g. deferred scripts and objects in view */
+	FETCH_PRIORITY_HIGH,
+	/** Default priority */
+	FETCH_PRIORITY_NORMAL,
+	/** Not yet needed e.g. objects which have not been seen */
+	FETCH_PRIORITY_LOW,
+
+	FETCH_PRIORITY_COUNT /**< Number of fetch priorities */
+} fetch_priority;
+
 typedef void (*fetch_callback)(const fetch_msg *msg, void *p);
 
 /**
@@ -136,6 +153,7 @@ typedef void (*fetch_callback)(const fetch_msg *msg, void *p);
  * \param verifiable
  * \param downgrade_tls
  * \param headers
+ * \param priority The priority used to order the fetch while queued.
  * \param fetch_out ponter to recive new fetch object.
  * \return NSERROR_OK and fetch_out updated else appropriate error code
  */
@@ -143,7 +161,19 @@ nserror fetch_start(nsurl *url, nsurl *referer, fetch_callback callback,
 		    void *p, bool only_2xx, const char *post_urlenc,
 		    const struct fetch_multipart_data *post_multipart,
 		    bool verifiable, bool downgrade_tls,
-		    const char *headers[], struct fetch **fetch_out);
+		    const char *headers[], fetch_priority priority,
+		    struct fetch **fetch_out);
+
+/**
+ * Change the priority of a fetch.
+ *
+ * Fetches which are still queued are dispatched in the new priority
+ * order. Fetches already started are unaffected.
+ *
+ * \param fetch The fetch to change.
+ * \param priority The new priority.
+ */
+void fetch_set_priority(struct fetch *fetch, fetch_priority priority);
 
 /**
  * Abort a fetch.
@@ -265,4 +295,17 @@ void fetch_set_cookie(struct fetch *fetch, const char *data);
  */
 nserror fetch_fdset(fd_set *read_fd_set, fd_set *write_fd_set, fd_set *except_fd_set, int *maxfd);
 
+/**
+ * Notify the fetchers of events on a watched file descriptor.
+ *
+ * Frontends providing the watch_fd fetch table entry call this when
+ * a file descriptor being watched has events pending. Fetchers which
+ * use file descriptor watches are not polled.
+ *
+ * \param fd The file descriptor with events pending.
+ * \param events The events which are pending.
+ * \return NSERROR_OK on success or appropriate error code.
+ */
+nserror fetch_fd_ready(int fd, enum fetch_fd_events events);
+
 #endif
@@ -28,6 +28,8 @@
 #include "utils/inet.h" /* this is necessary for the fd_set definition */
 #include <libwapcaplet/libwapcaplet.h>
 
+#include "netsurf/fetch.h"
+
 struct nsurl;
 struct fetch_multipart_data;
 struct fetch;
@@ -96,6 +98,15 @@ struct fetcher_operation_table {
 	int (*fdset)(lwc_string *scheme, fd_set *read_set, fd_set *write_set,
 		     fd_set *error_set);
 
+	/**
+	 * notify the fetcher of events on a watched file descriptor.
+	 *
+	 * Fetchers providing this are driven by file descriptor
+	 * watches and are not polled while only their fetches are
+	 * active.
+	 */
+	void (*fdready)(lwc_string *scheme, int fd, enum fetch_fd_events events);
+
 	/**
 	 * Finalise the fetcher.
 	 */
@@ -274,6 +274,9 @@ static char fetch_proxy_userpwd[100];
 /** Interlock to prevent initiation during callbacks */
 static bool inside_curl = false;
 
+/** Progress is driven by frontend file descriptor watches, not polling */
+static bool curl_socket_driven = false;
+
 
 /**
  * Initialise a cURL fetcher.
@@ -1131,6 +1134,12 @@ static void fetch_curl_abort(void *vf)
 		if (inside_curl) {
 			NSLOG(netsurf, DEBUG, "Deferring cleanup");
 			f->abort = true;
+			if (curl_socket_driven) {
+				/* no poll will notice the abort so retry
+				 * once outside curl.
+				 */
+				guit->misc->schedule(0, fetch_curl_abort, f);
+			}
 		} else {
 			NSLOG(netsurf, DEBUG, "Immediate abort");
 			fetch_curl_stop(f);
@@ -1151,6 +1160,11 @@ static void fetch_curl_free(void *vf)
 	struct curl_fetch_info *f = (struct curl_fetch_info *)vf;
 	int i;
 
+	if (curl_socket_driven) {
+		/* remove any pending deferred abort */
+		guit->misc->schedule(-1, fetch_curl_abort, f);
+	}
+
 	if (f->curl_handle) {
 		curl_easy_cleanup(f->curl_handle);
 	}
@@ -1350,6 +1364,29 @@ static void fetch_curl_done(CURL *curl_handle, CURLcode result)
 }
 
 
+/**
+ * Process completed fetches reported by curl.
+ */
+static void fetch_curl_check_done(void)
+{
+	int queue;
+	CURLMsg *curl_msg;
+
+	curl_msg = curl_multi_info_read(fetch_curl_multi, &queue);
+	while (curl_msg) {
+		switch (curl_msg->msg) {
+			case CURLMSG_DONE:
+				fetch_curl_done(curl_msg->easy_handle,
+						curl_msg->data.result);
+				break;
+			default:
+				break;
+		}
+		curl_msg = curl_multi_info_read(fetch_curl_multi, &queue);
+	}
+}
+
+
 /**
  * Do some work on current fetches.
  *
@@ -1357,9 +1394,13 @@ static void fetch_curl_done(CURL *curl_handle, CURLcode result)
  */
 static void fetch_curl_poll(lwc_string *scheme_ignored)
 {
-	int running, queue;
+	int running;
 	CURLMcode codem;
-	CURLMsg *curl_msg;
+
+	if (curl_socket_driven) {
+		/* progress is driven from file descriptor activity */
+		return;
+	}
 
 	if (nsoption_bool(suppress_curl_debug) == false) {
 		fd_set read_fd_set, write_fd_set, exc_fd_set;
@@ -1412,23 +1453,119 @@ static void fetch_curl_poll(lwc_string *scheme_ignored)
 		}
 	} while (codem == CURLM_CALL_MULTI_PERFORM);
 
-	/* process curl results */
-	curl_msg = curl_multi_info_read(fetch_curl_multi, &queue);
-	while (curl_msg) {
-		switch (curl_msg->msg) {
-			case CURLMSG_DONE:
-				fetch_curl_done(curl_msg->easy_handle,
-						curl_msg->data.result);
-				break;
-			default:
-				break;
-		}
-		curl_msg = curl_multi_info_read(fetch_curl_multi, &queue);
+	fetch_curl_check_done();
+	inside_curl = false;
+}
+
+
+/**
+ * Drive curl from file descriptor activity or a timeout.
+ *
+ * \param s The socket with activity or CURL_SOCKET_TIMEOUT
+ * \param mask The CURL_CSELECT_* activity bitmask
+ */
+static void fetch_curl_socket_action(curl_socket_t s, int mask)
+{
+	int running;
+	CURLMcode codem;
+
+	inside_curl = true;
+	codem = curl_multi_socket_action(fetch_curl_multi, s, mask, &running);
+	if (codem != CURLM_OK) {
+		NSLOG(netsurf, WARNING, "curl_multi_socket_action: %i %s",
+		      codem, curl_multi_strerror(codem));
 	}
+	fetch_curl_check_done();
 	inside_curl = false;
 }
 
 
+/**
+ * Scheduled callback for the curl timeout.
+ */
+static void fetch_curl_timeout(void *p)
+{
+	fetch_curl_socket_action(CURL_SOCKET_TIMEOUT, 0);
+}
+
+
+/**
+ * Callback from curl to change the file descriptors it is waiting on.
+ */
+static int
+fetch_curl_socket_cb(CURL *easy, curl_socket_t s, int what,
+		     void *userp, void *socketp)
+{
+	enum fetch_fd_events events;
+	nserror res;
+
+	switch (what) {
+	case CURL_POLL_IN:
+		events = FETCH_FD_READ;
+		break;
+
+	case CURL_POLL_OUT:
+		events = FETCH_FD_WRITE;
+		break;
+
+	case CURL_POLL_INOUT:
+		events = FETCH_FD_READ | FETCH_FD_WRITE;
+		break;
+
+	default:
+		events = FETCH_FD_NONE;
+		break;
+	}
+
+	res = guit->fetch->watch_fd(s, events);
+	if (res != NSERROR_OK) {
+		NSLOG(netsurf, WARNING, "Unable to watch fd %d", s);
+		return -1;
+	}
+	return 0;
+}
+
+
+/**
+ * Callback from curl to change the time it next needs to be driven.
+ */
+static int
+fetch_curl_timer_cb(CURLM *multi, long timeout_ms, void *userp)
+{
+	if (timeout_ms < 0) {
+		/* remove the timer */
+		guit->misc->schedule(-1, fetch_curl_timeout, NULL);
+	} else {
+		guit->misc->schedule(timeout_ms, fetch_curl_timeout, NULL);
+	}
+	return 0;
+}
+
+
+/**
+ * Process activity on a file descriptor being watched for curl.
+ */
+static void
+fetch_curl_fdready(lwc_string *scheme_ignored,
+		   int fd,
+		   enum fetch_fd_events events)
+{
+	int mask = 0;
+
+	if ((events & FETCH_FD_READ) != 0) {
+		mask |= CURL_CSELECT_IN;
+	}
+	if ((events & FETCH_FD_WRITE) != 0) {
+		mask |= CURL_CSELECT_OUT;
+	}
+	if ((events & FETCH_FD_ERROR) != 0) {
+		mask |= CURL_CSELECT_ERR;
+	}
+
+	fetch_curl_socket_action(fd, mask);
+}
+
+
 
 
 /**
@@ -1645,6 +1782,11 @@ static int fetch_curl_fdset(lwc_string *scheme, fd_set *read_set,
 	CURLMcode code;
 	int maxfd = -1;
 
+	if (curl_socket_driven) {
+		/* file descriptors are reported through watch_fd */
+		return -1;
+	}
+
 	code = curl_multi_fdset(fetch_curl_multi,
 				read_set,
 				write_set,
@@ -1664,7 +1806,7 @@ nserror fetch_curl_register(void)
 	curl_version_info_data *data;
 	int i;
 	lwc_string *scheme;
-	const struct fetcher_operation_table fetcher_ops = {
+	struct fetcher_operation_table fetcher_ops = {
 		.initialise = fetch_curl_initialise,
 		.acceptable = fetch_curl_can_fetch,
 		.setup = fetch_curl_setup,
@@ -1690,6 +1832,11 @@ nserror fetch_curl_register(void)
 
 	NSLOG(netsurf, INFO, "curl_version %s", curl_version());
 
+	if (guit->fetch->watch_fd != NULL) {
+		curl_socket_driven = true;
+		fetcher_ops.fdready = fetch_curl_fdready;
+	}
+
 	code = curl_global_init(CURL_GLOBAL_ALL);
 	if (code != CURLE_OK) {
 		NSLOG(netsurf, INFO, "curl_global_init failed.");
@@ -1721,6 +1868,19 @@ nserror fetch_curl_register(void)
 	}
 #endif
 
+	if (curl_socket_driven) {
+		CURLMcode mcode;
+
+#undef SETOPT
+#define SETOPT(option, value) \
+	mcode = curl_multi_setopt(fetch_curl_multi, option, value);	\
+	if (mcode != CURLM_OK)						\
+		goto curl_multi_setopt_failed;
+
+		SETOPT(CURLMOPT_SOCKETFUNCTION, fetch_curl_socket_cb);
+		SETOPT(CURLMOPT_TIMERFUNCTION, fetch_curl_timer_cb);
+	}
+
 	/* Create a curl easy handle with the options that are common to all
 	 *  fetches.
 	 */
@@ -1827,9 +1987,7 @@ curl_easy_setopt_failed:
 	NSLOG(netsurf, INFO, "curl_easy_setopt failed.");
 	return NSERROR_INIT_FAILED;
 
-#if LIBCURL_VERSION_NUM >= 0x071e00
 curl_multi_setopt_failed:
 	NSLOG(netsurf, INFO, "curl_multi_setopt failed.");
 	return NSERROR_INIT_FAILED;
-#endif
 }
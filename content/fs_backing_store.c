@@ -25,14 +25,14 @@
  * \todo Consider improving eviction sorting to include objects size
  *         and remaining lifetime and other cost metrics.
  *
- * \todo Implement mmap retrieval where supported.
- *
  * \todo Implement static retrieval for metadata objects as their heap
  *         lifetime is typically very short, though this may be obsoleted
  *         by a small object storage strategy.
  *
  */
 
+#include "utils/config.h"
+
 #include <unistd.h>
 #include <string.h>
 #include <sys/stat.h>
@@ -41,7 +41,15 @@
 #include <errno.h>
 #include <time.h>
 #include <stdlib.h>
+#ifdef HAVE_MMAP
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include <zlib.h>
 #include <nsutils/unistd.h>
+#include <nsutils/time.h>
 
 #include "netsurf/inttypes.h"
 #include "utils/filepath.h"
@@ -56,7 +64,7 @@
 #include "content/backing_store.h"
 
 /** Backing store file format version */
-#define CONTROL_VERSION 202
+#define CONTROL_VERSION 203
 
 /**
  * Number of milliseconds after a update before control data
@@ -64,6 +72,21 @@
  */
 #define CONTROL_MAINT_TIME 10000
 
+/** Minimum size of element worth attempting to compress */
+#define COMPRESS_MIN_SIZE 256
+
+/** Maximum number of data writes which may be outstanding */
+#define WRITE_QUEUE_SIZE 64
+
+/** Maximum number of bytes of data writes which may be outstanding */
+#define WRITE_QUEUE_BYTES (4 * 1024 * 1024)
+
+/**
+ * Number of milliseconds between checks for completed writes while
+ * writes are outstanding.
+ */
+#define WRITE_REAP_TIME 100
+
 /** Filename of serialised entries */
 #define ENTRIES_FNAME "entries"
 
@@ -133,6 +156,8 @@ enum store_entry_elem_flags {
 	ENTRY_ELEM_FLAG_MMAP = 0x2,
 	/** entry data allocation is in small object pool */
 	ENTRY_ELEM_FLAG_SMALL = 0x4,
+	/** entry data is stored compressed */
+	ENTRY_ELEM_FLAG_COMPRESSED = 0x8,
 };
 
 
@@ -156,7 +181,8 @@ enum store_entry_flags {
  */
 struct store_entry_element {
 	uint8_t* data; /**< data allocated */
-	uint32_t size; /**< size of entry element on disc */
+	uint32_t size; /**< size of entry element data */
+	uint32_t disc_size; /**< size of entry element on disc */
 	block_index_t block; /**< small object data block */
 	uint8_t ref; /**< element data reference count */
 	uint8_t flags; /**< entry flags */
@@ -191,6 +217,50 @@ struct block_file {
 	uint8_t use_map[BLOCK_USE_MAP_SIZE];
 };
 
+/**
+ * Type of write performed by the writer.
+ *
+ * @note The order is the order writes are performed within a batch.
+ */
+enum store_write_type {
+	STORE_WRITE_BLOCK, /**< write element into a block file */
+	STORE_WRITE_FILE, /**< write element as an individual file */
+	STORE_WRITE_REPLACE, /**< atomically replace a control file */
+};
+
+/**
+ * A write waiting for, or completed by, the writer.
+ *
+ * The writer only performs the I/O described here, all other store
+ * state is only ever touched by the main thread.
+ */
+struct store_write {
+	struct store_write *next; /**< next write in queue */
+	unsigned int seq; /**< sequence number of submission */
+	enum store_write_type type; /**< type of write */
+
+	int fd; /**< block file descriptor for block writes */
+	off_t offst; /**< offset within block file for block writes */
+	char *fname; /**< filename for file and replace writes */
+	char *tname; /**< temporary filename for replace writes */
+
+	uint8_t *data; /**< data to write */
+	size_t size; /**< size of data */
+	uint8_t *alloc; /**< allocation owned by the write */
+	size_t queued; /**< size accounted to the write queue */
+
+	bool compress; /**< compress the data first where worthwhile */
+	bool compressed; /**< the data written was compressed */
+
+	/** url of entry the data belongs to or NULL for control data */
+	nsurl *url;
+	int elem_idx; /**< element index within entry */
+
+	nserror res; /**< result of the write */
+	int err; /**< errno from a failed write */
+	unsigned long elapsed; /**< time taken to perform the write in ms */
+};
+
 /**
  * log2 of block size.
  */
@@ -231,6 +301,29 @@ struct store_state {
 	 */
 	bool blocks_opened;
 
+	bool compress; /**< compress element data where worthwhile */
+	unsigned int compress_pending; /**< writes yet to be compressed */
+
+	/** completed element writes are reported here */
+	void (*written)(size_t written, unsigned long elapsed);
+
+	/* writer */
+	llcache_store_sync sync; /**< synchronisation policy */
+	struct store_write *write_queue; /**< writes waiting for writer */
+	struct store_write **write_tail; /**< end of write queue */
+	struct store_write *write_done; /**< writes completed by writer */
+	unsigned int write_seq; /**< sequence of next submitted write */
+	unsigned int write_count; /**< number of outstanding writes */
+	size_t write_size; /**< bytes of outstanding writes */
+	bool write_reap; /**< completion check is scheduled */
+#ifdef HAVE_PTHREAD
+	bool writer_running; /**< writer thread has been started */
+	bool writer_quit; /**< writer thread should exit once idle */
+	pthread_t writer; /**< writer thread */
+	pthread_mutex_t write_lock; /**< protects queue and done lists */
+	pthread_cond_t write_cond; /**< signals writes queued or quit */
+#endif
+
 
 	/* stats */
 	uint64_t total_alloc; /**< total size of all allocated storage. */
@@ -238,6 +331,9 @@ struct store_state {
 	size_t hit_count; /**< number of cache hits */
 	uint64_t hit_size; /**< size of storage served */
 	size_t miss_count; /**< number of cache misses */
+	size_t map_count; /**< number of hits served by mapping storage */
+	size_t compress_count; /**< number of elements stored compressed */
+	uint64_t compress_saved; /**< bytes saved by compression */
 
 };
 
@@ -286,6 +382,7 @@ static hashmap_parameters_t entries_hashmap_parameters = {
 	.key_eq = entries_hashmap_key_eq,
 	.value_alloc = entries_hashmap_value_alloc,
 	.value_destroy = entries_hashmap_value_destroy,
+	.flat = true, /* may hold tens of thousands of entries */
 };
 
 /**
@@ -452,7 +549,7 @@ invalidate_element(struct store_state *state,
 		free(fname);
 	}
 
-	state->total_alloc -= bse->elem[elem_idx].size;
+	state->total_alloc -= bse->elem[elem_idx].disc_size;
 
 	return NSERROR_OK;
 }
@@ -506,6 +603,42 @@ invalidate_entry(struct store_state *state, struct store_entry *bse)
 }
 
 
+/**
+ * release any allocation for an entry
+ */
+static nserror entry_release_alloc(struct store_entry_element *elem)
+{
+	if ((elem->flags & ENTRY_ELEM_FLAG_HEAP) != 0) {
+		elem->ref--;
+		if (elem->ref == 0) {
+			NSLOG(netsurf, DEEPDEBUG, "freeing %p", elem->data);
+			free(elem->data);
+			elem->flags &= ~ENTRY_ELEM_FLAG_HEAP;
+		}
+	}
+#ifdef HAVE_MMAP
+	if ((elem->flags & ENTRY_ELEM_FLAG_MMAP) != 0) {
+		elem->ref--;
+		if (elem->ref == 0) {
+			uintptr_t base;
+			size_t pagesize = sysconf(_SC_PAGESIZE);
+
+			/* mappings always start on a page boundary and
+			 * the data is within the first page of it.
+			 */
+			base = (uintptr_t)elem->data & ~(uintptr_t)(pagesize - 1);
+
+			NSLOG(netsurf, DEEPDEBUG, "unmapping %p", elem->data);
+			munmap((void *)base,
+			       elem->disc_size + ((uintptr_t)elem->data - base));
+			elem->flags &= ~ENTRY_ELEM_FLAG_MMAP;
+		}
+	}
+#endif
+	return NSERROR_OK;
+}
+
+
 /**
  * Quick sort comparison.
  */
@@ -628,8 +761,8 @@ static nserror store_evict(struct store_state *state)
 	for (ent = 0; ent < estate.ent_count; ent++) {
 		struct store_entry *bse = estate.elist[ent];
 
-		removed += bse->elem[ENTRY_ELEM_DATA].size;
-		removed += bse->elem[ENTRY_ELEM_META].size;
+		removed += bse->elem[ENTRY_ELEM_DATA].disc_size;
+		removed += bse->elem[ENTRY_ELEM_META].disc_size;
 
 		ret = invalidate_entry(state, bse);
 		if (ret != NSERROR_OK) {
@@ -651,7 +784,583 @@ static nserror store_evict(struct store_state *state)
 }
 
 /**
- * Write a single store entry to disk
+ * Compress element data for storage.
+ *
+ * \param data The data to compress.
+ * \param datalen The length of \a data.
+ * \param disc_data_out The compressed data on success.
+ * \param disclen_out The length of the compressed data on success.
+ * \return true if the data was usefully compressed else false.
+ */
+static bool
+store_compress(const uint8_t *data,
+	       size_t datalen,
+	       uint8_t **disc_data_out,
+	       size_t *disclen_out)
+{
+	uint8_t *disc_data;
+	uLongf disclen;
+	int zret;
+
+	if (datalen < COMPRESS_MIN_SIZE) {
+		return false;
+	}
+
+	disclen = compressBound(datalen);
+	disc_data = malloc(disclen);
+	if (disc_data == NULL) {
+		return false;
+	}
+
+	zret = compress2(disc_data, &disclen, data, datalen,
+			 Z_DEFAULT_COMPRESSION);
+	if ((zret != Z_OK) || (disclen > (datalen - (datalen / 8)))) {
+		/* not worth storing compressed */
+		free(disc_data);
+		return false;
+	}
+
+	*disc_data_out = disc_data;
+	*disclen_out = disclen;
+
+	return true;
+}
+
+/**
+ * Perform a single write.
+ *
+ * This may be called from the writer thread so must only use the
+ * contents of the write and the immutable parts of the store state.
+ *
+ * \param state The backing store state.
+ * \param job The write to perform, its result is updated.
+ */
+static void store_write_run(struct store_state *state, struct store_write *job)
+{
+	ssize_t wr = -1;
+	int fd;
+	uint64_t startms = 0;
+	uint64_t endms = 0;
+	uint8_t *disc_data;
+	size_t disclen;
+
+	/* element data is compressed here rather than when it is
+	 * stored so the main thread is not held up
+	 */
+	if (job->compress &&
+	    store_compress(job->data, job->size, &disc_data, &disclen)) {
+		job->alloc = disc_data;
+		job->data = disc_data;
+		job->size = disclen;
+		job->compressed = true;
+	}
+
+	/* only the write itself is timed, not the compression */
+	nsu_getmonotonic_ms(&startms);
+
+	switch (job->type) {
+	case STORE_WRITE_BLOCK:
+		wr = nsu_pwrite(job->fd, job->data, job->size, job->offst);
+		break;
+
+	case STORE_WRITE_FILE:
+		/* ensure all path elements to file exist */
+		if (netsurf_mkdir_all(job->fname) != NSERROR_OK) {
+			break;
+		}
+		fd = open(job->fname, O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR);
+		if (fd == -1) {
+			break;
+		}
+		wr = write(fd, job->data, job->size);
+		if ((wr == (ssize_t)job->size) &&
+		    (state->sync == LLCACHE_STORE_SYNC_ALL) &&
+		    (fsync(fd) != 0)) {
+			wr = -1;
+		}
+		job->err = errno; /* close can change errno */
+		close(fd);
+		errno = job->err;
+		break;
+
+	case STORE_WRITE_REPLACE:
+		fd = open(job->tname, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+		if (fd == -1) {
+			break;
+		}
+		wr = write(fd, job->data, job->size);
+		if ((wr == (ssize_t)job->size) &&
+		    (state->sync != LLCACHE_STORE_SYNC_NONE) &&
+		    (fsync(fd) != 0)) {
+			wr = -1;
+		}
+		job->err = errno; /* close can change errno */
+		close(fd);
+		if (wr != (ssize_t)job->size) {
+			unlink(job->tname);
+			errno = job->err;
+			break;
+		}
+
+		/* remove() call is to handle non-POSIX rename() implementations */
+		(void)remove(job->fname);
+		if (rename(job->tname, job->fname) != 0) {
+			job->err = errno;
+			unlink(job->tname);
+			errno = job->err;
+			wr = -1;
+		}
+		break;
+	}
+
+	if (wr != (ssize_t)job->size) {
+		job->err = errno;
+		job->res = NSERROR_SAVE_FAILED;
+	} else {
+		job->res = NSERROR_OK;
+	}
+
+	nsu_getmonotonic_ms(&endms);
+	job->elapsed = endms - startms;
+}
+
+
+/**
+ * Write ordering comparison.
+ *
+ * Block writes are grouped by block file in ascending offset order,
+ * all other writes retain their submission order.
+ */
+static int store_write_compar(const void *va, const void *vb)
+{
+	const struct store_write *a = *(const struct store_write **)va;
+	const struct store_write *b = *(const struct store_write **)vb;
+
+	if (a->type != b->type) {
+		return (a->type < b->type) ? -1 : 1;
+	}
+
+	if (a->type == STORE_WRITE_BLOCK) {
+		if (a->fd != b->fd) {
+			return (a->fd < b->fd) ? -1 : 1;
+		}
+		if (a->offst != b->offst) {
+			return (a->offst < b->offst) ? -1 : 1;
+		}
+	}
+
+	if (a->seq != b->seq) {
+		return (a->seq < b->seq) ? -1 : 1;
+	}
+	return 0;
+}
+
+
+/**
+ * Perform a batch of writes.
+ *
+ * The writes are ordered so writes to each block file are issued
+ * together and all element data is written before any control data
+ * which references it. Control data replaced again later in the same
+ * batch is not written at all.
+ *
+ * \param state The backing store state.
+ * \param batch The list of writes to perform.
+ */
+static void store_write_batch(struct store_state *state, struct store_write *batch)
+{
+	struct store_write **jobs;
+	struct store_write *job;
+	size_t count = 0;
+	size_t idx;
+	size_t later;
+	int sync_fd = -1; /* block file with unsynchronised writes */
+
+	for (job = batch; job != NULL; job = job->next) {
+		count++;
+	}
+
+	jobs = malloc(count * sizeof(struct store_write *));
+	if (jobs == NULL) {
+		/* unable to order the batch so write it as submitted */
+		for (job = batch; job != NULL; job = job->next) {
+			store_write_run(state, job);
+			if ((job->type == STORE_WRITE_BLOCK) &&
+			    (state->sync == LLCACHE_STORE_SYNC_ALL)) {
+				fsync(job->fd);
+			}
+		}
+		return;
+	}
+
+	count = 0;
+	for (job = batch; job != NULL; job = job->next) {
+		jobs[count++] = job;
+	}
+	qsort(jobs, count, sizeof(struct store_write *), store_write_compar);
+
+	for (idx = 0; idx < count; idx++) {
+		job = jobs[idx];
+
+		/* synchronise a block file once all its writes are done */
+		if ((sync_fd != -1) &&
+		    ((job->type != STORE_WRITE_BLOCK) || (job->fd != sync_fd))) {
+			fsync(sync_fd);
+			sync_fd = -1;
+		}
+
+		if (job->type == STORE_WRITE_REPLACE) {
+			/* check for the same file being replaced again */
+			for (later = idx + 1; later < count; later++) {
+				if (strcmp(jobs[later]->fname, job->fname) == 0) {
+					break;
+				}
+			}
+			if (later < count) {
+				job->res = NSERROR_OK;
+				continue;
+			}
+		}
+
+		store_write_run(state, job);
+
+		if ((job->type == STORE_WRITE_BLOCK) &&
+		    (state->sync == LLCACHE_STORE_SYNC_ALL)) {
+			sync_fd = job->fd;
+		}
+	}
+
+	if (sync_fd != -1) {
+		fsync(sync_fd);
+	}
+
+	free(jobs);
+}
+
+
+static void control_maintenance(void *s);
+
+/**
+ * Complete a write.
+ *
+ * Releases the reference the write held on the entry element data
+ * and invalidates the entry if the write failed.
+ *
+ * \param state The backing store state.
+ * \param job The completed write.
+ */
+static void store_write_complete(struct store_state *state, struct store_write *job)
+{
+	struct store_entry *bse;
+	struct store_entry_element *elem;
+
+	state->write_count--;
+	state->write_size -= job->queued;
+
+	if (job->res != NSERROR_OK) {
+		NSLOG(netsurf, ERROR,
+		      "Write failed of %"PRIsizet" bytes from %p to %s at %"PRIsizet" errno %d",
+		      job->size,
+		      job->data,
+		      (job->fname != NULL) ? job->fname : "block",
+		      (size_t)job->offst,
+		      job->err);
+	} else {
+		NSLOG(netsurf, VERBOSE,
+		      "Wrote %"PRIsizet" bytes from %p to %s at %"PRIsizet,
+		      job->size,
+		      job->data,
+		      (job->fname != NULL) ? job->fname : "block",
+		      (size_t)job->offst);
+	}
+
+	if (job->url != NULL) {
+		if ((job->res == NSERROR_OK) && (state->written != NULL)) {
+			/* the element size as stored, however it was written */
+			state->written(job->queued, job->elapsed);
+		}
+
+		bse = hashmap_lookup(state->entries, job->url);
+		if ((bse != NULL) && (job->res == NSERROR_OK) && job->compressed) {
+			/* account for the element being stored compressed */
+			elem = &bse->elem[job->elem_idx];
+			state->total_alloc -= elem->disc_size;
+			elem->disc_size = job->size;
+			state->total_alloc += elem->disc_size;
+			elem->flags |= ENTRY_ELEM_FLAG_COMPRESSED;
+
+			state->compress_count++;
+			state->compress_saved += elem->size - elem->disc_size;
+			state->entries_dirty = true;
+		}
+		if (job->compress) {
+			state->compress_pending--;
+			if (state->entries_dirty) {
+				guit->misc->schedule(CONTROL_MAINT_TIME,
+						     control_maintenance,
+						     state);
+			}
+		}
+		if (bse != NULL) {
+			entry_release_alloc(&bse->elem[job->elem_idx]);
+
+			/* an entry which failed to write or was
+			 * invalidated while the write was outstanding
+			 * is removed now the allocation is released.
+			 */
+			if ((job->res != NSERROR_OK) ||
+			    ((bse->flags & ENTRY_FLAGS_INVALID) != 0)) {
+				invalidate_entry(state, bse);
+			}
+		}
+		nsurl_unref(job->url);
+	}
+
+	free(job->alloc);
+	free(job->fname);
+	free(job->tname);
+	free(job);
+}
+
+
+/**
+ * Complete all writes the writer has finished.
+ *
+ * Scheduled callback while there are outstanding writes.
+ *
+ * \param s The backing store state.
+ */
+static void store_write_reap(void *s)
+{
+	struct store_state *state = s;
+	struct store_write *done;
+	struct store_write *next;
+
+#ifdef HAVE_PTHREAD
+	if (state->writer_running) {
+		pthread_mutex_lock(&state->write_lock);
+	}
+#endif
+	done = state->write_done;
+	state->write_done = NULL;
+#ifdef HAVE_PTHREAD
+	if (state->writer_running) {
+		pthread_mutex_unlock(&state->write_lock);
+	}
+#endif
+
+	while (done != NULL) {
+		next = done->next;
+		store_write_complete(state, done);
+		done = next;
+	}
+
+	state->write_reap = false;
+	if (state->write_count > 0) {
+		state->write_reap = true;
+		guit->misc->schedule(WRITE_REAP_TIME, store_write_reap, state);
+	}
+}
+
+
+#ifdef HAVE_PTHREAD
+/**
+ * Writer thread.
+ *
+ * Takes all the queued writes as a batch, performs them and places
+ * them on the completed list, until told to quit and the queue is
+ * empty.
+ *
+ * \param s The backing store state.
+ * \return NULL
+ */
+static void *store_writer(void *s)
+{
+	struct store_state *state = s;
+	struct store_write *batch;
+	struct store_write **tail;
+
+	pthread_mutex_lock(&state->write_lock);
+	for (;;) {
+		while ((state->write_queue == NULL) &&
+		       (state->writer_quit == false)) {
+			pthread_cond_wait(&state->write_cond, &state->write_lock);
+		}
+		if (state->write_queue == NULL) {
+			break;
+		}
+
+		batch = state->write_queue;
+		state->write_queue = NULL;
+		state->write_tail = &state->write_queue;
+		pthread_mutex_unlock(&state->write_lock);
+
+		store_write_batch(state, batch);
+
+		/* move the completed batch to the done list */
+		for (tail = &batch; *tail != NULL; tail = &(*tail)->next);
+
+		pthread_mutex_lock(&state->write_lock);
+		*tail = state->write_done;
+		state->write_done = batch;
+	}
+	pthread_mutex_unlock(&state->write_lock);
+
+	return NULL;
+}
+
+
+/**
+ * Start the writer thread.
+ *
+ * If the thread cannot be started writes are performed synchronously.
+ *
+ * \param state The backing store state.
+ */
+static void store_writer_start(struct store_state *state)
+{
+	if (pthread_mutex_init(&state->write_lock, NULL) != 0) {
+		return;
+	}
+	if (pthread_cond_init(&state->write_cond, NULL) != 0) {
+		pthread_mutex_destroy(&state->write_lock);
+		return;
+	}
+	if (pthread_create(&state->writer, NULL, store_writer, state) != 0) {
+		NSLOG(netsurf, WARNING, "Unable to start writer thread");
+		pthread_cond_destroy(&state->write_cond);
+		pthread_mutex_destroy(&state->write_lock);
+		return;
+	}
+	state->writer_running = true;
+}
+
+
+/**
+ * Stop the writer thread once all queued writes are performed.
+ *
+ * \param state The backing store state.
+ */
+static void store_writer_stop(struct store_state *state)
+{
+	if (state->writer_running == false) {
+		return;
+	}
+
+	pthread_mutex_lock(&state->write_lock);
+	state->writer_quit = true;
+	pthread_cond_signal(&state->write_cond);
+	pthread_mutex_unlock(&state->write_lock);
+
+	pthread_join(state->writer, NULL);
+
+	pthread_cond_destroy(&state->write_cond);
+	pthread_mutex_destroy(&state->write_lock);
+	state->writer_running = false;
+}
+#endif
+
+
+/**
+ * Submit a write to the writer.
+ *
+ * Without a writer thread the write is performed immediately.
+ *
+ * \param state The backing store state.
+ * \param job The write to submit.
+ */
+static void store_write_submit(struct store_state *state, struct store_write *job)
+{
+	job->next = NULL;
+	job->seq = state->write_seq++;
+	job->queued = job->size;
+
+	state->write_count++;
+	state->write_size += job->queued;
+	if (job->compress) {
+		state->compress_pending++;
+	}
+
+#ifdef HAVE_PTHREAD
+	if (state->writer_running) {
+		pthread_mutex_lock(&state->write_lock);
+		*state->write_tail = job;
+		state->write_tail = &job->next;
+		pthread_cond_signal(&state->write_cond);
+		pthread_mutex_unlock(&state->write_lock);
+
+		if (state->write_reap == false) {
+			state->write_reap = true;
+			guit->misc->schedule(WRITE_REAP_TIME,
+					     store_write_reap,
+					     state);
+		}
+		return;
+	}
+#endif
+
+	store_write_batch(state, job);
+	store_write_complete(state, job);
+}
+
+
+/**
+ * Submit an atomic replacement of a control file.
+ *
+ * \param state The backing store state.
+ * \param tname The temporary name used for the replacement.
+ * \param fname The name of the control file.
+ * \param data The new control file contents, ownership passes to the write.
+ * \param size The size of the \a data.
+ * \return NSERROR_OK on success or error code on failure.
+ */
+static nserror
+store_write_replace(struct store_state *state,
+		    const char *tname,
+		    const char *fname,
+		    uint8_t *data,
+		    size_t size)
+{
+	struct store_write *job;
+	nserror ret;
+
+	job = calloc(1, sizeof(struct store_write));
+	if (job == NULL) {
+		free(data);
+		return NSERROR_NOMEM;
+	}
+
+	ret = netsurf_mkpath(&job->tname, NULL, 2, state->path, tname);
+	if (ret == NSERROR_OK) {
+		ret = netsurf_mkpath(&job->fname, NULL, 2, state->path, fname);
+	}
+	if (ret != NSERROR_OK) {
+		free(job->tname);
+		free(job);
+		free(data);
+		return ret;
+	}
+
+	job->type = STORE_WRITE_REPLACE;
+	job->data = data;
+	job->size = size;
+	job->alloc = data;
+
+	store_write_submit(state, job);
+
+	return NSERROR_OK;
+}
+
+
+typedef struct {
+	uint8_t *data;
+	size_t len;
+	size_t alloc;
+	size_t written;
+} write_entry_iteration_state;
+
+/**
+ * Serialise a single store entry
  *
  * To serialise a single store entry for now we write out a 32bit int
  * which is the length of the url, then that many bytes of the url.
@@ -659,24 +1368,32 @@ static nserror store_evict(struct store_state *state)
  * a useless nsurl pointer.
  */
 static nserror
-write_entry(struct store_entry *ent, int fd)
+write_entry(struct store_entry *ent, write_entry_iteration_state *ws)
 {
 	uint32_t len = strlen(nsurl_access(ent->url));
-	if (write(fd, &len, sizeof(len)) != sizeof(len))
-		return NSERROR_SAVE_FAILED;
-	if (write(fd, nsurl_access(ent->url), len) != (ssize_t)len)
-		return NSERROR_SAVE_FAILED;
-	if (write(fd, ent, sizeof(*ent)) != sizeof(*ent))
-		return NSERROR_SAVE_FAILED;
+	size_t need = sizeof(len) + len + sizeof(*ent);
+
+	if ((ws->len + need) > ws->alloc) {
+		uint8_t *data;
+		size_t alloc = (ws->alloc * 2) + need;
+
+		data = realloc(ws->data, alloc);
+		if (data == NULL)
+			return NSERROR_NOMEM;
+		ws->data = data;
+		ws->alloc = alloc;
+	}
+
+	memcpy(ws->data + ws->len, &len, sizeof(len));
+	ws->len += sizeof(len);
+	memcpy(ws->data + ws->len, nsurl_access(ent->url), len);
+	ws->len += len;
+	memcpy(ws->data + ws->len, ent, sizeof(*ent));
+	ws->len += sizeof(*ent);
 
 	return NSERROR_OK;
 }
 
-typedef struct {
-	int fd;
-	size_t written;
-} write_entry_iteration_state;
-
 /**
  * Callback for iterating the entries hashmap
  */
@@ -688,21 +1405,19 @@ write_entry_iterator(void *key, void *value, void *ctx)
 	write_entry_iteration_state *state = ctx;
 	state->written++;
 	/* We stop early if we fail to write this entry */
-	return write_entry(ent, state->fd) != NSERROR_OK;
+	return write_entry(ent, state) != NSERROR_OK;
 }
 
 /**
  * Write filesystem entries to file.
  *
- * Serialise entry index out to storage.
+ * Serialise entry index and submit it to be written out to storage.
  *
  * @param state The backing store state to serialise.
  * @return NSERROR_OK on success or error code on failure.
  */
 static nserror write_entries(struct store_state *state)
 {
-	char *tname = NULL; /* temporary file name for atomic replace */
-	char *fname = NULL; /* target filename */
 	write_entry_iteration_state weistate;
 	nserror ret;
 
@@ -713,43 +1428,28 @@ static nserror write_entries(struct store_state *state)
 		return NSERROR_OK;
 	}
 
-	ret = netsurf_mkpath(&tname, NULL, 2, state->path, "t"ENTRIES_FNAME);
-	if (ret != NSERROR_OK) {
-		return ret;
-	}
-
-	weistate.fd = open(tname, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
-	if (weistate.fd == -1) {
-		free(tname);
-		return NSERROR_SAVE_FAILED;
+	if (state->compress_pending > 0) {
+		/* the stored size of some elements is not yet known,
+		 * the entries are written once their writes complete.
+		 */
+		return NSERROR_OK;
 	}
 
 	if (hashmap_iterate(state->entries, write_entry_iterator, &weistate)) {
 		/* The iteration ended early, so we failed */
-		close(weistate.fd);
-		unlink(tname);
-		free(tname);
-		return NSERROR_SAVE_FAILED;
+		free(weistate.data);
+		return NSERROR_NOMEM;
 	}
 
-	close(weistate.fd);
-
-	ret = netsurf_mkpath(&fname, NULL, 2, state->path, ENTRIES_FNAME);
+	ret = store_write_replace(state,
+				  "t"ENTRIES_FNAME,
+				  ENTRIES_FNAME,
+				  weistate.data,
+				  weistate.len);
 	if (ret != NSERROR_OK) {
-		unlink(tname);
-		free(tname);
 		return ret;
 	}
 
-	/* remove() call is to handle non-POSIX rename() implementations */
-	(void)remove(fname);
-	if (rename(tname, fname) != 0) {
-		unlink(tname);
-		free(tname);
-		free(fname);
-		return NSERROR_SAVE_FAILED;
-	}
-
 	NSLOG(netsurf, INFO, "Wrote out %"PRIsizet" entries", weistate.written);
 
 	return NSERROR_OK;
@@ -758,20 +1458,17 @@ static nserror write_entries(struct store_state *state)
 /**
  * Write block file use map to file.
  *
- * Serialise block file use map out to storage.
+ * Serialise block file use map and submit it to be written out to
+ * storage.
  *
  * \param state The backing store state to serialise.
  * \return NSERROR_OK on success or error code on failure.
  */
 static nserror write_blocks(struct store_state *state)
 {
-	int fd;
-	char *tname = NULL; /* temporary file name for atomic replace */
-	char *fname = NULL; /* target filename */
+	uint8_t *data;
 	size_t blocks_size;
 	size_t written = 0;
-	size_t wr;
-	nserror ret;
 	int bfidx; /* block file index */
 	int elem_idx;
 
@@ -780,61 +1477,27 @@ static nserror write_blocks(struct store_state *state)
 		return NSERROR_OK;
 	}
 
-	ret = netsurf_mkpath(&tname, NULL, 2, state->path, "t"BLOCKS_FNAME);
-	if (ret != NSERROR_OK) {
-		return ret;
-	}
+	blocks_size = (BLOCK_FILE_COUNT * ENTRY_ELEM_COUNT) * BLOCK_USE_MAP_SIZE;
 
-	fd = open(tname, O_RDWR | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
-	if (fd == -1) {
-		free(tname);
-		return NSERROR_SAVE_FAILED;
+	data = malloc(blocks_size);
+	if (data == NULL) {
+		return NSERROR_NOMEM;
 	}
 
-	blocks_size = (BLOCK_FILE_COUNT * ENTRY_ELEM_COUNT) * BLOCK_USE_MAP_SIZE;
-
 	for (elem_idx = 0; elem_idx < ENTRY_ELEM_COUNT; elem_idx++) {
 		for (bfidx = 0; bfidx < BLOCK_FILE_COUNT; bfidx++) {
-			wr = write(fd,
-				   &state->blocks[elem_idx][bfidx].use_map[0],
-				   BLOCK_USE_MAP_SIZE);
-			if (wr != BLOCK_USE_MAP_SIZE) {
-				NSLOG(netsurf, DEBUG,
-				      "writing block file %d use index on file number %d failed",
-				      elem_idx,
-				      bfidx);
-				goto wr_err;
-			}
-			written += wr;
+			memcpy(data + written,
+			       &state->blocks[elem_idx][bfidx].use_map[0],
+			       BLOCK_USE_MAP_SIZE);
+			written += BLOCK_USE_MAP_SIZE;
 		}
 	}
-wr_err:
-	close(fd);
-
-	/* check all data was written */
-	if (written != blocks_size) {
-		unlink(tname);
-		free(tname);
-		return NSERROR_SAVE_FAILED;
-	}
-
-	ret = netsurf_mkpath(&fname, NULL, 2, state->path, BLOCKS_FNAME);
-	if (ret != NSERROR_OK) {
-		unlink(tname);
-		free(tname);
-		return ret;
-	}
-
-	/* remove() call is to handle non-POSIX rename() implementations */
-	(void)remove(fname);
-	if (rename(tname, fname) != 0) {
-		unlink(tname);
-		free(tname);
-		free(fname);
-		return NSERROR_SAVE_FAILED;
-	}
 
-	return NSERROR_OK;
+	return store_write_replace(state,
+				   "t"BLOCKS_FNAME,
+				   BLOCKS_FNAME,
+				   data,
+				   blocks_size);
 }
 
 /**
@@ -975,6 +1638,7 @@ static block_index_t alloc_block(struct store_state *state, int elem_idx)
  * @param elem_idx The index of the entry element to use.
  * @param data The data to store
  * @param datalen The length of data in \a data
+ * @param disclen The length of the data when stored on disc
  * @param bse Pointer used to return value.
  * @return NSERROR_OK and \a bse updated on success or NSERROR_NOT_FOUND
  *         if no entry corresponds to the url.
@@ -985,6 +1649,7 @@ set_store_entry(struct store_state *state,
 		int elem_idx,
 		uint8_t *data,
 		const size_t datalen,
+		const size_t disclen,
 		struct store_entry **bse)
 {
 	struct store_entry *se;
@@ -1032,12 +1697,13 @@ set_store_entry(struct store_state *state,
 	elem->ref = 1;
 
 	/* account for size of entry element */
-	state->total_alloc -= elem->size;
+	state->total_alloc -= elem->disc_size;
 	elem->size = datalen;
-	state->total_alloc += elem->size;
+	elem->disc_size = disclen;
+	state->total_alloc += elem->disc_size;
 
 	/* if the element will fit in a small block attempt to allocate one */
-	if (elem->size <= (1U << log2_block_size[elem_idx])) {
+	if (elem->disc_size <= (1U << log2_block_size[elem_idx])) {
 		elem->block = alloc_block(state, elem_idx);
 	}
 
@@ -1197,8 +1863,8 @@ read_entries(struct store_state *state)
 			NSLOG(netsurf, DEBUG, "Successfully read entry for %s", nsurl_access(ent->url));
 			read_entries++;
 			/* Note the size allocation */
-			state->total_alloc += ent->elem[ENTRY_ELEM_DATA].size;
-			state->total_alloc += ent->elem[ENTRY_ELEM_META].size;
+			state->total_alloc += ent->elem[ENTRY_ELEM_DATA].disc_size;
+			state->total_alloc += ent->elem[ENTRY_ELEM_META].disc_size;
 			/* And ensure we don't pretend to have this in memory yet */
 			ent->elem[ENTRY_ELEM_DATA].flags &= ~(ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP);
 			ent->elem[ENTRY_ELEM_META].flags &= ~(ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP);
@@ -1454,6 +2120,10 @@ initialise(const struct llcache_store_parameters *parameters)
 	newstate->path = strdup(parameters->path);
 	newstate->limit = parameters->limit;
 	newstate->hysteresis = parameters->hysteresis;
+	newstate->sync = parameters->sync;
+	newstate->compress = parameters->compress;
+	newstate->written = parameters->written;
+	newstate->write_tail = &newstate->write_queue;
 
 	/* read store control and create new if required */
 	ret = read_control(newstate);
@@ -1508,6 +2178,10 @@ initialise(const struct llcache_store_parameters *parameters)
 
 	storestate = newstate;
 
+#ifdef HAVE_PTHREAD
+	store_writer_start(newstate);
+#endif
+
 	NSLOG(netsurf, INFO, "FS backing store init successful");
 
 	NSLOG(netsurf, INFO,
@@ -1537,6 +2211,16 @@ finalise(void)
 	unsigned int op_count;
 
 	if (storestate != NULL) {
+		/* complete all outstanding writes so the stored size
+		 * of every element is known
+		 */
+#ifdef HAVE_PTHREAD
+		store_writer_stop(storestate);
+#endif
+		guit->misc->schedule(-1, store_write_reap, storestate);
+		store_write_reap(storestate);
+
+		/* without the writer the control data is written here */
 		guit->misc->schedule(-1, control_maintenance, storestate);
 		write_entries(storestate);
 		write_blocks(storestate);
@@ -1551,6 +2235,14 @@ finalise(void)
 			}
 		}
 
+		NSLOG(netsurf, INFO,
+		      "Cache hits served by mapping %"PRIsizet,
+		      storestate->map_count);
+		NSLOG(netsurf, INFO,
+		      "Cache elements compressed %"PRIsizet" saving %"PRIu64" bytes",
+		      storestate->compress_count,
+		      storestate->compress_saved);
+
 		op_count = storestate->hit_count + storestate->miss_count;
 
 		/* avoid division by zero */
@@ -1575,23 +2267,54 @@ finalise(void)
 }
 
 
+/**
+ * Submit a write of an element of an entry to backing storage.
+ *
+ * The write holds a reference to the element data until it completes.
+ *
+ * \param state The backing store state to use.
+ * \param bse The entry to store
+ * \param elem_idx The element index within the entry.
+ * \param compress Whether the writer should compress the element data.
+ * \param job The write with its type specific fields set.
+ */
+static void store_write_element(struct store_state *state,
+				struct store_entry *bse,
+				int elem_idx,
+				bool compress,
+				struct store_write *job)
+{
+	struct store_entry_element *elem = &bse->elem[elem_idx];
+
+	job->data = elem->data;
+	job->size = elem->size;
+	job->compress = compress;
+	job->url = nsurl_ref(bse->url);
+	job->elem_idx = elem_idx;
+
+	elem->ref++;
+
+	store_write_submit(state, job);
+}
+
 /**
  * Write an element of an entry to backing storage in a small block file.
  *
  * \param state The backing store state to use.
  * \param bse The entry to store
  * \param elem_idx The element index within the entry.
+ * \param compress Whether the writer should compress the element data.
  * \return NSERROR_OK on success or error code.
  */
 static nserror store_write_block(struct store_state *state,
 			 struct store_entry *bse,
-			 int elem_idx)
+			 int elem_idx,
+			 bool compress)
 {
 	block_index_t bf = (bse->elem[elem_idx].block >> BLOCK_ENTRY_COUNT) &
 		((1 << BLOCK_FILE_COUNT) - 1); /* block file block resides in */
 	block_index_t bi = bse->elem[elem_idx].block & ((1U << BLOCK_ENTRY_COUNT) -1); /* block index in file */
-	ssize_t wr;
-	off_t offst;
+	struct store_write *job;
 
 	/* ensure the block file fd is good */
 	if (state->blocks[elem_idx][bf].fd == -1) {
@@ -1606,29 +2329,23 @@ static nserror store_write_block(struct store_state *state,
 		state->blocks_opened = true;
 	}
 
-	offst = (unsigned int)bi << log2_block_size[elem_idx];
-
-	wr = nsu_pwrite(state->blocks[elem_idx][bf].fd,
-			bse->elem[elem_idx].data,
-			bse->elem[elem_idx].size,
-			offst);
-	if (wr != (ssize_t)bse->elem[elem_idx].size) {
-		NSLOG(netsurf, ERROR,
-		      "Write failed %"PRIssizet" of %d bytes from %p at %"PRIsizet" block %d errno %d",
-		      wr,
-		      bse->elem[elem_idx].size,
-		      bse->elem[elem_idx].data,
-		      (size_t)offst,
-		      bse->elem[elem_idx].block,
-		      errno);
-		return NSERROR_SAVE_FAILED;
+	job = calloc(1, sizeof(struct store_write));
+	if (job == NULL) {
+		return NSERROR_NOMEM;
 	}
 
-	NSLOG(netsurf, INFO,
-	      "Wrote %"PRIssizet" bytes from %p at %"PRIsizet" block %d", wr,
-	      bse->elem[elem_idx].data, (size_t)offst,
+	job->type = STORE_WRITE_BLOCK;
+	job->fd = state->blocks[elem_idx][bf].fd;
+	job->offst = (unsigned int)bi << log2_block_size[elem_idx];
+
+	NSLOG(netsurf, DEBUG,
+	      "Writing %d bytes from %p at %"PRIsizet" block %d",
+	      bse->elem[elem_idx].disc_size,
+	      bse->elem[elem_idx].data, (size_t)job->offst,
 	      bse->elem[elem_idx].block);
 
+	store_write_element(state, bse, elem_idx, compress, job);
+
 	return NSERROR_OK;
 }
 
@@ -1638,41 +2355,35 @@ static nserror store_write_block(struct store_state *state,
  * \param state The backing store state to use.
  * \param bse The entry to store
  * \param elem_idx The element index within the entry.
+ * \param compress Whether the writer should compress the element data.
  * \return NSERROR_OK on success or error code.
  */
 static nserror store_write_file(struct store_state *state,
 			 struct store_entry *bse,
-			 int elem_idx)
+			 int elem_idx,
+			 bool compress)
 {
-	ssize_t wr;
-	int fd;
-	int err;
+	struct store_write *job;
 
-	fd = store_open(state, nsurl_hash(bse->url), elem_idx, O_CREAT | O_WRONLY);
-	if (fd < 0) {
-		perror("");
-		NSLOG(netsurf, ERROR, "Open failed %d errno %d", fd, errno);
-		return NSERROR_SAVE_FAILED;
+	job = calloc(1, sizeof(struct store_write));
+	if (job == NULL) {
+		return NSERROR_NOMEM;
 	}
 
-	wr = write(fd, bse->elem[elem_idx].data, bse->elem[elem_idx].size);
-	err = errno; /* close can change errno */
-
-	close(fd);
-	if (wr != (ssize_t)bse->elem[elem_idx].size) {
-		NSLOG(netsurf, ERROR,
-		      "Write failed %"PRIssizet" of %d bytes from %p errno %d",
-		      wr,
-		      bse->elem[elem_idx].size,
-		      bse->elem[elem_idx].data,
-		      err);
-
-		/** @todo Delete the file? */
-		return NSERROR_SAVE_FAILED;
+	job->type = STORE_WRITE_FILE;
+	job->fname = store_fname(state, nsurl_hash(bse->url), elem_idx);
+	if (job->fname == NULL) {
+		NSLOG(netsurf, ERROR, "filename error");
+		free(job);
+		return NSERROR_NOMEM;
 	}
 
-	NSLOG(netsurf, VERBOSE, "Wrote %"PRIssizet" bytes from %p", wr,
-	      bse->elem[elem_idx].data);
+	NSLOG(netsurf, DEBUG, "Writing %d bytes from %p to %s",
+	      bse->elem[elem_idx].disc_size,
+	      bse->elem[elem_idx].data,
+	      job->fname);
+
+	store_write_element(state, bse, elem_idx, compress, job);
 
 	return NSERROR_OK;
 }
@@ -1697,6 +2408,7 @@ store(nsurl *url,
 	nserror ret;
 	struct store_entry *bse;
 	int elem_idx;
+	bool compress;
 
 	/* check backing store is initialised */
 	if (storestate == NULL) {
@@ -1710,39 +2422,155 @@ store(nsurl *url,
 		elem_idx = ENTRY_ELEM_DATA;
 	}
 
+	/* Refuse further data while the writer is backlogged. Metadata
+	 * is always accepted as it completes an object whose data has
+	 * already been accepted.
+	 */
+	if ((elem_idx == ENTRY_ELEM_DATA) &&
+	    ((storestate->write_count >= WRITE_QUEUE_SIZE) ||
+	     (storestate->write_size >= WRITE_QUEUE_BYTES))) {
+		NSLOG(netsurf, DEBUG, "write queue full");
+		return NSERROR_NOSPACE;
+	}
+
+	/* compress the data unless it is already in a compressed
+	 * format. The writer compresses it so storage is allocated
+	 * for the uncompressed size and the element size is updated
+	 * when the write completes.
+	 */
+	compress = storestate->compress &&
+		((bsflags & BACKING_STORE_COMPRESSED) == 0);
+
 	/* set the store entry up */
-	ret = set_store_entry(storestate, url, elem_idx, data, datalen, &bse);
+	ret = set_store_entry(storestate, url, elem_idx,
+			      data, datalen, datalen, &bse);
 	if (ret != NSERROR_OK) {
 		NSLOG(netsurf, ERROR, "store entry setting failed");
 		return ret;
 	}
 
+	bse->elem[elem_idx].flags &= ~ENTRY_ELEM_FLAG_COMPRESSED;
+
 	if (bse->elem[elem_idx].block != 0) {
 		/* small block storage */
-		ret = store_write_block(storestate, bse, elem_idx);
+		ret = store_write_block(storestate, bse, elem_idx, compress);
 	} else {
 		/* separate file in backing store */
-		ret = store_write_file(storestate, bse, elem_idx);
+		ret = store_write_file(storestate, bse, elem_idx, compress);
 	}
 
 	return ret;
 }
 
+#ifdef HAVE_MMAP
 /**
- * release any allocation for an entry
+ * Map a region of a storage file into memory.
+ *
+ * The mapping is read only and shared so the pages come straight
+ * from the system page cache and are shared with any other process
+ * using the same backing store.
+ *
+ * \param fd The file descriptor to map from.
+ * \param offst The offset within the file of the data.
+ * \param size The size of the data.
+ * \return A pointer to the data or NULL if it could not be mapped.
  */
-static nserror entry_release_alloc(struct store_entry_element *elem)
+static uint8_t *store_map(int fd, off_t offst, size_t size)
 {
-	if ((elem->flags & ENTRY_ELEM_FLAG_HEAP) != 0) {
-		elem->ref--;
-		if (elem->ref == 0) {
-			NSLOG(netsurf, DEEPDEBUG, "freeing %p", elem->data);
-			free(elem->data);
-			elem->flags &= ~ENTRY_ELEM_FLAG_HEAP;
+	struct stat sb;
+	size_t pagesize;
+	off_t map_offst;
+	uint8_t *map;
+
+	if (size == 0) {
+		return NULL;
+	}
+
+	/* accessing a mapping beyond the end of the file faults so
+	 * ensure the file actually contains all the data.
+	 */
+	if ((fstat(fd, &sb) != 0) ||
+	    (sb.st_size < (off_t)(offst + size))) {
+		return NULL;
+	}
+
+	pagesize = sysconf(_SC_PAGESIZE);
+	map_offst = offst & ~(off_t)(pagesize - 1);
+
+	map = mmap(NULL,
+		   size + (offst - map_offst),
+		   PROT_READ,
+		   MAP_SHARED,
+		   fd,
+		   map_offst);
+	if (map == MAP_FAILED) {
+		NSLOG(netsurf, DEBUG, "mmap failed errno %d", errno);
+		return NULL;
+	}
+
+	return map + (offst - map_offst);
+}
+
+
+/**
+ * Map an element of an entry from the backing storage.
+ *
+ * \param state The backing store state to use.
+ * \param bse The entry to map.
+ * \param elem_idx The element index within the entry.
+ * \return NSERROR_OK and the element data set on success or error code.
+ */
+static nserror store_map_elem(struct store_state *state,
+			      struct store_entry *bse,
+			      int elem_idx)
+{
+	struct store_entry_element *elem = &bse->elem[elem_idx];
+	block_index_t bf; /* block file block resides in */
+	block_index_t bi; /* block index in file */
+	int fd;
+
+	if (elem->block != 0) {
+		bf = (elem->block >> BLOCK_ENTRY_COUNT) &
+			((1 << BLOCK_FILE_COUNT) - 1);
+		bi = elem->block & ((1 << BLOCK_ENTRY_COUNT) - 1);
+
+		/* ensure the block file fd is good */
+		if (state->blocks[elem_idx][bf].fd == -1) {
+			state->blocks[elem_idx][bf].fd = store_open(state, bf,
+					elem_idx + ENTRY_ELEM_COUNT, O_CREAT | O_RDWR);
+			if (state->blocks[elem_idx][bf].fd == -1) {
+				return NSERROR_NOT_FOUND;
+			}
+
+			/* flag that a block file has been opened */
+			state->blocks_opened = true;
 		}
+		fd = state->blocks[elem_idx][bf].fd;
+
+		elem->data = store_map(fd,
+				       (off_t)bi << log2_block_size[elem_idx],
+				       elem->disc_size);
+	} else {
+		fd = store_open(state, nsurl_hash(bse->url), elem_idx, O_RDONLY);
+		if (fd < 0) {
+			return NSERROR_NOT_FOUND;
+		}
+
+		/* the mapping remains valid once the file is closed */
+		elem->data = store_map(fd, 0, elem->disc_size);
+		close(fd);
 	}
+
+	if (elem->data == NULL) {
+		return NSERROR_NOT_FOUND;
+	}
+
+	NSLOG(netsurf, DEEPDEBUG, "Mapped %d bytes at %p block %d",
+	      elem->disc_size, elem->data, elem->block);
+
 	return NSERROR_OK;
 }
+#endif
 
 
 /**
@@ -1751,11 +2579,13 @@ static nserror entry_release_alloc(struct store_entry_element *elem)
  * \param state The backing store state to use.
  * \param bse The entry to read.
  * \param elem_idx The element index within the entry.
+ * \param data The buffer to read the element as stored on disc into.
  * \return NSERROR_OK on success or error code.
  */
 static nserror store_read_block(struct store_state *state,
 			 struct store_entry *bse,
-			 int elem_idx)
+			 int elem_idx,
+			 uint8_t *data)
 {
 	block_index_t bf = (bse->elem[elem_idx].block >> BLOCK_ENTRY_COUNT) &
 		((1 << BLOCK_FILE_COUNT) - 1); /* block file block resides in */
@@ -1779,15 +2609,15 @@ static nserror store_read_block(struct store_state *state,
 	offst = (unsigned int)bi << log2_block_size[elem_idx];
 
 	rd = nsu_pread(state->blocks[elem_idx][bf].fd,
-		       bse->elem[elem_idx].data,
-		       bse->elem[elem_idx].size,
+		       data,
+		       bse->elem[elem_idx].disc_size,
 		       offst);
-	if (rd != (ssize_t)bse->elem[elem_idx].size) {
+	if (rd != (ssize_t)bse->elem[elem_idx].disc_size) {
 		NSLOG(netsurf, ERROR,
 		      "Failed reading %"PRIssizet" of %d bytes into %p from %"PRIsizet" block %d errno %d",
 		      rd,
-		      bse->elem[elem_idx].size,
-		      bse->elem[elem_idx].data,
+		      bse->elem[elem_idx].disc_size,
+		      data,
 		      (size_t)offst,
 		      bse->elem[elem_idx].block,
 		      errno);
@@ -1796,7 +2626,7 @@ static nserror store_read_block(struct store_state *state,
 
 	NSLOG(netsurf, DEEPDEBUG,
 	      "Read %"PRIssizet" bytes into %p from %"PRIsizet" block %d", rd,
-	      bse->elem[elem_idx].data, (size_t)offst,
+	      data, (size_t)offst,
 	      bse->elem[elem_idx].block);
 
 	return NSERROR_OK;
@@ -1808,11 +2638,13 @@ static nserror store_read_block(struct store_state *state,
  * \param state The backing store state to use.
  * \param bse The entry to read.
  * \param elem_idx The element index within the entry.
+ * \param data The buffer to read the element as stored on disc into.
  * \return NSERROR_OK on success or error code.
  */
 static nserror store_read_file(struct store_state *state,
 			 struct store_entry *bse,
-			 int elem_idx)
+			 int elem_idx,
+			 uint8_t *data)
 {
 	int fd;
 	ssize_t rd; /* return from read */
@@ -1827,10 +2659,10 @@ static nserror store_read_file(struct store_state *state,
 		return NSERROR_NOT_FOUND;
 	}
 
-	while (tot < bse->elem[elem_idx].size) {
+	while (tot < bse->elem[elem_idx].disc_size) {
 		rd = read(fd,
-			  bse->elem[elem_idx].data + tot,
-			  bse->elem[elem_idx].size - tot);
+			  data + tot,
+			  bse->elem[elem_idx].disc_size - tot);
 		if (rd <= 0) {
 			NSLOG(netsurf, ERROR,
 			      "read error returned %"PRIssizet" errno %d",
@@ -1845,7 +2677,58 @@ static nserror store_read_file(struct store_state *state,
 	close(fd);
 
 	NSLOG(netsurf, DEEPDEBUG, "Read %"PRIsizet" bytes into %p", tot,
-	      bse->elem[elem_idx].data);
+	      data);
+
+	return ret;
+}
+
+/**
+ * Read an element of an entry from the backing storage.
+ *
+ * The element data allocation must already be made and is filled
+ * with the element data, decompressing it if necessary.
+ *
+ * \param state The backing store state to use.
+ * \param bse The entry to read.
+ * \param elem_idx The element index within the entry.
+ * \return NSERROR_OK on success or error code.
+ */
+static nserror store_read_element(struct store_state *state,
+				  struct store_entry *bse,
+				  int elem_idx)
+{
+	struct store_entry_element *elem = &bse->elem[elem_idx];
+	uint8_t *disc_data = elem->data;
+	uLongf datalen;
+	nserror ret;
+
+	if ((elem->flags & ENTRY_ELEM_FLAG_COMPRESSED) != 0) {
+		disc_data = malloc(elem->disc_size);
+		if (disc_data == NULL) {
+			return NSERROR_NOMEM;
+		}
+	}
+
+	if (elem->block != 0) {
+		ret = store_read_block(state, bse, elem_idx, disc_data);
+	} else {
+		ret = store_read_file(state, bse, elem_idx, disc_data);
+	}
+
+	if (disc_data != elem->data) {
+		if (ret == NSERROR_OK) {
+			datalen = elem->size;
+			if ((uncompress(elem->data, &datalen,
+					disc_data, elem->disc_size) != Z_OK) ||
+			    (datalen != elem->size)) {
+				NSLOG(netsurf, ERROR,
+				      "Failed decompressing %d bytes into %d",
+				      elem->disc_size, elem->size);
+				ret = NSERROR_INVALID;
+			}
+		}
+		free(disc_data);
+	}
 
 	return ret;
 }
@@ -1896,7 +2779,7 @@ fetch(nsurl *url,
 	elem = &bse->elem[elem_idx];
 
 	/* if an allocation already exists return it */
-	if ((elem->flags & ENTRY_ELEM_FLAG_HEAP) != 0) {
+	if ((elem->flags & (ENTRY_ELEM_FLAG_HEAP | ENTRY_ELEM_FLAG_MMAP)) != 0) {
 		/* use the existing allocation and bump the ref count. */
 		elem->ref++;
 
@@ -1904,6 +2787,15 @@ fetch(nsurl *url,
 		      "Using existing entry (%p) allocation %p refs:%d", bse,
 		      elem->data, elem->ref);
 
+#ifdef HAVE_MMAP
+	} else if (((elem->flags & ENTRY_ELEM_FLAG_COMPRESSED) == 0) &&
+		   (store_map_elem(storestate, bse, elem_idx) == NSERROR_OK)) {
+		/* mark the entry as having a valid mapping */
+		elem->flags |= ENTRY_ELEM_FLAG_MMAP;
+		elem->ref = 1;
+
+		storestate->map_count++;
+#endif
 	} else {
 		/* allocate from the heap */
 		elem->data = malloc(elem->size);
@@ -1920,11 +2812,7 @@ fetch(nsurl *url,
 		elem->ref = 1;
 
 		/* fill the new block */
-		if (elem->block != 0) {
-			ret = store_read_block(storestate, bse, elem_idx);
-		} else {
-			ret = store_read_file(storestate, bse, elem_idx);
-		}
+		ret = store_read_element(storestate, bse, elem_idx);
 	}
 
 	/* free the allocation if there is a read error */
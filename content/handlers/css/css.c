@@ -26,6 +26,7 @@
 #include "utils/http.h"
 #include "utils/log.h"
 #include "utils/messages.h"
+#include "utils/perf.h"
 #include "content/content_protected.h"
 #include "content/content_factory.h"
 #include "content/fetch.h"
@@ -270,8 +271,15 @@ nscss_process_data(struct content *c, const char *data, unsigned int size)
 static css_error nscss_process_css_data(struct content_css_data *c,
 		const char *data, unsigned int size)
 {
-	return css_stylesheet_append_data(c->sheet,
+	uint64_t perf_start = perf_begin();
+	css_error error;
+
+	error = css_stylesheet_append_data(c->sheet,
 			(const uint8_t *) data, size);
+
+	perf_end(PERF_PHASE_PARSE, perf_start);
+
+	return error;
 }
 
 /**
@@ -302,10 +310,13 @@ bool nscss_convert(struct content *c)
  */
 static css_error nscss_convert_css_data(struct content_css_data *c)
 {
+	uint64_t perf_start = perf_begin();
 	css_error error;
 
 	error = css_stylesheet_data_done(c->sheet);
 
+	perf_end(PERF_PHASE_PARSE, perf_start);
+
 	/* Process pending imports */
 	if (error == CSS_IMPORTS_PENDING) {
 		/* We must not have registered any imports yet */
@@ -588,7 +599,8 @@ css_error nscss_handle_import(void *pw, css_stylesheet *parent,
 		ctx = NULL;
 	} else {
 		nerror = hlcache_handle_retrieve(ns_url,
-				0, ns_ref, NULL, nscss_import, ctx,
+				LLCACHE_RETRIEVE_PRIORITY_BLOCKING,
+				ns_ref, NULL, nscss_import, ctx,
 				&child, accept,
 				&c->imports[c->import_count].c);
 		if (nerror != NSERROR_OK) {
@@ -17,6 +17,7 @@
  */
 
 #include <assert.h>
+#include <stdlib.h>
 #include <string.h>
 #include <strings.h>
 
@@ -26,6 +27,7 @@
 #include "utils/nsurl.h"
 #include "netsurf/plot_style.h"
 #include "netsurf/url_db.h"
+#include "content/urldb.h"
 #include "desktop/system_colour.h"
 
 #include "css/internal.h"
@@ -244,6 +246,135 @@ static void nscss_dom_user_data_handler(dom_node_operation operation,
 	}
 }
 
+/**
+ * Resolved link target, stored as libdom node user data on anchors
+ *
+ * Selection of :visited and box construction both need the absolute
+ * URL of an anchor's href.  Resolving it once and keeping it on the
+ * node avoids repeating the join (and the urldb lookup) every time the
+ * node is restyled.
+ */
+struct nscss_href_data {
+	dom_string *href; /**< href attribute the URL was resolved from */
+	nsurl *base; /**< base URL the href was resolved against */
+	nsurl *url; /**< resolved absolute URL */
+	unsigned int generation; /**< urldb visit generation of visited */
+	bool visited; /**< whether url has been visited */
+};
+
+/**
+ * Destroy resolved link data
+ *
+ * \param data The link data to destroy
+ */
+static void nscss_href_data_destroy(struct nscss_href_data *data)
+{
+	dom_string_unref(data->href);
+	nsurl_unref(data->base);
+	nsurl_unref(data->url);
+	free(data);
+}
+
+/* Handler for nscss_href_data, stored as libdom node user data */
+static void nscss_href_user_data_handler(dom_node_operation operation,
+		dom_string *key, void *data, struct dom_node *src,
+		struct dom_node *dst)
+{
+	if (dom_string_isequal(corestring_dom___ns_key_href_node_data,
+			key) == false || data == NULL) {
+		return;
+	}
+
+	switch (operation) {
+	case DOM_NODE_CLONED:
+	case DOM_NODE_RENAMED:
+		/* Revalidated against the node on next use */
+		break;
+
+	case DOM_NODE_IMPORTED:
+	case DOM_NODE_ADOPTED:
+	case DOM_NODE_DELETED:
+		nscss_href_data_destroy(data);
+		break;
+
+	default:
+		NSLOG(netsurf, INFO, "User data operation not handled.");
+		assert(0);
+	}
+}
+
+/**
+ * Find the resolved link data on a node, if it is still valid
+ *
+ * \param n     DOM node
+ * \param href  Current href attribute of the node
+ * \param base  Base URL the href is to be resolved against
+ * \return The node's link data, or NULL if absent or stale
+ */
+static struct nscss_href_data *
+nscss_get_href_data(dom_node *n, dom_string *href, nsurl *base)
+{
+	struct nscss_href_data *data = NULL;
+	dom_exception exc;
+
+	exc = dom_node_get_user_data(n, corestring_dom___ns_key_href_node_data,
+			(void *) &data);
+	if (exc != DOM_NO_ERR || data == NULL) {
+		return NULL;
+	}
+
+	if (data->base != base || dom_string_isequal(data->href, href) == false) {
+		return NULL;
+	}
+
+	return data;
+}
+
+/* exported interface documented in css/select.h */
+nserror nscss_set_node_href(dom_node *n, dom_string *href, nsurl *base,
+		nsurl *url)
+{
+	struct nscss_href_data *data, *old = NULL;
+	dom_exception exc;
+
+	data = malloc(sizeof(*data));
+	if (data == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	data->href = dom_string_ref(href);
+	data->base = nsurl_ref(base);
+	data->url = nsurl_ref(url);
+	data->generation = 0;
+	data->visited = false;
+
+	exc = dom_node_set_user_data(n, corestring_dom___ns_key_href_node_data,
+			data, nscss_href_user_data_handler, (void *) &old);
+	if (exc != DOM_NO_ERR) {
+		nscss_href_data_destroy(data);
+		return NSERROR_DOM;
+	}
+
+	if (old != NULL) {
+		nscss_href_data_destroy(old);
+	}
+
+	return NSERROR_OK;
+}
+
+/* exported interface documented in css/select.h */
+nsurl *nscss_get_node_href(dom_node *n, dom_string *href, nsurl *base)
+{
+	struct nscss_href_data *data;
+
+	data = nscss_get_href_data(n, href, base);
+	if (data == NULL) {
+		return NULL;
+	}
+
+	return nsurl_ref(data->url);
+}
+
 /**
  * Get style selection results for an element
  *
@@ -1597,9 +1728,11 @@ css_error node_is_link(void *pw, void *n, bool *match)
 css_error node_is_visited(void *pw, void *node, bool *match)
 {
 	nscss_select_ctx *ctx = pw;
+	struct nscss_href_data *href;
 	nsurl *url;
 	nserror error;
 	const struct url_data *data;
+	unsigned int generation;
 
 	dom_exception exc;
 	dom_node *n = node;
@@ -1628,27 +1761,51 @@ css_error node_is_visited(void *pw, void *node, bool *match)
 		return CSS_OK;
 	}
 
-	/* Make href absolute */
-	/* TODO: this duplicates what we do for box->href
-	 *       should we put the absolute URL on the dom node? */
-	error = nsurl_join(ctx->base_url, dom_string_data(s), &url);
+	/* Reuse the absolute URL already resolved for this href, which
+	 * is shared with box->href once the node has been converted */
+	href = nscss_get_href_data(n, s, ctx->base_url);
+	if (href == NULL) {
+		/* Make href absolute */
+		error = nsurl_join(ctx->base_url, dom_string_data(s), &url);
+		if (error != NSERROR_OK) {
+			/* Couldn't make nsurl object */
+			dom_string_unref(s);
+			return CSS_NOMEM;
+		}
 
-	/* Finished with href string */
-	dom_string_unref(s);
+		/* Failure to cache just means resolving it again next time */
+		if (nscss_set_node_href(n, s, ctx->base_url, url) == NSERROR_OK) {
+			href = nscss_get_href_data(n, s, ctx->base_url);
+		}
 
-	if (error != NSERROR_OK) {
-		/* Couldn't make nsurl object */
-		return CSS_NOMEM;
+		if (href == NULL) {
+			data = urldb_get_url_data(url);
+			*match = (data != NULL && data->visits > 0);
+
+			nsurl_unref(url);
+			dom_string_unref(s);
+
+			return CSS_OK;
+		}
+
+		nsurl_unref(url);
 	}
 
-	data = urldb_get_url_data(url);
+	/* Finished with href string */
+	dom_string_unref(s);
 
-	/* Visited if in the db and has
-	 * non-zero visit count */
-	if (data != NULL && data->visits > 0)
-		*match = true;
+	/* Only consult the db if visit data changed since last time */
+	generation = urldb_get_visit_generation();
+	if (href->generation != generation) {
+		data = urldb_get_url_data(href->url);
+
+		/* Visited if in the db and has
+		 * non-zero visit count */
+		href->visited = (data != NULL && data->visits > 0);
+		href->generation = generation;
+	}
 
-	nsurl_unref(url);
+	*match = href->visited;
 
 	return CSS_OK;
 }
@@ -25,6 +25,8 @@
 
 #include <libcss/libcss.h>
 
+#include "utils/errors.h"
+
 struct content;
 struct nsurl;
 
@@ -56,4 +58,31 @@ css_error named_ancestor_node(void *pw, void *node,
 
 css_error node_is_visited(void *pw, void *node, bool *match);
 
+/**
+ * Record the resolved target of an anchor node's href
+ *
+ * The URL is kept on the node and reused by :visited selection for as
+ * long as the node's href attribute and base URL are unchanged.
+ *
+ * \param n     Anchor element
+ * \param href  Value of the node's href attribute
+ * \param base  Base URL href was resolved against
+ * \param url   Absolute URL href resolves to
+ * \return NSERROR_OK on success or appropriate error code otherwise
+ */
+nserror nscss_set_node_href(dom_node *n, dom_string *href, struct nsurl *base,
+		struct nsurl *url);
+
+/**
+ * Find the resolved target of an anchor node's href
+ *
+ * \param n     Anchor element
+ * \param href  Value of the node's href attribute
+ * \param base  Base URL href is to be resolved against
+ * \return A reference to the absolute URL, or NULL if it has not been
+ *         resolved from this href and base
+ */
+struct nsurl *nscss_get_node_href(dom_node *n, dom_string *href,
+		struct nsurl *base);
+
 #endif
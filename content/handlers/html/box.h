@@ -86,7 +86,10 @@ typedef enum {
 	REPLACE_DIM = 1 << 9,	/* replaced element has given dimensions */
 	IFRAME      = 1 << 10,	/* box contains an iframe */
 	CONVERT_CHILDREN = 1 << 11,  /* wanted children converting */
-	IS_REPLACED = 1 << 12	/* box is a replaced element */
+	IS_REPLACED = 1 << 12,	/* box is a replaced element */
+	NEEDS_LAYOUT = 1 << 13,	/* box or a descendant must be laid out again */
+	LAYOUT_KEPT = 1 << 14,	/* block context kept from previous layout */
+	ABS_DESCENDANTS = 1 << 15 /* has absolute, fixed or iframe descendants */
 } box_flags;
 
 
@@ -144,6 +147,45 @@ struct column {
 };
 
 
+/**
+ * Previous layout of a block formatting context.
+ *
+ * Records what a block context was last laid out with and the
+ * resulting size, so an unchanged context can be kept by later layouts
+ * instead of being laid out again.
+ */
+struct box_layout_state {
+	int width;		/**< content width laid out at */
+	int height;		/**< height (or AUTO) before layout */
+	int padding[4];		/**< padding before layout */
+	int viewport_height;	/**< viewport height laid out with */
+	int result_height;	/**< height after layout */
+	int result_padding;	/**< bottom padding after layout */
+};
+
+
+/**
+ * Entry in a vertical index of a box's children.
+ */
+struct box_child_index_entry {
+	struct box *box; /**< child box */
+	int y0; /**< top of child's descendant box, in parent coordinates */
+	int y1; /**< lowest bottom of this and all preceding entries */
+};
+
+/**
+ * Vertical index of a box's children.
+ *
+ * Built by layout for boxes with many children whose tops are in
+ * document order, so the children extending over a vertical range can
+ * be found without visiting every child.  Floats are not indexed.
+ */
+struct box_child_index {
+	unsigned int count; /**< number of entries */
+	struct box_child_index_entry entry[]; /**< entries in document order */
+};
+
+
 /**
  * Linked list of object element parameters.
  */
@@ -269,6 +311,18 @@ struct box {
 	 */
 	int cached_place_below_level;
 
+	/**
+	 * Previous layout if box is the root of a block formatting
+	 * context which has been laid out, or NULL.
+	 */
+	struct box_layout_state *layout_state;
+
+	/**
+	 * Index of children by vertical extent, or NULL if the box has
+	 * too few children or they are not in vertical order.
+	 */
+	struct box_child_index *child_index;
+
 
 	/**
 	 * Coordinate of left padding edge relative to parent box, or
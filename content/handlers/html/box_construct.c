@@ -34,6 +34,7 @@
 #include "utils/string.h"
 #include "utils/ascii.h"
 #include "utils/nsurl.h"
+#include "utils/perf.h"
 #include "netsurf/misc.h"
 #include "css/select.h"
 #include "desktop/gui_internal.h"
@@ -258,6 +259,7 @@ box_get_style(html_content *c,
 	css_stylesheet *inline_style = NULL;
 	css_select_results *styles;
 	nscss_select_ctx ctx;
+	uint64_t perf_start;
 
 	/* Firstly, construct inline stylesheet, if any */
 	err = dom_element_get_attribute(n, corestring_dom_style, &s);
@@ -287,7 +289,9 @@ box_get_style(html_content *c,
 	ctx.parent_style = parent_style;
 
 	/* Select style for element */
+	perf_start = perf_begin();
 	styles = nscss_get_style(&ctx, n, &c->media, inline_style);
+	perf_end(PERF_PHASE_SELECT, perf_start);
 
 	/* No longer need inline style */
 	if (inline_style != NULL)
@@ -1237,6 +1241,25 @@ static bool box_construct_text(struct box_construct_ctx *ctx)
 }
 
 
+/**
+ * Finish box tree construction, notifying the client.
+ *
+ * \param ctx Box construction context
+ * \param success Whether construction succeeded
+ * \param perf_start Measurement start time of the current step
+ */
+static void
+box_construct_done(struct box_construct_ctx *ctx,
+		   bool success,
+		   uint64_t perf_start)
+{
+	/* the client's work is not part of box construction */
+	perf_end(PERF_PHASE_BOX, perf_start);
+
+	ctx->cb(ctx->content, success);
+}
+
+
 /**
  * Convert an ELEMENT node to a box tree fragment,
  * then schedule conversion of the next ELEMENT node
@@ -1247,6 +1270,7 @@ static void convert_xml_to_box(struct box_construct_ctx *ctx)
 	bool convert_children;
 	uint32_t num_processed = 0;
 	const uint32_t max_processed_before_yield = 10;
+	uint64_t perf_start = perf_begin();
 
 	do {
 		convert_children = true;
@@ -1254,7 +1278,7 @@ static void convert_xml_to_box(struct box_construct_ctx *ctx)
 		assert(ctx->n != NULL);
 
 		if (box_construct_element(ctx, &convert_children) == false) {
-			ctx->cb(ctx->content, false);
+			box_construct_done(ctx, false, perf_start);
 			dom_node_unref(ctx->n);
 			free(ctx);
 			return;
@@ -1268,7 +1292,7 @@ static void convert_xml_to_box(struct box_construct_ctx *ctx)
 
 			err = dom_node_get_node_type(next, &type);
 			if (err != DOM_NO_ERR) {
-				ctx->cb(ctx->content, false);
+				box_construct_done(ctx, false, perf_start);
 				dom_node_unref(next);
 				free(ctx);
 				return;
@@ -1280,7 +1304,7 @@ static void convert_xml_to_box(struct box_construct_ctx *ctx)
 			if (type == DOM_TEXT_NODE) {
 				ctx->n = next;
 				if (box_construct_text(ctx) == false) {
-					ctx->cb(ctx->content, false);
+					box_construct_done(ctx, false, perf_start);
 					dom_node_unref(ctx->n);
 					free(ctx);
 					return;
@@ -1305,12 +1329,12 @@ static void convert_xml_to_box(struct box_construct_ctx *ctx)
 			/** \todo Remove box_normalise_block */
 			if (box_normalise_block(&root, ctx->root_box,
 					ctx->content) == false) {
-				ctx->cb(ctx->content, false);
+				box_construct_done(ctx, false, perf_start);
 			} else {
 				ctx->content->layout = root.children;
 				ctx->content->layout->parent = NULL;
 
-				ctx->cb(ctx->content, true);
+				box_construct_done(ctx, true, perf_start);
 			}
 
 			assert(ctx->n == NULL);
@@ -1320,6 +1344,8 @@ static void convert_xml_to_box(struct box_construct_ctx *ctx)
 		}
 	} while (++num_processed < max_processed_before_yield);
 
+	perf_end(PERF_PHASE_BOX, perf_start);
+
 	/* More work to do: schedule a continuation */
 	guit->misc->schedule(0, (void *)convert_xml_to_box, ctx);
 }
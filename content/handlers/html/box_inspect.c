@@ -263,19 +263,104 @@ box_move_xy(struct box *b, enum box_walk_dir dir, int *x, int *y)
 }
 
 
+/**
+ * Move from box to its first child which may contain a point
+ *
+ * \param b   box to move from
+ * \param x   box's global x-coord, updated to position of child
+ * \param y   box's global y-coord, updated to position of child
+ * \param py  global y-coord of the point
+ * \return  the first candidate non-float child, or NULL if none
+ */
+static inline struct box *
+box_move_children_xy(struct box *b, int *x, int *y, int py)
+{
+	unsigned int first, end;
+	struct box *n;
+
+	if (!box_children_in_range(b, py - *y, py - *y, &first, &end))
+		return box_move_xy(b, BOX_WALK_CHILDREN, x, y);
+
+	if (first == end)
+		return NULL;
+
+	n = b->child_index->entry[first].box;
+	*x += n->x;
+	*y += n->y;
+
+	return n;
+}
+
+
+/**
+ * Move from box to its next sibling which may contain a point
+ *
+ * \param b   box to move from, which is not a float
+ * \param x   box's global x-coord, updated to position of sibling
+ * \param y   box's global y-coord, updated to position of sibling
+ * \param py  global y-coord of the point
+ * \return  the next candidate non-float sibling, or NULL if none
+ */
+static inline struct box *
+box_move_next_sibling_xy(struct box *b, int *x, int *y, int py)
+{
+	const struct box_child_index *index;
+	unsigned int first, end;
+	unsigned int lo, hi, mid;
+	int rel = py - (*y - b->y);
+	int top = b->y + b->descendant_y0;
+	struct box *n;
+
+	if (b->parent == NULL ||
+	    !box_children_in_range(b->parent, rel, rel, &first, &end))
+		return box_move_xy(b, BOX_WALK_NEXT_SIBLING, x, y);
+
+	/* Find b in the index; the first entry at its top, and then
+	 * along any others sharing that top */
+	index = b->parent->child_index;
+	lo = 0;
+	hi = index->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->entry[mid].y0 < top)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	while (lo < index->count && index->entry[lo].box != b &&
+	       index->entry[lo].y0 == top)
+		lo++;
+	if (lo == index->count || index->entry[lo].box != b)
+		return box_move_xy(b, BOX_WALK_NEXT_SIBLING, x, y);
+
+	if (lo + 1 > first)
+		first = lo + 1;
+	if (first >= end)
+		return NULL;
+
+	n = index->entry[first].box;
+	*x += n->x - b->x;
+	*y += n->y - b->y;
+
+	return n;
+}
+
+
 /**
  * Itterator for walking to next box in interaction order
  *
  * \param b	box to find next box from
  * \param x	box's global x-coord, updated to position of next box
  * \param y	box's global y-coord, updated to position of next box
+ * \param py	global y-coord of the point boxes are wanted at
  * \param skip_children	whether to skip box's children
  *
  * This walks to a boxes float children before its children.  When walking
- * children, floating boxes are skipped.
+ * children, floating boxes are skipped, as are boxes which cannot contain
+ * the point according to the parent's child index.
  */
 static inline struct box *
-box_next_xy(struct box *b, int *x, int *y, bool skip_children)
+box_next_xy(struct box *b, int *x, int *y, int py, bool skip_children)
 {
 	struct box *n;
 	int tx, ty;
@@ -298,7 +383,7 @@ box_next_xy(struct box *b, int *x, int *y, bool skip_children)
  done_float_children:
 
 	tx = *x; ty = *y;
-	n = box_move_xy(b, BOX_WALK_CHILDREN, &tx, &ty);
+	n = box_move_children_xy(b, &tx, &ty, py);
 	if (n) {
 		/* Next node is child */
 		*x = tx;
@@ -340,7 +425,7 @@ box_next_xy(struct box *b, int *x, int *y, bool skip_children)
 		}
 
 		tx = *x; ty = *y;
-		n = box_move_xy(b, BOX_WALK_NEXT_SIBLING, &tx, &ty);
+		n = box_move_next_sibling_xy(b, &tx, &ty, py);
 		if (n) {
 			/* Go to non-float (ancestor) sibling */
 			*x = tx;
@@ -573,6 +658,48 @@ void box_bounds(struct box *box, struct rect *r)
 }
 
 
+/* Exported function documented in html/box_inspect.h */
+bool
+box_children_in_range(const struct box *box,
+		      int y0, int y1,
+		      unsigned int *first, unsigned int *end)
+{
+	const struct box_child_index *index = box->child_index;
+	unsigned int lo, hi, mid;
+
+	if (index == NULL || (box->flags & NEEDS_LAYOUT)) {
+		/* No index, or children changed since it was built */
+		return false;
+	}
+
+	/* First entry whose descendants, or those of an earlier entry,
+	 * reach down to the range */
+	lo = 0;
+	hi = index->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->entry[mid].y1 < y0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*first = lo;
+
+	/* First entry starting below the range */
+	hi = index->count;
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (index->entry[mid].y0 <= y1)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	*end = lo;
+
+	return true;
+}
+
+
 /* Exported function documented in html/box.h */
 struct box *
 box_at_point(const nscss_len_ctx *len_ctx,
@@ -586,7 +713,7 @@ box_at_point(const nscss_len_ctx *len_ctx,
 	assert(box);
 
 	skip_children = false;
-	while ((box = box_next_xy(box, box_x, box_y, skip_children))) {
+	while ((box = box_next_xy(box, box_x, box_y, y, skip_children))) {
 		if (box_contains_point(len_ctx, box, x - *box_x, y - *box_y,
 				       &physically)) {
 			*box_x -= scrollbar_get_offset(box->scroll_x);
@@ -70,6 +70,25 @@ void box_bounds(struct box *box, struct rect *r);
 struct box *box_at_point(const nscss_len_ctx *len_ctx, struct box *box, const int x, const int y, int *box_x, int *box_y);
 
 
+/**
+ * Find the children of a box which may extend over a vertical range.
+ *
+ * Children outside the range returned do not extend over the range
+ * with their descendants.  Children within it are candidates only and
+ * must still be tested.  Floats are never included.
+ *
+ * \param  box    box whose children to find
+ * \param  y0     top of range, relative to box
+ * \param  y1     bottom of range, inclusive, relative to box
+ * \param  first  updated to index of first candidate in box->child_index
+ * \param  end    updated to index after last candidate
+ * \return  true if box's children are indexed and first and end were
+ *          updated, false if all the children must be visited
+ */
+bool box_children_in_range(const struct box *box, int y0, int y1,
+		unsigned int *first, unsigned int *end);
+
+
 /**
  * Find a box based upon its id attribute.
  *
@@ -143,6 +143,8 @@ box_create(css_select_results *styles,
 	box->float_container = NULL;
 	box->next_float = NULL;
 	box->cached_place_below_level = 0;
+	box->layout_state = NULL;
+	box->child_index = NULL;
 	box->list_marker = NULL;
 	box->col = NULL;
 	box->gadget = NULL;
@@ -248,6 +250,20 @@ void box_free_box(struct box *box)
 }
 
 
+/* Exported function documented in html/box_manipulate.h */
+void box_invalidate_layout(struct box *box, bool minmax)
+{
+	struct box *b;
+
+	for (b = box; b != NULL; b = b->parent) {
+		if (minmax) {
+			b->max_width = UNKNOWN_MAX_WIDTH;
+		}
+		b->flags |= NEEDS_LAYOUT;
+	}
+}
+
+
 /* exported interface documented in html/box.h */
 nserror
 box_handle_scrollbars(struct content *c,
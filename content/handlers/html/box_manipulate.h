@@ -89,6 +89,19 @@ void box_free(struct box *box);
 void box_free_box(struct box *box);
 
 
+/**
+ * Mark a box as needing layout.
+ *
+ * The box and its ancestors are laid out again by the next layout,
+ * while block formatting contexts elsewhere in the tree may keep their
+ * previous layout.
+ *
+ * \param box     box whose content has changed
+ * \param minmax  whether the box's minimum and maximum widths changed
+ */
+void box_invalidate_layout(struct box *box, bool minmax);
+
+
 /**
  * Applies the given scroll setup to a box. This includes scroll
  * creation/deletion as well as scroll dimension updates.
@@ -39,6 +39,7 @@
 #include "utils/nsurl.h"
 #include "netsurf/plot_style.h"
 #include "css/hints.h"
+#include "css/select.h"
 #include "desktop/frame_types.h"
 #include "content/content_factory.h"
 
@@ -674,14 +675,38 @@ box_a(dom_node *n,
       struct box *box,
       bool *convert_children)
 {
-	bool ok;
+	bool ok = true;
 	nsurl *url;
+	lwc_string *scheme;
 	dom_string *s;
 	dom_exception err;
 
 	err = dom_element_get_attribute(n, corestring_dom_href, &s);
 	if (err == DOM_NO_ERR && s != NULL) {
-		ok = box_extract_link(content, s, content->base_url, &url);
+		/* reuse the link already resolved by :visited selection */
+		url = nscss_get_node_href(n, s, content->base_url);
+		if (url != NULL && content->enable_scripting == false) {
+			/* javascript: links are extracted from instead */
+			scheme = nsurl_get_component(url, NSURL_SCHEME);
+			if (scheme == corestring_lwc_javascript) {
+				nsurl_unref(url);
+				url = NULL;
+			}
+			if (scheme != NULL) {
+				lwc_string_unref(scheme);
+			}
+		}
+
+		if (url == NULL) {
+			ok = box_extract_link(content, s, content->base_url,
+					      &url);
+			if (ok && url) {
+				/* share the resolved link with :visited
+				 * selection */
+				nscss_set_node_href(n, s, content->base_url,
+						    url);
+			}
+		}
 		dom_string_unref(s);
 		if (!ok)
 			return false;
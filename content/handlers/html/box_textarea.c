@@ -186,6 +186,7 @@ static void box_textarea_callback(void *data, struct textarea_msg *msg)
 	case TEXTAREA_MSG_REDRAW_REQUEST:
 	{
 		/* Request redraw of the required textarea rectangle */
+		struct rect area;
 		int x, y;
 
 		if (html->reflowing == true) {
@@ -196,6 +197,12 @@ static void box_textarea_callback(void *data, struct textarea_msg *msg)
 
 		box_coords(box, &x, &y);
 
+		area.x0 = x + msg->data.redraw.x0;
+		area.y0 = y + msg->data.redraw.y0;
+		area.x1 = x + msg->data.redraw.x1;
+		area.y1 = y + msg->data.redraw.y1;
+		html_redraw_tiles_invalidate(html, &area);
+
 		content__request_redraw((struct content *)html,
 				x + msg->data.redraw.x0,
 				y + msg->data.redraw.y0,
@@ -465,7 +465,8 @@ bool html_css_process_link(html_content *htmlc, dom_node *node)
 	child.charset = htmlc->encoding;
 	child.quirks = htmlc->base.quirks;
 
-	ns_error = hlcache_handle_retrieve(joined, 0,
+	ns_error = hlcache_handle_retrieve(joined,
+			LLCACHE_RETRIEVE_PRIORITY_BLOCKING,
 			content_get_url(&htmlc->base),
 			NULL, html_convert_css_callback,
 			htmlc, &child, CONTENT_CSS,
@@ -22,12 +22,289 @@
  * HTML internal font handling implementation.
  */
 
+#include <stdlib.h>
+#include <string.h>
+
 #include "utils/nsoption.h"
+#include "utils/log.h"
+#include "utils/hashmap.h"
 #include "netsurf/plot_style.h"
+#include "netsurf/layout.h"
 #include "css/utils.h"
 
 #include "html/font.h"
 
+/** Maximum number of widths held in the text width cache */
+#define FONT_WIDTH_CACHE_SIZE 8192
+
+/** Longest string, in bytes, whose width is cached */
+#define FONT_WIDTH_CACHE_MAX_LENGTH 256
+
+/**
+ * Text width cache key
+ *
+ * Only the parts of the plot style which affect the width of text are
+ * considered; the colours are not.
+ */
+struct font_width_key {
+	uint32_t hash; /**< hash of the remaining fields */
+	lwc_string **families; /**< NULL terminated font families or NULL */
+	plot_font_generic_family_t family; /**< generic font family */
+	plot_style_fixed size; /**< font size */
+	int weight; /**< font weight */
+	plot_font_flags_t flags; /**< font flags */
+	const char *string; /**< measured text, not NUL terminated */
+	size_t length; /**< length of string in bytes */
+};
+
+/**
+ * Text width cache entry
+ */
+struct font_width_entry {
+	struct font_width_key *key; /**< the key held by the cache map */
+	struct font_width_entry *prev; /**< more recently used entry */
+	struct font_width_entry *next; /**< less recently used entry */
+	int width; /**< measured width of the text */
+};
+
+/**
+ * Text width cache
+ */
+static struct font_width_cache {
+	hashmap_t *map; /**< entries keyed by style and string */
+	struct font_width_entry *head; /**< most recently used entry */
+	struct font_width_entry *tail; /**< least recently used entry */
+	struct font_width_cache_stats stats; /**< cache statistics */
+
+	/** font options the cached widths were measured with */
+	char *options[5];
+	/** default font family the cached widths were measured with */
+	int font_default;
+	/** minimum font size the cached widths were measured with */
+	int font_min_size;
+	/** generation of the font options */
+	unsigned int generation;
+} font_width_cache;
+
+
+/**
+ * Compute the hash of a text width cache key
+ *
+ * \param key  The key to hash
+ * \return The hash of the key
+ */
+static uint32_t font_width_key_compute_hash(const struct font_width_key *key)
+{
+	uint32_t hash = 0x811c9dc5;
+	const unsigned char *c;
+	size_t i;
+
+#define FONT_WIDTH_HASH(v) hash = (hash ^ (uint32_t)(v)) * 0x01000193
+	if (key->families != NULL) {
+		for (i = 0; key->families[i] != NULL; i++) {
+			FONT_WIDTH_HASH((uintptr_t)key->families[i] >> 4);
+		}
+	}
+	FONT_WIDTH_HASH(key->family);
+	FONT_WIDTH_HASH(key->size);
+	FONT_WIDTH_HASH(key->weight);
+	FONT_WIDTH_HASH(key->flags);
+	for (c = (const unsigned char *)key->string, i = 0;
+	     i < key->length;
+	     i++) {
+		FONT_WIDTH_HASH(c[i]);
+	}
+#undef FONT_WIDTH_HASH
+
+	return hash;
+}
+
+static uint32_t font_width_key_hash(void *key)
+{
+	return ((struct font_width_key *)key)->hash;
+}
+
+static bool font_width_key_eq(void *a, void *b)
+{
+	struct font_width_key *ka = a;
+	struct font_width_key *kb = b;
+	size_t i;
+
+	if (ka->hash != kb->hash ||
+	    ka->length != kb->length ||
+	    ka->family != kb->family ||
+	    ka->size != kb->size ||
+	    ka->weight != kb->weight ||
+	    ka->flags != kb->flags) {
+		return false;
+	}
+
+	if (ka->families == NULL || kb->families == NULL) {
+		if (ka->families != kb->families) {
+			return false;
+		}
+	} else {
+		for (i = 0; ka->families[i] == kb->families[i]; i++) {
+			if (ka->families[i] == NULL) {
+				break;
+			}
+		}
+		if (ka->families[i] != kb->families[i]) {
+			return false;
+		}
+	}
+
+	return memcmp(ka->string, kb->string, ka->length) == 0;
+}
+
+/**
+ * Clone a text width cache key
+ *
+ * The key, its font families and its string are copied into a single
+ * allocation.  The families are referenced so that their interned
+ * addresses remain valid for comparison while the key is cached.
+ */
+static void *font_width_key_clone(void *key)
+{
+	struct font_width_key *k = key;
+	struct font_width_key *clone;
+	size_t count = 0;
+	size_t i;
+
+	if (k->families != NULL) {
+		while (k->families[count] != NULL) {
+			count++;
+		}
+		count++;
+	}
+
+	clone = malloc(sizeof(*clone) +
+		       count * sizeof(lwc_string *) +
+		       k->length);
+	if (clone == NULL) {
+		return NULL;
+	}
+
+	*clone = *k;
+	if (k->families != NULL) {
+		clone->families = (lwc_string **)(clone + 1);
+		for (i = 0; i < count; i++) {
+			clone->families[i] = (k->families[i] == NULL) ?
+				NULL : lwc_string_ref(k->families[i]);
+		}
+	}
+	clone->string = (char *)(clone + 1) + count * sizeof(lwc_string *);
+	memcpy((char *)clone->string, k->string, k->length);
+
+	return clone;
+}
+
+static void font_width_key_destroy(void *key)
+{
+	struct font_width_key *k = key;
+	size_t i;
+
+	if (k->families != NULL) {
+		for (i = 0; k->families[i] != NULL; i++) {
+			lwc_string_unref(k->families[i]);
+		}
+	}
+
+	free(k);
+}
+
+static void *font_width_value_alloc(void *key)
+{
+	struct font_width_entry *entry;
+
+	entry = calloc(1, sizeof(*entry));
+	if (entry == NULL) {
+		return NULL;
+	}
+
+	entry->key = key;
+
+	return entry;
+}
+
+static void font_width_value_destroy(void *value)
+{
+	struct font_width_entry *entry = value;
+
+	if (entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	} else if (font_width_cache.head == entry) {
+		font_width_cache.head = entry->next;
+	}
+
+	if (entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	} else if (font_width_cache.tail == entry) {
+		font_width_cache.tail = entry->prev;
+	}
+
+	font_width_cache.stats.entries--;
+
+	free(entry);
+}
+
+static hashmap_parameters_t font_width_cache_params = {
+	.key_clone = font_width_key_clone,
+	.key_hash = font_width_key_hash,
+	.key_eq = font_width_key_eq,
+	.key_destroy = font_width_key_destroy,
+	.value_alloc = font_width_value_alloc,
+	.value_destroy = font_width_value_destroy,
+	.flat = true,
+};
+
+/**
+ * Make a text width cache entry the most recently used
+ *
+ * \param entry  The entry to move, which may not yet be in the list
+ */
+static void font_width_cache_touch(struct font_width_entry *entry)
+{
+	if (font_width_cache.head == entry) {
+		return;
+	}
+
+	/* unlink */
+	if (entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	}
+	if (entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	} else if (font_width_cache.tail == entry) {
+		font_width_cache.tail = entry->prev;
+	}
+
+	/* and link at head */
+	entry->prev = NULL;
+	entry->next = font_width_cache.head;
+	if (font_width_cache.head != NULL) {
+		font_width_cache.head->prev = entry;
+	}
+	font_width_cache.head = entry;
+	if (font_width_cache.tail == NULL) {
+		font_width_cache.tail = entry;
+	}
+}
+
+/**
+ * Discard all cached widths
+ */
+static void font_width_cache_flush(void)
+{
+	if (font_width_cache.map != NULL) {
+		hashmap_destroy(font_width_cache.map);
+		font_width_cache.map = NULL;
+	}
+	font_width_cache.head = NULL;
+	font_width_cache.tail = NULL;
+	font_width_cache.stats.entries = 0;
+}
+
 /**
  * Map a generic CSS font family to a generic plot font family
  *
@@ -162,3 +439,160 @@ void font_plot_style_from_css(
 	fstyle->foreground = nscss_color_to_ns(col);
 	fstyle->background = 0;
 }
+
+
+/* exported function documented in html/font.h */
+nserror font_width(const struct gui_layout_table *font_func,
+		   const plot_font_style_t *fstyle,
+		   const char *string,
+		   size_t length,
+		   int *width)
+{
+	struct font_width_key key;
+	struct font_width_entry *entry;
+	nserror res;
+
+	if (length > FONT_WIDTH_CACHE_MAX_LENGTH) {
+		return font_func->width(fstyle, string, length, width);
+	}
+
+	key.families = (lwc_string **)fstyle->families;
+	key.family = fstyle->family;
+	key.size = fstyle->size;
+	key.weight = fstyle->weight;
+	key.flags = fstyle->flags;
+	key.string = string;
+	key.length = length;
+	key.hash = font_width_key_compute_hash(&key);
+
+	if (font_width_cache.map != NULL) {
+		entry = hashmap_lookup(font_width_cache.map, &key);
+		if (entry != NULL) {
+			font_width_cache.stats.hits++;
+			font_width_cache_touch(entry);
+			*width = entry->width;
+			return NSERROR_OK;
+		}
+	}
+
+	font_width_cache.stats.misses++;
+
+	res = font_func->width(fstyle, string, length, width);
+	if (res != NSERROR_OK) {
+		return res;
+	}
+
+	if (font_width_cache.map == NULL) {
+		font_width_cache.map = hashmap_create(&font_width_cache_params);
+		if (font_width_cache.map == NULL) {
+			/* not caching is not fatal */
+			return NSERROR_OK;
+		}
+	}
+
+	entry = hashmap_insert(font_width_cache.map, &key);
+	if (entry == NULL) {
+		return NSERROR_OK;
+	}
+	entry->width = *width;
+	font_width_cache.stats.entries++;
+	font_width_cache_touch(entry);
+
+	/* discard least recently used widths beyond the limit */
+	while (font_width_cache.stats.entries > FONT_WIDTH_CACHE_SIZE) {
+		font_width_cache.stats.evictions++;
+		hashmap_remove(font_width_cache.map,
+			       font_width_cache.tail->key);
+	}
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Check a cached font option against its current value
+ *
+ * \param cached   Location of the cached value, updated if changed
+ * \param current  The current option value, may be NULL
+ * \return true if the value changed
+ */
+static bool font_width_cache_option_changed(char **cached, const char *current)
+{
+	if (*cached == NULL && current == NULL) {
+		return false;
+	}
+	if (*cached != NULL && current != NULL && strcmp(*cached, current) == 0) {
+		return false;
+	}
+
+	free(*cached);
+	*cached = (current == NULL) ? NULL : strdup(current);
+
+	return true;
+}
+
+
+/* exported function documented in html/font.h */
+unsigned int font_width_cache_validate(void)
+{
+	char **options = font_width_cache.options;
+	bool changed = false;
+
+	changed |= font_width_cache_option_changed(&options[0],
+			nsoption_charp(font_sans));
+	changed |= font_width_cache_option_changed(&options[1],
+			nsoption_charp(font_serif));
+	changed |= font_width_cache_option_changed(&options[2],
+			nsoption_charp(font_mono));
+	changed |= font_width_cache_option_changed(&options[3],
+			nsoption_charp(font_cursive));
+	changed |= font_width_cache_option_changed(&options[4],
+			nsoption_charp(font_fantasy));
+
+	if (font_width_cache.font_default != nsoption_int(font_default)) {
+		font_width_cache.font_default = nsoption_int(font_default);
+		changed = true;
+	}
+
+	if (font_width_cache.font_min_size != nsoption_int(font_min_size)) {
+		font_width_cache.font_min_size = nsoption_int(font_min_size);
+		changed = true;
+	}
+
+	if (changed) {
+		NSLOG(netsurf, INFO, "Font options changed; discarding %u widths",
+		      font_width_cache.stats.entries);
+		font_width_cache_flush();
+		font_width_cache.generation++;
+	}
+
+	return font_width_cache.generation;
+}
+
+
+/* exported function documented in html/font.h */
+void font_width_cache_get_stats(struct font_width_cache_stats *stats)
+{
+	*stats = font_width_cache.stats;
+}
+
+
+/* exported function documented in html/font.h */
+void font_width_cache_fini(void)
+{
+	size_t i;
+
+	NSLOG(netsurf, INFO,
+	      "Text width cache: %u hits, %u misses, %u evictions",
+	      font_width_cache.stats.hits,
+	      font_width_cache.stats.misses,
+	      font_width_cache.stats.evictions);
+
+	font_width_cache_flush();
+
+	for (i = 0; i < sizeof(font_width_cache.options) /
+		     sizeof(font_width_cache.options[0]); i++) {
+		free(font_width_cache.options[i]);
+		font_width_cache.options[i] = NULL;
+	}
+}
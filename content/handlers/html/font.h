@@ -27,7 +27,20 @@
 #ifndef NETSURF_HTML_FONT_H
 #define NETSURF_HTML_FONT_H
 
+#include "utils/errors.h"
+
 struct plot_font_style;
+struct gui_layout_table;
+
+/**
+ * Text width cache statistics
+ */
+struct font_width_cache_stats {
+	unsigned int entries; /**< number of widths currently cached */
+	unsigned int hits; /**< lookups answered from the cache */
+	unsigned int misses; /**< lookups passed to the frontend */
+	unsigned int evictions; /**< widths discarded to bound the cache */
+};
 
 /**
  * Populate a font style using data from a computed CSS style
@@ -40,4 +53,47 @@ void font_plot_style_from_css(const nscss_len_ctx *len_ctx,
 			      const css_computed_style *css,
 			      struct plot_font_style *fstyle);
 
+/**
+ * Measure the width of a string, using the text width cache
+ *
+ * Widths are cached by font style and string, shared between all
+ * contents, and the least recently used are discarded once the cache
+ * is full.
+ *
+ * \param font_func  Font functions to measure uncached strings with
+ * \param fstyle     Plot style for the text
+ * \param string     UTF-8 string to measure
+ * \param length     Length of string, in bytes
+ * \param width      Updated to width of string[0..length)
+ * \return NSERROR_OK and width updated or appropriate error code
+ */
+nserror font_width(const struct gui_layout_table *font_func,
+		   const struct plot_font_style *fstyle,
+		   const char *string,
+		   size_t length,
+		   int *width);
+
+/**
+ * Discard cached widths if the font configuration has changed
+ *
+ * Widths measured with the previous font options are no longer
+ * valid.  This should be called before laying out a document.
+ *
+ * \return The generation of the font configuration, which changes
+ *         whenever cached widths are discarded for this reason.
+ */
+unsigned int font_width_cache_validate(void);
+
+/**
+ * Get text width cache statistics
+ *
+ * \param stats  Updated with the current statistics
+ */
+void font_width_cache_get_stats(struct font_width_cache_stats *stats);
+
+/**
+ * Finalise the text width cache, discarding all cached widths
+ */
+void font_width_cache_fini(void);
+
 #endif
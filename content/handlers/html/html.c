@@ -41,6 +41,7 @@
 #include "utils/nsoption.h"
 #include "utils/string.h"
 #include "utils/ascii.h"
+#include "utils/perf.h"
 #include "netsurf/content.h"
 #include "netsurf/browser_window.h"
 #include "netsurf/utf8.h"
@@ -70,6 +71,7 @@
 #include "html/form_internal.h"
 #include "html/imagemap.h"
 #include "html/layout.h"
+#include "html/font.h"
 #include "html/textselection.h"
 
 #define CHUNK 4096
@@ -458,6 +460,8 @@ html_create_html_data(html_content *c, const http_parameter *params)
 	c->aborted = false;
 	c->refresh = false;
 	c->reflowing = false;
+	c->layout_reusable = false;
+	c->layout_font_generation = 0;
 	c->title = NULL;
 	c->bctx = NULL;
 	c->layout = NULL;
@@ -469,11 +473,15 @@ html_create_html_data(html_content *c, const http_parameter *params)
 	c->universal = NULL;
 	c->num_objects = 0;
 	c->object_list = NULL;
+	c->unprioritised_objects = 0;
+	c->prioritised_area.x0 = c->prioritised_area.x1 = 0;
+	c->prioritised_area.y0 = c->prioritised_area.y1 = 0;
 	c->forms = NULL;
 	c->imagemaps = NULL;
 	c->bw = NULL;
 	c->frameset = NULL;
 	c->iframe = NULL;
+	c->redraw_tiles = NULL;
 	c->page = NULL;
 	c->font_func = guit->layout;
 	c->drag_type = HTML_DRAG_NONE;
@@ -711,6 +719,7 @@ html_process_data(struct content *c, const char *data, unsigned int size)
 	html_content *html = (html_content *) c;
 	dom_hubbub_error dom_ret;
 	nserror err = NSERROR_OK; /* assume its all going to be ok */
+	uint64_t perf_start = perf_begin();
 
 	dom_ret = dom_hubbub_parser_parse_chunk(html->parser,
 					      (const uint8_t *) data,
@@ -723,6 +732,8 @@ html_process_data(struct content *c, const char *data, unsigned int size)
 		 err = html_process_encoding_change(c, data, size);
 	}
 
+	perf_end(PERF_PHASE_PARSE, perf_start);
+
 	/* broadcast the error if necessary */
 	if (err != NSERROR_OK) {
 		content_broadcast_error(c, err, NULL);
@@ -824,9 +835,12 @@ html_begin_conversion(html_content *htmlc)
 	 * complete to avoid repeating the completion pointlessly.
 	 */
 	if (htmlc->parse_completed == false) {
+		uint64_t perf_start = perf_begin();
+
 		NSLOG(netsurf, INFO, "Completing parse (%p)", htmlc);
 		/* complete parsing */
 		error = dom_hubbub_parser_completed(htmlc->parser);
+		perf_end(PERF_PHASE_PARSE, perf_start);
 		if (error == DOM_HUBBUB_HUBBUB_ERR_PAUSED && htmlc->base.active > 0) {
 			/* The act of completing the parse failed because we've
 			 * encountered a sync script which needs to run
@@ -1030,18 +1044,43 @@ static void html_reformat(struct content *c, int width, int height)
 	uint64_t ms_before;
 	uint64_t ms_after;
 	uint64_t ms_interval;
+	unsigned int font_generation;
+	css_fixed vw, vh;
+	uint64_t perf_start = perf_begin();
 
 	nsu_getmonotonic_ms(&ms_before);
 
 	htmlc->reflowing = true;
 
-	htmlc->len_ctx.vw = nscss_pixels_physical_to_css(INTTOFIX(width));
-	htmlc->len_ctx.vh = nscss_pixels_physical_to_css(INTTOFIX(height));
+	vw = nscss_pixels_physical_to_css(INTTOFIX(width));
+	vh = nscss_pixels_physical_to_css(INTTOFIX(height));
+	font_generation = font_width_cache_validate();
+
+	/* Lengths relative to the viewport and the fonts in use may
+	 * change the layout of any box, so only keep the previous layout
+	 * of unchanged block contexts when neither has changed. */
+	htmlc->layout_reusable = htmlc->had_initial_layout &&
+			htmlc->len_ctx.vw == vw &&
+			htmlc->len_ctx.vh == vh &&
+			htmlc->layout_font_generation == font_generation;
+	htmlc->layout_font_generation = font_generation;
+
+	htmlc->len_ctx.vw = vw;
+	htmlc->len_ctx.vh = vh;
 	htmlc->len_ctx.root_style = htmlc->layout->style;
 
 	layout_document(htmlc, width, height);
 	layout = htmlc->layout;
 
+	perf_end(PERF_PHASE_LAYOUT, perf_start);
+	perf_mark(PERF_MARK_FIRST_LAYOUT);
+
+	/* recorded redraws are of the previous layout */
+	html_redraw_tiles_invalidate(htmlc, NULL);
+
+	/* objects may have moved into view */
+	htmlc->prioritised_area.x1 = htmlc->prioritised_area.x0;
+
 	/* width and height are at least margin box of document */
 	c->width = layout->x + layout->padding[LEFT] + layout->width +
 		layout->padding[RIGHT] + layout->border[RIGHT].width +
@@ -1069,6 +1108,16 @@ static void html_reformat(struct content *c, int width, int height)
 		ms_interval = nsoption_uint(min_reflow_period) * 10;
 	}
 	c->reformat_time = ms_after + ms_interval;
+
+	if (NSLOG_COMPILED_MIN_LEVEL <= NSLOG_LEVEL_DEBUG) {
+		struct font_width_cache_stats stats;
+
+		font_width_cache_get_stats(&stats);
+		NSLOG(netsurf, DEBUG,
+		      "Text widths: %u cached, %u hits, %u misses, %u evictions",
+		      stats.entries, stats.hits, stats.misses,
+		      stats.evictions);
+	}
 }
 
 
@@ -1081,10 +1130,20 @@ static void html_reformat(struct content *c, int width, int height)
 
 void html_redraw_a_box(hlcache_handle *h, struct box *box)
 {
+	html_content *html = (html_content *) hlcache_handle_get_content(h);
+	struct rect area;
 	int x, y;
 
 	box_coords(box, &x, &y);
 
+	/* Recordings of the box's border, outline and overflowing
+	 * descendants are stale too */
+	area.x0 = x + box->descendant_x0;
+	area.y0 = y + box->descendant_y0;
+	area.x1 = x + box->descendant_x1 + 1;
+	area.y1 = y + box->descendant_y1 + 1;
+	html_redraw_tiles_invalidate(html, &area);
+
 	content_request_redraw(h, x, y,
 			box->padding[LEFT] + box->width + box->padding[RIGHT],
 			box->padding[TOP] + box->height + box->padding[BOTTOM]);
@@ -1100,10 +1159,19 @@ void html_redraw_a_box(hlcache_handle *h, struct box *box)
 
 void html__redraw_a_box(struct html_content *html, struct box *box)
 {
+	struct rect area;
 	int x, y;
 
 	box_coords(box, &x, &y);
 
+	/* Recordings of the box's border, outline and overflowing
+	 * descendants are stale too */
+	area.x0 = x + box->descendant_x0;
+	area.y0 = y + box->descendant_y0;
+	area.x1 = x + box->descendant_x1 + 1;
+	area.y1 = y + box->descendant_y1 + 1;
+	html_redraw_tiles_invalidate(html, &area);
+
 	content__request_redraw((struct content *)html, x, y,
 			box->padding[LEFT] + box->width + box->padding[RIGHT],
 			box->padding[TOP] + box->height + box->padding[BOTTOM]);
@@ -1266,6 +1334,9 @@ static void html_destroy(struct content *c)
 	/* Free scripts */
 	html_script_free(html);
 
+	/* Free recorded redraws, which refer to objects */
+	html_redraw_tiles_destroy(html);
+
 	/* Free objects */
 	html_object_free_objects(html);
 
@@ -1331,6 +1402,7 @@ static nserror html_close(struct content *c)
 	htmlc->bw = NULL;
 
 	/* remove all object references from the html content */
+	html_redraw_tiles_invalidate(htmlc, NULL);
 	html_object_close_objects(htmlc);
 
 	if (htmlc->jsthread != NULL) {
@@ -2179,6 +2251,7 @@ static content_type html_content_type(void)
 
 static void html_fini(void)
 {
+	font_width_cache_fini();
 	html_css_fini();
 }
 
@@ -122,6 +122,11 @@ static const css_border_color_func border_color_funcs[4] = {
 	[LEFT]   = css_computed_border_left_color,
 };
 
+/**
+ * Minimum number of children a box must have for them to be indexed
+ */
+#define LAYOUT_CHILD_INDEX_MIN 32
+
 /* forward declaration to break cycles */
 static bool layout_block_context(
 		struct box *block,
@@ -650,7 +655,7 @@ layout_minmax_line(struct box *first,
 
 			if (b->next) {
 				if (b->space == UNKNOWN_WIDTH) {
-					font_func->width(&fstyle, " ", 1,
+					font_width(font_func, &fstyle, " ", 1,
 							 &b->space);
 				}
 				max += b->space;
@@ -687,7 +692,7 @@ layout_minmax_line(struct box *first,
 							data.select.items; o;
 							o = o->next) {
 						int opt_width;
-						font_func->width(&fstyle,
+						font_width(font_func, &fstyle,
 								o->text,
 								strlen(o->text),
 								&opt_width);
@@ -701,7 +706,7 @@ layout_minmax_line(struct box *first,
 						b->width += SCROLLBAR_WIDTH;
 
 				} else {
-					font_func->width(&fstyle, b->text,
+					font_width(font_func, &fstyle, b->text,
 						b->length, &b->width);
 					b->flags |= MEASURED;
 				}
@@ -709,7 +714,7 @@ layout_minmax_line(struct box *first,
 			max += b->width;
 			if (b->next) {
 				if (b->space == UNKNOWN_WIDTH) {
-					font_func->width(&fstyle, " ", 1,
+					font_width(font_func, &fstyle, " ", 1,
 							 &b->space);
 				}
 				max += b->space;
@@ -736,8 +741,9 @@ layout_minmax_line(struct box *first,
 					for (j = i; j != b->length &&
 							b->text[j] != ' '; j++)
 						;
-					font_func->width(&fstyle, b->text + i,
-							 j - i, &width);
+					font_width(font_func, &fstyle,
+							b->text + i, j - i,
+							&width);
 					if (min < width)
 						min = width;
 					i = j + 1;
@@ -2775,7 +2781,7 @@ layout_text_box_split(html_content *content,
 		/* We're need to add a space, and we don't know how big
 		 * it's to be, OR we have a space of unknown width anyway;
 		 * Calculate space width */
-		font_func->width(fstyle, " ", 1, &space_width);
+		font_width(font_func, fstyle, " ", 1, &space_width);
 	}
 
 	if (split_box->space == UNKNOWN_WIDTH)
@@ -3248,7 +3254,7 @@ layout_line(struct box *first,
 		} else if (b->type == BOX_INLINE_END) {
 			b->width = 0;
 			if (b->space == UNKNOWN_WIDTH) {
-				font_func->width(&fstyle, " ", 1, &b->space);
+				font_width(font_func, &fstyle, " ", 1, &b->space);
 				/** \todo handle errors */
 			}
 			space_after = b->space;
@@ -3288,7 +3294,7 @@ layout_line(struct box *first,
 							data.select.items; o;
 							o = o->next) {
 						int opt_width;
-						font_func->width(&fstyle,
+						font_width(font_func, &fstyle,
 								o->text,
 								strlen(o->text),
 								&opt_width);
@@ -3300,7 +3306,7 @@ layout_line(struct box *first,
 					if (nsoption_bool(core_select_menu))
 						b->width += SCROLLBAR_WIDTH;
 				} else {
-					font_func->width(&fstyle, b->text,
+					font_width(font_func, &fstyle, b->text,
 							b->length, &b->width);
 					b->flags |= MEASURED;
 				}
@@ -3313,14 +3319,14 @@ layout_line(struct box *first,
 			if (b->text && (x + b->width < x1 - x0) &&
 					!(b->flags & MEASURED) &&
 					b->next) {
-				font_func->width(&fstyle, b->text,
+				font_width(font_func, &fstyle, b->text,
 						 b->length, &b->width);
 				b->flags |= MEASURED;
 			}
 
 			x += b->width;
 			if (b->space == UNKNOWN_WIDTH) {
-				font_func->width(&fstyle, " ", 1, &b->space);
+				font_width(font_func, &fstyle, " ", 1, &b->space);
 				/** \todo handle errors */
 			}
 			space_after = b->space;
@@ -3456,7 +3462,7 @@ layout_line(struct box *first,
 							&content->len_ctx,
 							b->style, &fstyle);
 					/** \todo handle errors */
-					font_func->width(&fstyle, " ", 1,
+					font_width(font_func, &fstyle, " ", 1,
 							 &b->space);
 				}
 				space_after = b->space;
@@ -3913,6 +3919,78 @@ static bool layout_inline_container(struct box *inline_container, int width,
 }
 
 
+/**
+ * Check whether a block formatting context can keep its previous layout.
+ *
+ * Only blocks and inline blocks in flow are considered.  Contexts
+ * containing positioned descendants or iframes are always laid out
+ * again, as their placement depends on boxes outside the context.
+ *
+ * \param  block  BLOCK, INLINE_BLOCK, or TABLE_CELL to check
+ * \return  true if block can be kept when unchanged
+ */
+static bool layout_block_context_keepable(const struct box *block)
+{
+	if (block->type != BOX_BLOCK && block->type != BOX_INLINE_BLOCK)
+		return false;
+
+	if (block->object || block->gadget ||
+			(block->flags & (IFRAME | REPLACE_DIM |
+					ABS_DESCENDANTS)))
+		return false;
+
+	if (block->style && (css_computed_position(block->style) ==
+				CSS_POSITION_ABSOLUTE ||
+			css_computed_position(block->style) ==
+				CSS_POSITION_FIXED))
+		return false;
+
+	return true;
+}
+
+
+/**
+ * Keep the previous layout of an unchanged block formatting context.
+ *
+ * The context is unchanged if nothing in it has been invalidated and
+ * it is being laid out with the same dimensions as last time.  As
+ * coordinates within the context are relative to its block, the
+ * context's descendants need not be visited at all.
+ *
+ * \param  block	    BLOCK, INLINE_BLOCK, or TABLE_CELL to layout
+ * \param  viewport_height  Height of viewport in pixels or -ve if unknown
+ * \param  content	    The HTML content being laid out
+ * \return  true if the previous layout was kept
+ */
+static bool
+layout_block_context_keep(struct box *block,
+			  int viewport_height,
+			  const html_content *content)
+{
+	const struct box_layout_state *state = block->layout_state;
+
+	block->flags &= ~LAYOUT_KEPT;
+
+	if (state == NULL || !content->layout_reusable ||
+			(block->flags & NEEDS_LAYOUT) ||
+			!layout_block_context_keepable(block))
+		return false;
+
+	if (state->width != block->width ||
+			state->height != block->height ||
+			state->viewport_height != viewport_height ||
+			memcmp(state->padding, block->padding,
+					sizeof(state->padding)) != 0)
+		return false;
+
+	block->height = state->result_height;
+	block->padding[BOTTOM] = state->result_padding;
+	block->flags |= LAYOUT_KEPT;
+
+	return true;
+}
+
+
 /**
  * Layout a block formatting context.
  *
@@ -3939,6 +4017,7 @@ layout_block_context(struct box *block,
 	bool in_margin = false;
 	css_fixed gadget_size;
 	css_unit gadget_unit; /* Checkbox / radio buttons */
+	struct box_layout_state entry;
 
 	assert(block->type == BOX_BLOCK ||
 			block->type == BOX_INLINE_BLOCK ||
@@ -3946,6 +4025,15 @@ layout_block_context(struct box *block,
 	assert(block->width != UNKNOWN_WIDTH);
 	assert(block->width != AUTO);
 
+	if (layout_block_context_keep(block, viewport_height, content))
+		return true;
+
+	/* Note what the block context is laid out with */
+	entry.width = block->width;
+	entry.height = block->height;
+	memcpy(entry.padding, block->padding, sizeof(entry.padding));
+	entry.viewport_height = viewport_height;
+
 	block->float_children = NULL;
 	block->cached_place_below_level = 0;
 	block->clear_level = 0;
@@ -4407,6 +4495,20 @@ layout_block_context(struct box *block,
 				block->padding[BOTTOM], block->padding[LEFT]);
 	}
 
+	/* Remember the layout so it can be kept while unchanged */
+	block->flags &= ~NEEDS_LAYOUT;
+	if (layout_block_context_keepable(block)) {
+		if (block->layout_state == NULL) {
+			block->layout_state = talloc(content->bctx,
+					struct box_layout_state);
+		}
+		if (block->layout_state != NULL) {
+			entry.result_height = block->height;
+			entry.result_padding = block->padding[BOTTOM];
+			*block->layout_state = entry;
+		}
+	}
+
 	return true;
 }
 
@@ -4439,7 +4541,7 @@ layout_lists(struct box *box,
 				if (marker->width == UNKNOWN_WIDTH) {
 					font_plot_style_from_css(len_ctx,
 							marker->style, &fstyle);
-					font_func->width(&fstyle,
+					font_width(font_func, &fstyle,
 							marker->text,
 							marker->length,
 							&marker->width);
@@ -4458,6 +4560,9 @@ layout_lists(struct box *box,
 			/* Gap between marker and content */
 			marker->x -= 4;
 		}
+		if (child->flags & LAYOUT_KEPT)
+			/* Markers inside are already laid out */
+			continue;
 		layout_lists(child, font_func, len_ctx);
 	}
 }
@@ -4961,6 +5066,9 @@ layout_position_absolute(struct box *box,
 				return false;
 			if (!layout_position_absolute(c, c, 0, 0, content))
 				return false;
+		} else if (c->flags & LAYOUT_KEPT) {
+			/* Kept block contexts have no positioned boxes */
+			continue;
 		} else if (c->style && css_computed_position(c->style) ==
 				CSS_POSITION_RELATIVE) {
 			if (!layout_position_absolute(c, c, 0, 0, content))
@@ -5153,8 +5261,10 @@ layout_position_relative(
 			fny = fy + y;
 		}
 
-		/* recurse first */
-		layout_position_relative(len_ctx, box, fn, fnx, fny);
+		/* recurse first, unless the previous layout of box was
+		 * kept, in which case its descendants are already offset */
+		if (!(box->flags & LAYOUT_KEPT))
+			layout_position_relative(len_ctx, box, fn, fnx, fny);
 
 		/* Ignore things we're not interested in. */
 		if (!box->style || (box->style &&
@@ -5292,6 +5402,92 @@ layout_update_descendant_bbox(
 }
 
 
+/**
+ * Index the children of a box by their vertical extent.
+ *
+ * Only boxes with many children, whose tops are in document order,
+ * are indexed.  This is the usual case for long documents, and lets
+ * redraw and hit testing skip directly to the children of interest.
+ *
+ * \param  box  box with children whose descendant boxes are calculated
+ */
+static void layout_index_children(struct box *box)
+{
+	struct box_child_index *index;
+	struct box *child;
+	unsigned int count = 0;
+	int top = INT_MIN;
+	int bottom = INT_MIN;
+
+	for (child = box->children; child; child = child->next) {
+		if (child->type == BOX_FLOAT_LEFT ||
+				child->type == BOX_FLOAT_RIGHT)
+			continue;
+
+		/* Absolutely positioned boxes may be clipped to outside
+		 * of their descendant box, and are rarely in order */
+		if (child->style && (css_computed_position(child->style) ==
+					CSS_POSITION_ABSOLUTE ||
+				css_computed_position(child->style) ==
+					CSS_POSITION_FIXED))
+			return;
+
+		if (child->y + child->descendant_y0 < top)
+			return;
+		top = child->y + child->descendant_y0;
+		count++;
+	}
+
+	if (count < LAYOUT_CHILD_INDEX_MIN)
+		return;
+
+	index = talloc_size(box, sizeof(*index) +
+			count * sizeof(index->entry[0]));
+	if (index == NULL)
+		/* Children will just be visited in turn */
+		return;
+
+	index->count = 0;
+	for (child = box->children; child; child = child->next) {
+		struct box_child_index_entry *entry;
+
+		if (child->type == BOX_FLOAT_LEFT ||
+				child->type == BOX_FLOAT_RIGHT)
+			continue;
+
+		if (bottom < child->y + child->descendant_y1)
+			bottom = child->y + child->descendant_y1;
+
+		entry = &index->entry[index->count++];
+		entry->box = child;
+		entry->y0 = child->y + child->descendant_y0;
+		entry->y1 = bottom;
+	}
+
+	box->child_index = index;
+}
+
+
+/**
+ * Note whether a box has descendants which are placed relative to boxes
+ * outside of it.
+ *
+ * \param  box    box to update
+ * \param  child  child of box, with its own descendants already noted
+ */
+static inline void layout_note_abs_descendants(struct box *box,
+		const struct box *child)
+{
+	if ((child->flags & (ABS_DESCENDANTS | IFRAME)) ||
+			child->iframe != NULL ||
+			(child->style && (css_computed_position(child->style) ==
+					CSS_POSITION_ABSOLUTE ||
+				css_computed_position(child->style) ==
+					CSS_POSITION_FIXED)))
+		box->flags |= ABS_DESCENDANTS;
+}
+
+
 /**
  * Recursively calculate the descendant_[xy][01] values for a laid-out box tree
  * and inform iframe browser windows of their size and position.
@@ -5309,6 +5505,16 @@ static void layout_calculate_descendant_bboxes(
 	assert(box->height != AUTO);
 	/* assert((box->width >= 0) && (box->height >= 0)); */
 
+	if (box->flags & LAYOUT_KEPT)
+		/* Bounding box relative to the box is unchanged */
+		return;
+
+	box->flags &= ~(ABS_DESCENDANTS | NEEDS_LAYOUT);
+	if (box->child_index != NULL) {
+		talloc_free(box->child_index);
+		box->child_index = NULL;
+	}
+
 	/* Initialise box's descendant box to border edge box */
 	layout_get_box_bbox(len_ctx, box,
 			&box->descendant_x0, &box->descendant_y0,
@@ -5363,6 +5569,7 @@ static void layout_calculate_descendant_bboxes(
 			continue;
 
 		layout_calculate_descendant_bboxes(len_ctx, child);
+		layout_note_abs_descendants(box, child);
 
 		if (box->style && css_computed_overflow_x(box->style) ==
 				CSS_OVERFLOW_HIDDEN &&
@@ -5378,6 +5585,7 @@ static void layout_calculate_descendant_bboxes(
 				child->type == BOX_FLOAT_RIGHT);
 
 		layout_calculate_descendant_bboxes(len_ctx, child);
+		layout_note_abs_descendants(box, child);
 
 		layout_update_descendant_bbox(len_ctx, box, child, 0, 0);
 	}
@@ -5388,6 +5596,8 @@ static void layout_calculate_descendant_bboxes(
 
 		layout_update_descendant_bbox(len_ctx, box, child, 0, 0);
 	}
+
+	layout_index_children(box);
 }
 
 
@@ -5436,9 +5646,11 @@ bool layout_document(html_content *content, int width, int height)
 					 doc->children->margin[BOTTOM]);
 	}
 
-	layout_lists(doc, font_func, &content->len_ctx);
-	layout_position_absolute(doc, doc, 0, 0, content);
-	layout_position_relative(&content->len_ctx, doc, doc, 0, 0);
+	if (!(doc->flags & LAYOUT_KEPT)) {
+		layout_lists(doc, font_func, &content->len_ctx);
+		layout_position_absolute(doc, doc, 0, 0, content);
+		layout_position_relative(&content->len_ctx, doc, doc, 0, 0);
+	}
 
 	layout_calculate_descendant_bboxes(&content->len_ctx, doc);
 
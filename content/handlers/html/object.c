@@ -45,6 +45,7 @@
 #include "html/interaction.h"
 #include "html/box.h"
 #include "html/box_inspect.h"
+#include "html/box_manipulate.h"
 #include "html/object.h"
 
 /* break reference loop */
@@ -84,6 +85,25 @@ html_object_failed(struct box *box, html_content *content, bool background)
 	return;
 }
 
+/**
+ * Discard recorded redraws of an area which an object will redraw.
+ *
+ * \param c     document containing the object
+ * \param data  redraw message data for the area, in document coordinates
+ */
+static void
+html_object_invalidate_redraw(html_content *c, const union content_msg_data *data)
+{
+	struct rect area;
+
+	area.x0 = data->redraw.x;
+	area.y0 = data->redraw.y;
+	area.x1 = data->redraw.x + data->redraw.width;
+	area.y1 = data->redraw.y + data->redraw.height;
+
+	html_redraw_tiles_invalidate(c, &area);
+}
+
 /**
  * Update a box whose content has completed rendering.
  */
@@ -93,8 +113,6 @@ html_object_done(struct box *box,
 		 hlcache_handle *object,
 		 bool background)
 {
-	struct box *b;
-
 	if (background) {
 		box->background = object;
 		return;
@@ -112,11 +130,11 @@ html_object_done(struct box *box,
 		break;
 	}
 
-	if (!(box->flags & REPLACE_DIM)) {
-		/* invalidate parent min, max widths */
-		for (b = box; b; b = b->parent)
-			b->max_width = UNKNOWN_MAX_WIDTH;
+	/* invalidate parent layout, and min, max widths unless the
+	 * replaced element's dimensions were given */
+	box_invalidate_layout(box, !(box->flags & REPLACE_DIM));
 
+	if (!(box->flags & REPLACE_DIM)) {
 		/* delete any clones of this box */
 		while (box->next && (box->next->flags & CLONE)) {
 			/* box_free_box(box->next); */
@@ -190,6 +208,9 @@ html_object_callback(hlcache_handle *object,
 				content__reformat(&c->base, false,
 						c->base.available_width,
 						c->base.available_height);
+		} else {
+			/* object is displayed while its data arrives */
+			html_object_done(box, object, o->background);
 		}
 		break;
 
@@ -217,6 +238,7 @@ html_object_callback(hlcache_handle *object,
 			data.redraw.width = box->width;
 			data.redraw.height = box->height;
 
+			html_object_invalidate_redraw(c, &data);
 			content_broadcast(&c->base, CONTENT_MSG_REDRAW, &data);
 		}
 		break;
@@ -345,6 +367,7 @@ html_object_callback(hlcache_handle *object,
 				data.redraw.y += y + box->padding[TOP];
 			}
 
+			html_object_invalidate_redraw(c, &data);
 			content_broadcast(&c->base, CONTENT_MSG_REDRAW, &data);
 		}
 		break;
@@ -481,14 +504,16 @@ html_object_callback(hlcache_handle *object,
 				c->base.available_height);
 		content_set_done(&c->base);
 	} else if (nsoption_bool(incremental_reflow) &&
-		   event->type == CONTENT_MSG_DONE &&
+		   (event->type == CONTENT_MSG_DONE ||
+		    event->type == CONTENT_MSG_READY) &&
 		   box != NULL &&
 		   !(box->flags & REPLACE_DIM) &&
 		   (c->base.status == CONTENT_STATUS_READY ||
 		    c->base.status == CONTENT_STATUS_DONE)) {
 		/* 1) the configuration option to reflow pages while
 		 *      objects are fetched is set
-		 * 2) an object is newly fetched & converted,
+		 * 2) an object is newly fetched & converted, or its size
+		 *      is known while it is fetched,
 		 * 3) the box's dimensions need to change due to being replaced
 		 * 4) the object's parent HTML is ready for reformat,
 		 */
@@ -541,6 +566,9 @@ static bool html_replace_object(struct content_html_object *object, nsurl *url)
 			      c->base.active);
 		}
 
+		/* recorded redraws may refer to the existing object */
+		html_redraw_tiles_invalidate(c, NULL);
+
 		hlcache_handle_release(object->content);
 		object->content = NULL;
 
@@ -657,6 +685,80 @@ nserror html_object_abort_objects(html_content *htmlc)
 }
 
 
+/* exported interface documented in html/object.h */
+nserror
+html_object_prioritise_visible(html_content *html,
+			       int x, int y, float scale,
+			       const struct rect *clip)
+{
+	struct content_html_object *object;
+	struct rect *checked = &html->prioritised_area;
+	struct box *box;
+	struct rect area;
+	struct rect r;
+	int bx, by;
+
+	if (html->unprioritised_objects == 0)
+		return NSERROR_OK;
+
+	/* redraw area in document coordinates */
+	area.x0 = (clip->x0 - x) / scale;
+	area.y0 = (clip->y0 - y) / scale;
+	area.x1 = (clip->x1 - x) / scale + 1;
+	area.y1 = (clip->y1 - y) / scale + 1;
+
+	/* nothing can have come into view since the last check unless
+	 * the document was scrolled, scaled or laid out again
+	 */
+	if (checked->x0 < checked->x1 &&
+	    area.x0 >= checked->x0 && area.x1 <= checked->x1 &&
+	    area.y0 >= checked->y0 && area.y1 <= checked->y1)
+		return NSERROR_OK;
+
+	*checked = area;
+
+	for (object = html->object_list;
+	     object != NULL;
+	     object = object->next) {
+		if (object->prioritised || object->box == NULL)
+			continue;
+
+		/* a finished fetch has no priority left to raise */
+		if (object->content == NULL ||
+		    content_get_status(object->content) ==
+				CONTENT_STATUS_DONE ||
+		    content_get_status(object->content) ==
+				CONTENT_STATUS_ERROR) {
+			object->prioritised = true;
+			html->unprioritised_objects--;
+			continue;
+		}
+
+		box = object->box;
+		box_coords(box, &bx, &by);
+
+		r.x0 = x + bx * scale;
+		r.y0 = y + by * scale;
+		r.x1 = r.x0 + (box->padding[LEFT] + box->width +
+			       box->padding[RIGHT]) * scale + 1;
+		r.y1 = r.y0 + (box->padding[TOP] + box->height +
+			       box->padding[BOTTOM]) * scale + 1;
+
+		if (r.x1 <= clip->x0 || r.x0 >= clip->x1 ||
+		    r.y1 <= clip->y0 || r.y0 >= clip->y1)
+			continue;
+
+		object->prioritised = true;
+		html->unprioritised_objects--;
+
+		hlcache_handle_set_priority(object->content,
+				LLCACHE_RETRIEVE_PRIORITY_HIGH);
+	}
+
+	return NSERROR_OK;
+}
+
+
 /* exported interface documented in html/object.h */
 nserror html_object_close_objects(html_content *html)
 {
@@ -699,6 +801,7 @@ nserror html_object_free_objects(html_content *html)
 		html->object_list = victim->next;
 		free(victim);
 	}
+	html->unprioritised_objects = 0;
 	return NSERROR_OK;
 }
 
@@ -714,6 +817,7 @@ html_fetch_object(html_content *c,
 	struct content_html_object *object;
 	hlcache_handle_callback object_callback;
 	hlcache_child_context child;
+	uint32_t fetch_flags = HLCACHE_RETRIEVE_SNIFF_TYPE;
 	nserror error;
 
 	/* If we've already been aborted, don't bother attempting the fetch */
@@ -732,6 +836,8 @@ html_fetch_object(html_content *c,
 		object_callback = html_object_nobox_callback;
 	} else {
 		object_callback = html_object_callback;
+		/* raised by html_object_prioritise_visible() once seen */
+		fetch_flags |= LLCACHE_RETRIEVE_PRIORITY_LOW;
 	}
 
 	object->parent = (struct content *) c;
@@ -742,7 +848,7 @@ html_fetch_object(html_content *c,
 	object->background = background;
 
 	error = hlcache_handle_retrieve(url,
-					HLCACHE_RETRIEVE_SNIFF_TYPE,
+					fetch_flags,
 					content_get_url(&c->base),
 					NULL,
 					object_callback,
@@ -761,6 +867,8 @@ html_fetch_object(html_content *c,
 
 	c->num_objects++;
 	if (box != NULL) {
+		c->unprioritised_objects++;
+		c->prioritised_area.x1 = c->prioritised_area.x0;
 		c->base.active++;
 		NSLOG(netsurf, INFO, "%d fetches active", c->base.active);
 	}
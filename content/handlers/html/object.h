@@ -28,6 +28,7 @@ struct html_content;
 struct browser_window;
 struct box;
 struct nsurl;
+struct rect;
 
 /**
  * Start a fetch for an object required by a page.
@@ -83,4 +84,21 @@ nserror html_object_open_objects(struct html_content *html, struct browser_windo
  */
 nserror html_object_abort_objects(struct html_content *html);
 
+
+/**
+ * raise the fetch priority of content objects which are in view.
+ *
+ * Objects are fetched at low priority until they are first seen. The
+ * objects are only checked again once the redraw area leaves the area
+ * last checked or the document is laid out again.
+ *
+ * \param html The html content being redrawn.
+ * \param x coordinate of the content's top left in target coordinates.
+ * \param y coordinate of the content's top left in target coordinates.
+ * \param scale Scale of the redraw.
+ * \param clip The area being redrawn in target coordinates.
+ * \return NSERROR_OK on success else appropriate error code.
+ */
+nserror html_object_prioritise_visible(struct html_content *html, int x, int y, float scale, const struct rect *clip);
+
 #endif
@@ -35,6 +35,7 @@ struct gui_layout_table;
 struct scrollbar_msg_data;
 struct content_redraw_data;
 struct selection;
+struct html_redraw_tiles;
 
 typedef enum {
 	HTML_DRAG_NONE,			/** No drag */
@@ -127,6 +128,12 @@ typedef struct html_content {
 	/** Whether an initial layout has been done */
 	bool had_initial_layout;
 
+	/** Whether unchanged block contexts may keep their previous layout */
+	bool layout_reusable;
+
+	/** Font configuration generation of the previous layout */
+	unsigned int layout_font_generation;
+
 	/** Whether scripts are enabled for this content */
 	bool enable_scripting;
 
@@ -169,6 +176,10 @@ typedef struct html_content {
 	unsigned int num_objects;
 	/** List of objects. */
 	struct content_html_object *object_list;
+	/** Number of objects whose fetch priority may yet be raised. */
+	unsigned int unprioritised_objects;
+	/** Document area last checked for objects to prioritise. */
+	struct rect prioritised_area;
 	/** Forms, in reverse order to document. */
 	struct form *forms;
 	/** Hash table of imagemaps. */
@@ -183,6 +194,9 @@ typedef struct html_content {
 	/** Inline frame information */
 	struct content_html_iframe *iframe;
 
+	/** Recorded plot operations of redrawn areas, or NULL */
+	struct html_redraw_tiles *redraw_tiles;
+
 	/** Content of type CONTENT_HTML containing this, or NULL if not an
 	 * object within a page. */
 	struct html_content *page;
@@ -299,6 +313,24 @@ nserror html_proceed_to_done(html_content *html);
 bool html_redraw(struct content *c, struct content_redraw_data *data,
 		const struct rect *clip, const struct redraw_context *ctx);
 
+/**
+ * Discard recorded plot operations for an area of an HTML content.
+ *
+ * Must be called whenever the appearance of the content changes without
+ * it being reformatted.
+ *
+ * \param html  content of type CONTENT_HTML
+ * \param area  changed area in content coordinates, or NULL for all
+ */
+void html_redraw_tiles_invalidate(html_content *html, const struct rect *area);
+
+/**
+ * Free all recorded plot operations of an HTML content.
+ *
+ * \param html  content of type CONTENT_HTML
+ */
+void html_redraw_tiles_destroy(html_content *html);
+
 
 /* in html/redraw_border.c */
 bool html_redraw_borders(struct box *box, int x_parent, int y_parent,
@@ -51,6 +51,7 @@
 #include "content/textsearch.h"
 #include "css/utils.h"
 #include "desktop/selection.h"
+#include "desktop/display_list.h"
 #include "desktop/print.h"
 #include "desktop/scrollbar.h"
 #include "desktop/textarea.h"
@@ -63,10 +64,55 @@
 #include "html/form_internal.h"
 #include "html/private.h"
 #include "html/layout.h"
+#include "html/object.h"
 
 
 bool html_redraw_debug = false;
 
+/** Size of recorded redraw tiles, in content pixels */
+#define HTML_REDRAW_TILE_SIZE 256
+
+/** Maximum number of recorded redraw tiles kept for a document */
+#define HTML_REDRAW_TILE_COUNT 64
+
+/**
+ * Recorded squares of a document
+ */
+struct html_redraw_tiles {
+	/** Background colour the tiles were recorded over */
+	colour background_colour;
+	/** Whether background images were recorded */
+	bool background_images;
+	/** The tiles */
+	struct display_list_tiles *tiles;
+};
+
+
+/**
+ * Redraw a content, or record its redraw when recording a display list
+ *
+ * Recording the content, rather than the plot operations it makes,
+ * ensures any bitmap it plots is current when the recording is replayed.
+ *
+ * \param h     content to redraw
+ * \param data  redraw data for the content
+ * \param clip  clip rectangle
+ * \param ctx   current redraw context
+ * \return true if successful, false otherwise
+ */
+static bool
+html_redraw_content(struct hlcache_handle *h,
+		    struct content_redraw_data *data,
+		    const struct rect *clip,
+		    const struct redraw_context *ctx)
+{
+	if (display_list_recording(ctx)) {
+		return (display_list_content(ctx, h, data, clip) == NSERROR_OK);
+	}
+
+	return content_redraw(h, data, clip, ctx);
+}
+
 /**
  * Determine if a box has a background that needs drawing
  *
@@ -789,7 +835,7 @@ static bool html_redraw_background(int x, int y, struct box *box, float scale,
 				bg_data.repeat_y = repeat_y;
 
 				/* We just continue if redraw fails */
-				content_redraw(background->background,
+				html_redraw_content(background->background,
 						&bg_data, &r, ctx);
 			}
 		}
@@ -947,7 +993,7 @@ static bool html_redraw_inline_background(int x, int y, struct box *box,
 			bg_data.repeat_y = repeat_y;
 
 			/* We just continue if redraw fails */
-			content_redraw(box->background, &bg_data, &r, ctx);
+			html_redraw_content(box->background, &bg_data, &r, ctx);
 		}
 	}
 
@@ -1182,18 +1228,40 @@ static bool html_redraw_box_children(const html_content *html, struct box *box,
 		const struct redraw_context *ctx)
 {
 	struct box *c;
-
-	for (c = box->children; c; c = c->next) {
-
-		if (c->type != BOX_FLOAT_LEFT && c->type != BOX_FLOAT_RIGHT)
-			if (!html_redraw_box(html, c,
+	unsigned int i, end;
+	int origin_y = y_parent + box->y - scrollbar_get_offset(box->scroll_y);
+
+	/* Only visit children which may extend into the clip rectangle.
+	 * The range is widened to allow for rounding when scaling. */
+	if (box_children_in_range(box,
+			(int) ((clip->y0 - 2) / scale) - 1 - origin_y,
+			(int) ((clip->y1 + 2) / scale) + 1 - origin_y,
+			&i, &end)) {
+		for (; i < end; i++) {
+			if (!html_redraw_box(html,
+					box->child_index->entry[i].box,
 					x_parent + box->x -
 					scrollbar_get_offset(box->scroll_x),
-					y_parent + box->y -
-					scrollbar_get_offset(box->scroll_y),
+					origin_y,
 					clip, scale, current_background_color,
 					ctx))
 				return false;
+		}
+	} else {
+		for (c = box->children; c; c = c->next) {
+
+			if (c->type != BOX_FLOAT_LEFT &&
+					c->type != BOX_FLOAT_RIGHT)
+				if (!html_redraw_box(html, c,
+						x_parent + box->x -
+						scrollbar_get_offset(
+							box->scroll_x),
+						origin_y,
+						clip, scale,
+						current_background_color,
+						ctx))
+					return false;
+		}
 	}
 	for (c = box->float_children; c; c = c->next_float)
 		if (!html_redraw_box(html, c,
@@ -1775,7 +1843,7 @@ bool html_redraw_box(const html_content *html, struct box *box,
 			obj_data.y /= scale;
 		}
 
-		if (!content_redraw(box->object, &obj_data, &r, ctx)) {
+		if (!html_redraw_content(box->object, &obj_data, &r, ctx)) {
 			/* Show image fail */
 			/* Unicode (U+FFFC) 'OBJECT REPLACEMENT CHARACTER' */
 			const char *obj = "\xef\xbf\xbc";
@@ -1929,6 +1997,224 @@ bool html_redraw_box(const html_content *html, struct box *box,
 	return ((!plot->group_end) || (ctx->plot->group_end(ctx) == NSERROR_OK));
 }
 
+/**
+ * Draw the document of a CONTENT_HTML, without any open select menu.
+ *
+ * \param  html  content of type CONTENT_HTML
+ * \param  data  redraw data for this content redraw
+ * \param  clip  current clip region
+ * \param  ctx   current redraw context
+ * \return true if successful, false otherwise
+ */
+static bool
+html_redraw_document(html_content *html,
+		     struct content_redraw_data *data,
+		     const struct rect *clip,
+		     const struct redraw_context *ctx)
+{
+	bool result;
+	plot_style_t pstyle_fill_bg = {
+		.fill_type = PLOT_OP_TYPE_SOLID,
+		.fill_colour = data->background_colour,
+	};
+
+	/* clear to background colour */
+	result = (ctx->plot->clip(ctx, clip) == NSERROR_OK);
+
+	if (html->background_colour != NS_TRANSPARENT)
+		pstyle_fill_bg.fill_colour = html->background_colour;
+
+	result &= (ctx->plot->rectangle(ctx, &pstyle_fill_bg, clip) == NSERROR_OK);
+
+	result &= html_redraw_box(html, html->layout, data->x, data->y, clip,
+			data->scale, pstyle_fill_bg.fill_colour, ctx);
+
+	return result;
+}
+
+
+/**
+ * Divide rounding towards negative infinity
+ *
+ * \param  a  dividend
+ * \param  b  divisor, which must be positive
+ * \return a / b, rounded down
+ */
+static inline int html_redraw_floor_div(int a, int b)
+{
+	return (a >= 0) ? (a / b) : -((b - 1 - a) / b);
+}
+
+
+/**
+ * Draw a CONTENT_HTML by replaying recorded tiles of its document
+ *
+ * Tiles are recorded as they are first needed, at the origin of the
+ * content, and replayed offset to where the content is drawn.
+ *
+ * \param  html  content of type CONTENT_HTML
+ * \param  data  redraw data for this content redraw
+ * \param  clip  current clip region
+ * \param  ctx   current redraw context
+ * \return true if successful, false otherwise
+ */
+static bool
+html_redraw_tiled(html_content *html,
+		  struct content_redraw_data *data,
+		  const struct rect *clip,
+		  const struct redraw_context *ctx)
+{
+	struct html_redraw_tiles *tiles = html->redraw_tiles;
+	struct content_redraw_data tile_data = *data;
+	struct redraw_context rec_ctx;
+	struct display_list *dl;
+	struct rect tile_clip;
+	struct rect r;
+	int col0, col1, row0, row1;
+	int col, row;
+	bool result = true;
+
+	if (tiles->background_colour != data->background_colour ||
+	    tiles->background_images != ctx->background_images) {
+		display_list_tiles_invalidate(tiles->tiles, NULL);
+		tiles->background_colour = data->background_colour;
+		tiles->background_images = ctx->background_images;
+	}
+
+	/* Drop recordings which may no longer be replayed; this is only
+	 * safe between redraws */
+	display_list_tiles_start(tiles->tiles);
+
+	tile_data.x = 0;
+	tile_data.y = 0;
+
+	col0 = html_redraw_floor_div(clip->x0 - data->x, HTML_REDRAW_TILE_SIZE);
+	col1 = html_redraw_floor_div(clip->x1 - 1 - data->x,
+			HTML_REDRAW_TILE_SIZE);
+	row0 = html_redraw_floor_div(clip->y0 - data->y, HTML_REDRAW_TILE_SIZE);
+	row1 = html_redraw_floor_div(clip->y1 - 1 - data->y,
+			HTML_REDRAW_TILE_SIZE);
+
+	for (row = row0; row <= row1; row++) {
+		for (col = col0; col <= col1; col++) {
+			tile_clip.x0 = col * HTML_REDRAW_TILE_SIZE;
+			tile_clip.y0 = row * HTML_REDRAW_TILE_SIZE;
+			tile_clip.x1 = tile_clip.x0 + HTML_REDRAW_TILE_SIZE;
+			tile_clip.y1 = tile_clip.y0 + HTML_REDRAW_TILE_SIZE;
+
+			r.x0 = max(tile_clip.x0 + data->x, clip->x0);
+			r.y0 = max(tile_clip.y0 + data->y, clip->y0);
+			r.x1 = min(tile_clip.x1 + data->x, clip->x1);
+			r.y1 = min(tile_clip.y1 + data->y, clip->y1);
+
+			dl = display_list_tiles_find(tiles->tiles, col, row);
+			if (dl == NULL &&
+			    display_list_tiles_add(tiles->tiles, col, row,
+					&dl) == NSERROR_OK) {
+				display_list_record(dl, ctx, &rec_ctx);
+				if (!html_redraw_document(html, &tile_data,
+						&tile_clip, &rec_ctx)) {
+					display_list_tiles_discard(
+							tiles->tiles, col, row);
+					dl = NULL;
+				}
+			}
+
+			if (dl == NULL) {
+				/* Draw directly */
+				result &= html_redraw_document(html, data,
+						&r, ctx);
+				continue;
+			}
+
+			result &= (display_list_replay(dl,
+					data->x, data->y, &r, ctx) ==
+					NSERROR_OK);
+
+			/* Recordings which plot bitmaps directly may only
+			 * be replayed now, while those bitmaps exist */
+			if (!display_list_cacheable(dl))
+				display_list_tiles_discard(tiles->tiles,
+						col, row);
+		}
+	}
+
+	/* Leave the clip as a direct redraw would */
+	result &= (ctx->plot->clip(ctx, clip) == NSERROR_OK);
+
+	return result;
+}
+
+
+/* exported interface documented in html/private.h */
+void html_redraw_tiles_invalidate(html_content *html, const struct rect *area)
+{
+	if (html->redraw_tiles == NULL)
+		return;
+
+	display_list_tiles_invalidate(html->redraw_tiles->tiles, area);
+}
+
+
+/* exported interface documented in html/private.h */
+void html_redraw_tiles_destroy(html_content *html)
+{
+	if (html->redraw_tiles == NULL)
+		return;
+
+	display_list_tiles_destroy(html->redraw_tiles->tiles);
+
+	free(html->redraw_tiles);
+	html->redraw_tiles = NULL;
+}
+
+
+/**
+ * Find whether a redraw of a CONTENT_HTML may use recorded tiles
+ *
+ * Only unscaled interactive redraws of documents without inline frames
+ * are recorded.  Inline frames are drawn from their own browser window,
+ * whose changes are not seen by the document.
+ *
+ * \param  html  content of type CONTENT_HTML
+ * \param  data  redraw data for this content redraw
+ * \param  ctx   current redraw context
+ * \return true if the redraw may use recorded tiles
+ */
+static bool
+html_redraw_tiles_usable(html_content *html,
+			 const struct content_redraw_data *data,
+			 const struct redraw_context *ctx)
+{
+	if (!ctx->interactive ||
+	    data->scale != 1.0 ||
+	    html->iframe != NULL ||
+	    display_list_recording(ctx))
+		return false;
+
+	if (html->redraw_tiles == NULL) {
+		struct html_redraw_tiles *tiles;
+
+		tiles = calloc(1, sizeof(*tiles));
+		if (tiles == NULL)
+			return false;
+
+		if (display_list_tiles_create(HTML_REDRAW_TILE_SIZE,
+				HTML_REDRAW_TILE_COUNT,
+				&tiles->tiles) != NSERROR_OK) {
+			free(tiles);
+			return false;
+		}
+
+		tiles->background_colour = data->background_colour;
+		tiles->background_images = ctx->background_images;
+		html->redraw_tiles = tiles;
+	}
+
+	return true;
+}
+
+
 /**
  * Draw a CONTENT_HTML using the current set of plotters (plot).
  *
@@ -1948,13 +2234,8 @@ bool html_redraw(struct content *c, struct content_redraw_data *data,
 	struct box *box;
 	bool result = true;
 	bool select, select_only;
-	plot_style_t pstyle_fill_bg = {
-		.fill_type = PLOT_OP_TYPE_SOLID,
-		.fill_colour = data->background_colour,
-	};
 
-	box = html->layout;
-	assert(box);
+	assert(html->layout);
 
 	/* The select menu needs special treating because, when opened, it
 	 * reaches beyond its layout box.
@@ -1970,17 +2251,17 @@ bool html_redraw(struct content *c, struct content_redraw_data *data,
 				data->scale, clip);
 	}
 
-	if (!select_only) {
-		/* clear to background colour */
-		result = (ctx->plot->clip(ctx, clip) == NSERROR_OK);
-
-		if (html->background_colour != NS_TRANSPARENT)
-			pstyle_fill_bg.fill_colour = html->background_colour;
-
-		result &= (ctx->plot->rectangle(ctx, &pstyle_fill_bg, clip) == NSERROR_OK);
+	if (ctx->interactive) {
+		html_object_prioritise_visible(html, data->x, data->y,
+					       data->scale, clip);
+	}
 
-		result &= html_redraw_box(html, box, data->x, data->y, clip,
-				data->scale, pstyle_fill_bg.fill_colour, ctx);
+	if (!select_only) {
+		if (html_redraw_tiles_usable(html, data, ctx)) {
+			result = html_redraw_tiled(html, data, clip, ctx);
+		} else {
+			result = html_redraw_document(html, data, clip, ctx);
+		}
 	}
 
 	if (select) {
@@ -391,6 +391,7 @@ exec_src_script(html_content *c,
 	bool defer;
 	enum html_script_type script_type;
 	hlcache_handle_callback script_cb;
+	uint32_t fetch_flags;
 	dom_hubbub_error ret = DOM_HUBBUB_OK;
 	dom_exception exc; /* returned by libdom functions */
 
@@ -437,6 +438,7 @@ exec_src_script(html_content *c,
 		/* asyncronous script */
 		script_type = HTML_SCRIPT_ASYNC;
 		script_cb = convert_script_async_cb;
+		fetch_flags = 0;
 
 	} else {
 		exc = dom_element_has_attribute(node,
@@ -449,10 +451,13 @@ exec_src_script(html_content *c,
 			/* defered script */
 			script_type = HTML_SCRIPT_DEFER;
 			script_cb = convert_script_defer_cb;
+			fetch_flags = LLCACHE_RETRIEVE_PRIORITY_HIGH;
 		} else {
 			/* syncronous script */
 			script_type = HTML_SCRIPT_SYNC;
 			script_cb = convert_script_sync_cb;
+			/* the parse is paused until this arrives */
+			fetch_flags = LLCACHE_RETRIEVE_PRIORITY_BLOCKING;
 		}
 	}
 
@@ -468,7 +473,7 @@ exec_src_script(html_content *c,
 	child.quirks = c->base.quirks;
 
 	ns_error = hlcache_handle_retrieve(joined,
-					   0,
+					   fetch_flags,
 					   content_get_url(&c->base),
 					   NULL,
 					   script_cb,
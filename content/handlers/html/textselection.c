@@ -483,6 +483,7 @@ html_textselection_redraw(struct content *c,
 	}
 
 	if (rdw.inited) {
+		html_redraw_tiles_invalidate(html, &rdw.r);
 		content__request_redraw(c,
 					rdw.r.x0,
 					rdw.r.y0,
@@ -18,13 +18,17 @@
 
 #include <stdbool.h>
 #include <stdlib.h>
+#include <nsutils/time.h>
 
 #include "utils/utils.h"
 #include "utils/log.h"
 #include "utils/messages.h"
+#include "utils/nsoption.h"
 #include "netsurf/plotters.h"
 #include "netsurf/bitmap.h"
 #include "netsurf/content.h"
+#include "netsurf/misc.h"
+#include "content/content_protected.h"
 #include "desktop/gui_internal.h"
 
 #include "image/bmp.h"
@@ -168,3 +172,120 @@ bool image_bitmap_plot(struct bitmap *bitmap,
 				  data->background_colour,
 				  flags) == NSERROR_OK);
 }
+
+
+/* exported interface documented in image/image.h */
+void image_progress_init(struct image_progress *progress, struct content *c)
+{
+	progress->c = c;
+	progress->start_time = 0;
+	progress->redraw_time = 0;
+	progress->decode_time = 0;
+	progress->y0 = 0;
+	progress->y1 = 0;
+	progress->scheduled = false;
+}
+
+
+/* exported interface documented in image/image.h */
+bool image_progress_wanted(struct image_progress *progress)
+{
+	uint64_t ms_now;
+
+	nsu_getmonotonic_ms(&ms_now);
+	if (progress->start_time == 0) {
+		progress->start_time = ms_now;
+	}
+
+	return (ms_now - progress->start_time) >=
+		(nsoption_uint(min_reflow_period) * 10);
+}
+
+
+/**
+ * Scheduled redraw of decoded rows.
+ *
+ * \param p The redraw throttle.
+ */
+static void image_progress__scheduled(void *p)
+{
+	struct image_progress *progress = p;
+
+	progress->scheduled = false;
+	image_progress_flush(progress);
+}
+
+
+/* exported interface documented in image/image.h */
+void image_progress_flush(struct image_progress *progress)
+{
+	struct content *c = progress->c;
+	uint64_t ms_now;
+	uint64_t ms_interval;
+
+	if (progress->scheduled) {
+		guit->misc->schedule(-1, image_progress__scheduled, progress);
+		progress->scheduled = false;
+	}
+
+	if (progress->y1 <= progress->y0) {
+		return;
+	}
+
+	content__request_redraw(c, 0, progress->y0,
+				c->width, progress->y1 - progress->y0);
+
+	progress->y0 = progress->y1 = 0;
+
+	/* calculate next redraw time at three times what it took to decode */
+	nsu_getmonotonic_ms(&ms_now);
+
+	ms_interval = progress->decode_time * 3;
+	if (ms_interval < (nsoption_uint(min_reflow_period) * 10)) {
+		ms_interval = nsoption_uint(min_reflow_period) * 10;
+	}
+	progress->redraw_time = ms_now + ms_interval;
+	progress->decode_time = 0;
+}
+
+
+/* exported interface documented in image/image.h */
+void image_progress_update(struct image_progress *progress,
+			   int y0, int y1,
+			   uint64_t decode_time)
+{
+	uint64_t ms_now;
+
+	if (y1 <= y0) {
+		return;
+	}
+
+	if (progress->y1 > progress->y0) {
+		progress->y0 = min(progress->y0, y0);
+		progress->y1 = max(progress->y1, y1);
+	} else {
+		progress->y0 = y0;
+		progress->y1 = y1;
+	}
+	progress->decode_time += decode_time;
+
+	nsu_getmonotonic_ms(&ms_now);
+	if (ms_now >= progress->redraw_time) {
+		image_progress_flush(progress);
+	} else if (progress->scheduled == false) {
+		progress->scheduled = true;
+		guit->misc->schedule(progress->redraw_time - ms_now,
+				     image_progress__scheduled,
+				     progress);
+	}
+}
+
+
+/* exported interface documented in image/image.h */
+void image_progress_fini(struct image_progress *progress)
+{
+	if (progress->scheduled) {
+		guit->misc->schedule(-1, image_progress__scheduled, progress);
+		progress->scheduled = false;
+	}
+}
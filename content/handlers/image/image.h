@@ -23,10 +23,31 @@
 #ifndef NETSURF_IMAGE_IMAGE_H_
 #define NETSURF_IMAGE_IMAGE_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "utils/errors.h"
 
+struct content;
 struct content_redraw_data;
 
+/**
+ * Redraw throttle for an image displayed while it is decoded.
+ *
+ * Rows decoded are accumulated and redrawn no more often than the
+ * reflow period, or three times as long as the decoding took, as for
+ * HTML reflows while objects are fetched.
+ */
+struct image_progress {
+	struct content *c; /**< content being decoded */
+	uint64_t start_time; /**< time the first data arrived (ms) */
+	uint64_t redraw_time; /**< earliest time for the next redraw (ms) */
+	uint64_t decode_time; /**< time spent decoding since last redraw (ms) */
+	int y0; /**< first row decoded since the last redraw */
+	int y1; /**< row after the last decoded since the last redraw */
+	bool scheduled; /**< a redraw is scheduled */
+};
+
 /** Initialise the content handlers for image types.
  */
 nserror image_init(void);
@@ -42,4 +63,53 @@ bool image_bitmap_plot(struct bitmap *bitmap,
 		       const struct rect *clip,
 		       const struct redraw_context *ctx);
 
+/**
+ * Initialise a redraw throttle.
+ *
+ * \param progress The throttle to initialise.
+ * \param c The content being decoded.
+ */
+void image_progress_init(struct image_progress *progress, struct content *c);
+
+/**
+ * Decide whether to decode an image as its data arrives.
+ *
+ * Images whose data all arrives within the reflow period are only
+ * decoded once complete, so they may be decoded at the size they are
+ * plotted.  Slower ones are decoded and displayed as data arrives.
+ *
+ * \param progress The redraw throttle.
+ * \return true if the image should be decoded as data arrives.
+ */
+bool image_progress_wanted(struct image_progress *progress);
+
+/**
+ * Record rows of an image which have been decoded.
+ *
+ * A redraw of the rows is requested when the throttle allows,
+ * otherwise it is scheduled for when it does.
+ *
+ * \param progress The redraw throttle.
+ * \param y0 The first row decoded.
+ * \param y1 The row after the last decoded.
+ * \param decode_time The time taken to decode the rows (ms).
+ */
+void image_progress_update(struct image_progress *progress,
+			   int y0, int y1,
+			   uint64_t decode_time);
+
+/**
+ * Request a redraw of any rows decoded but not yet redrawn.
+ *
+ * \param progress The redraw throttle.
+ */
+void image_progress_flush(struct image_progress *progress);
+
+/**
+ * Finalise a redraw throttle, cancelling any scheduled redraw.
+ *
+ * \param progress The redraw throttle.
+ */
+void image_progress_fini(struct image_progress *progress);
+
 #endif
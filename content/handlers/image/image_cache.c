@@ -27,11 +27,20 @@
 #include <string.h>
 #include <stdlib.h>
 
+#include "utils/config.h"
+
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
 #include "netsurf/inttypes.h"
 #include "utils/utils.h"
 #include "utils/log.h"
+#include "utils/hashmap.h"
 #include "netsurf/misc.h"
 #include "netsurf/bitmap.h"
+#include "netsurf/content.h"
 #include "content/llcache.h"
 #include "content/content_protected.h"
 #include "desktop/gui_internal.h"
@@ -39,6 +48,12 @@
 #include "image/image_cache.h"
 #include "image/image.h"
 
+/** Maximum number of background decoder threads */
+#define IMAGE_CACHE_DECODERS 4
+
+/** Interval between checks for completed background decodes (ms) */
+#define IMAGE_CACHE_DECODE_REAP_TIME 10
+
 /**
  * Age of an entry within the cache
  *
@@ -47,12 +62,37 @@
  */
 typedef unsigned int cache_age;
 
+/**
+ * Background decode of a content.
+ *
+ * Decodes are made from a copy of the content source so the content
+ * may be destroyed while the decode is in progress.
+ */
+struct image_cache_decode {
+	struct image_cache_decode *next; /**< next in queue or done list */
+
+	struct content *content; /**< content being decoded */
+	image_cache_decode_fn *decode; /**< routine to decode source */
+	uint8_t *source; /**< copy of the content source data */
+	size_t source_size; /**< size of source data */
+	int width; /**< width wanted */
+	int height; /**< height wanted */
+	size_t size; /**< memory claimed by the decode */
+
+	bool cancelled; /**< entry was freed, result is not wanted */
+	nserror res; /**< result of the decode */
+	struct image_cache_pixels pixels; /**< decoded pixels */
+};
+
 /**
  * Image cache entry
+ *
+ * Entries are kept in a list ordered by the age of their last redraw,
+ * most recent first, so the list tail is the least recently used.
  */
 struct image_cache_entry_s {
-	struct image_cache_entry_s *next; /**< next cache entry in list */
-	struct image_cache_entry_s *prev; /**< previous cache entry in list */
+	struct image_cache_entry_s *next; /**< next older cache entry in list */
+	struct image_cache_entry_s *prev; /**< previous newer cache entry in list */
 
 	/** content is used as a key */
 	struct content *content;
@@ -60,6 +100,28 @@ struct image_cache_entry_s {
 	struct bitmap *bitmap;
 	/** routine to convert content into bitmap */
 	image_cache_convert_fn *convert;
+	/** routine to convert content into bitmap at a reduced size */
+	image_cache_convert_scaled_fn *convert_scaled;
+	/** bitmap is smaller than the content */
+	bool reduced;
+	/** Size the content was last plotted at */
+	int plot_width, plot_height;
+
+	/** routine to decode content source in the background */
+	image_cache_decode_fn *decode;
+	/** routine giving the size of a decode or NULL */
+	image_cache_decode_size_fn *decode_size;
+	/** background decode in progress or NULL */
+	struct image_cache_decode *decoding;
+	/** background decode is waiting for memory */
+	bool decode_deferred;
+	/** background decode failed so convert synchronously */
+	bool decode_failed;
+
+	/** bitmap is being decoded as the content data arrives */
+	bool partial;
+	/** routine to stop the decode into a partial bitmap */
+	image_cache_evict_fn *evict;
 
 	/* Statistics for replacement algorithm */
 
@@ -86,9 +148,20 @@ struct image_cache_s {
 	/** The "age" of the current operation */
 	cache_age current_age;
 
-	/* The objects the cache holds */
+	/* The objects the cache holds, most recently redrawn first */
 	struct image_cache_entry_s *entries;
 
+	/** The least recently redrawn object */
+	struct image_cache_entry_s *entries_tail;
+
+	/** Index of the entries by content */
+	hashmap_t *index;
+
+	/** Entry last found by index number */
+	struct image_cache_entry_s *findn_entry;
+	/** Index number of the entry last found by index number */
+	int findn_entryn;
+
 
 	/* Statistics for management algorithm */
 
@@ -134,6 +207,27 @@ struct image_cache_s {
 	int peak_conversions;
 	/** Size of bitmap with most conversions */
 	unsigned int peak_conversions_size;
+
+	/** Number of bitmaps freed by the cleaner */
+	int evict_count;
+	/** Total size of bitmaps freed by the cleaner */
+	uint64_t evict_size;
+
+	/* background decoding */
+	struct image_cache_decode *decode_queue; /**< decodes waiting for a decoder */
+	struct image_cache_decode **decode_tail; /**< end of decode queue */
+	struct image_cache_decode *decode_done; /**< decodes completed by decoders */
+	unsigned int decode_count; /**< number of outstanding decodes */
+	size_t decode_size; /**< memory claimed by outstanding decodes */
+	unsigned int decode_deferred; /**< entries waiting for decode memory */
+	bool decode_reap; /**< completion check is scheduled */
+#ifdef HAVE_PTHREAD
+	unsigned int decoders; /**< number of decoder threads running */
+	bool decoders_quit; /**< decoder threads should exit */
+	pthread_t decoder[IMAGE_CACHE_DECODERS]; /**< decoder threads */
+	pthread_mutex_t decode_lock; /**< protects queue and done lists */
+	pthread_cond_t decode_cond; /**< signals decodes queued or quit */
+#endif
 };
 
 /** image cache state */
@@ -143,18 +237,34 @@ static struct image_cache_s *image_cache = NULL;
 /**
  * Find a cache entry by index.
  *
+ * Consecutive index numbers are found from the previous result so
+ * enumerating the cache does not walk the list for every entry.
+ *
  * \param entryn index of cache entry
  * \return cache entry at index or NULL if not found.
  */
 static struct image_cache_entry_s *image_cache__findn(int entryn)
 {
 	struct image_cache_entry_s *found;
+	int foundn;
+
+	if ((image_cache->findn_entry != NULL) &&
+	    (image_cache->findn_entryn <= entryn)) {
+		found = image_cache->findn_entry;
+		foundn = image_cache->findn_entryn;
+	} else {
+		found = image_cache->entries;
+		foundn = 0;
+	}
 
-	found = image_cache->entries;
-	while ((found != NULL) && (entryn > 0)) {
-		entryn--;
+	while ((found != NULL) && (foundn < entryn)) {
+		foundn++;
 		found = found->next;
 	}
+
+	image_cache->findn_entry = found;
+	image_cache->findn_entryn = foundn;
+
 	return found;
 }
 
@@ -167,15 +277,65 @@ static struct image_cache_entry_s *image_cache__findn(int entryn)
  */
 static struct image_cache_entry_s *image_cache__find(const struct content *c)
 {
-	struct image_cache_entry_s *found;
+	return hashmap_lookup(image_cache->index, (void *)c);
+}
 
-	found = image_cache->entries;
-	while ((found != NULL) && (found->content != c)) {
-		found = found->next;
+/**
+ * Content index key hash.
+ *
+ * The key is the content pointer itself.
+ */
+static uint32_t image_cache__index_hash(void *key)
+{
+	uintptr_t ptr = (uintptr_t)key;
+
+	/* allocations are aligned so discard the low bits */
+	return (uint32_t)((ptr >> 4) ^ (ptr >> 20));
+}
+
+static void *image_cache__index_key_clone(void *key)
+{
+	return key;
+}
+
+static void image_cache__index_key_destroy(void *key)
+{
+}
+
+static bool image_cache__index_key_eq(void *key1, void *key2)
+{
+	return key1 == key2;
+}
+
+static void *image_cache__index_value_alloc(void *key)
+{
+	struct image_cache_entry_s *centry;
+
+	centry = calloc(1, sizeof(struct image_cache_entry_s));
+	if (centry != NULL) {
+		centry->content = key;
 	}
-	return found;
+	return centry;
 }
 
+static void image_cache__index_value_destroy(void *value)
+{
+	free(value);
+}
+
+/**
+ * Parameters for the content index, entries are owned by the index
+ */
+static hashmap_parameters_t image_cache_index_parameters = {
+	.key_clone = image_cache__index_key_clone,
+	.key_hash = image_cache__index_hash,
+	.key_eq = image_cache__index_key_eq,
+	.key_destroy = image_cache__index_key_destroy,
+	.value_alloc = image_cache__index_value_alloc,
+	.value_destroy = image_cache__index_value_destroy,
+	.flat = true,
+};
+
 /**
  * Update the image cache statistics with an entry.
  *
@@ -216,34 +376,61 @@ static void image_cache_stats_bitmap_add(struct image_cache_entry_s *centry)
 	}
 }
 
+/**
+ * Add an entry to the least recently used end of the entry list.
+ *
+ * New entries have never been redrawn so are the oldest.
+ */
 static void image_cache__link(struct image_cache_entry_s *centry)
 {
-	centry->next = image_cache->entries;
-	centry->prev = NULL;
-	if (centry->next != NULL) {
-		centry->next->prev = centry;
+	centry->next = NULL;
+	centry->prev = image_cache->entries_tail;
+	if (centry->prev != NULL) {
+		centry->prev->next = centry;
+	} else {
+		image_cache->entries = centry;
 	}
-	image_cache->entries = centry;
+	image_cache->entries_tail = centry;
+
+	image_cache->findn_entry = NULL;
 }
 
 static void image_cache__unlink(struct image_cache_entry_s *centry)
 {
-	/* unlink entry */
-	if (centry->prev == NULL) {
-		/* first in list */
-		if (centry->next != NULL) {
-			centry->next->prev = centry->prev;
-			image_cache->entries = centry->next;
-		} else {
-			/* empty list */
-			image_cache->entries = NULL;
-		}
-	} else {
+	if (centry->prev != NULL) {
 		centry->prev->next = centry->next;
+	} else {
+		image_cache->entries = centry->next;
+	}
 
-		if (centry->next != NULL) {
-			centry->next->prev = centry->prev;
-		}
+	if (centry->next != NULL) {
+		centry->next->prev = centry->prev;
+	} else {
+		image_cache->entries_tail = centry->prev;
+	}
+
+	centry->next = NULL;
+	centry->prev = NULL;
+
+	image_cache->findn_entry = NULL;
+}
+
+/**
+ * Record a redraw of an entry making it the most recently used.
+ *
+ * \param centry The image cache entry redrawn.
+ */
+static void image_cache__touch(struct image_cache_entry_s *centry)
+{
+	centry->redraw_count++;
+	centry->redraw_age = image_cache->current_age;
+
+	if (centry != image_cache->entries) {
+		image_cache__unlink(centry);
+
+		centry->next = image_cache->entries;
+		centry->next->prev = centry;
+		image_cache->entries = centry;
 	}
 }
 
@@ -274,6 +461,473 @@ static void image_cache__free_bitmap(struct image_cache_entry_s *centry)
 
 }
 
+/**
+ * Find whether the bitmap of an entry is awaited from a background decode.
+ *
+ * \param centry The image cache entry.
+ * \return true if a background decode is outstanding.
+ */
+static inline bool image_cache__decode_pending(struct image_cache_entry_s *centry)
+{
+	return (centry->decoding != NULL) || centry->decode_deferred;
+}
+
+#ifdef HAVE_PTHREAD
+/**
+ * Create a bitmap from decoded pixels.
+ *
+ * \param pixels The decoded pixels.
+ * \return The new bitmap or NULL on failure.
+ */
+static struct bitmap *
+image_cache__bitmap_create(const struct image_cache_pixels *pixels)
+{
+	struct bitmap *bitmap;
+	uint8_t *buffer;
+	size_t rowstride;
+	int y;
+
+	bitmap = guit->bitmap->create(pixels->width, pixels->height,
+			BITMAP_NEW | (pixels->opaque ? BITMAP_OPAQUE : 0));
+	if (bitmap == NULL) {
+		return NULL;
+	}
+
+	buffer = guit->bitmap->get_buffer(bitmap);
+	if (buffer == NULL) {
+		guit->bitmap->destroy(bitmap);
+		return NULL;
+	}
+
+	rowstride = guit->bitmap->get_rowstride(bitmap);
+	for (y = 0; y < pixels->height; y++) {
+		memcpy(buffer + rowstride * y,
+		       pixels->buffer + pixels->rowstride * y,
+		       (size_t)pixels->width * 4);
+	}
+	guit->bitmap->modified(bitmap);
+
+	return bitmap;
+}
+
+/**
+ * Complete a background decode.
+ *
+ * The decoded bitmap replaces any smaller one of the entry and the
+ * content is redrawn.
+ *
+ * \param icache The image cache context.
+ * \param job The completed decode.
+ */
+static void
+image_cache__decode_complete(struct image_cache_s *icache,
+			     struct image_cache_decode *job)
+{
+	struct image_cache_entry_s *centry;
+	struct content *c = job->content;
+	struct bitmap *bitmap = NULL;
+
+	icache->decode_count--;
+	icache->decode_size -= job->size;
+
+	if (job->cancelled == false) {
+		/* entries cancel their decode when freed */
+		centry = image_cache__find(c);
+		assert((centry != NULL) && (centry->decoding == job));
+		centry->decoding = NULL;
+
+		if (job->res == NSERROR_OK) {
+			bitmap = image_cache__bitmap_create(&job->pixels);
+		}
+
+		if (bitmap == NULL) {
+			centry->decode_failed = true;
+		} else if ((centry->bitmap != NULL) &&
+			   (guit->bitmap->get_width(centry->bitmap) >= job->pixels.width) &&
+			   (guit->bitmap->get_height(centry->bitmap) >= job->pixels.height)) {
+			/* converted at least as large while decoding */
+			guit->bitmap->destroy(bitmap);
+		} else {
+			image_cache__free_bitmap(centry);
+
+			centry->bitmap = bitmap;
+			centry->bitmap_size = (size_t)job->pixels.width *
+				job->pixels.height * 4;
+			centry->reduced = (job->pixels.width < c->width) ||
+				(job->pixels.height < c->height);
+
+			image_cache_stats_bitmap_add(centry);
+			icache->miss_count++;
+			icache->miss_size += centry->bitmap_size;
+		}
+
+		/* a failed decode is converted when redrawn */
+		content__request_redraw(c, 0, 0, c->width, c->height);
+	}
+
+	free(job->pixels.buffer);
+	free(job->source);
+	free(job);
+}
+
+static bool
+image_cache__decode_submit(struct image_cache_entry_s *centry,
+			   int width,
+			   int height);
+
+/**
+ * Complete all decodes the decoders have finished.
+ *
+ * Decodes deferred for want of memory are submitted as outstanding
+ * decodes complete, most recently redrawn first.
+ *
+ * Scheduled callback while there are outstanding decodes.
+ *
+ * \param p The image cache context.
+ */
+static void image_cache__decode_reap(void *p)
+{
+	struct image_cache_s *icache = p;
+	struct image_cache_decode *done;
+	struct image_cache_decode *next;
+	struct image_cache_entry_s *centry;
+
+	pthread_mutex_lock(&icache->decode_lock);
+	done = icache->decode_done;
+	icache->decode_done = NULL;
+	pthread_mutex_unlock(&icache->decode_lock);
+
+	while (done != NULL) {
+		next = done->next;
+		image_cache__decode_complete(icache, done);
+		done = next;
+	}
+
+	centry = icache->entries;
+	while ((centry != NULL) && (icache->decode_deferred > 0)) {
+		if (centry->decode_deferred) {
+			centry->decode_deferred = false;
+			icache->decode_deferred--;
+
+			if (image_cache__decode_submit(centry,
+						       centry->plot_width,
+						       centry->plot_height) == false) {
+				/* converted when redrawn instead */
+				content__request_redraw(centry->content, 0, 0,
+						centry->content->width,
+						centry->content->height);
+			} else if (centry->decode_deferred) {
+				/* no more memory for decoding yet */
+				break;
+			}
+		}
+		centry = centry->next;
+	}
+
+	icache->decode_reap = false;
+	if (icache->decode_count > 0) {
+		icache->decode_reap = true;
+		guit->misc->schedule(IMAGE_CACHE_DECODE_REAP_TIME,
+				     image_cache__decode_reap,
+				     icache);
+	}
+}
+
+/**
+ * Decode the content of an entry in the background.
+ *
+ * Memory for outstanding decodes is taken from that left under the
+ * cache limit, decodes which would exceed it wait for earlier ones to
+ * complete.  One decode is always allowed so they progress.
+ *
+ * \param centry The image cache entry to decode.
+ * \param width The width wanted, or zero for the intrinsic size.
+ * \param height The height wanted, or zero for the intrinsic size.
+ * \return true if the bitmap will be provided by a background decode,
+ *         false if the content must be converted synchronously.
+ */
+static bool
+image_cache__decode_submit(struct image_cache_entry_s *centry,
+			   int width,
+			   int height)
+{
+	struct image_cache_s *icache = image_cache;
+	struct content *c = centry->content;
+	struct image_cache_decode *job;
+	const uint8_t *source;
+	size_t source_size;
+	int decode_width;
+	int decode_height;
+	size_t size;
+
+	if (image_cache__decode_pending(centry)) {
+		return true;
+	}
+
+	if ((icache->decoders == 0) ||
+	    (centry->decode == NULL) ||
+	    centry->decode_failed) {
+		return false;
+	}
+
+	source = content__get_source_data(c, &source_size);
+	if (source == NULL) {
+		return false;
+	}
+
+	if ((width <= 0) || (width > c->width)) {
+		width = c->width;
+	}
+	if ((height <= 0) || (height > c->height)) {
+		height = c->height;
+	}
+
+	/* decoders which cannot scale give the intrinsic size */
+	decode_width = c->width;
+	decode_height = c->height;
+	if (centry->decode_size != NULL) {
+		centry->decode_size(c, width, height,
+				    &decode_width, &decode_height);
+	}
+
+	/* the decoded pixels and the bitmap they are copied into */
+	size = (size_t)decode_width * decode_height * 4 * 2 + source_size;
+
+	if ((icache->decode_count > 0) &&
+	    (icache->total_bitmap_size + icache->decode_size + size >
+	     icache->params.limit)) {
+		centry->decode_deferred = true;
+		icache->decode_deferred++;
+		return true;
+	}
+
+	job = calloc(1, sizeof(struct image_cache_decode));
+	if (job == NULL) {
+		return false;
+	}
+	job->source = malloc(source_size);
+	if (job->source == NULL) {
+		free(job);
+		return false;
+	}
+	memcpy(job->source, source, source_size);
+	job->source_size = source_size;
+	job->content = c;
+	job->decode = centry->decode;
+	job->width = width;
+	job->height = height;
+	job->size = size;
+
+	centry->decoding = job;
+	icache->decode_count++;
+	icache->decode_size += size;
+
+	pthread_mutex_lock(&icache->decode_lock);
+	*icache->decode_tail = job;
+	icache->decode_tail = &job->next;
+	pthread_cond_signal(&icache->decode_cond);
+	pthread_mutex_unlock(&icache->decode_lock);
+
+	if (icache->decode_reap == false) {
+		icache->decode_reap = true;
+		guit->misc->schedule(IMAGE_CACHE_DECODE_REAP_TIME,
+				     image_cache__decode_reap,
+				     icache);
+	}
+
+	return true;
+}
+
+/**
+ * Cancel any background decode of an entry.
+ *
+ * \param centry The image cache entry being freed.
+ */
+static void image_cache__decode_cancel(struct image_cache_entry_s *centry)
+{
+	if (centry->decode_deferred) {
+		centry->decode_deferred = false;
+		image_cache->decode_deferred--;
+	}
+
+	if (centry->decoding != NULL) {
+		pthread_mutex_lock(&image_cache->decode_lock);
+		centry->decoding->cancelled = true;
+		pthread_mutex_unlock(&image_cache->decode_lock);
+		centry->decoding = NULL;
+	}
+}
+
+/**
+ * Decoder thread.
+ *
+ * Takes queued decodes one at a time, performs them and places them
+ * on the completed list, until told to quit.
+ *
+ * \param p The image cache context.
+ * \return NULL
+ */
+static void *image_cache__decoder(void *p)
+{
+	struct image_cache_s *icache = p;
+	struct image_cache_decode *job;
+
+	pthread_mutex_lock(&icache->decode_lock);
+	for (;;) {
+		while ((icache->decode_queue == NULL) &&
+		       (icache->decoders_quit == false)) {
+			pthread_cond_wait(&icache->decode_cond,
+					  &icache->decode_lock);
+		}
+		if (icache->decoders_quit) {
+			break;
+		}
+
+		job = icache->decode_queue;
+		icache->decode_queue = job->next;
+		if (icache->decode_queue == NULL) {
+			icache->decode_tail = &icache->decode_queue;
+		}
+
+		if (job->cancelled) {
+			job->res = NSERROR_INVALID;
+		} else {
+			pthread_mutex_unlock(&icache->decode_lock);
+
+			job->res = job->decode(job->source,
+					       job->source_size,
+					       job->width,
+					       job->height,
+					       &job->pixels);
+
+			pthread_mutex_lock(&icache->decode_lock);
+		}
+
+		job->next = icache->decode_done;
+		icache->decode_done = job;
+	}
+	pthread_mutex_unlock(&icache->decode_lock);
+
+	return NULL;
+}
+
+/**
+ * Start the decoder threads, one for each processor up to a limit.
+ *
+ * If no thread can be started all conversions are synchronous.
+ *
+ * \param icache The image cache context.
+ */
+static void image_cache__decoders_start(struct image_cache_s *icache)
+{
+	long count = 1;
+
+#ifdef _SC_NPROCESSORS_ONLN
+	count = sysconf(_SC_NPROCESSORS_ONLN);
+#endif
+	if (count < 1) {
+		count = 1;
+	} else if (count > IMAGE_CACHE_DECODERS) {
+		count = IMAGE_CACHE_DECODERS;
+	}
+
+	icache->decode_tail = &icache->decode_queue;
+
+	if (pthread_mutex_init(&icache->decode_lock, NULL) != 0) {
+		return;
+	}
+	if (pthread_cond_init(&icache->decode_cond, NULL) != 0) {
+		pthread_mutex_destroy(&icache->decode_lock);
+		return;
+	}
+
+	while (icache->decoders < count) {
+		if (pthread_create(&icache->decoder[icache->decoders],
+				   NULL,
+				   image_cache__decoder,
+				   icache) != 0) {
+			NSLOG(netsurf, WARNING, "Unable to start decoder thread");
+			break;
+		}
+		icache->decoders++;
+	}
+
+	if (icache->decoders == 0) {
+		pthread_cond_destroy(&icache->decode_cond);
+		pthread_mutex_destroy(&icache->decode_lock);
+	}
+}
+
+/**
+ * Stop the decoder threads and discard all outstanding decodes.
+ *
+ * \param icache The image cache context.
+ */
+static void image_cache__decoders_stop(struct image_cache_s *icache)
+{
+	struct image_cache_decode *jobs[2];
+	struct image_cache_decode *next;
+	unsigned int decoder;
+	unsigned int list;
+
+	if (icache->decoders == 0) {
+		return;
+	}
+
+	pthread_mutex_lock(&icache->decode_lock);
+	icache->decoders_quit = true;
+	pthread_cond_broadcast(&icache->decode_cond);
+	pthread_mutex_unlock(&icache->decode_lock);
+
+	for (decoder = 0; decoder < icache->decoders; decoder++) {
+		pthread_join(icache->decoder[decoder], NULL);
+	}
+
+	pthread_cond_destroy(&icache->decode_cond);
+	pthread_mutex_destroy(&icache->decode_lock);
+	icache->decoders = 0;
+
+	guit->misc->schedule(-1, image_cache__decode_reap, icache);
+
+	jobs[0] = icache->decode_queue;
+	jobs[1] = icache->decode_done;
+	for (list = 0; list < 2; list++) {
+		while (jobs[list] != NULL) {
+			next = jobs[list]->next;
+			free(jobs[list]->pixels.buffer);
+			free(jobs[list]->source);
+			free(jobs[list]);
+			jobs[list] = next;
+		}
+	}
+	icache->decode_queue = NULL;
+	icache->decode_tail = &icache->decode_queue;
+	icache->decode_done = NULL;
+	icache->decode_count = 0;
+	icache->decode_size = 0;
+}
+#else
+static inline bool
+image_cache__decode_submit(struct image_cache_entry_s *centry,
+			   int width,
+			   int height)
+{
+	return false;
+}
+
+static inline void image_cache__decode_cancel(struct image_cache_entry_s *centry)
+{
+}
+
+static inline void image_cache__decoders_start(struct image_cache_s *icache)
+{
+}
+
+static inline void image_cache__decoders_stop(struct image_cache_s *icache)
+{
+}
+#endif
+
 /**
  * free image cache entry
  *
@@ -289,33 +943,55 @@ static void image_cache__free_entry(struct image_cache_entry_s *centry)
 		image_cache->total_unrendered++;
 	}
 
+	image_cache__decode_cancel(centry);
+
 	image_cache__free_bitmap(centry);
 
 	image_cache__unlink(centry);
 
-	free(centry);
+	hashmap_remove(image_cache->index, centry->content);
 }
 
 /**
  * Image cache cleaner
  *
+ * Once the cache exceeds its limit, bitmaps are freed from the least
+ * recently redrawn entries until it is below the limit less the
+ * hysteresis. Entries redrawn within the last clean interval are
+ * considered active and are never freed.
+ *
  * \param icache The image cache context.
+ * \param size Size of a bitmap about to be added to the cache.
  */
-static void image_cache__clean(struct image_cache_s *icache)
-{
-	struct image_cache_entry_s *centry = icache->entries;
-
-	while (centry != NULL) {
-		if ((icache->current_age - centry->redraw_age) >
-		    icache->params.bg_clean_time) {
-			/* only consider older entries, avoids active entries */
-			if ((icache->total_bitmap_size >
-			     (icache->params.limit - icache->params.hysteresis)) &&
-			    (rand() > (RAND_MAX / 2))) {
-				image_cache__free_bitmap(centry);
+static void image_cache__clean(struct image_cache_s *icache, size_t size)
+{
+	struct image_cache_entry_s *centry = icache->entries_tail;
+	size_t target;
+
+	if (icache->total_bitmap_size + size <= icache->params.limit) {
+		return;
+	}
+
+	if (icache->params.limit > icache->params.hysteresis) {
+		target = icache->params.limit - icache->params.hysteresis;
+	} else {
+		target = 0;
+	}
+
+	while ((centry != NULL) &&
+	       (icache->total_bitmap_size + size > target) &&
+	       ((icache->current_age - centry->redraw_age) >
+		icache->params.bg_clean_time)) {
+		if (centry->bitmap != NULL) {
+			if (centry->partial) {
+				/* stop the content decoding into it */
+				centry->evict(centry->content);
 			}
+			icache->evict_count++;
+			icache->evict_size += centry->bitmap_size;
+			image_cache__free_bitmap(centry);
 		}
-		centry=centry->next;
+		centry = centry->prev;
 	}
 }
 
@@ -335,28 +1011,134 @@ static void image_cache__background_update(void *p)
 	NSLOG(netsurf, INFO, "Cache age %ds", icache->current_age / 1000);
 #endif
 
-	image_cache__clean(icache);
+	image_cache__clean(icache, 0);
 
 	guit->misc->schedule(icache->params.bg_clean_time,
 				image_cache__background_update,
 				icache);
 }
 
-/* exported interface documented in image_cache.h */
-struct bitmap *image_cache_get_bitmap(const struct content *c)
+/**
+ * Scheduled destruction of a bitmap which has been replaced.
+ *
+ * \param p The bitmap to destroy.
+ */
+static void image_cache__retired_destroy(void *p)
 {
-	struct image_cache_entry_s *centry;
+	guit->bitmap->destroy(p);
+}
 
-	centry = image_cache__find(c);
-	if (centry == NULL) {
+/**
+ * Remove the bitmap from an entry so it can be converted again.
+ *
+ * The bitmap may already have been plotted by the redraw in progress
+ * and some plotters keep the bitmaps they are given until the redraw
+ * completes, so it is only destroyed once control has returned to the
+ * scheduler.
+ *
+ * \param centry The image cache entry to remove the bitmap from.
+ */
+static void image_cache__retire_bitmap(struct image_cache_entry_s *centry)
+{
+	guit->misc->schedule(0, image_cache__retired_destroy, centry->bitmap);
+	centry->bitmap = NULL;
+	image_cache->total_bitmap_size -= centry->bitmap_size;
+	image_cache->bitmap_count--;
+}
+
+/**
+ * Convert the content of an entry into a bitmap.
+ *
+ * \param centry The image cache entry to convert.
+ * \param width The width wanted, or zero for the intrinsic size.
+ * \param height The height wanted, or zero for the intrinsic size.
+ * \return The new bitmap or NULL on failure.
+ */
+static struct bitmap *
+image_cache__convert(struct image_cache_entry_s *centry, int width, int height)
+{
+	struct content *c = centry->content;
+	struct bitmap *bitmap;
+	int bitmap_width;
+	int bitmap_height;
+
+	if (centry->convert_scaled != NULL) {
+		bitmap = centry->convert_scaled(c, width, height);
+	} else if (centry->convert != NULL) {
+		bitmap = centry->convert(c);
+	} else {
 		return NULL;
 	}
 
+	if (bitmap != NULL) {
+		bitmap_width = guit->bitmap->get_width(bitmap);
+		bitmap_height = guit->bitmap->get_height(bitmap);
+
+		centry->bitmap_size = (size_t)bitmap_width * bitmap_height * 4;
+		centry->reduced = (bitmap_width < c->width) ||
+			(bitmap_height < c->height);
+	}
+
+	return bitmap;
+}
+
+/**
+ * Obtain the bitmap of an entry, converting the content if necessary.
+ *
+ * A bitmap converted at a reduced size is converted again if it is
+ * smaller than wanted.
+ *
+ * When the conversion may be made in the background any smaller
+ * bitmap is given until it completes, or NULL if there is none.
+ *
+ * \param centry The image cache entry.
+ * \param width The width wanted, or zero for the intrinsic size.
+ * \param height The height wanted, or zero for the intrinsic size.
+ * \param background Whether to convert in the background if possible.
+ * \return The bitmap or NULL if the conversion failed or is pending.
+ */
+static struct bitmap *
+image_cache__get(struct image_cache_entry_s *centry,
+		 int width,
+		 int height,
+		 bool background)
+{
+	const struct content *c = centry->content;
+
+	if (centry->partial) {
+		/* nothing to convert from until all the data arrives */
+		return centry->bitmap;
+	}
+
+	if ((centry->bitmap != NULL) && centry->reduced) {
+		if ((width <= 0) || (width > c->width)) {
+			width = c->width;
+		}
+		if ((height <= 0) || (height > c->height)) {
+			height = c->height;
+		}
+
+		if ((guit->bitmap->get_width(centry->bitmap) < width) ||
+		    (guit->bitmap->get_height(centry->bitmap) < height)) {
+			if (background &&
+			    image_cache__decode_submit(centry, width, height)) {
+				/* plot the smaller bitmap meanwhile */
+				image_cache->hit_count++;
+				image_cache->hit_size += centry->bitmap_size;
+				return centry->bitmap;
+			}
+			image_cache__retire_bitmap(centry);
+		}
+	}
+
 	if (centry->bitmap == NULL) {
-		if (centry->convert != NULL) {
-			centry->bitmap = centry->convert(centry->content);
+		if (background &&
+		    image_cache__decode_submit(centry, width, height)) {
+			return NULL;
 		}
 
+		centry->bitmap = image_cache__convert(centry, width, height);
+
 		if (centry->bitmap != NULL) {
 			image_cache_stats_bitmap_add(centry);
 			image_cache->miss_count++;
@@ -373,6 +1155,19 @@ struct bitmap *image_cache_get_bitmap(const struct content *c)
 	return centry->bitmap;
 }
 
+/* exported interface documented in image_cache.h */
+struct bitmap *image_cache_get_bitmap(const struct content *c)
+{
+	struct image_cache_entry_s *centry;
+
+	centry = image_cache__find(c);
+	if (centry == NULL) {
+		return NULL;
+	}
+
+	return image_cache__get(centry, 0, 0, false);
+}
+
 /* exported interface documented in image_cache.h */
 bool image_cache_speculate(struct content *c)
 {
@@ -422,10 +1217,19 @@ image_cache_init(const struct image_cache_parameters *image_cache_parameters)
 
 	image_cache->params = *image_cache_parameters;
 
+	image_cache->index = hashmap_create(&image_cache_index_parameters);
+	if (image_cache->index == NULL) {
+		free(image_cache);
+		image_cache = NULL;
+		return NSERROR_NOMEM;
+	}
+
 	guit->misc->schedule(image_cache->params.bg_clean_time,
 				image_cache__background_update,
 				image_cache);
 
+	image_cache__decoders_start(image_cache);
+
 	NSLOG(netsurf, INFO,
 	      "Image cache initialised with a limit of %"PRIsizet" hysteresis of %"PRIsizet,
 	      image_cache->params.limit,
@@ -448,6 +1252,8 @@ nserror image_cache_fini(void)
 		image_cache__free_entry(image_cache->entries);
 	}
 
+	image_cache__decoders_stop(image_cache);
+
 	op_count = image_cache->hit_count +
 		image_cache->miss_count +
 		image_cache->fail_count;
@@ -501,17 +1307,40 @@ nserror image_cache_fini(void)
 	      image_cache->peak_conversions_size,
 	      image_cache->peak_conversions);
 
+	NSLOG(netsurf, INFO, "Bitmaps evicted: %d (size %"PRIu64")",
+	      image_cache->evict_count,
+	      image_cache->evict_size);
+
+	hashmap_destroy(image_cache->index);
+
 	free(image_cache);
 
 	return NSERROR_OK;
 }
 
-/* exported interface documented in image_cache.h */
-nserror image_cache_add(struct content *content,
-			struct bitmap *bitmap,
-			image_cache_convert_fn *convert)
+/**
+ * Add an image content to the cache.
+ *
+ * \param content The content handle used as a key
+ * \param bitmap A bitmap of the already converted content or NULL.
+ * \param convert Function to convert the content or NULL.
+ * \param convert_scaled Function to convert the content at a reduced
+ *                       size or NULL.
+ * \param decode Function to decode the content in the background or NULL.
+ * \param decode_size Function giving the size of a decode or NULL.
+ * \return A netsurf error code.
+ */
+static nserror
+image_cache__add(struct content *content,
+		 struct bitmap *bitmap,
+		 image_cache_convert_fn *convert,
+		 image_cache_convert_scaled_fn *convert_scaled,
+		 image_cache_decode_fn *decode,
+		 image_cache_decode_size_fn *decode_size)
 {
 	struct image_cache_entry_s *centry;
+	int bitmap_width;
+	int bitmap_height;
 
 	/* bump the cache age by a ms to ensure multiple items are not
 	 * added at exactly the same time
@@ -521,12 +1350,11 @@ nserror image_cache_add(struct content *content,
 	centry = image_cache__find(content);
 	if (centry == NULL) {
 		/* new cache entry, content not previously added */
-		centry = calloc(1, sizeof(struct image_cache_entry_s));
+		centry = hashmap_insert(image_cache->index, content);
 		if (centry == NULL) {
 			return NSERROR_NOMEM;
 		}
 		image_cache__link(centry);
-		centry->content = content;
 
 		centry->bitmap_size = content->width * content->height * 4;
 	}
@@ -535,6 +1363,20 @@ nserror image_cache_add(struct content *content,
 	      content, bitmap);
 
 	centry->convert = convert;
+	centry->convert_scaled = convert_scaled;
+	centry->decode = decode;
+	centry->decode_size = decode_size;
+
+	if (centry->partial) {
+		/* the bitmap decoded as data arrived is complete */
+		centry->partial = false;
+		if (centry->bitmap != NULL) {
+			bitmap_width = guit->bitmap->get_width(centry->bitmap);
+			bitmap_height = guit->bitmap->get_height(centry->bitmap);
+			centry->reduced = (bitmap_width < content->width) ||
+				(bitmap_height < content->height);
+		}
+	}
 
 	/* set bitmap entry if one is passed, free extant one if present */
 	if (bitmap != NULL) {
@@ -544,11 +1386,12 @@ nserror image_cache_add(struct content *content,
 			image_cache_stats_bitmap_add(centry);
 		}
 		centry->bitmap = bitmap;
-	} else {
+	} else if (centry->bitmap == NULL) {
 		/* no bitmap, check to see if we should speculatively convert */
-		if ((centry->convert != NULL) &&
+		if (((centry->convert != NULL) ||
+		     (centry->convert_scaled != NULL)) &&
 		    (image_cache_speculate(content) == true)) {
-			centry->bitmap = centry->convert(centry->content);
+			centry->bitmap = image_cache__convert(centry, 0, 0);
 
 			if (centry->bitmap != NULL) {
 				image_cache_stats_bitmap_add(centry);
@@ -563,6 +1406,72 @@ nserror image_cache_add(struct content *content,
 	return NSERROR_OK;
 }
 
+/* exported interface documented in image_cache.h */
+nserror image_cache_add(struct content *content,
+			struct bitmap *bitmap,
+			image_cache_convert_fn *convert)
+{
+	return image_cache__add(content, bitmap, convert, NULL, NULL, NULL);
+}
+
+/* exported interface documented in image_cache.h */
+nserror image_cache_add_scaled(struct content *content,
+			       image_cache_convert_scaled_fn *convert,
+			       image_cache_decode_fn *decode,
+			       image_cache_decode_size_fn *decode_size)
+{
+	return image_cache__add(content, NULL, NULL, convert, decode,
+				decode_size);
+}
+
+/* exported interface documented in image_cache.h */
+nserror image_cache_add_partial(struct content *content,
+				struct bitmap *bitmap,
+				image_cache_evict_fn *evict)
+{
+	struct image_cache_entry_s *centry;
+	size_t size = 0;
+
+	centry = image_cache__find(content);
+
+	if ((centry == NULL) || (centry->bitmap != bitmap)) {
+		size = (size_t)guit->bitmap->get_width(bitmap) *
+			guit->bitmap->get_height(bitmap) * 4;
+
+		/* make room for the bitmap as a conversion would */
+		image_cache__clean(image_cache,
+				   size + image_cache->decode_size);
+		if (image_cache->total_bitmap_size +
+		    image_cache->decode_size + size >
+		    image_cache->params.limit) {
+			return NSERROR_NOMEM;
+		}
+	}
+
+	if (centry == NULL) {
+		centry = hashmap_insert(image_cache->index, content);
+		if (centry == NULL) {
+			return NSERROR_NOMEM;
+		}
+		image_cache__link(centry);
+	}
+
+	if (centry->bitmap != bitmap) {
+		image_cache__free_bitmap(centry);
+
+		centry->bitmap = bitmap;
+		centry->bitmap_size = size;
+		image_cache_stats_bitmap_add(centry);
+
+		/* not evicted before it can first be redrawn */
+		centry->redraw_age = image_cache->current_age;
+	}
+	centry->partial = true;
+	centry->evict = evict;
+
+	return NSERROR_OK;
+}
+
 /* exported interface documented in image_cache.h */
 nserror image_cache_remove(struct content *content)
 {
@@ -667,6 +1576,8 @@ case chr :					\
 			FMTCHR('v', "d", total_extra_conversions_count);
 			FMTCHR('w', "u", peak_conversions_size);
 			FMTCHR('x', "d", peak_conversions);
+			FMTCHR('y', "d", evict_count);
+			FMTCHR('z', PRIu64, evict_size);
 
 
 			}
@@ -810,29 +1721,17 @@ bool image_cache_redraw(struct content *c,
 		return false;
 	}
 
-	if (centry->bitmap == NULL) {
-		if (centry->convert != NULL) {
-			centry->bitmap = centry->convert(centry->content);
-		}
+	/* no larger a bitmap than is plotted is needed */
+	centry->plot_width = data->width;
+	centry->plot_height = data->height;
 
-		if (centry->bitmap != NULL) {
-			image_cache_stats_bitmap_add(centry);
-			image_cache->miss_count++;
-			image_cache->miss_size += centry->bitmap_size;
-		} else {
-			image_cache->fail_count++;
-			image_cache->fail_size += centry->bitmap_size;
-			return false;
-		}
-	} else {
-		image_cache->hit_count++;
-		image_cache->hit_size += centry->bitmap_size;
+	if (image_cache__get(centry, data->width, data->height, true) == NULL) {
+		/* nothing is plotted until a background decode completes */
+		return image_cache__decode_pending(centry);
 	}
 
-
 	/* update statistics */
-	centry->redraw_count++;
-	centry->redraw_age = image_cache->current_age;
+	image_cache__touch(centry);
 
 	return image_bitmap_plot(centry->bitmap, data, clip, ctx);
 }
@@ -861,8 +1760,25 @@ void *image_cache_get_internal(const struct content *c, void *context)
 /* exported interface documented in image_cache.h */
 bool image_cache_is_opaque(struct content *c)
 {
+	struct image_cache_entry_s *centry;
 	struct bitmap *bmp;
-	bmp = image_cache_get_bitmap(c);
+
+	centry = image_cache__find(c);
+	if (centry == NULL) {
+		return false;
+	}
+
+	/* opacity does not depend on size, so any bitmap will do and
+	 * there is no need to convert at more than the plotted size
+	 */
+	if (centry->bitmap != NULL) {
+		bmp = centry->bitmap;
+	} else {
+		bmp = image_cache__get(centry,
+				       max(centry->plot_width, 1),
+				       max(centry->plot_height, 1),
+				       true);
+	}
 	if (bmp != NULL) {
 		return guit->bitmap->get_opaque(bmp);
 	}
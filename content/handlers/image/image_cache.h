@@ -37,6 +37,9 @@
 #ifndef NETSURF_IMAGE_IMAGE_CACHE_H_
 #define NETSURF_IMAGE_IMAGE_CACHE_H_
 
+#include <stdbool.h>
+#include <stdint.h>
+
 #include "utils/errors.h"
 #include "netsurf/content_type.h"
 
@@ -45,6 +48,65 @@ struct redraw_context;
 
 typedef struct bitmap * (image_cache_convert_fn) (struct content *content);
 
+/**
+ * Convert a content into a bitmap of at least a given size.
+ *
+ * The bitmap may be smaller than the content's intrinsic size, but
+ * not smaller than the given width and height unless the content
+ * itself is.  A width and height of zero ask for the intrinsic size.
+ */
+typedef struct bitmap * (image_cache_convert_scaled_fn) (struct content *content, int width, int height);
+
+/**
+ * Pixels decoded from a content's source data.
+ *
+ * The pixels are in the same format as bitmap buffers.
+ */
+struct image_cache_pixels {
+	int width; /**< width of the pixels */
+	int height; /**< height of the pixels */
+	size_t rowstride; /**< bytes from the start of one row to the next */
+	bool opaque; /**< pixels are all opaque */
+	uint8_t *buffer; /**< pixel storage, allocated with malloc */
+};
+
+/**
+ * Decode a content's source data into pixels of at least a given size.
+ *
+ * The size is treated as by image_cache_convert_scaled_fn.  Decoders
+ * are called from decode threads so must not use any frontend or
+ * core interface, or any state shared with other decodes.
+ *
+ * \param source The content source data.
+ * \param source_size The size of the source data.
+ * \param width The width wanted, or zero for the intrinsic size.
+ * \param height The height wanted, or zero for the intrinsic size.
+ * \param pixels Updated with the decoded pixels.
+ * \return NSERROR_OK on success, appropriate error otherwise.
+ */
+typedef nserror (image_cache_decode_fn) (const uint8_t *source, size_t source_size, int width, int height, struct image_cache_pixels *pixels);
+
+/**
+ * Find the size of the pixels a decode of a content will give.
+ *
+ * \param content The content to be decoded.
+ * \param width The width wanted, or zero for the intrinsic size.
+ * \param height The height wanted, or zero for the intrinsic size.
+ * \param decode_width Updated with the width of the decoded pixels.
+ * \param decode_height Updated with the height of the decoded pixels.
+ */
+typedef void (image_cache_decode_size_fn) (struct content *content, int width, int height, int *decode_width, int *decode_height);
+
+/**
+ * Tell a content that the bitmap it is decoding into is being evicted.
+ *
+ * The content must stop decoding into the bitmap, which is destroyed
+ * once this returns.
+ *
+ * \param content The content whose bitmap is evicted.
+ */
+typedef void (image_cache_evict_fn) (struct content *content);
+
 struct image_cache_parameters {
 	/** How frequently the background cache clean process is run (ms) */
 	unsigned int bg_clean_time;
@@ -77,6 +139,52 @@ nserror image_cache_add(struct content *content,
 			struct bitmap *bitmap, 
 			image_cache_convert_fn *convert);
 
+/** adds an image content which may be converted at a reduced size.
+ *
+ * Redraws convert the content at no more than the size it is plotted
+ * at, converting it again if it is later plotted larger.  Obtaining
+ * the bitmap with image_cache_get_bitmap() always gives the intrinsic
+ * size.
+ *
+ * If a decoder is given, redraws decode the content in the background
+ * where possible.  Until the decode completes any smaller bitmap
+ * already held is plotted, or nothing, and a redraw of the content is
+ * requested once the bitmap is ready.
+ *
+ * @param content The content handle used as a key
+ * @param convert A function pointer to convert the content into a bitmap.
+ * @param decode A function pointer to decode the content source or NULL.
+ * @param decode_size A function pointer giving the size of a decode, or
+ *                    NULL if decodes are always at the intrinsic size.
+ * @return A netsurf error code.
+ */
+nserror image_cache_add_scaled(struct content *content,
+			       image_cache_convert_scaled_fn *convert,
+			       image_cache_decode_fn *decode,
+			       image_cache_decode_size_fn *decode_size);
+
+/** adds the bitmap of an image content whose data is still arriving.
+ *
+ * The bitmap is plotted as it is until the content is added with
+ * image_cache_add() or image_cache_add_scaled(), and the caller may
+ * continue to decode into it meanwhile.  The cache takes ownership of
+ * the bitmap and keeps it as the converted bitmap once the content is
+ * added.
+ *
+ * The bitmap counts against the cache limit.  It is refused if room
+ * cannot be made for it, and may be evicted like any other bitmap
+ * while the content is not being redrawn.
+ *
+ * @param content The content handle used as a key
+ * @param bitmap A bitmap of the content decoded so far.
+ * @param evict A function pointer called if the bitmap is evicted.
+ * @return NSERROR_OK on success, NSERROR_NOMEM if the bitmap does not
+ *         fit within the cache limit, or another netsurf error code.
+ */
+nserror image_cache_add_partial(struct content *content,
+				struct bitmap *bitmap,
+				image_cache_evict_fn *evict);
+
 nserror image_cache_remove(struct content *content);
 
 
@@ -155,6 +263,8 @@ int image_cache_snentryf(char *string, size_t size, unsigned int entryn,
  *     of times.
  * x The number of times the image that was converted (read missed cache) 
  *     highest number of times.
+ * y The number of bitmaps freed by the cache cleaner.
+ * z The total size of bitmaps freed by the cache cleaner.
  *
  * format modifiers:
  * A p before the value modifies the replacement to be a percentage.
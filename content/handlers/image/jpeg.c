@@ -27,6 +27,7 @@
 #include <stdbool.h>
 #include <stdlib.h>
 #include <setjmp.h>
+#include <nsutils/time.h>
 
 #include "utils/utils.h"
 #include "utils/log.h"
@@ -38,6 +39,7 @@
 #include "content/content_factory.h"
 #include "desktop/gui_internal.h"
 
+#include "image/image.h"
 #include "image/image_cache.h"
 
 #define JPEG_INTERNAL_OPTIONS
@@ -49,6 +51,14 @@
  */
 #define MIN_JPEG_SIZE 20
 
+/** largest bitmap, in pixels, a jpeg is decoded into as its data arrives
+ *
+ * The whole image is held while it is decoded so larger ones are
+ * decoded at a DCT scaling which fits, and again at the size they are
+ * plotted once complete.
+ */
+#define NSJPEG_STREAM_MAX_PIXELS (2048 * 2048)
+
 #ifdef riscos
 /* We prefer the library to be configured with these options to save
  * copying data during decoding. */
@@ -62,6 +72,46 @@ static char nsjpeg_error_buffer[JMSG_LENGTH_MAX];
 
 static unsigned char nsjpeg_eoi[] = { 0xff, JPEG_EOI };
 
+/** Stage reached decoding a jpeg as its data arrives */
+enum nsjpeg_stream_state {
+	NSJPEG_STREAM_HEADER, /**< reading the header */
+	NSJPEG_STREAM_START, /**< starting decompression */
+	NSJPEG_STREAM_SCANLINES, /**< reading scanlines */
+	NSJPEG_STREAM_SCAN_START, /**< starting output of a scan */
+	NSJPEG_STREAM_SCAN_SCANLINES, /**< reading scanlines of a scan */
+	NSJPEG_STREAM_SCAN_FINISH, /**< finishing output of a scan */
+	NSJPEG_STREAM_FINISH, /**< finishing decompression */
+	NSJPEG_STREAM_DONE, /**< image completely decoded */
+	NSJPEG_STREAM_STOPPED, /**< decoding abandoned */
+};
+
+/** State of a jpeg being decoded as its data arrives */
+struct nsjpeg_stream {
+	/** source manager, first so it may be found from the cinfo */
+	struct jpeg_source_mgr source_mgr;
+	struct jpeg_decompress_struct cinfo;
+	struct jpeg_error_mgr jerr;
+	jmp_buf setjmp_buffer;
+
+	enum nsjpeg_stream_state state;
+	size_t fed; /**< amount of source data given to the library */
+	size_t skip; /**< source data to skip once it arrives */
+	bool complete; /**< all the source data has arrived */
+
+	struct bitmap *bitmap; /**< bitmap being decoded into */
+	uint8_t *pixels; /**< bitmap buffer */
+	size_t rowstride; /**< bitmap row stride */
+};
+
+/** jpeg content */
+typedef struct nsjpeg_content {
+	struct content base; /**< base content */
+
+	struct image_progress progress; /**< redraw throttle */
+	struct nsjpeg_stream *stream; /**< decode as data arrives */
+	bool no_stream; /**< only decode once all data has arrived */
+} nsjpeg_content;
+
 /**
  * Content create entry point.
  */
@@ -70,21 +120,23 @@ static nserror nsjpeg_create(const content_handler *handler,
 		llcache_handle *llcache, const char *fallback_charset,
 		bool quirks, struct content **c)
 {
-	struct content *jpeg;
+	nsjpeg_content *jpeg;
 	nserror error;
 
-	jpeg = calloc(1, sizeof(struct content));
+	jpeg = calloc(1, sizeof(nsjpeg_content));
 	if (jpeg == NULL)
 		return NSERROR_NOMEM;
 
-	error = content__init(jpeg, handler, imime_type, params,
+	error = content__init(&jpeg->base, handler, imime_type, params,
 			      llcache, fallback_charset, quirks);
 	if (error != NSERROR_OK) {
 		free(jpeg);
 		return error;
 	}
 
-	*c = jpeg;
+	image_progress_init(&jpeg->progress, &jpeg->base);
+
+	*c = &jpeg->base;
 
 	return NSERROR_OK;
 }
@@ -165,19 +217,191 @@ static void nsjpeg_error_exit(j_common_ptr cinfo)
 }
 
 /**
- * create a bitmap from jpeg content.
+ * Warning output handler for decompression off the main thread.
+ *
+ * Logging is not available so warnings are discarded.
  */
-static struct bitmap *
-jpeg_cache_convert(struct content *c)
+static void nsjpeg_error_log_quiet(j_common_ptr cinfo)
+{
+}
+
+
+/**
+ * Fatal error handler for decompression off the main thread.
+ */
+static void nsjpeg_error_exit_quiet(j_common_ptr cinfo)
+{
+	jmp_buf *setjmp_buffer = (jmp_buf *) cinfo->client_data;
+
+	longjmp(*setjmp_buffer, 1);
+}
+
+/**
+ * Find the largest DCT scaling which still gives at least a size.
+ *
+ * The library can scale by 1/2, 1/4 and 1/8 while decoding at a
+ * fraction of the cost of a full decode.  Scaled dimensions are the
+ * image dimensions divided by the scaling, rounded up.
+ *
+ * \param image_width intrinsic width of the image
+ * \param image_height intrinsic height of the image
+ * \param width width wanted, or zero for the intrinsic size
+ * \param height height wanted, or zero for the intrinsic size
+ * \return the scaling denominator
+ */
+static unsigned int
+nsjpeg_scale_denom(unsigned int image_width,
+		   unsigned int image_height,
+		   int width,
+		   int height)
+{
+	unsigned int denom;
+
+	if ((width <= 0) || (height <= 0)) {
+		return 1;
+	}
+
+	for (denom = 8; denom > 1; denom >>= 1) {
+		if (((image_width + denom - 1) / denom >=
+		     (unsigned int)width) &&
+		    ((image_height + denom - 1) / denom >=
+		     (unsigned int)height)) {
+			break;
+		}
+	}
+
+	return denom;
+}
+
+/**
+ * Select the largest DCT scaling which still gives at least a size.
+ *
+ * \param cinfo decompressor with the header read
+ * \param width width wanted, or zero for the intrinsic size
+ * \param height height wanted, or zero for the intrinsic size
+ */
+static void
+nsjpeg_set_scale(struct jpeg_decompress_struct *cinfo, int width, int height)
+{
+	cinfo->scale_num = 1;
+	cinfo->scale_denom = nsjpeg_scale_denom(cinfo->image_width,
+						cinfo->image_height,
+						width, height);
+}
+
+/**
+ * Select the least DCT scaling which fits a jpeg decoded as its data arrives.
+ *
+ * The size the image will be plotted at is not known until it has
+ * been displayed, so it is decoded at the largest size which fits.
+ *
+ * \param cinfo decompressor with the header read
+ */
+static void nsjpeg_stream_set_scale(struct jpeg_decompress_struct *cinfo)
+{
+	unsigned int denom;
+	size_t width;
+	size_t height;
+
+	for (denom = 1; denom < 8; denom <<= 1) {
+		width = (cinfo->image_width + denom - 1) / denom;
+		height = (cinfo->image_height + denom - 1) / denom;
+		if (width * height <= NSJPEG_STREAM_MAX_PIXELS) {
+			break;
+		}
+	}
+
+	nsjpeg_set_scale(cinfo,
+			 (cinfo->image_width + denom - 1) / denom,
+			 (cinfo->image_height + denom - 1) / denom);
+}
+
+/**
+ * Convert a decompressed scanline into the bitmap pixel format in place.
+ *
+ * \param cinfo decompressor which produced the scanline
+ * \param row the scanline
+ */
+static void nsjpeg_convert_row(struct jpeg_decompress_struct *cinfo, JSAMPROW row)
+{
+	int width = cinfo->output_width;
+
+	if (cinfo->out_color_space == JCS_CMYK) {
+		int i;
+		for (i = width - 1; 0 <= i; i--) {
+			/* Trivial inverse CMYK -> RGBA */
+			const int c = row[i * 4 + 0];
+			const int m = row[i * 4 + 1];
+			const int y = row[i * 4 + 2];
+			const int k = row[i * 4 + 3];
+
+			const int ck = c * k;
+			const int mk = m * k;
+			const int yk = y * k;
+
+#define DIV255(x) ((x) + 1 + ((x) >> 8)) >> 8
+			row[i * 4 + 0] = DIV255(ck);
+			row[i * 4 + 1] = DIV255(mk);
+			row[i * 4 + 2] = DIV255(yk);
+			row[i * 4 + 3] = 0xff;
+#undef DIV255
+		}
+	} else {
+#if RGB_RED != 0 || RGB_GREEN != 1 || RGB_BLUE != 2 || RGB_PIXELSIZE != 4
+		/* Missmatch between configured libjpeg pixel format and
+		 * NetSurf pixel format.  Convert to RGBA */
+		int i;
+		for (i = width - 1; 0 <= i; i--) {
+			int r = row[i * RGB_PIXELSIZE + RGB_RED];
+			int g = row[i * RGB_PIXELSIZE + RGB_GREEN];
+			int b = row[i * RGB_PIXELSIZE + RGB_BLUE];
+			row[i * 4 + 0] = r;
+			row[i * 4 + 1] = g;
+			row[i * 4 + 2] = b;
+			row[i * 4 + 3] = 0xff;
+		}
+#endif
+	}
+}
+
+/**
+ * Allocate storage for decompressed jpeg pixels.
+ *
+ * \param pw Context given to nsjpeg_decompress().
+ * \param width Width of the decompressed image.
+ * \param height Height of the decompressed image.
+ * \param rowstride Updated with the bytes between rows.
+ * \return The start of the first row or NULL on failure.
+ */
+typedef uint8_t *(nsjpeg_alloc_fn)(void *pw, int width, int height, size_t *rowstride);
+
+/**
+ * Decompress jpeg source data into pixels of no less than a size.
+ *
+ * If decompression fails part way the pixels decompressed so far are
+ * kept.
+ *
+ * \param source_data The jpeg source data.
+ * \param source_size The size of the source data.
+ * \param target_width The width wanted, or zero for the intrinsic size.
+ * \param target_height The height wanted, or zero for the intrinsic size.
+ * \param quiet Whether to suppress logging, required off the main thread.
+ * \param alloc Routine to allocate the pixels.
+ * \param pw Context for \a alloc.
+ * \return true if pixels were allocated, false otherwise.
+ */
+static bool
+nsjpeg_decompress(const uint8_t *source_data,
+		  size_t source_size,
+		  int target_width,
+		  int target_height,
+		  bool quiet,
+		  nsjpeg_alloc_fn *alloc,
+		  void *pw)
 {
-	const uint8_t *source_data; /* Jpeg source data */
-	size_t source_size; /* length of Jpeg source data */
 	struct jpeg_decompress_struct cinfo;
 	struct jpeg_error_mgr jerr;
 	jmp_buf setjmp_buffer;
-	unsigned int height;
-	unsigned int width;
-	struct bitmap * volatile bitmap = NULL;
 	uint8_t * volatile pixels = NULL;
 	size_t rowstride;
 	struct jpeg_source_mgr source_mgr = {
@@ -189,23 +413,26 @@ jpeg_cache_convert(struct content *c)
 		jpeg_resync_to_restart,
 		nsjpeg_term_source };
 
-	/* obtain jpeg source data and perfom minimal sanity checks */
-	source_data = content__get_source_data(c, &source_size);
-
+	/* perfom minimal sanity checks */
 	if ((source_data == NULL) ||
 	    (source_size < MIN_JPEG_SIZE)) {
-		return NULL;
+		return false;
 	}
 
 	/* setup a JPEG library error handler */
 	cinfo.err = jpeg_std_error(&jerr);
-	jerr.error_exit = nsjpeg_error_exit;
-	jerr.output_message = nsjpeg_error_log;
+	if (quiet) {
+		jerr.error_exit = nsjpeg_error_exit_quiet;
+		jerr.output_message = nsjpeg_error_log_quiet;
+	} else {
+		jerr.error_exit = nsjpeg_error_exit;
+		jerr.output_message = nsjpeg_error_log;
+	}
 
 	/* handler for fatal errors during decompression */
 	if (setjmp(setjmp_buffer)) {
 		jpeg_destroy_decompress(&cinfo);
-		return bitmap;
+		return (pixels != NULL);
 	}
 
 	cinfo.client_data = &setjmp_buffer;
@@ -227,88 +454,552 @@ jpeg_cache_convert(struct content *c)
 		cinfo.out_color_space = JCS_RGB;
 	}
 	cinfo.dct_method = JDCT_ISLOW;
+	nsjpeg_set_scale(&cinfo, target_width, target_height);
 
 	/* commence the decompression, output parameters now valid */
 	jpeg_start_decompress(&cinfo);
 
-	width = cinfo.output_width;
-	height = cinfo.output_height;
+	pixels = alloc(pw, cinfo.output_width, cinfo.output_height, &rowstride);
+	if (pixels == NULL) {
+		jpeg_destroy_decompress(&cinfo);
+		return false;
+	}
+
+	/* Convert scanlines from jpeg into pixels */
+	do {
+		JSAMPROW scanlines[1];
+
+		scanlines[0] = (JSAMPROW) (pixels +
+					   rowstride * cinfo.output_scanline);
+		jpeg_read_scanlines(&cinfo, scanlines, 1);
+
+		nsjpeg_convert_row(&cinfo, scanlines[0]);
+	} while (cinfo.output_scanline != cinfo.output_height);
+
+	jpeg_finish_decompress(&cinfo);
+	jpeg_destroy_decompress(&cinfo);
+
+	return true;
+}
+
+/**
+ * Allocate a bitmap for decompressed jpeg pixels.
+ */
+static uint8_t *
+jpeg_cache_alloc(void *pw, int width, int height, size_t *rowstride)
+{
+	struct bitmap **bitmap = pw;
+	uint8_t *pixels;
 
 	/* create opaque bitmap (jpegs cannot be transparent) */
-	bitmap = guit->bitmap->create(width, height, BITMAP_NEW | BITMAP_OPAQUE);
-	if (bitmap == NULL) {
+	*bitmap = guit->bitmap->create(width, height, BITMAP_NEW | BITMAP_OPAQUE);
+	if (*bitmap == NULL) {
 		/* empty bitmap could not be created */
-		jpeg_destroy_decompress(&cinfo);
 		return NULL;
 	}
 
-	pixels = guit->bitmap->get_buffer(bitmap);
+	pixels = guit->bitmap->get_buffer(*bitmap);
 	if (pixels == NULL) {
 		/* bitmap with no buffer available */
-		guit->bitmap->destroy(bitmap);
-		jpeg_destroy_decompress(&cinfo);
+		guit->bitmap->destroy(*bitmap);
+		*bitmap = NULL;
 		return NULL;
 	}
 
-	/* Convert scanlines from jpeg into bitmap */
-	rowstride = guit->bitmap->get_rowstride(bitmap);
-	do {
+	*rowstride = guit->bitmap->get_rowstride(*bitmap);
+
+	return pixels;
+}
+
+/**
+ * create a bitmap from jpeg content at no less than a size.
+ */
+static struct bitmap *
+jpeg_cache_convert(struct content *c, int target_width, int target_height)
+{
+	const uint8_t *source_data; /* Jpeg source data */
+	size_t source_size; /* length of Jpeg source data */
+	struct bitmap *bitmap = NULL;
+
+	source_data = content__get_source_data(c, &source_size);
+
+	if (nsjpeg_decompress(source_data, source_size,
+			      target_width, target_height, false,
+			      jpeg_cache_alloc, &bitmap) == false) {
+		return NULL;
+	}
+	guit->bitmap->modified(bitmap);
+
+	return bitmap;
+}
+
+/**
+ * Allocate a buffer for jpeg pixels decoded in the background.
+ */
+static uint8_t *
+jpeg_cache_decode_alloc(void *pw, int width, int height, size_t *rowstride)
+{
+	struct image_cache_pixels *pixels = pw;
+
+	/* cleared as rows are missing if decompression fails */
+	pixels->buffer = calloc((size_t)width * height, 4);
+	if (pixels->buffer == NULL) {
+		return NULL;
+	}
+
+	pixels->width = width;
+	pixels->height = height;
+	pixels->rowstride = (size_t)width * 4;
+	pixels->opaque = true;
+
+	*rowstride = pixels->rowstride;
+
+	return pixels->buffer;
+}
+
+/**
+ * decode jpeg source into pixels of no less than a size.
+ *
+ * Called from image cache decoder threads.
+ */
+static nserror
+jpeg_cache_decode(const uint8_t *source,
+		  size_t source_size,
+		  int width,
+		  int height,
+		  struct image_cache_pixels *pixels)
+{
+	if (nsjpeg_decompress(source, source_size, width, height, true,
+			      jpeg_cache_decode_alloc, pixels) == false) {
+		return NSERROR_INVALID;
+	}
+
+	return NSERROR_OK;
+}
+
+/**
+ * find the size of the pixels a jpeg decode of no less than a size gives.
+ */
+static void
+jpeg_cache_decode_size(struct content *c,
+		       int width,
+		       int height,
+		       int *decode_width,
+		       int *decode_height)
+{
+	unsigned int denom;
+
+	denom = nsjpeg_scale_denom(c->width, c->height, width, height);
+
+	*decode_width = (c->width + denom - 1) / denom;
+	*decode_height = (c->height + denom - 1) / denom;
+}
+
+/**
+ * Fill the input buffer of a jpeg being decoded as its data arrives.
+ *
+ * Decoding is suspended until more data arrives.  Once all data has
+ * arrived the source is truncated so an EOI marker is inserted, as by
+ * nsjpeg_fill_input_buffer().
+ */
+static boolean nsjpeg_stream_fill_input_buffer(j_decompress_ptr cinfo)
+{
+	struct nsjpeg_stream *stream = (struct nsjpeg_stream *) cinfo->src;
+
+	if (stream->complete == false) {
+		return FALSE;
+	}
+
+	return nsjpeg_fill_input_buffer(cinfo);
+}
+
+
+/**
+ * Skip data of a jpeg being decoded as its data arrives.
+ *
+ * Data which has not yet arrived is skipped once it does.
+ */
+static void nsjpeg_stream_skip_input_data(j_decompress_ptr cinfo, long num_bytes)
+{
+	struct nsjpeg_stream *stream = (struct nsjpeg_stream *) cinfo->src;
+
+	if (num_bytes <= 0) {
+		return;
+	}
+
+	if ((size_t) num_bytes > cinfo->src->bytes_in_buffer) {
+		stream->skip += num_bytes - cinfo->src->bytes_in_buffer;
+		cinfo->src->next_input_byte += cinfo->src->bytes_in_buffer;
+		cinfo->src->bytes_in_buffer = 0;
+	} else {
+		cinfo->src->next_input_byte += num_bytes;
+		cinfo->src->bytes_in_buffer -= num_bytes;
+	}
+}
+
+
+/**
+ * Give a jpeg being decoded as its data arrives all the data so far.
+ *
+ * The source data may move as it grows so the library input is
+ * pointed at the same offset within the current data.
+ *
+ * \param stream The decode state.
+ * \param data The source data so far.
+ * \param size The size of the source data so far.
+ */
+static void
+nsjpeg_stream_feed(struct nsjpeg_stream *stream, const uint8_t *data, size_t size)
+{
+	size_t offset;
+
+	offset = stream->fed - stream->source_mgr.bytes_in_buffer;
+	if (stream->skip > 0) {
+		size_t skip = min(stream->skip, size - offset);
+		offset += skip;
+		stream->skip -= skip;
+	}
+
+	stream->source_mgr.next_input_byte = data + offset;
+	stream->source_mgr.bytes_in_buffer = size - offset;
+	stream->fed = size;
+}
+
+
+/**
+ * Stop decoding a jpeg whose bitmap is evicted from the image cache.
+ *
+ * The rest of the image is decoded once all its data has arrived.
+ *
+ * \param c The jpeg content.
+ */
+static void nsjpeg_stream_evict(struct content *c)
+{
+	nsjpeg_content *jpeg_c = (nsjpeg_content *) c;
+	struct nsjpeg_stream *stream = jpeg_c->stream;
+
+	if (stream == NULL) {
+		return;
+	}
+
+	stream->bitmap = NULL;
+	stream->pixels = NULL;
+	stream->state = NSJPEG_STREAM_STOPPED;
+}
+
+
+/**
+ * Start output of a jpeg being decoded as its data arrives.
+ *
+ * An initially transparent bitmap is made for the rows to be decoded
+ * into and published to the image cache, and the content is made
+ * ready.
+ *
+ * \param jpeg_c The jpeg content.
+ * \return true on success, false if the image is not to be displayed
+ *         until it is complete.
+ */
+static bool nsjpeg_stream_start(nsjpeg_content *jpeg_c)
+{
+	struct nsjpeg_stream *stream = jpeg_c->stream;
+	struct jpeg_decompress_struct *cinfo = &stream->cinfo;
+	struct content *c = &jpeg_c->base;
+
+	if ((size_t) cinfo->output_width * cinfo->output_height >
+	    NSJPEG_STREAM_MAX_PIXELS) {
+		/* too large to hold even when scaled */
+		return false;
+	}
+
+	stream->bitmap = guit->bitmap->create(cinfo->output_width,
+					      cinfo->output_height,
+					      BITMAP_NEW | BITMAP_CLEAR_MEMORY);
+	if (stream->bitmap == NULL) {
+		return false;
+	}
+
+	stream->pixels = guit->bitmap->get_buffer(stream->bitmap);
+	if (stream->pixels == NULL) {
+		guit->bitmap->destroy(stream->bitmap);
+		stream->bitmap = NULL;
+		return false;
+	}
+	stream->rowstride = guit->bitmap->get_rowstride(stream->bitmap);
+
+	if (image_cache_add_partial(c, stream->bitmap,
+				    nsjpeg_stream_evict) != NSERROR_OK) {
+		/* no room in the cache, decode once complete instead */
+		guit->bitmap->destroy(stream->bitmap);
+		stream->bitmap = NULL;
+		return false;
+	}
+
+	/* the bitmap may be scaled down from the image */
+	c->width = cinfo->image_width;
+	c->height = cinfo->image_height;
+	c->size = c->width * c->height * 4;
+
+	content_set_ready_partial(c);
+
+	return true;
+}
+
+
+/**
+ * Decompress scanlines of a jpeg being decoded as its data arrives.
+ *
+ * \param jpeg_c The jpeg content.
+ * \return true when all the scanlines of the output pass are done,
+ *         false if decoding is suspended.
+ */
+static bool nsjpeg_stream_scanlines(nsjpeg_content *jpeg_c)
+{
+	struct nsjpeg_stream *stream = jpeg_c->stream;
+	struct jpeg_decompress_struct *cinfo = &stream->cinfo;
+	JDIMENSION y0 = cinfo->output_scanline;
+	uint64_t ms_before;
+	uint64_t ms_after;
+
+	nsu_getmonotonic_ms(&ms_before);
+
+	while (cinfo->output_scanline < cinfo->output_height) {
 		JSAMPROW scanlines[1];
 
-		scanlines[0] = (JSAMPROW) (pixels +
-					   rowstride * cinfo.output_scanline);
-		jpeg_read_scanlines(&cinfo, scanlines, 1);
+		scanlines[0] = (JSAMPROW) (stream->pixels +
+				stream->rowstride * cinfo->output_scanline);
+		if (jpeg_read_scanlines(cinfo, scanlines, 1) == 0) {
+			break;
+		}
 
-		if (cinfo.out_color_space == JCS_CMYK) {
-			int i;
-			for (i = width - 1; 0 <= i; i--) {
-				/* Trivial inverse CMYK -> RGBA */
-				const int c = scanlines[0][i * 4 + 0];
-				const int m = scanlines[0][i * 4 + 1];
-				const int y = scanlines[0][i * 4 + 2];
-				const int k = scanlines[0][i * 4 + 3];
+		nsjpeg_convert_row(cinfo, scanlines[0]);
+	}
 
-				const int ck = c * k;
-				const int mk = m * k;
-				const int yk = y * k;
+	if (cinfo->output_scanline > y0) {
+		guit->bitmap->modified(stream->bitmap);
 
-#define DIV255(x) ((x) + 1 + ((x) >> 8)) >> 8
-				scanlines[0][i * 4 + 0] = DIV255(ck);
-				scanlines[0][i * 4 + 1] = DIV255(mk);
-				scanlines[0][i * 4 + 2] = DIV255(yk);
-				scanlines[0][i * 4 + 3] = 0xff;
-#undef DIV255
+		nsu_getmonotonic_ms(&ms_after);
+		image_progress_update(&jpeg_c->progress,
+				      y0, cinfo->output_scanline,
+				      ms_after - ms_before);
+	}
+
+	return (cinfo->output_scanline == cinfo->output_height);
+}
+
+
+/**
+ * Decode as much as possible of a jpeg whose data is arriving.
+ *
+ * Baseline jpegs are decoded a scanline at a time.  Progressive jpegs
+ * are decoded in buffered image mode, outputting the image again as
+ * each further scan arrives.
+ *
+ * \param jpeg_c The jpeg content.
+ */
+static void nsjpeg_stream_decode(nsjpeg_content *jpeg_c)
+{
+	struct nsjpeg_stream *stream = jpeg_c->stream;
+	struct jpeg_decompress_struct *cinfo = &stream->cinfo;
+	int status;
+
+	if (setjmp(stream->setjmp_buffer)) {
+		/* keep the image decoded so far */
+		stream->state = NSJPEG_STREAM_STOPPED;
+		return;
+	}
+
+	for (;;) {
+		switch (stream->state) {
+		case NSJPEG_STREAM_HEADER:
+			if (jpeg_read_header(cinfo, TRUE) == JPEG_SUSPENDED) {
+				return;
 			}
-		} else {
-#if RGB_RED != 0 || RGB_GREEN != 1 || RGB_BLUE != 2 || RGB_PIXELSIZE != 4
-			/* Missmatch between configured libjpeg pixel format and
-			 * NetSurf pixel format.  Convert to RGBA */
-			int i;
-			for (i = width - 1; 0 <= i; i--) {
-				int r = scanlines[0][i * RGB_PIXELSIZE + RGB_RED];
-				int g = scanlines[0][i * RGB_PIXELSIZE + RGB_GREEN];
-				int b = scanlines[0][i * RGB_PIXELSIZE + RGB_BLUE];
-				scanlines[0][i * 4 + 0] = r;
-				scanlines[0][i * 4 + 1] = g;
-				scanlines[0][i * 4 + 2] = b;
-				scanlines[0][i * 4 + 3] = 0xff;
+
+			if (cinfo->jpeg_color_space == JCS_CMYK ||
+			    cinfo->jpeg_color_space == JCS_YCCK) {
+				cinfo->out_color_space = JCS_CMYK;
+			} else {
+				cinfo->out_color_space = JCS_RGB;
 			}
-#endif
+			cinfo->dct_method = JDCT_ISLOW;
+			cinfo->buffered_image = jpeg_has_multiple_scans(cinfo);
+			nsjpeg_stream_set_scale(cinfo);
+			stream->state = NSJPEG_STREAM_START;
+			break;
+
+		case NSJPEG_STREAM_START:
+			if (jpeg_start_decompress(cinfo) == FALSE) {
+				return;
+			}
+
+			if (nsjpeg_stream_start(jpeg_c) == false) {
+				stream->state = NSJPEG_STREAM_STOPPED;
+				return;
+			}
+
+			if (cinfo->buffered_image) {
+				stream->state = NSJPEG_STREAM_SCAN_START;
+			} else {
+				stream->state = NSJPEG_STREAM_SCANLINES;
+			}
+			break;
+
+		case NSJPEG_STREAM_SCANLINES:
+			if (nsjpeg_stream_scanlines(jpeg_c) == false) {
+				return;
+			}
+			stream->state = NSJPEG_STREAM_FINISH;
+			break;
+
+		case NSJPEG_STREAM_SCAN_START:
+			/* absorb all the input available */
+			do {
+				status = jpeg_consume_input(cinfo);
+			} while ((status != JPEG_SUSPENDED) &&
+				 (status != JPEG_REACHED_EOI));
+
+			if ((cinfo->output_scan_number >=
+			     cinfo->input_scan_number) &&
+			    (jpeg_input_complete(cinfo) == FALSE)) {
+				/* no new scan to output yet */
+				return;
+			}
+
+			if (jpeg_start_output(cinfo,
+					      cinfo->input_scan_number) == FALSE) {
+				return;
+			}
+			stream->state = NSJPEG_STREAM_SCAN_SCANLINES;
+			break;
+
+		case NSJPEG_STREAM_SCAN_SCANLINES:
+			if (nsjpeg_stream_scanlines(jpeg_c) == false) {
+				return;
+			}
+			stream->state = NSJPEG_STREAM_SCAN_FINISH;
+			break;
+
+		case NSJPEG_STREAM_SCAN_FINISH:
+			if (jpeg_finish_output(cinfo) == FALSE) {
+				return;
+			}
+
+			if (jpeg_input_complete(cinfo) &&
+			    (cinfo->input_scan_number ==
+			     cinfo->output_scan_number)) {
+				stream->state = NSJPEG_STREAM_FINISH;
+			} else {
+				stream->state = NSJPEG_STREAM_SCAN_START;
+			}
+			break;
+
+		case NSJPEG_STREAM_FINISH:
+			if (jpeg_finish_decompress(cinfo) == FALSE) {
+				return;
+			}
+
+			/* jpegs cannot be transparent */
+			guit->bitmap->set_opaque(stream->bitmap, true);
+			guit->bitmap->modified(stream->bitmap);
+			stream->state = NSJPEG_STREAM_DONE;
+			return;
+
+		case NSJPEG_STREAM_DONE:
+		case NSJPEG_STREAM_STOPPED:
+			return;
 		}
-	} while (cinfo.output_scanline != cinfo.output_height);
-	guit->bitmap->modified(bitmap);
+	}
+}
 
-	jpeg_finish_decompress(&cinfo);
-	jpeg_destroy_decompress(&cinfo);
 
-	return bitmap;
+/**
+ * Finish decoding a jpeg as its data arrived.
+ *
+ * \param jpeg_c The jpeg content.
+ */
+static void nsjpeg_stream_destroy(nsjpeg_content *jpeg_c)
+{
+	struct nsjpeg_stream *stream = jpeg_c->stream;
+
+	if (stream == NULL) {
+		return;
+	}
+
+	image_progress_fini(&jpeg_c->progress);
+	jpeg_destroy_decompress(&stream->cinfo);
+	free(stream);
+	jpeg_c->stream = NULL;
+}
+
+
+/**
+ * Process data for a CONTENT_JPEG.
+ *
+ * Once the data has been arriving for a while it is decoded as it
+ * arrives, so the image can be displayed before it is complete.
+ */
+static bool nsjpeg_process_data(struct content *c, const char *data,
+				unsigned int size)
+{
+	nsjpeg_content *jpeg_c = (nsjpeg_content *) c;
+	struct nsjpeg_stream *stream = jpeg_c->stream;
+	const uint8_t *source_data;
+	size_t source_size;
+
+	if (jpeg_c->no_stream) {
+		return true;
+	}
+
+	if (stream == NULL) {
+		if (image_progress_wanted(&jpeg_c->progress) == false) {
+			return true;
+		}
+
+		stream = calloc(1, sizeof(struct nsjpeg_stream));
+		if (stream == NULL) {
+			jpeg_c->no_stream = true;
+			return true;
+		}
+
+		stream->source_mgr.init_source = nsjpeg_init_source;
+		stream->source_mgr.fill_input_buffer = nsjpeg_stream_fill_input_buffer;
+		stream->source_mgr.skip_input_data = nsjpeg_stream_skip_input_data;
+		stream->source_mgr.resync_to_restart = jpeg_resync_to_restart;
+		stream->source_mgr.term_source = nsjpeg_term_source;
+
+		stream->cinfo.err = jpeg_std_error(&stream->jerr);
+		stream->jerr.error_exit = nsjpeg_error_exit;
+		stream->jerr.output_message = nsjpeg_error_log;
+		stream->cinfo.client_data = &stream->setjmp_buffer;
+
+		jpeg_create_decompress(&stream->cinfo);
+		stream->cinfo.src = &stream->source_mgr;
+
+		jpeg_c->stream = stream;
+	}
+
+	source_data = content__get_source_data(c, &source_size);
+	nsjpeg_stream_feed(stream, source_data, source_size);
+
+	nsjpeg_stream_decode(jpeg_c);
+
+	if ((stream->state == NSJPEG_STREAM_STOPPED) &&
+	    (stream->bitmap == NULL)) {
+		/* nothing displayed, decode once complete instead */
+		nsjpeg_stream_destroy(jpeg_c);
+		jpeg_c->no_stream = true;
+	}
+
+	return true;
 }
 
+
 /**
  * Convert a CONTENT_JPEG for display.
  */
 static bool nsjpeg_convert(struct content *c)
 {
+	nsjpeg_content *jpeg_c = (nsjpeg_content *) c;
 	struct jpeg_decompress_struct cinfo;
 	struct jpeg_error_mgr jerr;
 	jmp_buf setjmp_buffer;
@@ -321,9 +1012,19 @@ static bool nsjpeg_convert(struct content *c)
 	size_t size;
 	char *title;
 
-	/* check image header is valid and get width/height */
 	data = content__get_source_data(c, &size);
 
+	if (jpeg_c->stream != NULL) {
+		/* finish decoding what has been displayed so far */
+		jpeg_c->stream->complete = true;
+		nsjpeg_stream_feed(jpeg_c->stream, data, size);
+		nsjpeg_stream_decode(jpeg_c);
+		image_progress_flush(&jpeg_c->progress);
+		nsjpeg_stream_destroy(jpeg_c);
+	}
+
+	/* check image header is valid and get width/height */
+
 	cinfo.err = jpeg_std_error(&jerr);
 	jerr.error_exit = nsjpeg_error_exit;
 	jerr.output_message = nsjpeg_error_log;
@@ -354,7 +1055,8 @@ static bool nsjpeg_convert(struct content *c)
 
 	jpeg_destroy_decompress(&cinfo);
 
-	image_cache_add(c, NULL, jpeg_cache_convert);
+	image_cache_add_scaled(c, jpeg_cache_convert, jpeg_cache_decode,
+			       jpeg_cache_decode_size);
 
 	/* set title text */
 	title = messages_get_buff("JPEGTitle",
@@ -374,42 +1076,59 @@ static bool nsjpeg_convert(struct content *c)
 
 
 
+/**
+ * Destroy a CONTENT_JPEG and free all resources it owns.
+ */
+static void nsjpeg_destroy(struct content *c)
+{
+	nsjpeg_content *jpeg_c = (nsjpeg_content *) c;
+
+	nsjpeg_stream_destroy(jpeg_c);
+	image_progress_fini(&jpeg_c->progress);
+
+	image_cache_destroy(c);
+}
+
+
 /**
  * Clone content.
  */
 static nserror nsjpeg_clone(const struct content *old, struct content **newc)
 {
-	struct content *jpeg_c;
+	nsjpeg_content *jpeg_c;
 	nserror error;
 
-	jpeg_c = calloc(1, sizeof(struct content));
+	jpeg_c = calloc(1, sizeof(nsjpeg_content));
 	if (jpeg_c == NULL)
 		return NSERROR_NOMEM;
 
-	error = content__clone(old, jpeg_c);
+	error = content__clone(old, &jpeg_c->base);
 	if (error != NSERROR_OK) {
-		content_destroy(jpeg_c);
+		content_destroy(&jpeg_c->base);
 		return error;
 	}
 
-	/* re-convert if the content is ready */
-	if ((old->status == CONTENT_STATUS_READY) ||
-	    (old->status == CONTENT_STATUS_DONE)) {
-		if (nsjpeg_convert(jpeg_c) == false) {
-			content_destroy(jpeg_c);
+	image_progress_init(&jpeg_c->progress, &jpeg_c->base);
+
+	/* re-convert if the content is complete; one ready while its
+	 * data arrives is converted when the rest does */
+	if (old->status == CONTENT_STATUS_DONE) {
+		if (nsjpeg_convert(&jpeg_c->base) == false) {
+			content_destroy(&jpeg_c->base);
 			return NSERROR_CLONE_FAILED;
 		}
 	}
 
-	*newc = jpeg_c;
+	*newc = &jpeg_c->base;
 
 	return NSERROR_OK;
 }
 
 static const content_handler nsjpeg_content_handler = {
 	.create = nsjpeg_create,
+	.process_data = nsjpeg_process_data,
 	.data_complete = nsjpeg_convert,
-	.destroy = image_cache_destroy,
+	.destroy = nsjpeg_destroy,
 	.redraw = image_cache_redraw,
 	.clone = nsjpeg_clone,
 	.get_internal = image_cache_get_internal,
@@ -368,30 +368,51 @@ static bool nspng_process_data(struct content *c, const char *data,
 }
 
 struct png_cache_read_data_s {
-	const uint8_t *data;
-	size_t size;
+	struct content *c; /**< content whose source data is read */
+	size_t offset; /**< offset of the next chunk of source data */
+	const uint8_t *data; /**< unread data of the current chunk */
+	size_t size; /**< length of unread data in the current chunk */
 };
 
-/** PNG library read fucntion to read data from a memory array 
+/** PNG library read function to read data from a content's source chunks
  */
 static void 
 png_cache_read_fn(png_structp png_ptr, png_bytep data, png_size_t length)
 {
 	struct png_cache_read_data_s *png_cache_read_data;
+	size_t copied = 0;
+	size_t chunk;
+
 	png_cache_read_data = png_get_io_ptr(png_ptr);
 
-	if (length > png_cache_read_data->size) {
-		length = png_cache_read_data->size;
+	while (copied < length) {
+		if (png_cache_read_data->size == 0) {
+			png_cache_read_data->data = content__get_source_chunk(
+					png_cache_read_data->c,
+					png_cache_read_data->offset,
+					&png_cache_read_data->size);
+			if (png_cache_read_data->data == NULL) {
+				break;
+			}
+			png_cache_read_data->offset +=
+					png_cache_read_data->size;
+		}
+
+		chunk = length - copied;
+		if (chunk > png_cache_read_data->size) {
+			chunk = png_cache_read_data->size;
+		}
+
+		memcpy(data + copied, png_cache_read_data->data, chunk);
+
+		png_cache_read_data->data += chunk;
+		png_cache_read_data->size -= chunk;
+		copied += chunk;
 	}
 
-	if (length == 0) {
+	if (copied == 0) {
 		png_error(png_ptr, "Read Error");
 	}
-
-	memcpy(data, png_cache_read_data->data, length);
-
-	png_cache_read_data->data += length;
-	png_cache_read_data->size -= length;
 }
 
 /** calculate an array of row pointers into a bitmap data area
@@ -437,13 +458,14 @@ png_cache_convert(struct content *c)
 	png_uint_32 width, height;
 	volatile png_bytep * volatile row_pointers = NULL;
 
-	png_cache_read_data.data = 
-		content__get_source_data(c, &png_cache_read_data.size);
+	png_cache_read_data.c = c;
+	png_cache_read_data.data =
+		content__get_source_chunk(c, 0, &png_cache_read_data.size);
 
-	if ((png_cache_read_data.data == NULL) || 
-	    (png_cache_read_data.size <= 8)) {
+	if (png_cache_read_data.data == NULL) {
 		return NULL;
 	}
+	png_cache_read_data.offset = png_cache_read_data.size;
 
 	png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL,
 			nspng_error, nspng_warning);
@@ -553,6 +575,7 @@ static nserror nspng_clone(const struct content *old_c, struct content **new_c)
 	nspng_content *clone_png_c;
 	nserror error;
 	const uint8_t *data;
+	size_t offset;
 	size_t size;
 
 	clone_png_c = calloc(1, sizeof(nspng_content));
@@ -572,8 +595,10 @@ static nserror nspng_clone(const struct content *old_c, struct content **new_c)
 		return error;
 	}
 
-	data = content__get_source_data(&clone_png_c->base, &size);
-	if (size > 0) {
+	for (offset = 0;
+	     (data = content__get_source_chunk(&clone_png_c->base,
+					       offset, &size)) != NULL;
+	     offset += size) {
 		if (nspng_process_data(&clone_png_c->base, (const char *)data, size) == false) {
 			content_destroy(&clone_png_c->base);
 			return NSERROR_NOMEM;
@@ -84,9 +84,11 @@ webp_create(const content_handler *handler,
 
 /**
  * create a bitmap from webp content.
+ *
+ * The content is always converted at its intrinsic size.
  */
 static struct bitmap *
-webp_cache_convert(struct content *c)
+webp_cache_convert(struct content *c, int width, int height)
 {
 	const uint8_t *source_data; /* webp source data */
 	size_t source_size; /* length of webp source data */
@@ -146,6 +148,51 @@ webp_cache_convert(struct content *c)
 	return bitmap;
 }
 
+/**
+ * decode webp source into pixels.
+ *
+ * Called from image cache decoder threads.  The source is always
+ * decoded at its intrinsic size.
+ */
+static nserror
+webp_cache_decode(const uint8_t *source,
+		  size_t source_size,
+		  int width,
+		  int height,
+		  struct image_cache_pixels *pixels)
+{
+	VP8StatusCode webpres;
+	WebPBitstreamFeatures webpfeatures;
+	size_t buffer_size;
+
+	webpres = WebPGetFeatures(source, source_size, &webpfeatures);
+	if (webpres != VP8_STATUS_OK) {
+		return NSERROR_INVALID;
+	}
+
+	pixels->width = webpfeatures.width;
+	pixels->height = webpfeatures.height;
+	pixels->rowstride = (size_t)webpfeatures.width * 4;
+	pixels->opaque = (webpfeatures.has_alpha == 0);
+
+	buffer_size = pixels->rowstride * webpfeatures.height;
+	pixels->buffer = malloc(buffer_size);
+	if (pixels->buffer == NULL) {
+		return NSERROR_NOMEM;
+	}
+
+	if (WebPDecodeRGBAInto(source,
+			       source_size,
+			       pixels->buffer,
+			       buffer_size,
+			       pixels->rowstride) == NULL) {
+		/* decode failed */
+		return NSERROR_INVALID;
+	}
+
+	return NSERROR_OK;
+}
+
 /**
  * Convert the webp source data content.
  *
@@ -176,7 +223,7 @@ static bool webp_convert(struct content *c)
 	c->height = height;
 	c->size = c->width * c->height * 4;
 
-	image_cache_add(c, NULL, webp_cache_convert);
+	image_cache_add_scaled(c, webp_cache_convert, webp_cache_decode, NULL);
 
 	content_set_ready(c);
 	content_set_done(c);
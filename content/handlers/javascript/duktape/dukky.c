@@ -25,6 +25,8 @@
  */
 
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <nsutils/time.h>
 
 #include "netsurf/inttypes.h"
@@ -32,7 +34,10 @@
 #include "utils/nsoption.h"
 #include "utils/log.h"
 #include "utils/corestrings.h"
+#include "utils/hashmap.h"
 #include "content/content.h"
+#include "desktop/gui_internal.h"
+#include "netsurf/misc.h"
 
 #include "javascript/js.h"
 #include "javascript/content.h"
@@ -53,6 +58,50 @@
 #define GENERICS_MAGIC MAGIC(GENERICS_TABLE)
 #define THREAD_MAP MAGIC(THREAD_MAP)
 
+/** Number of small allocation size classes, the smallest being 16 bytes */
+#define DUKKY_ARENA_CLASSES 8
+
+/** Size of the chunks small allocations are carved from */
+#define DUKKY_ARENA_CHUNK_SIZE (64 * 1024)
+
+/** Number of ready made heaps kept for new browsing contexts */
+#define DUKKY_HEAP_POOL_SIZE 2
+
+/**
+ * Header of an allocation made from a heap's arena
+ *
+ * Records the requested size, from which the size class is found.
+ */
+union dukky_arena_header {
+	size_t size;
+	double align_d;
+	void *align_p;
+};
+
+/**
+ * A chunk of memory for small allocations
+ */
+struct dukky_arena_chunk {
+	struct dukky_arena_chunk *next; /**< next chunk of the arena */
+	union dukky_arena_header blocks[]; /**< memory carved into blocks */
+};
+
+/**
+ * Size class arena for the allocations of a duktape heap
+ *
+ * Small allocations are carved from chunks and recycled through per
+ * size class free lists; the chunks are released with the heap.  Larger
+ * allocations go directly to the system allocator.
+ */
+struct dukky_arena {
+	struct dukky_arena_chunk *chunks; /**< chunks of the arena */
+	uint8_t *next; /**< unused memory in the newest chunk */
+	size_t left; /**< bytes of unused memory in the newest chunk */
+	union dukky_arena_header *free[DUKKY_ARENA_CLASSES]; /**< free lists */
+	size_t current; /**< bytes currently allocated */
+	size_t peak; /**< most bytes allocated at once */
+};
+
 /**
  * dukky javascript heap
  */
@@ -62,8 +111,17 @@ struct jsheap {
 	bool pending_destroy; /**< Whether this heap is pending destruction */
 	unsigned int live_threads; /**< number of live threads */
 	uint64_t exec_start_time;
+	struct dukky_arena arena; /**< memory of the heap */
 };
 
+/**
+ * Ready made heaps, with their prototypes already created
+ */
+static struct {
+	jsheap *heap[DUKKY_HEAP_POOL_SIZE]; /**< pooled heaps */
+	unsigned int count; /**< number of pooled heaps */
+} dukky_heap_pool;
+
 /**
  * dukky javascript thread
  */
@@ -75,6 +133,50 @@ struct jsthread {
 	duk_uarridx_t thread_idx; /**< The thread number */
 };
 
+/** Shortest script, in bytes, whose compiled form is cached */
+#define DUKKY_BYTECODE_MIN_LENGTH 512
+
+/** Bytes of source and bytecode held by the compiled script cache */
+#define DUKKY_BYTECODE_CACHE_SIZE (8 * 1024 * 1024)
+
+/**
+ * Compiled script cache key
+ *
+ * The source is compared in full, rather than trusting its hash, as
+ * inline scripts from different documents share a name.
+ */
+struct dukky_bytecode_key {
+	uint32_t hash; /**< hash of the name and source */
+	const char *name; /**< file name the script was compiled with */
+	const uint8_t *source; /**< script source */
+	size_t length; /**< length of source in bytes */
+};
+
+/**
+ * Compiled script cache entry
+ */
+struct dukky_bytecode_entry {
+	struct dukky_bytecode_key *key; /**< the key held by the cache map */
+	struct dukky_bytecode_entry *prev; /**< more recently used entry */
+	struct dukky_bytecode_entry *next; /**< less recently used entry */
+	void *bytecode; /**< dumped compiled function */
+	size_t size; /**< size of bytecode */
+	size_t footprint; /**< bytes of source and bytecode held */
+};
+
+/**
+ * Compiled script cache
+ *
+ * Compiled functions are dumped as bytecode, which is independent of
+ * the heap they were compiled in, so the cache is shared by all heaps.
+ */
+static struct dukky_bytecode_cache {
+	hashmap_t *map; /**< entries keyed by name and source */
+	struct dukky_bytecode_entry *head; /**< most recently used entry */
+	struct dukky_bytecode_entry *tail; /**< least recently used entry */
+	size_t size; /**< total footprint of the entries */
+} dukky_bytecode_cache;
+
 static duk_ret_t dukky_populate_object(duk_context *ctx, void *udata)
 {
 	/* ... obj args protoname nargs */
@@ -540,75 +642,528 @@ dukky_inject_not_ctr(duk_context *ctx, int idx, const char *name)
 
 /* Duktape heap utility functions */
 
-/* We need to override the defaults because not all platforms are fully ANSI
- * compatible.  E.g. RISC OS gets upset if we malloc or realloc a zero byte
- * block, as do debugging tools such as Electric Fence by Bruce Perens.
+/**
+ * Find the size class of an arena allocation
+ *
+ * \param size  The requested size
+ * \return The size class, or DUKKY_ARENA_CLASSES if too large for any
+ */
+static inline unsigned int dukky_arena_class(size_t size)
+{
+	size_t block = 16;
+	unsigned int cls;
+
+	size += sizeof(union dukky_arena_header);
+	for (cls = 0; cls < DUKKY_ARENA_CLASSES; cls++, block <<= 1) {
+		if (size <= block) {
+			break;
+		}
+	}
+
+	return cls;
+}
+
+/**
+ * Allocate memory from an arena
+ *
+ * \param arena  The arena to allocate from
+ * \param size   The size to allocate, which must not be zero
+ * \return The allocated memory, or NULL on failure
+ */
+static void *dukky_arena_alloc(struct dukky_arena *arena, size_t size)
+{
+	unsigned int cls = dukky_arena_class(size);
+	union dukky_arena_header *block;
+	size_t block_size = (size_t)16 << cls;
+
+	if (cls == DUKKY_ARENA_CLASSES) {
+		block = malloc(sizeof(*block) + size);
+	} else if (arena->free[cls] != NULL) {
+		/* The free list is linked through the headers' payload */
+		block = arena->free[cls];
+		arena->free[cls] = *(union dukky_arena_header **)(block + 1);
+	} else {
+		if (arena->left < block_size) {
+			struct dukky_arena_chunk *chunk;
+
+			chunk = malloc(sizeof(*chunk) +
+					DUKKY_ARENA_CHUNK_SIZE);
+			if (chunk == NULL) {
+				return NULL;
+			}
+			chunk->next = arena->chunks;
+			arena->chunks = chunk;
+			arena->next = (uint8_t *)chunk->blocks;
+			arena->left = DUKKY_ARENA_CHUNK_SIZE;
+		}
+		block = (union dukky_arena_header *)(void *)arena->next;
+		arena->next += block_size;
+		arena->left -= block_size;
+	}
+
+	if (block == NULL) {
+		return NULL;
+	}
+
+	block->size = size;
+	arena->current += size;
+	if (arena->peak < arena->current) {
+		arena->peak = arena->current;
+	}
+
+	return block + 1;
+}
+
+/**
+ * Release memory allocated from an arena
+ *
+ * \param arena  The arena the memory was allocated from
+ * \param ptr    The memory to release
+ */
+static void dukky_arena_free(struct dukky_arena *arena, void *ptr)
+{
+	union dukky_arena_header *block = (union dukky_arena_header *)ptr - 1;
+	unsigned int cls = dukky_arena_class(block->size);
+
+	arena->current -= block->size;
+
+	if (cls == DUKKY_ARENA_CLASSES) {
+		free(block);
+		return;
+	}
+
+	*(union dukky_arena_header **)ptr = arena->free[cls];
+	arena->free[cls] = block;
+}
+
+/**
+ * Release all of an arena's memory
+ *
+ * Any large allocations must already have been released.
+ *
+ * \param arena  The arena to finalise
+ */
+static void dukky_arena_fini(struct dukky_arena *arena)
+{
+	struct dukky_arena_chunk *chunk;
+
+	while (arena->chunks != NULL) {
+		chunk = arena->chunks;
+		arena->chunks = chunk->next;
+		free(chunk);
+	}
+}
+
+/* Allocation is zero safe, as not all platforms are fully ANSI compatible.
+ * E.g. RISC OS gets upset if we malloc or realloc a zero byte block, as do
+ * debugging tools such as Electric Fence by Bruce Perens.
  */
 
 static void *dukky_alloc_function(void *udata, duk_size_t size)
 {
+	jsheap *heap = udata;
+
 	if (size == 0)
 		return NULL;
 
-	return malloc(size);
+	return dukky_arena_alloc(&heap->arena, size);
 }
 
 static void *dukky_realloc_function(void *udata, void *ptr, duk_size_t size)
 {
-	if (ptr == NULL && size == 0)
-		return NULL;
+	jsheap *heap = udata;
+	union dukky_arena_header *block;
+	void *new_ptr;
+
+	if (ptr == NULL) {
+		return dukky_alloc_function(udata, size);
+	}
 
 	if (size == 0) {
-		free(ptr);
+		dukky_arena_free(&heap->arena, ptr);
+		return NULL;
+	}
+
+	block = (union dukky_arena_header *)ptr - 1;
+	if (dukky_arena_class(block->size) == dukky_arena_class(size)) {
+		if (dukky_arena_class(size) == DUKKY_ARENA_CLASSES) {
+			/* Large allocations are resized in place */
+			block = realloc(block, sizeof(*block) + size);
+			if (block == NULL) {
+				return NULL;
+			}
+		}
+
+		heap->arena.current += size;
+		heap->arena.current -= block->size;
+		if (heap->arena.peak < heap->arena.current) {
+			heap->arena.peak = heap->arena.current;
+		}
+		block->size = size;
+		return block + 1;
+	}
+
+	new_ptr = dukky_arena_alloc(&heap->arena, size);
+	if (new_ptr == NULL) {
 		return NULL;
 	}
 
-	return realloc(ptr, size);
+	memcpy(new_ptr, ptr, (block->size < size) ? block->size : size);
+	dukky_arena_free(&heap->arena, ptr);
+
+	return new_ptr;
 }
 
 
 static void dukky_free_function(void *udata, void *ptr)
 {
+	jsheap *heap = udata;
+
 	if (ptr != NULL)
-		free(ptr);
+		dukky_arena_free(&heap->arena, ptr);
 }
 
-/* exported interface documented in js.h */
-void js_initialise(void)
+/* Compiled script cache */
+
+/**
+ * Compute the hash of a compiled script cache key
+ *
+ * \param key  The key to hash
+ * \return The hash of the key
+ */
+static uint32_t
+dukky_bytecode_key_compute_hash(const struct dukky_bytecode_key *key)
 {
-	/** TODO: Forces JS on for our testing, needs changing before a release
-	 * lest we incur the wrath of others.
-	 */
-	/* Disabled force-on for forthcoming release */
-	/* nsoption_set_bool(enable_javascript, true);
-	 */
-	javascript_init();
+	uint32_t hash = 0x811c9dc5;
+	const unsigned char *c;
+	size_t i;
+
+	for (c = (const unsigned char *)key->name; *c != '\0'; c++) {
+		hash = (hash ^ *c) * 0x01000193;
+	}
+	for (i = 0; i < key->length; i++) {
+		hash = (hash ^ key->source[i]) * 0x01000193;
+	}
+
+	return hash;
 }
 
+static uint32_t dukky_bytecode_key_hash(void *key)
+{
+	return ((struct dukky_bytecode_key *)key)->hash;
+}
 
-/* exported interface documented in js.h */
-void js_finalise(void)
+static bool dukky_bytecode_key_eq(void *a, void *b)
 {
-	/* NADA for now */
+	struct dukky_bytecode_key *ka = a;
+	struct dukky_bytecode_key *kb = b;
+
+	return ka->hash == kb->hash &&
+		ka->length == kb->length &&
+		strcmp(ka->name, kb->name) == 0 &&
+		memcmp(ka->source, kb->source, ka->length) == 0;
 }
 
+/**
+ * Clone a compiled script cache key
+ *
+ * The key, its name and its source are copied into a single allocation.
+ */
+static void *dukky_bytecode_key_clone(void *key)
+{
+	struct dukky_bytecode_key *k = key;
+	struct dukky_bytecode_key *clone;
+	size_t name_len = strlen(k->name) + 1;
 
-/* exported interface documented in js.h */
-nserror
-js_newheap(int timeout, jsheap **heap)
+	clone = malloc(sizeof(*clone) + name_len + k->length);
+	if (clone == NULL) {
+		return NULL;
+	}
+
+	*clone = *k;
+	clone->name = (char *)(clone + 1);
+	memcpy((char *)clone->name, k->name, name_len);
+	clone->source = (uint8_t *)(clone + 1) + name_len;
+	memcpy((uint8_t *)clone->source, k->source, k->length);
+
+	return clone;
+}
+
+static void dukky_bytecode_key_destroy(void *key)
+{
+	free(key);
+}
+
+static void *dukky_bytecode_value_alloc(void *key)
+{
+	struct dukky_bytecode_entry *entry;
+
+	entry = calloc(1, sizeof(*entry));
+	if (entry == NULL) {
+		return NULL;
+	}
+
+	entry->key = key;
+
+	return entry;
+}
+
+static void dukky_bytecode_value_destroy(void *value)
+{
+	struct dukky_bytecode_entry *entry = value;
+
+	if (entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	} else if (dukky_bytecode_cache.head == entry) {
+		dukky_bytecode_cache.head = entry->next;
+	}
+
+	if (entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	} else if (dukky_bytecode_cache.tail == entry) {
+		dukky_bytecode_cache.tail = entry->prev;
+	}
+
+	dukky_bytecode_cache.size -= entry->footprint;
+
+	free(entry->bytecode);
+	free(entry);
+}
+
+static hashmap_parameters_t dukky_bytecode_cache_params = {
+	.key_clone = dukky_bytecode_key_clone,
+	.key_hash = dukky_bytecode_key_hash,
+	.key_eq = dukky_bytecode_key_eq,
+	.key_destroy = dukky_bytecode_key_destroy,
+	.value_alloc = dukky_bytecode_value_alloc,
+	.value_destroy = dukky_bytecode_value_destroy,
+};
+
+/**
+ * Make a compiled script cache entry the most recently used
+ *
+ * \param entry  The entry to move, which may not yet be in the list
+ */
+static void dukky_bytecode_cache_touch(struct dukky_bytecode_entry *entry)
+{
+	if (dukky_bytecode_cache.head == entry) {
+		return;
+	}
+
+	/* unlink */
+	if (entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	}
+	if (entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	} else if (dukky_bytecode_cache.tail == entry) {
+		dukky_bytecode_cache.tail = entry->prev;
+	}
+
+	/* and link at head */
+	entry->prev = NULL;
+	entry->next = dukky_bytecode_cache.head;
+	if (dukky_bytecode_cache.head != NULL) {
+		dukky_bytecode_cache.head->prev = entry;
+	}
+	dukky_bytecode_cache.head = entry;
+	if (dukky_bytecode_cache.tail == NULL) {
+		dukky_bytecode_cache.tail = entry;
+	}
+}
+
+/**
+ * Add a compiled script to the cache
+ *
+ * \param key       The name and source the script was compiled from
+ * \param bytecode  The dumped compiled function
+ * \param size      The size of bytecode
+ */
+static void
+dukky_bytecode_cache_insert(struct dukky_bytecode_key *key,
+			    const void *bytecode,
+			    size_t size)
+{
+	struct dukky_bytecode_entry *entry;
+	size_t footprint = key->length + size;
+	void *copy;
+
+	/* Don't let one script displace everything else */
+	if (footprint > DUKKY_BYTECODE_CACHE_SIZE / 4) {
+		return;
+	}
+
+	if (dukky_bytecode_cache.map == NULL) {
+		dukky_bytecode_cache.map = hashmap_create(
+				&dukky_bytecode_cache_params);
+		if (dukky_bytecode_cache.map == NULL) {
+			return;
+		}
+	}
+
+	copy = malloc(size);
+	if (copy == NULL) {
+		return;
+	}
+	memcpy(copy, bytecode, size);
+
+	entry = hashmap_insert(dukky_bytecode_cache.map, key);
+	if (entry == NULL) {
+		free(copy);
+		return;
+	}
+
+	entry->bytecode = copy;
+	entry->size = size;
+	entry->footprint = footprint;
+	dukky_bytecode_cache.size += footprint;
+	dukky_bytecode_cache_touch(entry);
+
+	while (dukky_bytecode_cache.size > DUKKY_BYTECODE_CACHE_SIZE &&
+	       dukky_bytecode_cache.tail != entry) {
+		hashmap_remove(dukky_bytecode_cache.map,
+			       dukky_bytecode_cache.tail->key);
+	}
+}
+
+/**
+ * Discard all compiled scripts
+ */
+static void dukky_bytecode_cache_flush(void)
+{
+	if (dukky_bytecode_cache.map != NULL) {
+		hashmap_destroy(dukky_bytecode_cache.map);
+		dukky_bytecode_cache.map = NULL;
+	}
+	dukky_bytecode_cache.head = NULL;
+	dukky_bytecode_cache.tail = NULL;
+	dukky_bytecode_cache.size = 0;
+}
+
+static duk_ret_t dukky_bytecode_dump(duk_context *ctx, void *udata)
+{
+	/* ... func */
+	duk_dump_function(ctx);
+	/* ... bytecode */
+	return 1;
+}
+
+static duk_ret_t dukky_bytecode_load(duk_context *ctx, void *udata)
+{
+	struct dukky_bytecode_entry *entry = udata;
+	void *buf;
+
+	buf = duk_push_fixed_buffer(ctx, entry->size);
+	memcpy(buf, entry->bytecode, entry->size);
+	/* ... bytecode */
+	duk_load_function(ctx);
+	/* ... func */
+	return 1;
+}
+
+/**
+ * Compile eval code, reusing the compiled function for the same script
+ *
+ * This behaves as duk_pcompile_lstring_filename() with DUK_COMPILE_EVAL;
+ * the file name is on the top of the stack and is replaced by the
+ * compiled function or by an error.
+ *
+ * \param ctx     The duktape context
+ * \param source  The script source
+ * \param length  The length of source in bytes
+ * \return 0 on success, or non-zero on error
+ */
+static duk_int_t
+dukky_pcompile_cached(duk_context *ctx, const uint8_t *source, size_t length)
+{
+	struct dukky_bytecode_key key;
+	struct dukky_bytecode_entry *entry;
+	duk_size_t size;
+	void *bytecode;
+
+	key.name = duk_get_string(ctx, -1);
+	if (length < DUKKY_BYTECODE_MIN_LENGTH || key.name == NULL) {
+		return duk_pcompile_lstring_filename(ctx, DUK_COMPILE_EVAL,
+				(const char *)source, length);
+	}
+	key.source = source;
+	key.length = length;
+	key.hash = dukky_bytecode_key_compute_hash(&key);
+
+	/* ..., name */
+	if (dukky_bytecode_cache.map != NULL) {
+		entry = hashmap_lookup(dukky_bytecode_cache.map, &key);
+		if (entry != NULL) {
+			if (duk_safe_call(ctx, dukky_bytecode_load,
+					  entry, 0, 1) == 0) {
+				/* ..., name, func */
+				duk_remove(ctx, -2);
+				/* ..., func */
+				dukky_bytecode_cache_touch(entry);
+				NSLOG(dukky, DEEPDEBUG,
+				      "Reused compiled %s", key.name);
+				return 0;
+			}
+			/* ..., name, err */
+			duk_pop(ctx);
+			hashmap_remove(dukky_bytecode_cache.map, entry->key);
+		}
+	}
+
+	/* The name is kept on the stack while the key refers to it */
+	duk_dup_top(ctx);
+	/* ..., name, name */
+	if (duk_pcompile_lstring_filename(ctx, DUK_COMPILE_EVAL,
+					  (const char *)source, length) != 0) {
+		/* ..., name, err */
+		duk_remove(ctx, -2);
+		return 1;
+	}
+
+	/* ..., name, func */
+	duk_dup_top(ctx);
+	if (duk_safe_call(ctx, dukky_bytecode_dump, NULL, 1, 1) == 0) {
+		/* ..., name, func, bytecode */
+		bytecode = duk_get_buffer(ctx, -1, &size);
+		if (bytecode != NULL) {
+			dukky_bytecode_cache_insert(&key, bytecode, size);
+		}
+	}
+	duk_pop(ctx);
+	/* ..., name, func */
+	duk_remove(ctx, -2);
+	/* ..., func */
+
+	return 0;
+}
+
+
+/**
+ * Create a heap, with its prototypes
+ *
+ * \param heap_out  Updated to the new heap
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror dukky_createheap(jsheap **heap_out)
 {
 	duk_context *ctx;
+	uint64_t ms_before, ms_after;
 	jsheap *ret = calloc(1, sizeof(*ret));
-	*heap = NULL;
+	*heap_out = NULL;
 	NSLOG(dukky, DEBUG, "Creating new duktape javascript heap");
 	if (ret == NULL) return NSERROR_NOMEM;
+	(void) nsu_getmonotonic_ms(&ms_before);
 	ctx = ret->ctx = duk_create_heap(
 		dukky_alloc_function,
 		dukky_realloc_function,
 		dukky_free_function,
 		ret,
 		NULL);
-	if (ret->ctx == NULL) { free(ret); return NSERROR_NOMEM; }
+	if (ret->ctx == NULL) {
+		dukky_arena_fini(&ret->arena);
+		free(ret);
+		return NSERROR_NOMEM;
+	}
 	/* Create the prototype stuffs */
 	duk_push_global_object(ctx);
 	duk_push_boolean(ctx, true);
@@ -619,8 +1174,12 @@ js_newheap(int timeout, jsheap **heap)
 	/* Now create the thread map */
 	duk_push_object(ctx);
 	duk_put_global_string(ctx, THREAD_MAP);
+	(void) nsu_getmonotonic_ms(&ms_after);
 
-	*heap = ret;
+	NSLOG(dukky, INFO, "Created javascript heap %p in %"PRIu64"ms, %"PRIsizet" bytes",
+	      ret, ms_after - ms_before, ret->arena.current);
+
+	*heap_out = ret;
 	return NSERROR_OK;
 }
 
@@ -630,10 +1189,97 @@ static void dukky_destroyheap(jsheap *heap)
 	assert(heap->pending_destroy == true);
 	assert(heap->live_threads == 0);
 	NSLOG(dukky, DEBUG, "Destroying duktape javascript context");
+	NSLOG(dukky, INFO, "Destroying javascript heap %p, peak %"PRIsizet" bytes",
+	      heap, heap->arena.peak);
 	duk_destroy_heap(heap->ctx);
+	dukky_arena_fini(&heap->arena);
 	free(heap);
 }
 
+
+/**
+ * Fill the pool of ready made heaps
+ *
+ * Run from the scheduler, so heaps are made ahead of, rather than
+ * during, the creation of browsing contexts. Filling stops if a heap
+ * cannot be made and resumes when a heap is next requested.
+ *
+ * \param p  Unused
+ */
+static void dukky_heap_pool_fill(void *p)
+{
+	jsheap *heap;
+
+	if (!nsoption_bool(enable_javascript)) {
+		return;
+	}
+
+	if (dukky_heap_pool.count >= DUKKY_HEAP_POOL_SIZE) {
+		return;
+	}
+
+	if (dukky_createheap(&heap) != NSERROR_OK) {
+		/* The next js_newheap() tries again */
+		NSLOG(dukky, INFO, "Unable to fill javascript heap pool");
+		return;
+	}
+	dukky_heap_pool.heap[dukky_heap_pool.count++] = heap;
+
+	/* One heap at a time, to keep each callback short */
+	if (dukky_heap_pool.count < DUKKY_HEAP_POOL_SIZE) {
+		guit->misc->schedule(0, dukky_heap_pool_fill, NULL);
+	}
+}
+
+
+/* exported interface documented in js.h */
+void js_initialise(void)
+{
+	/** TODO: Forces JS on for our testing, needs changing before a release
+	 * lest we incur the wrath of others.
+	 */
+	/* Disabled force-on for forthcoming release */
+	/* nsoption_set_bool(enable_javascript, true);
+	 */
+	javascript_init();
+
+	guit->misc->schedule(0, dukky_heap_pool_fill, NULL);
+}
+
+
+/* exported interface documented in js.h */
+void js_finalise(void)
+{
+	guit->misc->schedule(-1, dukky_heap_pool_fill, NULL);
+
+	while (dukky_heap_pool.count > 0) {
+		jsheap *heap = dukky_heap_pool.heap[--dukky_heap_pool.count];
+		heap->pending_destroy = true;
+		dukky_destroyheap(heap);
+	}
+
+	dukky_bytecode_cache_flush();
+}
+
+
+/* exported interface documented in js.h */
+nserror
+js_newheap(int timeout, jsheap **heap)
+{
+	/* Pooled heaps have never run any script, so are as new */
+	if (dukky_heap_pool.count > 0) {
+		*heap = dukky_heap_pool.heap[--dukky_heap_pool.count];
+		NSLOG(dukky, DEBUG, "Using pooled javascript heap %p", *heap);
+		guit->misc->schedule(0, dukky_heap_pool_fill, NULL);
+		return NSERROR_OK;
+	}
+
+	guit->misc->schedule(0, dukky_heap_pool_fill, NULL);
+
+	return dukky_createheap(heap);
+}
+
+
 /* exported interface documented in js.h */
 void js_destroyheap(jsheap *heap)
 {
@@ -699,8 +1345,7 @@ nserror js_newthread(jsheap *heap, void *win_priv, void *doc_priv, jsthread **th
 	/* ... */
 	duk_push_string(CTX, "polyfill.js");
 	/* ..., polyfill.js */
-	if (duk_pcompile_lstring_filename(CTX, DUK_COMPILE_EVAL,
-					  (const char *)polyfill_js, polyfill_js_len) != 0) {
+	if (dukky_pcompile_cached(CTX, polyfill_js, polyfill_js_len) != 0) {
 		NSLOG(dukky, CRITICAL, "%s", duk_safe_to_string(CTX, -1));
 		NSLOG(dukky, CRITICAL, "Unable to compile polyfill.js, thread aborted");
 		js_destroythread(ret);
@@ -720,8 +1365,7 @@ nserror js_newthread(jsheap *heap, void *win_priv, void *doc_priv, jsthread **th
 	/* ... */
 	duk_push_string(CTX, "generics.js");
 	/* ..., generics.js */
-	if (duk_pcompile_lstring_filename(CTX, DUK_COMPILE_EVAL,
-					  (const char *)generics_js, generics_js_len) != 0) {
+	if (dukky_pcompile_cached(CTX, generics_js, generics_js_len) != 0) {
 		NSLOG(dukky, CRITICAL, "%s", duk_safe_to_string(CTX, -1));
 		NSLOG(dukky, CRITICAL, "Unable to compile generics.js, thread aborted");
 		js_destroythread(ret);
@@ -945,10 +1589,7 @@ js_exec(jsthread *thread, const uint8_t *txt, size_t txtlen, const char *name)
 	} else {
 		duk_push_string(CTX, "?unknown source?");
 	}
-	if (duk_pcompile_lstring_filename(CTX,
-					  DUK_COMPILE_EVAL,
-					  (const char *)txt,
-					  txtlen) != 0) {
+	if (dukky_pcompile_cached(CTX, txt, txtlen) != 0) {
 		NSLOG(dukky, DEBUG, "Failed to compile JavaScript input");
 		goto handle_error;
 	}
@@ -551,6 +551,7 @@ static nserror textplain_clone(const struct content *old, struct content **newc)
 	nserror error;
 	const uint8_t *data;
 	size_t size;
+	size_t offset;
 
 	text = calloc(1, sizeof(textplain_content));
 	if (text == NULL)
@@ -569,8 +570,10 @@ static nserror textplain_clone(const struct content *old, struct content **newc)
 		return error;
 	}
 
-	data = content__get_source_data(&text->base, &size);
-	if (size > 0) {
+	for (offset = 0;
+	     (data = content__get_source_chunk(&text->base,
+					       offset, &size)) != NULL;
+	     offset += size) {
 		if (textplain_process_data(&text->base,
 					   (const char *)data,
 					   size) == false) {
@@ -25,7 +25,9 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "netsurf/inttypes.h"
 #include "utils/http.h"
+#include "utils/hashmap.h"
 #include "utils/log.h"
 #include "utils/messages.h"
 #include "utils/ring.h"
@@ -36,7 +38,8 @@
 
 #include "content/mimesniff.h"
 #include "content/hlcache.h"
-// Note, this is *ONLY* so that we can abort cleanly during shutdown of the cache
+// Note, this is only so that we can abort cleanly during shutdown of the cache
+// and estimate the size of retained contents
 #include "content/content_protected.h"
 #include "content/content_factory.h"
 
@@ -75,6 +78,25 @@ struct hlcache_entry {
 
 	hlcache_entry *next;		/**< Next sibling */
 	hlcache_entry *prev;		/**< Previous sibling */
+
+	nsurl *url;			/**< Index key, or NULL if not indexed */
+	hlcache_entry *url_next;	/**< Next entry with the same URL */
+	hlcache_entry *url_prev;	/**< Previous entry with the same URL */
+
+	bool unused;			/**< Entry is on the unused list */
+	size_t retained_size;		/**< Size accounted while unused */
+	hlcache_entry *unused_next;	/**< Next more recently unused entry */
+	hlcache_entry *unused_prev;	/**< Previous less recently unused entry */
+};
+
+/**
+ * Content index bucket.
+ *
+ * Chains the shareable entries whose content was created from a
+ * low-level cache object with a given URL.
+ */
+struct hlcache_url_bucket {
+	hlcache_entry *entries; /**< Head of entries with this URL */
 };
 
 /** Current state of the cache.
@@ -87,12 +109,25 @@ struct hlcache_s {
 	/** List of cached content objects */
 	hlcache_entry *content_list;
 
+	/** Index of shareable content entries by low-level object URL */
+	hashmap_t *content_index;
+
+	/** Least recently unused entry without users */
+	hlcache_entry *unused_head;
+
+	/** Most recently unused entry without users */
+	hlcache_entry *unused_tail;
+
+	/** Total size of unused contents being retained */
+	size_t retained_size;
+
 	/** Ring of retrieval contexts */
 	hlcache_retrieval_ctx *retrieval_ctx_ring;
 
 	/* statistics */
 	unsigned int hit_count;
 	unsigned int miss_count;
+	unsigned int evict_count;
 };
 
 /** high level cache state */
@@ -104,24 +139,227 @@ static struct hlcache_s *hlcache = NULL;
  ******************************************************************************/
 
 
+/* Content index hashmap parameters
+ *
+ * Our hashmap has nsurl keys and hlcache_url_bucket values
+ */
+
+static bool
+hlcache_content_index_key_eq(void *key1, void *key2)
+{
+	return nsurl_compare((nsurl *)key1, (nsurl *)key2, NSURL_COMPLETE);
+}
+
+static void *
+hlcache_content_index_value_alloc(void *key)
+{
+	return calloc(1, sizeof(struct hlcache_url_bucket));
+}
+
+static void
+hlcache_content_index_value_destroy(void *value)
+{
+	free(value);
+}
+
+static hashmap_parameters_t hlcache_content_index_parameters = {
+	.key_clone = (hashmap_key_clone_t)nsurl_ref,
+	.key_destroy = (hashmap_key_destroy_t)nsurl_unref,
+	.key_hash = (hashmap_key_hash_t)nsurl_hash,
+	.key_eq = hlcache_content_index_key_eq,
+	.value_alloc = hlcache_content_index_value_alloc,
+	.value_destroy = hlcache_content_index_value_destroy,
+};
+
+/**
+ * Add a cache entry to the content list and index
+ *
+ * Only shareable contents are indexed as no other content can be
+ * found for reuse. An entry which cannot be indexed is still cached
+ * but will not be found by future retrievals.
+ *
+ * \param entry The entry to add.
+ */
+static void hlcache_entry_add(hlcache_entry *entry)
+{
+	struct hlcache_url_bucket *bucket;
+	nsurl *url;
+
+	entry->prev = NULL;
+	entry->next = hlcache->content_list;
+	if (hlcache->content_list != NULL)
+		hlcache->content_list->prev = entry;
+	hlcache->content_list = entry;
+
+	if (content_is_shareable(entry->content) == false)
+		return;
+
+	url = llcache_handle_get_url(content_get_llcache_handle(entry->content));
+	if (url == NULL)
+		return;
+
+	bucket = hashmap_lookup(hlcache->content_index, url);
+	if (bucket == NULL) {
+		bucket = hashmap_insert(hlcache->content_index, url);
+		if (bucket == NULL) {
+			NSLOG(netsurf, WARNING,
+			      "Unable to index content %p", entry->content);
+			return;
+		}
+	}
+
+	entry->url = nsurl_ref(url);
+	entry->url_prev = NULL;
+	entry->url_next = bucket->entries;
+	if (bucket->entries != NULL)
+		bucket->entries->url_prev = entry;
+	bucket->entries = entry;
+}
+
+/**
+ * Remove a cache entry from the content list and index
+ *
+ * \param entry The entry to remove.
+ */
+static void hlcache_entry_remove(hlcache_entry *entry)
+{
+	if (entry->prev == NULL)
+		hlcache->content_list = entry->next;
+	else
+		entry->prev->next = entry->next;
+
+	if (entry->next != NULL)
+		entry->next->prev = entry->prev;
+
+	if (entry->url != NULL) {
+		struct hlcache_url_bucket *bucket;
+
+		bucket = hashmap_lookup(hlcache->content_index, entry->url);
+		assert(bucket != NULL);
+
+		if (entry->url_prev == NULL)
+			bucket->entries = entry->url_next;
+		else
+			entry->url_prev->url_next = entry->url_next;
+
+		if (entry->url_next != NULL)
+			entry->url_next->url_prev = entry->url_prev;
+
+		if (bucket->entries == NULL)
+			hashmap_remove(hlcache->content_index, entry->url);
+
+		nsurl_unref(entry->url);
+		entry->url = NULL;
+	}
+}
+
+/**
+ * Compute the retained size of a content
+ *
+ * Handlers do not all estimate the size of their decoded data so the
+ * source size is included as a proxy for it.
+ *
+ * \param c The content to size.
+ * \return The size of the content in bytes.
+ */
+static size_t hlcache_content_size(struct content *c)
+{
+	size_t source_size = 0;
+
+	(void) content__get_source_data(c, &source_size);
+
+	return c->size + source_size;
+}
+
+/**
+ * Make an entry whose content has no users a candidate for retention
+ *
+ * \param entry The entry which has become unused.
+ */
+static void hlcache_entry_unused(hlcache_entry *entry)
+{
+	assert(entry->unused == false);
+
+	entry->unused = true;
+	entry->retained_size = hlcache_content_size(entry->content);
+	hlcache->retained_size += entry->retained_size;
+
+	entry->unused_next = NULL;
+	entry->unused_prev = hlcache->unused_tail;
+	if (hlcache->unused_tail != NULL)
+		hlcache->unused_tail->unused_next = entry;
+	else
+		hlcache->unused_head = entry;
+	hlcache->unused_tail = entry;
+}
+
+/**
+ * Remove an entry from the unused list
+ *
+ * \param entry The entry which is being used or destroyed.
+ */
+static void hlcache_entry_used(hlcache_entry *entry)
+{
+	if (entry->unused == false)
+		return;
+
+	if (entry->unused_prev != NULL)
+		entry->unused_prev->unused_next = entry->unused_next;
+	else
+		hlcache->unused_head = entry->unused_next;
+
+	if (entry->unused_next != NULL)
+		entry->unused_next->unused_prev = entry->unused_prev;
+	else
+		hlcache->unused_tail = entry->unused_prev;
+
+	entry->unused_next = entry->unused_prev = NULL;
+
+	hlcache->retained_size -= entry->retained_size;
+	entry->retained_size = 0;
+	entry->unused = false;
+}
+
+/**
+ * Determine if an unused entry is worth retaining for reuse
+ *
+ * \param entry The unused entry to consider.
+ * \return true if the content may be reused by a later retrieval.
+ */
+static bool hlcache_entry_is_reusable(hlcache_entry *entry)
+{
+	if (entry->url == NULL)
+		return false;
+
+	if (content__get_status(entry->content) == CONTENT_STATUS_ERROR)
+		return false;
+
+	return llcache_handle_is_fresh(
+			content_get_llcache_handle(entry->content));
+}
+
 /**
  * Attempt to clean the cache
+ *
+ * Unused contents are considered from least to most recently used.
+ * Contents which cannot be reused are destroyed while fresh shareable
+ * contents are retained until their total size exceeds the
+ * configured limit.
  */
 static void hlcache_clean(void *force_clean_flag)
 {
 	hlcache_entry *entry, *next;
 	bool force_clean = (force_clean_flag != NULL);
 
-	for (entry = hlcache->content_list; entry != NULL; entry = next) {
-		next = entry->next;
-
-		if (entry->content == NULL)
-			continue;
+	for (entry = hlcache->unused_head; entry != NULL; entry = next) {
+		next = entry->unused_next;
 
-		if (content_count_users(entry->content) != 0)
+		if (content_count_users(entry->content) != 0) {
+			hlcache_entry_used(entry);
 			continue;
+		}
 
-		if (content__get_status(entry->content) == CONTENT_STATUS_LOADING) {
+		if (content__is_loading(entry->content)) {
 			if (force_clean == false)
 				continue;
 			NSLOG(netsurf, DEBUG, "Forcing content cleanup during shutdown");
@@ -129,21 +367,17 @@ static void hlcache_clean(void *force_clean_flag)
 			content_set_error(entry->content);
 		}
 
-		/** \todo This is over-zealous: all unused contents
-		 * will be immediately destroyed. Ideally, we want to
-		 * purge all unused contents that are using stale
-		 * source data, and enough fresh contents such that
-		 * the cache fits in the configured cache size limit.
-		 */
+		if ((force_clean == false) &&
+		    (hlcache->retained_size <= hlcache->params.limit) &&
+		    hlcache_entry_is_reusable(entry))
+			continue;
 
-		/* Remove entry from cache */
-		if (entry->prev == NULL)
-			hlcache->content_list = entry->next;
-		else
-			entry->prev->next = entry->next;
+		if (hlcache_entry_is_reusable(entry))
+			hlcache->evict_count++;
 
-		if (entry->next != NULL)
-			entry->next->prev = entry->prev;
+		/* Remove entry from cache */
+		hlcache_entry_used(entry);
+		hlcache_entry_remove(entry);
 
 		/* Destroy content */
 		content_destroy(entry->content);
@@ -152,6 +386,10 @@ static void hlcache_clean(void *force_clean_flag)
 		free(entry);
 	}
 
+	NSLOG(netsurf, DEEPDEBUG,
+	      "Retaining %"PRIsizet" bytes of unused contents (limit %"PRIsizet")",
+	      hlcache->retained_size, hlcache->params.limit);
+
 	/* Attempt to clean the llcache */
 	llcache_clean(false);
 
@@ -228,22 +466,20 @@ static nserror hlcache_find_content(hlcache_retrieval_ctx *ctx,
 	hlcache_event event;
 	nserror error = NSERROR_OK;
 
-	/* Search list of cached contents for a suitable one */
-	for (entry = hlcache->content_list; entry != NULL; entry = entry->next) {
+	struct hlcache_url_bucket *bucket;
+
+	/* Search indexed contents for the low-level object */
+	bucket = hashmap_lookup(hlcache->content_index,
+				llcache_handle_get_url(ctx->llcache));
+	entry = (bucket != NULL) ? bucket->entries : NULL;
+	for (; entry != NULL; entry = entry->url_next) {
 		hlcache_handle entry_handle = { entry, NULL, NULL };
 		const llcache_handle *entry_llcache;
 
-		if (entry->content == NULL)
-			continue;
-
 		/* Ignore contents in the error state */
 		if (content_get_status(&entry_handle) == CONTENT_STATUS_ERROR)
 			continue;
 
-		/* Ensure that content is shareable */
-		if (content_is_shareable(entry->content) == false)
-			continue;
-
 		/* Ensure that quirks mode is acceptable */
 		if (content_matches_quirks(entry->content,
 				ctx->child.quirks) == false)
@@ -260,7 +496,7 @@ static nserror hlcache_find_content(hlcache_retrieval_ctx *ctx,
 
 	if (entry == NULL) {
 		/* No existing entry, so need to create one */
-		entry = malloc(sizeof(hlcache_entry));
+		entry = calloc(1, sizeof(hlcache_entry));
 		if (entry == NULL)
 			return NSERROR_NOMEM;
 
@@ -274,11 +510,7 @@ static nserror hlcache_find_content(hlcache_retrieval_ctx *ctx,
 		}
 
 		/* Insert into cache */
-		entry->prev = NULL;
-		entry->next = hlcache->content_list;
-		if (hlcache->content_list != NULL)
-			hlcache->content_list->prev = entry;
-		hlcache->content_list = entry;
+		hlcache_entry_add(entry);
 
 		/* Signal to caller that we created a content */
 		error = NSERROR_NEED_DATA;
@@ -288,12 +520,33 @@ static nserror hlcache_find_content(hlcache_retrieval_ctx *ctx,
 		/* Found a suitable content: no longer need low-level handle */
 		llcache_handle_release(ctx->llcache);
 		hlcache->hit_count++;
+
+		/* Content may have been retained without users */
+		hlcache_entry_used(entry);
 	}
 
 	/* Associate handle with content */
 	if (content_add_user(entry->content,
-			hlcache_content_callback, ctx->handle) == false)
+			hlcache_content_callback, ctx->handle) == false) {
+		if (error == NSERROR_NEED_DATA) {
+			/* Newly created content, which owns the
+			 * low-level handle: discard it */
+			hlcache_entry_remove(entry);
+			content_abort(entry->content);
+			content_destroy(entry->content);
+			free(entry);
+		} else {
+			/* Existing content without users: allow it to
+			 * be retained or cleaned */
+			if (content_count_users(entry->content) == 0)
+				hlcache_entry_unused(entry);
+		}
+
+		/* Low-level handle has been released either way */
+		ctx->llcache = NULL;
+
 		return NSERROR_NOMEM;
+	}
 
 	/* Associate cache entry with handle */
 	ctx->handle->entry = entry;
@@ -369,8 +622,10 @@ static nserror hlcache_migrate_ctx(hlcache_retrieval_ctx *ctx,
 						ctx->handle->pw);
 			}
 
-			llcache_handle_abort(ctx->llcache);
-			llcache_handle_release(ctx->llcache);
+			if (ctx->llcache != NULL) {
+				llcache_handle_abort(ctx->llcache);
+				llcache_handle_release(ctx->llcache);
+			}
 		}
 	} else if (type == CONTENT_NONE &&
 			(ctx->flags & HLCACHE_RETRIEVE_MAY_DOWNLOAD)) {
@@ -557,8 +812,16 @@ hlcache_initialise(const struct hlcache_parameters *hlcache_parameters)
 		return NSERROR_NOMEM;
 	}
 
+	hlcache->content_index = hashmap_create(&hlcache_content_index_parameters);
+	if (hlcache->content_index == NULL) {
+		free(hlcache);
+		hlcache = NULL;
+		return NSERROR_NOMEM;
+	}
+
 	ret = llcache_initialise(&hlcache_parameters->llcache);
 	if (ret != NSERROR_OK) {
+		hashmap_destroy(hlcache->content_index);
 		free(hlcache);
 		hlcache = NULL;
 		return ret;
@@ -659,12 +922,13 @@ void hlcache_finalise(void)
 		hlcache->retrieval_ctx_ring = NULL;
 	}
 
-	NSLOG(netsurf, INFO, "hit/miss %d/%d", hlcache->hit_count,
-	      hlcache->miss_count);
+	NSLOG(netsurf, INFO, "hit/miss/evict %d/%d/%d", hlcache->hit_count,
+	      hlcache->miss_count, hlcache->evict_count);
 
 	/* De-schedule ourselves */
 	guit->misc->schedule(-1, hlcache_clean, NULL);
 
+	hashmap_destroy(hlcache->content_index);
 	free(hlcache);
 	hlcache = NULL;
 
@@ -736,6 +1000,9 @@ nserror hlcache_handle_release(hlcache_handle *handle)
 	if (handle->entry != NULL) {
 		content_remove_user(handle->entry->content,
 				hlcache_content_callback, handle);
+
+		if (content_count_users(handle->entry->content) == 0)
+			hlcache_entry_unused(handle->entry);
 	} else {
 		RING_ITERATE_START(struct hlcache_retrieval_ctx,
 				   hlcache->retrieval_ctx_ring,
@@ -776,6 +1043,35 @@ struct content *hlcache_handle_get_content(const hlcache_handle *handle)
 	return NULL;
 }
 
+/* See hlcache.h for documentation */
+nserror hlcache_handle_set_priority(hlcache_handle *handle, uint32_t flags)
+{
+	struct hlcache_entry *entry = handle->entry;
+
+	if (entry == NULL) {
+		/* No content yet so use the retrieval context */
+		RING_ITERATE_START(struct hlcache_retrieval_ctx,
+				   hlcache->retrieval_ctx_ring,
+				   ictx) {
+			if (ictx->handle == handle &&
+					ictx->migrate_target == false) {
+				llcache_handle_set_priority(ictx->llcache,
+							    flags);
+				RING_ITERATE_STOP(hlcache->retrieval_ctx_ring,
+						ictx);
+			}
+		} RING_ITERATE_END(hlcache->retrieval_ctx_ring, ictx);
+
+		return NSERROR_OK;
+	}
+
+	if (entry->content->llcache == NULL) {
+		return NSERROR_OK;
+	}
+
+	return llcache_handle_set_priority(entry->content->llcache, flags);
+}
+
 /* See hlcache.h for documentation */
 nserror hlcache_handle_abort(hlcache_handle *handle)
 {
@@ -838,11 +1134,7 @@ nserror hlcache_handle_abort(hlcache_handle *handle)
 
 		entry->content = clone;
 		handle->entry = entry;
-		entry->prev = NULL;
-		entry->next = hlcache->content_list;
-		if (hlcache->content_list != NULL)
-			hlcache->content_list->prev = entry;
-		hlcache->content_list = entry;
+		hlcache_entry_add(entry);
 
 		c = clone;
 	}
@@ -49,6 +49,9 @@ struct hlcache_parameters {
 	/** How frequently the background cache clean process is run (ms) */
 	unsigned int bg_clean_time;
 
+	/** Upper bound of the size of unused contents retained for reuse */
+	size_t limit;
+
 	struct llcache_parameters llcache;
 };
 
@@ -138,6 +141,16 @@ nserror hlcache_handle_release(hlcache_handle *handle);
  */
 nserror hlcache_handle_abort(hlcache_handle *handle);
 
+/**
+ * Change the fetch priority of a high-level cache handle
+ *
+ * \param handle  Handle to change priority of
+ * \param flags   Retrieval flags holding the new priority, see
+ *                ::llcache_handle_set_priority
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+nserror hlcache_handle_set_priority(hlcache_handle *handle, uint32_t flags);
+
 /**
  * Replace a high-level cache handle's callback
  *
@@ -47,6 +47,8 @@
 #include "utils/utils.h"
 #include "utils/time.h"
 #include "utils/http.h"
+#include "utils/hashmap.h"
+#include "utils/perf.h"
 #include "netsurf/misc.h"
 #include "desktop/gui_internal.h"
 
@@ -54,6 +56,11 @@
 #include "content/backing_store.h"
 #include "content/urldb.h"
 
+/**
+ * Define to cross check URL index lookups against a full cache list scan
+ */
+#undef LLCACHE_INDEX_DEBUG
+
 /**
  * State of a low-level cache object fetch.
  */
@@ -118,6 +125,8 @@ typedef struct {
 	bool tried_with_tls_downgrade;	/**< Whether we've tried TLS <= 1.0 */
 
 	bool tainted_tls;		/**< Whether the TLS transport is tainted */
+
+	uint64_t perf_start;		/**< Measured fetch start time */
 } llcache_fetch_ctx;
 
 /**
@@ -154,6 +163,47 @@ typedef struct {
 	char *value;		/**< Header value */
 } llcache_header;
 
+/**
+ * Eviction heaps.
+ *
+ * Unused cached objects are held in a heap ordered by the time they
+ * become stale and a heap ordered by the eviction policy priority.
+ */
+enum llcache_heap_type {
+	LLCACHE_HEAP_EXPIRY = 0, /**< Ordered by freshness expiry time */
+	LLCACHE_HEAP_EVICT, /**< Ordered by eviction policy priority */
+
+	LLCACHE_HEAP_COUNT /**< Number of eviction heaps */
+};
+
+/** Eviction heap of unused objects */
+struct llcache_heap {
+	struct llcache_object **entries; /**< Heap ordered object array */
+	size_t count; /**< Number of objects in the heap */
+	size_t alloc; /**< Allocated size of object array */
+};
+
+/** Number of rows in the eviction frequency sketch */
+#define LLCACHE_SKETCH_DEPTH 4
+
+/** Number of counters in each frequency sketch row, must be a power of 2 */
+#define LLCACHE_SKETCH_WIDTH 4096
+
+/** Number of frequency sketch increments after which counters are halved */
+#define LLCACHE_SKETCH_SAMPLE (LLCACHE_SKETCH_WIDTH * 10)
+
+/** Minimum allocation step for object source data buffers */
+#define LLCACHE_SOURCE_MIN_GROWTH (64 * 1024)
+
+/** Maximum allocation step for object source data buffers */
+#define LLCACHE_SOURCE_MAX_GROWTH (16 * 1024 * 1024)
+
+/** Relative cost of refetching an object from the backing store */
+#define LLCACHE_COST_DISC 5
+
+/** Relative cost of refetching an object over the network */
+#define LLCACHE_COST_NETWORK 100
+
 /** Current status of an object's data */
 typedef enum {
 	LLCACHE_STATE_RAM = 0, /**< source data is stored in RAM only */
@@ -169,6 +219,9 @@ struct llcache_object {
 	llcache_object *prev;	     /**< Previous in list */
 	llcache_object *next;	     /**< Next in list */
 
+	llcache_object *url_prev;    /**< Previous in URL index bucket */
+	llcache_object *url_next;    /**< Next in URL index bucket */
+
 	nsurl *url;		     /**< Post-redirect URL for object */
 
 	/** \todo We need a generic dynamic buffer object */
@@ -195,6 +248,18 @@ struct llcache_object {
 	llcache_header *headers;     /**< Fetch headers */
 	size_t num_headers;	     /**< Number of fetch headers */
 
+	/* Eviction state. */
+	llcache_object **list;	     /**< List the object is on or NULL */
+	uint32_t accounted_size;     /**< Size included in cache total */
+	uint32_t hits;		     /**< Number of times a user was added */
+	uint64_t access;	     /**< Cache clock at last use */
+	size_t heap_index[LLCACHE_HEAP_COUNT]; /**< One based position in
+						* each eviction heap or
+						* zero if not present
+						*/
+	double heap_key[LLCACHE_HEAP_COUNT]; /**< Key in each eviction heap */
+	llcache_object *evict_next;  /**< Next in deferred eviction list */
+
 	/* Instrumentation. These elements are strictly for information
 	 * to improve the cache performance and to provide performance
 	 * metrics. The values are non-authoritative and must not be used to
@@ -213,6 +278,9 @@ struct llcache_s {
 	/** Head of the low-level uncached object list */
 	llcache_object *uncached_objects;
 
+	/** Index of cached objects by URL */
+	hashmap_t *url_index;
+
 	/** The target upper bound for the RAM cache size */
 	uint32_t limit;
 
@@ -223,6 +291,43 @@ struct llcache_s {
 	bool all_caught_up;
 
 
+	/* memory eviction elements */
+
+
+	/** Total size of all objects on the cache lists */
+	uint64_t total_size;
+
+	/** The eviction policy in use */
+	const struct llcache_evict_policy_table *policy;
+
+	/** Heaps of unused cached objects */
+	struct llcache_heap heap[LLCACHE_HEAP_COUNT];
+
+	/** Logical clock advanced every time an object is used */
+	uint64_t clock;
+
+	/** GDSF inflation value, the priority of the last eviction */
+	double inflation;
+
+	/** Count-min frequency sketch of object use */
+	uint8_t sketch[LLCACHE_SKETCH_DEPTH][LLCACHE_SKETCH_WIDTH];
+
+	/** Sketch increments since counters were last halved */
+	uint32_t sketch_count;
+
+	/** Number of fresh objects returned from the cache */
+	uint64_t hit_count;
+
+	/** Number of cached objects requiring revalidation */
+	uint64_t revalidate_count;
+
+	/** Number of retrievals not present in the memory cache */
+	uint64_t miss_count;
+
+	/** Number of objects evicted to satisfy the size limit */
+	uint64_t evict_count;
+
+
 	/* backing store elements */
 
 
@@ -271,6 +376,11 @@ static void llcache_fetch_callback(const fetch_msg *msg, void *p);
 /* forward referenced catch up function */
 static void llcache_users_not_caught_up(void);
 
+/* forward referenced eviction functions */
+static void llcache_evict_add(llcache_object *object);
+static void llcache_evict_remove(llcache_object *object);
+static void llcache_evict_access(llcache_object *object);
+
 
 /******************************************************************************
  * Low-level cache internals						      *
@@ -366,6 +476,11 @@ static nserror llcache_object_remove_user(llcache_object *object,
 	/* record the time the last user was removed from the object */
 	if (object->users == NULL) {
 		object->last_used = time(NULL);
+
+		/* unused cached objects become eviction candidates */
+		if (object->list == &llcache->cached_objects) {
+			llcache_evict_add(object);
+		}
 	}
 
 	NSLOG(llcache, DEBUG, "Removing user %p from %p", user, object);
@@ -806,6 +921,41 @@ static nserror llcache_fetch_process_header(llcache_object *object,
 	return NSERROR_OK;
 }
 
+/**
+ * Determine the fetch priority held in retrieval flags
+ *
+ * \param flags Retrieval flags
+ * \return The fetch priority
+ */
+static fetch_priority llcache_flags_priority(uint32_t flags)
+{
+	if ((flags & LLCACHE_RETRIEVE_PRIORITY_BLOCKING) != 0) {
+		return FETCH_PRIORITY_BLOCKING;
+	} else if ((flags & LLCACHE_RETRIEVE_PRIORITY_HIGH) != 0) {
+		return FETCH_PRIORITY_HIGH;
+	} else if ((flags & LLCACHE_RETRIEVE_PRIORITY_LOW) != 0) {
+		return FETCH_PRIORITY_LOW;
+	}
+	return FETCH_PRIORITY_NORMAL;
+}
+
+/**
+ * Change the fetch priority of an object
+ *
+ * \param object Object to change priority of
+ * \param flags Retrieval flags holding the new priority
+ */
+static void llcache_object_set_priority(llcache_object *object, uint32_t flags)
+{
+	object->fetch.flags &= ~LLCACHE_RETRIEVE_PRIORITY_MASK;
+	object->fetch.flags |= (flags & LLCACHE_RETRIEVE_PRIORITY_MASK);
+
+	if (object->fetch.fetch != NULL) {
+		fetch_set_priority(object->fetch.fetch,
+				   llcache_flags_priority(flags));
+	}
+}
+
 /**
  * (Re)fetch an object
  *
@@ -885,6 +1035,8 @@ static nserror llcache_object_refetch(llcache_object *object)
 
 	NSLOG(llcache, DEBUG, "Re-fetching %p", object);
 
+	object->fetch.perf_start = perf_begin();
+
 	/* Kick off fetch */
 	res = fetch_start(object->url,
 			  object->fetch.referer,
@@ -896,6 +1048,7 @@ static nserror llcache_object_refetch(llcache_object *object)
 			  object->fetch.flags & LLCACHE_RETRIEVE_VERIFIABLE,
 			  object->fetch.tried_with_tls_downgrade,
 			  (const char **)headers,
+			  llcache_flags_priority(object->fetch.flags),
 			  &object->fetch.fetch);
 
 	/* Clean up cache-control headers */
@@ -1013,9 +1166,220 @@ static nserror llcache_object_destroy(llcache_object *object)
 	return NSERROR_OK;
 }
 
+/**
+ * total ram usage of object
+ *
+ * \param object The object to calculate the total RAM usage of.
+ * \return The total RAM usage in bytes.
+ */
+static inline uint32_t
+total_object_size(llcache_object *object)
+{
+	uint32_t tot;
+	size_t hdrc;
+
+	tot = sizeof(*object);
+	tot += nsurl_length(object->url);
+
+	if (object->source_data != NULL) {
+		tot += object->source_len;
+	}
+
+	tot += sizeof(llcache_header) * object->num_headers;
+
+	for (hdrc = 0; hdrc < object->num_headers; hdrc++) {
+		if (object->headers[hdrc].name != NULL) {
+			tot += strlen(object->headers[hdrc].name);
+		}
+		if (object->headers[hdrc].value != NULL) {
+			tot += strlen(object->headers[hdrc].value);
+		}
+	}
+
+	tot += cert_chain_size(object->chain);
+
+	return tot;
+}
+
+/**
+ * Update the accounted size of an object in the cache total.
+ *
+ * \param object The object to update.
+ */
+static void llcache_object_update_size(llcache_object *object)
+{
+	uint32_t size;
+
+	if (object->list == NULL) {
+		return;
+	}
+
+	size = total_object_size(object);
+	llcache->total_size -= object->accounted_size;
+	llcache->total_size += size;
+	object->accounted_size = size;
+}
+
+/**
+ * URL index bucket.
+ *
+ * Holds every cached object with a given URL. Buckets are only as
+ * long as the number of simultaneous cached versions of a resource
+ * so they are expected to be very short.
+ */
+struct llcache_url_bucket {
+	llcache_object *objects; /**< Head of objects with this URL */
+};
+
+/* URL index hashmap parameters
+ *
+ * Our hashmap has nsurl keys and llcache_url_bucket values
+ */
+
+static bool
+llcache_url_index_key_eq(void *key1, void *key2)
+{
+	return nsurl_compare((nsurl *)key1, (nsurl *)key2, NSURL_COMPLETE);
+}
+
+static void *
+llcache_url_index_value_alloc(void *key)
+{
+	return calloc(1, sizeof(struct llcache_url_bucket));
+}
+
+static void
+llcache_url_index_value_destroy(void *value)
+{
+	free(value);
+}
+
+static hashmap_parameters_t llcache_url_index_parameters = {
+	.key_clone = (hashmap_key_clone_t)nsurl_ref,
+	.key_destroy = (hashmap_key_destroy_t)nsurl_unref,
+	.key_hash = (hashmap_key_hash_t)nsurl_hash,
+	.key_eq = llcache_url_index_key_eq,
+	.value_alloc = llcache_url_index_value_alloc,
+	.value_destroy = llcache_url_index_value_destroy,
+};
+
+/**
+ * Add a cached object to the URL index
+ *
+ * If the index entry cannot be allocated the object is left out of the
+ * index. This is safe as it merely causes the object to never be
+ * found by a cache lookup and be cleaned as usual.
+ *
+ * \param object Object to add
+ */
+static void llcache_url_index_add(llcache_object *object)
+{
+	struct llcache_url_bucket *bucket;
+
+	bucket = hashmap_lookup(llcache->url_index, object->url);
+	if (bucket == NULL) {
+		bucket = hashmap_insert(llcache->url_index, object->url);
+		if (bucket == NULL) {
+			NSLOG(llcache, WARNING,
+			      "Unable to index %p (%s)",
+			      object, nsurl_access(object->url));
+			return;
+		}
+	}
+
+	object->url_prev = NULL;
+	object->url_next = bucket->objects;
+	if (bucket->objects != NULL) {
+		bucket->objects->url_prev = object;
+	}
+	bucket->objects = object;
+}
+
+/**
+ * Remove a cached object from the URL index
+ *
+ * \param object Object to remove
+ */
+static void llcache_url_index_remove(llcache_object *object)
+{
+	struct llcache_url_bucket *bucket;
+
+	bucket = hashmap_lookup(llcache->url_index, object->url);
+	if (bucket == NULL) {
+		/* object was never indexed */
+		return;
+	}
+
+	if (object->url_prev != NULL) {
+		object->url_prev->url_next = object->url_next;
+	} else if (bucket->objects == object) {
+		bucket->objects = object->url_next;
+	} else {
+		/* object was never indexed */
+		return;
+	}
+
+	if (object->url_next != NULL) {
+		object->url_next->url_prev = object->url_prev;
+	}
+
+	object->url_prev = object->url_next = NULL;
+
+	if (bucket->objects == NULL) {
+		hashmap_remove(llcache->url_index, object->url);
+	}
+}
+
+/**
+ * Find the most recently requested cached object for a URL
+ *
+ * \param url The URL to find.
+ * \return The newest object with a matching URL or NULL if there is none.
+ */
+static llcache_object *llcache_url_index_find_newest(nsurl *url)
+{
+	struct llcache_url_bucket *bucket;
+	llcache_object *obj, *newest = NULL;
+
+	bucket = hashmap_lookup(llcache->url_index, url);
+	if (bucket == NULL) {
+		return NULL;
+	}
+
+	for (obj = bucket->objects; obj != NULL; obj = obj->url_next) {
+		if (newest == NULL ||
+		    obj->cache.req_time > newest->cache.req_time) {
+			newest = obj;
+		}
+	}
+
+#ifdef LLCACHE_INDEX_DEBUG
+	{
+		llcache_object *scan = NULL;
+
+		for (obj = llcache->cached_objects; obj != NULL; obj = obj->next) {
+			if ((scan == NULL ||
+			     obj->cache.req_time > scan->cache.req_time) &&
+			    nsurl_compare(obj->url, url,
+					  NSURL_COMPLETE) == true) {
+				scan = obj;
+			}
+		}
+
+		assert((scan == NULL) == (newest == NULL));
+		assert((scan == NULL) ||
+		       (scan->cache.req_time == newest->cache.req_time));
+	}
+#endif
+
+	return newest;
+}
+
 /**
  * Add a low-level cache object to a cache list
  *
+ * Objects added to the cached object list are also added to the URL index.
+ *
  * \param object  Object to add
  * \param list	  List to add to
  * \return NSERROR_OK
@@ -1030,6 +1394,17 @@ static nserror llcache_object_add_to_list(llcache_object *object,
 		(*list)->prev = object;
 	*list = object;
 
+	object->list = list;
+	llcache_object_update_size(object);
+
+	if (list == &llcache->cached_objects) {
+		llcache_url_index_add(object);
+
+		if (object->users == NULL) {
+			llcache_evict_add(object);
+		}
+	}
+
 	return NSERROR_OK;
 }
 
@@ -1078,31 +1453,467 @@ llcache_object_rfc2616_remaining_lifetime(const llcache_cache_control *cd)
 }
 
 /**
- * Determine if an object is still fresh
+ * Determine if an object is still fresh
+ *
+ * \param object  Object to consider
+ * \return True if object is still fresh, false otherwise
+ */
+static bool llcache_object_is_fresh(const llcache_object *object)
+{
+	int remaining_lifetime;
+	const llcache_cache_control *cd = &object->cache;
+
+	remaining_lifetime = llcache_object_rfc2616_remaining_lifetime(cd);
+
+	NSLOG(llcache, DEBUG, "%p: (%d > 0 || %d != %d)", object,
+	     remaining_lifetime,
+	     object->fetch.state, LLCACHE_FETCH_COMPLETE);
+
+	/* The object is fresh if:
+	 * - it was not forbidden from being returned from the cache
+	 *   unvalidated.
+	 *
+	 * - it has remaining lifetime or still being fetched.
+	 */
+	return ((cd->no_cache == LLCACHE_VALIDATE_FRESH) &&
+		((remaining_lifetime > 0) ||
+		 (object->fetch.state != LLCACHE_FETCH_COMPLETE)));
+}
+
+/**
+ * Determine if one object should be evicted before another.
+ *
+ * \param heap The heap being ordered.
+ * \param a The first object.
+ * \param b The second object.
+ * \return true if \a a orders before \a b in the heap.
+ */
+static inline bool
+llcache_heap_less(enum llcache_heap_type heap,
+		  const llcache_object *a,
+		  const llcache_object *b)
+{
+	if (a->heap_key[heap] != b->heap_key[heap]) {
+		return a->heap_key[heap] < b->heap_key[heap];
+	}
+	/* break ties by least recent use */
+	return a->access < b->access;
+}
+
+/**
+ * Place an object at a position in a heap.
+ *
+ * \param heap The heap to update.
+ * \param idx The zero based position to place the object at.
+ * \param object The object to place.
+ */
+static inline void
+llcache_heap_set(enum llcache_heap_type heap, size_t idx, llcache_object *object)
+{
+	llcache->heap[heap].entries[idx] = object;
+	object->heap_index[heap] = idx + 1;
+}
+
+/**
+ * Move a heap entry towards the root until the heap is ordered.
+ *
+ * \param heap The heap to update.
+ * \param idx The zero based position of the entry to move.
+ */
+static void llcache_heap_sift_up(enum llcache_heap_type heap, size_t idx)
+{
+	llcache_object **entries = llcache->heap[heap].entries;
+	llcache_object *object = entries[idx];
+
+	while (idx > 0) {
+		size_t parent = (idx - 1) / 2;
+
+		if (!llcache_heap_less(heap, object, entries[parent])) {
+			break;
+		}
+		llcache_heap_set(heap, idx, entries[parent]);
+		idx = parent;
+	}
+	llcache_heap_set(heap, idx, object);
+}
+
+/**
+ * Move a heap entry away from the root until the heap is ordered.
+ *
+ * \param heap The heap to update.
+ * \param idx The zero based position of the entry to move.
+ */
+static void llcache_heap_sift_down(enum llcache_heap_type heap, size_t idx)
+{
+	llcache_object **entries = llcache->heap[heap].entries;
+	size_t count = llcache->heap[heap].count;
+	llcache_object *object = entries[idx];
+
+	for (;;) {
+		size_t child = (idx * 2) + 1;
+
+		if (child >= count) {
+			break;
+		}
+		if ((child + 1 < count) &&
+		    llcache_heap_less(heap, entries[child + 1], entries[child])) {
+			child++;
+		}
+		if (!llcache_heap_less(heap, entries[child], object)) {
+			break;
+		}
+		llcache_heap_set(heap, idx, entries[child]);
+		idx = child;
+	}
+	llcache_heap_set(heap, idx, object);
+}
+
+/**
+ * Insert an object into a heap using its current key.
+ *
+ * \param heap The heap to insert into.
+ * \param object The object to insert.
+ * \return NSERROR_OK on success or NSERROR_NOMEM if the heap could not grow.
+ */
+static nserror
+llcache_heap_insert(enum llcache_heap_type heap, llcache_object *object)
+{
+	struct llcache_heap *h = &llcache->heap[heap];
+
+	assert(object->heap_index[heap] == 0);
+
+	if (h->count == h->alloc) {
+		size_t alloc = (h->alloc == 0) ? 64 : h->alloc * 2;
+		llcache_object **entries;
+
+		entries = realloc(h->entries, alloc * sizeof(*entries));
+		if (entries == NULL) {
+			return NSERROR_NOMEM;
+		}
+		h->entries = entries;
+		h->alloc = alloc;
+	}
+
+	h->entries[h->count] = object;
+	h->count++;
+	llcache_heap_sift_up(heap, h->count - 1);
+
+	return NSERROR_OK;
+}
+
+/**
+ * Remove an object from a heap if it is present.
+ *
+ * \param heap The heap to remove from.
+ * \param object The object to remove.
+ */
+static void llcache_heap_remove(enum llcache_heap_type heap, llcache_object *object)
+{
+	struct llcache_heap *h = &llcache->heap[heap];
+	llcache_object *last;
+	size_t idx;
+
+	if (object->heap_index[heap] == 0) {
+		return;
+	}
+
+	idx = object->heap_index[heap] - 1;
+	object->heap_index[heap] = 0;
+
+	h->count--;
+	if (idx == h->count) {
+		return;
+	}
+
+	/* fill the hole with the last entry and restore the ordering */
+	last = h->entries[h->count];
+	llcache_heap_set(heap, idx, last);
+	if ((idx > 0) &&
+	    llcache_heap_less(heap, last, h->entries[(idx - 1) / 2])) {
+		llcache_heap_sift_up(heap, idx);
+	} else {
+		llcache_heap_sift_down(heap, idx);
+	}
+}
+
+/**
+ * Get the object at the root of a heap.
+ *
+ * \param heap The heap to examine.
+ * \return The first object in the heap order or NULL if the heap is empty.
+ */
+static inline llcache_object *llcache_heap_peek(enum llcache_heap_type heap)
+{
+	if (llcache->heap[heap].count == 0) {
+		return NULL;
+	}
+	return llcache->heap[heap].entries[0];
+}
+
+/**
+ * Compute the frequency sketch counter index of a URL hash for a row.
+ *
+ * \param hash The URL hash.
+ * \param row The sketch row.
+ * \return The counter index within the row.
+ */
+static inline uint32_t llcache_sketch_index(uint32_t hash, unsigned int row)
+{
+	static const uint32_t seed[LLCACHE_SKETCH_DEPTH] = {
+		0x9e3779b1, 0x85ebca77, 0xc2b2ae3d, 0x27d4eb2f
+	};
+
+	hash *= seed[row];
+	hash ^= hash >> 16;
+
+	return hash & (LLCACHE_SKETCH_WIDTH - 1);
+}
+
+/**
+ * Estimate the use frequency of an object from the sketch.
+ *
+ * \param object The object to estimate.
+ * \return The estimated use frequency.
+ */
+static unsigned int llcache_sketch_estimate(const llcache_object *object)
+{
+	uint32_t hash = nsurl_hash(object->url);
+	unsigned int freq = UINT8_MAX;
+	unsigned int row;
+
+	for (row = 0; row < LLCACHE_SKETCH_DEPTH; row++) {
+		uint8_t count;
+		count = llcache->sketch[row][llcache_sketch_index(hash, row)];
+		if (count < freq) {
+			freq = count;
+		}
+	}
+
+	return freq;
+}
+
+/**
+ * Record a use of an object in the frequency sketch.
+ *
+ * Only the smallest counters are incremented (conservative update) and
+ * every ::LLCACHE_SKETCH_SAMPLE increments all counters are halved so
+ * the frequency of historic use decays.
+ *
+ * \param object The object which was used.
+ */
+static void llcache_sketch_increment(const llcache_object *object)
+{
+	uint32_t hash = nsurl_hash(object->url);
+	unsigned int freq = llcache_sketch_estimate(object);
+	unsigned int row;
+	unsigned int col;
+
+	if (freq == UINT8_MAX) {
+		return;
+	}
+
+	for (row = 0; row < LLCACHE_SKETCH_DEPTH; row++) {
+		uint8_t *count;
+		count = &llcache->sketch[row][llcache_sketch_index(hash, row)];
+		if (*count == freq) {
+			(*count)++;
+		}
+	}
+
+	llcache->sketch_count++;
+	if (llcache->sketch_count >= LLCACHE_SKETCH_SAMPLE) {
+		for (row = 0; row < LLCACHE_SKETCH_DEPTH; row++) {
+			for (col = 0; col < LLCACHE_SKETCH_WIDTH; col++) {
+				llcache->sketch[row][col] >>= 1;
+			}
+		}
+		llcache->sketch_count = 0;
+	}
+}
+
+/**
+ * Estimate the relative cost of refetching an object if it is evicted.
+ *
+ * \param object The object to cost.
+ * \return The relative refetch cost.
+ */
+static double llcache_object_refetch_cost(const llcache_object *object)
+{
+	double fetch_time;
+
+	if (object->store_state == LLCACHE_STATE_DISC) {
+		return LLCACHE_COST_DISC;
+	}
+
+	/* network fetches cost more the longer they took */
+	fetch_time = difftime(object->cache.fin_time, object->cache.req_time);
+	if (fetch_time < 0) {
+		fetch_time = 0;
+	}
+
+	return LLCACHE_COST_NETWORK * (1 + fetch_time);
+}
+
+/**
+ * LRU eviction priority, objects are ordered purely by last use.
+ */
+static double llcache_evict_lru_priority(const llcache_object *object)
+{
+	return 0;
+}
+
+/**
+ * TinyLFU eviction priority, the sketch estimated use frequency.
+ */
+static double llcache_evict_tinylfu_priority(const llcache_object *object)
+{
+	return llcache_sketch_estimate(object);
+}
+
+/**
+ * TinyLFU use tracking.
+ */
+static void llcache_evict_tinylfu_access(const llcache_object *object)
+{
+	llcache_sketch_increment(object);
+}
+
+/**
+ * GDSF eviction priority.
+ *
+ * The priority is the frequency multiplied by the refetch cost per
+ * byte, offset by the inflation value so objects which have been in
+ * the cache for a long time without use are eventually evicted.
+ */
+static double llcache_evict_gdsf_priority(const llcache_object *object)
+{
+	uint32_t size = total_object_size((llcache_object *)object);
+
+	return llcache->inflation +
+		(((double)object->hits *
+		  llcache_object_refetch_cost(object)) / size);
+}
+
+/**
+ * GDSF eviction, raises the inflation value to the evicted priority.
+ */
+static void llcache_evict_gdsf_evicted(const llcache_object *object)
+{
+	if (object->heap_key[LLCACHE_HEAP_EVICT] > llcache->inflation) {
+		llcache->inflation = object->heap_key[LLCACHE_HEAP_EVICT];
+	}
+}
+
+/**
+ * Eviction policy operations.
+ */
+struct llcache_evict_policy_table {
+	/** Policy name for logging */
+	const char *name;
+
+	/** Compute the priority of an unused object, lower is evicted first */
+	double (*priority)(const llcache_object *object);
+
+	/** Optional notification that an object has been used */
+	void (*access)(const llcache_object *object);
+
+	/** Optional notification that an object is being evicted */
+	void (*evicted)(const llcache_object *object);
+};
+
+/** Eviction policy tables indexed by ::llcache_evict_policy */
+static const struct llcache_evict_policy_table
+llcache_evict_policies[LLCACHE_EVICT_COUNT] = {
+	[LLCACHE_EVICT_LRU] = {
+		.name = "LRU",
+		.priority = llcache_evict_lru_priority,
+	},
+	[LLCACHE_EVICT_TINYLFU] = {
+		.name = "TinyLFU",
+		.priority = llcache_evict_tinylfu_priority,
+		.access = llcache_evict_tinylfu_access,
+	},
+	[LLCACHE_EVICT_GDSF] = {
+		.name = "GDSF",
+		.priority = llcache_evict_gdsf_priority,
+		.evicted = llcache_evict_gdsf_evicted,
+	},
+};
+
+/**
+ * Make an unused cached object an eviction candidate.
+ *
+ * \param object The object to add.
+ */
+static void llcache_evict_add(llcache_object *object)
+{
+	int remaining_lifetime;
+
+	remaining_lifetime = llcache_object_rfc2616_remaining_lifetime(
+			&object->cache);
+
+	if (object->heap_index[LLCACHE_HEAP_EXPIRY] == 0) {
+		object->heap_key[LLCACHE_HEAP_EXPIRY] =
+			(double)time(NULL) + remaining_lifetime;
+		if (llcache_heap_insert(LLCACHE_HEAP_EXPIRY,
+					object) != NSERROR_OK) {
+			NSLOG(llcache, WARNING,
+			      "Unable to track expiry of %p", object);
+		}
+	}
+
+	if (object->heap_index[LLCACHE_HEAP_EVICT] == 0) {
+		object->heap_key[LLCACHE_HEAP_EVICT] =
+			llcache->policy->priority(object);
+		if (llcache_heap_insert(LLCACHE_HEAP_EVICT,
+					object) != NSERROR_OK) {
+			NSLOG(llcache, WARNING,
+			      "Unable to track eviction of %p", object);
+		}
+	}
+}
+
+/**
+ * Stop an object being an eviction candidate.
+ *
+ * \param object The object to remove.
+ */
+static void llcache_evict_remove(llcache_object *object)
+{
+	llcache_heap_remove(LLCACHE_HEAP_EXPIRY, object);
+	llcache_heap_remove(LLCACHE_HEAP_EVICT, object);
+}
+
+/**
+ * Recompute the eviction priority of an object after it changed.
  *
- * \param object  Object to consider
- * \return True if object is still fresh, false otherwise
+ * \param object The object to update.
  */
-static bool llcache_object_is_fresh(const llcache_object *object)
+static void llcache_evict_update(llcache_object *object)
 {
-	int remaining_lifetime;
-	const llcache_cache_control *cd = &object->cache;
+	if (object->heap_index[LLCACHE_HEAP_EVICT] == 0) {
+		return;
+	}
 
-	remaining_lifetime = llcache_object_rfc2616_remaining_lifetime(cd);
+	llcache_heap_remove(LLCACHE_HEAP_EVICT, object);
+	object->heap_key[LLCACHE_HEAP_EVICT] =
+		llcache->policy->priority(object);
+	llcache_heap_insert(LLCACHE_HEAP_EVICT, object);
+}
 
-	NSLOG(llcache, DEBUG, "%p: (%d > 0 || %d != %d)", object,
-	     remaining_lifetime,
-	     object->fetch.state, LLCACHE_FETCH_COMPLETE);
+/**
+ * Record a use of an object for the eviction policy.
+ *
+ * \param object The object being used.
+ */
+static void llcache_evict_access(llcache_object *object)
+{
+	object->hits++;
+	object->access = ++llcache->clock;
 
-	/* The object is fresh if:
-	 * - it was not forbidden from being returned from the cache
-	 *   unvalidated.
-	 *
-	 * - it has remaining lifetime or still being fetched.
-	 */
-	return ((cd->no_cache == LLCACHE_VALIDATE_FRESH) &&
-		((remaining_lifetime > 0) ||
-		 (object->fetch.state != LLCACHE_FETCH_COMPLETE)));
+	if (llcache->policy->access != NULL) {
+		llcache->policy->access(object);
+	}
 }
 
 /**
@@ -1173,6 +1984,15 @@ static nserror llcache_object_clone_cache_data(llcache_object *source,
 static nserror
 llcache_object_remove_from_list(llcache_object *object, llcache_object **list)
 {
+	if (list == &llcache->cached_objects) {
+		llcache_url_index_remove(object);
+		llcache_evict_remove(object);
+	}
+
+	llcache->total_size -= object->accounted_size;
+	object->accounted_size = 0;
+	object->list = NULL;
+
 	if (object == *list)
 		*list = object->next;
 	else
@@ -1196,6 +2016,8 @@ llcache_object_remove_from_list(llcache_object *object, llcache_object **list)
  */
 static nserror llcache_retrieve_persisted_data(llcache_object *object)
 {
+	nserror error;
+
 	/* ensure the source data is present if necessary */
 	if ((object->source_data != NULL) ||
 	    (object->store_state != LLCACHE_STATE_DISC)) {
@@ -1206,10 +2028,15 @@ static nserror llcache_retrieve_persisted_data(llcache_object *object)
 	}
 
 	/* Source data for the object may be in the persistent store */
-	return guit->llcache->fetch(object->url,
-				    BACKING_STORE_NONE,
-				    &object->source_data,
-				    &object->source_len);
+	error = guit->llcache->fetch(object->url,
+				     BACKING_STORE_NONE,
+				     &object->source_data,
+				     &object->source_len);
+	if (error == NSERROR_OK) {
+		llcache_object_update_size(object);
+	}
+
+	return error;
 }
 
 /**
@@ -1827,7 +2654,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 				   llcache_object **result)
 {
 	nserror error;
-	llcache_object *obj, *newest = NULL;
+	llcache_object *obj, *newest;
 
 	NSLOG(llcache, DEBUG,
 	      "Searching cache for %s flags:%x referer:%s post:%p",
@@ -1836,15 +2663,7 @@ llcache_object_retrieve_from_cache(nsurl *url,
 	      post);
 
 	/* Search for the most recently fetched matching object */
-	for (obj = llcache->cached_objects; obj != NULL; obj = obj->next) {
-
-		if ((newest == NULL ||
-		     obj->cache.req_time > newest->cache.req_time) &&
-		    nsurl_compare(obj->url, url,
-				  NSURL_COMPLETE) == true) {
-			newest = obj;
-		}
-	}
+	newest = llcache_url_index_find_newest(url);
 
 	/* No viable object found in cache create one and attempt to
 	 * pull from persistent store.
@@ -1852,6 +2671,9 @@ llcache_object_retrieve_from_cache(nsurl *url,
 	if (newest == NULL) {
 		NSLOG(llcache, DEBUG, "No viable object found in llcache");
 
+		llcache->miss_count++;
+		perf_count(PERF_COUNT_CACHE_MISS);
+
 		error = llcache_object_new(url, &obj);
 		if (error != NSERROR_OK)
 			return error;
@@ -1879,6 +2701,9 @@ llcache_object_retrieve_from_cache(nsurl *url,
 		/* Found a suitable object, and it's still fresh */
 		NSLOG(llcache, DEBUG, "Found fresh %p", newest);
 
+		llcache->hit_count++;
+		perf_count(PERF_COUNT_CACHE_HIT);
+
 		/* The client needs to catch up with the object's state.
 		 * This will occur the next time that llcache_poll is called.
 		 */
@@ -1910,6 +2735,9 @@ llcache_object_retrieve_from_cache(nsurl *url,
 	} else if (newest != NULL) {
 		/* Found a candidate object but it needs freshness validation */
 
+		llcache->revalidate_count++;
+		perf_count(PERF_COUNT_CACHE_REVALIDATE);
+
 		/* ensure the source data is present */
 		error = llcache_retrieve_persisted_data(newest);
 		if (error == NSERROR_OK) {
@@ -2084,6 +2912,12 @@ static nserror llcache_object_add_user(llcache_object *object,
 
 	user->handle->object = object;
 
+	/* objects in use are not eviction candidates */
+	if (object->users == NULL) {
+		llcache_evict_remove(object);
+	}
+	llcache_evict_access(object);
+
 	user->prev = NULL;
 	user->next = object->users;
 
@@ -2445,10 +3279,31 @@ llcache_fetch_process_data(llcache_object *object,
 		object->fetch.state = LLCACHE_FETCH_DATA;
 	}
 
-	/* Resize source buffer if it's too small */
+	/* Resize source buffer if it's too small.
+	 *
+	 * The buffer grows geometrically so the number of
+	 * reallocations is logarithmic in the object size, but each
+	 * step is bounded so very large objects do not overallocate by
+	 * more than the maximum step.
+	 */
 	if (object->source_len + len >= object->source_alloc) {
-		const size_t new_len = object->source_len + len + 64 * 1024;
-		uint8_t *temp = realloc(object->source_data, new_len);
+		size_t step = object->source_alloc;
+		size_t new_len;
+		uint8_t *temp;
+
+		if (step < LLCACHE_SOURCE_MIN_GROWTH) {
+			step = LLCACHE_SOURCE_MIN_GROWTH;
+		} else if (step > LLCACHE_SOURCE_MAX_GROWTH) {
+			step = LLCACHE_SOURCE_MAX_GROWTH;
+		}
+
+		new_len = object->source_alloc + step;
+		if (new_len <= object->source_len + len) {
+			new_len = object->source_len + len +
+				LLCACHE_SOURCE_MIN_GROWTH;
+		}
+
+		temp = realloc(object->source_data, new_len);
 		if (temp == NULL)
 			return NSERROR_NOMEM;
 
@@ -2727,12 +3582,64 @@ build_candidate_list(struct llcache_object ***lst_out, int *lst_len_out)
 	return NSERROR_OK;
 }
 
+/**
+ * Determine if an object's source data is in a compressed format.
+ *
+ * The backing store gains nothing from compressing such data again.
+ *
+ * \param object The object to examine.
+ * \return true if the source data is compressed else false.
+ */
+static bool llcache_object_is_compressed(const llcache_object *object)
+{
+	static const char *compressed_types[] = {
+		"image/",
+		"audio/",
+		"video/",
+		"font/woff",
+		"application/font-woff",
+		"application/gzip",
+		"application/x-gzip",
+		"application/zip",
+	};
+	const char *value;
+	size_t hloop;
+	size_t tloop;
+
+	for (hloop = 0; hloop < object->num_headers; hloop++) {
+		if (strcasecmp(object->headers[hloop].name,
+			       "Content-Type") != 0) {
+			continue;
+		}
+		value = object->headers[hloop].value;
+
+		/* svg is text despite being an image */
+		if (strncasecmp(value, "image/svg", SLEN("image/svg")) == 0) {
+			return false;
+		}
+
+		for (tloop = 0; tloop < NOF_ELEMENTS(compressed_types); tloop++) {
+			if (strncasecmp(value,
+					compressed_types[tloop],
+					strlen(compressed_types[tloop])) == 0) {
+				return true;
+			}
+		}
+		return false;
+	}
+
+	return false;
+}
+
 /**
  * Write an object to the backing store.
  *
  * \param object The object to put in the backing store.
  * \param written_out The amount of data written out.
- * \param elapsed The time in ms it took to complete the write to backing store.
+ * \param elapsed The time in ms it took to submit the write to the
+ *                backing store. The backing store may complete the
+ *                write later, the time taken to do so is reported to
+ *                llcache_persist_written().
  * \return NSERROR_OK on success or appropriate error code.
  */
 static nserror
@@ -2750,7 +3657,8 @@ write_backing_store(struct llcache_object *object,
 
 	/* put object data in backing store */
 	ret = guit->llcache->store(object->url,
-				   BACKING_STORE_NONE,
+				   llcache_object_is_compressed(object) ?
+				   BACKING_STORE_COMPRESSED : BACKING_STORE_NONE,
 				   object->source_data,
 				   object->source_len);
 	if (ret != NSERROR_OK) {
@@ -2783,6 +3691,9 @@ write_backing_store(struct llcache_object *object,
 
 	object->store_state = LLCACHE_STATE_DISC;
 
+	/* refetch cost has changed */
+	llcache_evict_update(object);
+
 	*written_out = object->source_len + metadatasize;
 
 	/* by ignoring the overflow this assumes the writeout took
@@ -2816,6 +3727,10 @@ static void llcache_persist_slowcheck(void *p)
 {
 	uint64_t total_bandwidth; /* total bandwidth */
 
+	if (llcache == NULL) {
+		return;
+	}
+
 	if (llcache->total_written > (2 * llcache->minimum_bandwidth)) {
 
 		total_bandwidth = (llcache->total_written * 1000) / llcache->total_elapsed;
@@ -2830,6 +3745,40 @@ static void llcache_persist_slowcheck(void *p)
 	}
 }
 
+/**
+ * Account for a write completed by the backing store.
+ *
+ * Writes are completed by the backing store some time after they
+ * are submitted so the overall bandwidth is accumulated here. When it
+ * falls below the minimum a check is scheduled, the backing store
+ * cannot be finalised from within its own completion.
+ *
+ * \param written The number of bytes written.
+ * \param elapsed The time taken to write them in ms.
+ */
+static void llcache_persist_written(size_t written, unsigned long elapsed)
+{
+	if (llcache == NULL) {
+		return;
+	}
+
+	/* ensure the write is accounted to have taken at least the
+	 * minimal amount of time
+	 */
+	if (elapsed == 0) {
+		elapsed = 1;
+	}
+
+	llcache->total_written += written;
+	llcache->total_elapsed += elapsed;
+
+	if ((llcache->total_written > (2 * llcache->minimum_bandwidth)) &&
+	    (((llcache->total_written * 1000) / llcache->total_elapsed) <
+	     llcache->minimum_bandwidth)) {
+		guit->misc->schedule(0, llcache_persist_slowcheck, NULL);
+	}
+}
+
 /**
  * Possibly write objects data to backing store.
  *
@@ -2863,6 +3812,13 @@ static void llcache_persist(void *p)
 	/* obtained a candidate list, make each object persistent in turn */
 	for (idx = 0; idx < lst_count; idx++) {
 		ret = write_backing_store(lst[idx], &written, &elapsed);
+		if (ret == NSERROR_NOSPACE) {
+			/* the backing store has a backlog of writes
+			 * so try again next time quantum.
+			 */
+			next = llcache->time_quantum;
+			break;
+		}
 		if (ret != NSERROR_OK) {
 			continue;
 		}
@@ -2882,33 +3838,22 @@ static void llcache_persist(void *p)
 		 */
 		if (total_elapsed > llcache->time_quantum) {
 			NSLOG(llcache, INFO, "Overran timeslot");
-			/* writeout has exhausted the available time.
-			 * Either the writeout is slow or the last
-			 * object was very large.
+			/* submitting the writeout has exhausted the
+			 * available time. Whether the writes themselves
+			 * are too slow is checked as the backing store
+			 * completes them.
 			 */
-			if (total_bandwidth < llcache->minimum_bandwidth) {
-				/* Writeout was slow in this time quantum.
-				 *  Schedule a check in the future to see if
-				 *  overall performance is too slow to be useful.
+			if (total_bandwidth > llcache->maximum_bandwidth) {
+				/* fast writeout of large file
+				 * so calculate delay as if
+				 * write happened only at max
+				 * limit
 				 */
-				guit->misc->schedule(
-						llcache->time_quantum * 100,
-						llcache_persist_slowcheck,
-						NULL);
-				break;
+				next = ((total_written * llcache->time_quantum) / write_limit) - total_elapsed;
 			} else {
-				if (total_bandwidth > llcache->maximum_bandwidth) {
-					/* fast writeout of large file
-					 * so calculate delay as if
-					 * write happened only at max
-					 * limit
-					 */
-					next = ((total_written * llcache->time_quantum) / write_limit) - total_elapsed;
-				} else {
-					next = llcache->time_quantum;
-				}
-				break;
+				next = llcache->time_quantum;
 			}
+			break;
 		} else if (total_written > write_limit) {
 			/* The bandwidth limit has been reached. */
 
@@ -2937,9 +3882,6 @@ static void llcache_persist(void *p)
 		}
 	}
 
-	llcache->total_written += total_written;
-	llcache->total_elapsed += total_elapsed;
-
 	NSLOG(llcache, DEBUG,
 	      "writeout size:%"PRIssizet" time:%lu bandwidth:%lubytes/s",
 	      total_written, total_elapsed, total_bandwidth);
@@ -2970,6 +3912,21 @@ static void llcache_fetch_callback(const fetch_msg *msg, void *p)
 
 	NSLOG(llcache, DEBUG, "Fetch event %d for %p", msg->type, object);
 
+	switch (msg->type) {
+	case FETCH_REDIRECT:
+	case FETCH_NOTMODIFIED:
+	case FETCH_FINISHED:
+	case FETCH_TIMEDOUT:
+	case FETCH_ERROR:
+		/* this fetch is over, whatever follows */
+		perf_end(PERF_PHASE_FETCH, object->fetch.perf_start);
+		object->fetch.perf_start = 0;
+		break;
+
+	default:
+		break;
+	}
+
 	switch (msg->type) {
 	case FETCH_HEADER:
 		/* Received a fetch header */
@@ -3158,6 +4115,12 @@ static void llcache_fetch_callback(const fetch_msg *msg, void *p)
 		}
 	}
 
+	/* Fetch events may have changed the size of the objects */
+	llcache_object_update_size(p);
+	if (object != p) {
+		llcache_object_update_size(object);
+	}
+
 	/* There may be users which are not caught up so schedule ourselves */
 	llcache_users_not_caught_up();
 }
@@ -3536,41 +4499,6 @@ llcache_object_snapshot(llcache_object *object,	llcache_object **snapshot)
 	return NSERROR_OK;
 }
 
-/**
- * total ram usage of object
- *
- * \param object The object to calculate the total RAM usage of.
- * \return The total RAM usage in bytes.
- */
-static inline uint32_t
-total_object_size(llcache_object *object)
-{
-	uint32_t tot;
-	size_t hdrc;
-
-	tot = sizeof(*object);
-	tot += nsurl_length(object->url);
-
-	if (object->source_data != NULL) {
-		tot += object->source_len;
-	}
-
-	tot += sizeof(llcache_header) * object->num_headers;
-
-	for (hdrc = 0; hdrc < object->num_headers; hdrc++) {
-		if (object->headers[hdrc].name != NULL) {
-			tot += strlen(object->headers[hdrc].name);
-		}
-		if (object->headers[hdrc].value != NULL) {
-			tot += strlen(object->headers[hdrc].value);
-		}
-	}
-
-	tot += cert_chain_size(object->chain);
-
-	return tot;
-}
-
 /******************************************************************************
  * Public API								      *
  ******************************************************************************/
@@ -3578,16 +4506,19 @@ total_object_size(llcache_object *object)
 /*
  * Attempt to clean the cache
  *
- * The memory cache cleaning discards objects in order of increasing value.
+ * The memory cache cleaning discards stale unused objects and then,
+ * while the cache exceeds its size limit, discards unused objects in
+ * the order selected by the eviction policy.
  *
  * Exported interface documented in llcache.h
  */
 void llcache_clean(bool purge)
 {
 	llcache_object *object, *next;
-	uint32_t llcache_size = 0;
+	llcache_object *deferred = NULL;
+	uint64_t limit;
+	time_t now = time(NULL);
 	int remaining_lifetime;
-	uint32_t limit;
 
 	NSLOG(llcache, DEBUG, "Attempting cache clean");
 
@@ -3614,142 +4545,134 @@ void llcache_clean(bool purge)
 			llcache_object_remove_from_list(object,
 					&llcache->uncached_objects);
 			llcache_object_destroy(object);
-		} else {
-			llcache_size += total_object_size(object);
 		}
 	}
 
-
-	/* Stale cacheable objects with no users or pending fetches */
-	for (object = llcache->cached_objects;
-	     object != NULL;
-	     object = next) {
-		next = object->next;
+	/* Stale cacheable objects with no users or pending fetches.
+	 *
+	 * The expiry heap holds every unused cached object ordered by
+	 * the time it was expected to become stale so only objects
+	 * which may have expired are examined.
+	 */
+	while (((object = llcache_heap_peek(LLCACHE_HEAP_EXPIRY)) != NULL) &&
+	       (object->heap_key[LLCACHE_HEAP_EXPIRY] <= (double)now)) {
+		llcache_heap_remove(LLCACHE_HEAP_EXPIRY, object);
 
 		remaining_lifetime = llcache_object_rfc2616_remaining_lifetime(
 				&object->cache);
 
-		if ((object->users == NULL) &&
-		    (object->candidate_count == 0) &&
-		    (object->fetch.fetch == NULL) &&
-		    (remaining_lifetime <= 0)) {
-			/* object is stale */
-			NSLOG(llcache, DEBUG, "discarding stale cacheable object with no "
-					"users or pending fetches (%p) %s",
-					object, nsurl_access(object->url));
-
-				llcache_object_remove_from_list(object,
-						&llcache->cached_objects);
+		if ((object->candidate_count != 0) ||
+		    (object->fetch.fetch != NULL) ||
+		    (remaining_lifetime > 0)) {
+			/* not discardable yet, reconsider later */
+			object->heap_key[LLCACHE_HEAP_EXPIRY] =
+				(double)now + remaining_lifetime;
+			object->evict_next = deferred;
+			deferred = object;
+			continue;
+		}
 
-				if (object->store_state == LLCACHE_STATE_DISC) {
-					guit->llcache->invalidate(object->url);
-				}
+		/* object is stale */
+		NSLOG(llcache, DEBUG, "discarding stale cacheable object with no "
+		      "users or pending fetches (%p) %s",
+		      object, nsurl_access(object->url));
 
-				llcache_object_destroy(object);
+		llcache_object_remove_from_list(object,
+				&llcache->cached_objects);
 
-		} else {
-			/* object has users so account for the storage */
-			llcache_size += total_object_size(object);
+		if (object->store_state == LLCACHE_STATE_DISC) {
+			guit->llcache->invalidate(object->url);
 		}
+
+		llcache_object_destroy(object);
+	}
+
+	for (object = deferred; object != NULL; object = next) {
+		next = object->evict_next;
+		object->evict_next = NULL;
+		llcache_heap_insert(LLCACHE_HEAP_EXPIRY, object);
 	}
+	deferred = NULL;
 
 	/* if the cache limit is exceeded try to make some objects
 	 * persistent so their RAM can be reclaimed in the next
 	 * step
 	 */
-	if (limit < llcache_size) {
+	if (limit < llcache->total_size) {
 		llcache_persist(NULL);
 	}
 
-	/* Source data of fresh cacheable objects with no users, no
-	 * pending fetches and pushed to persistent store while the
-	 * cache exceeds the configured size.
+	/* Unused objects in eviction policy order while the cache
+	 * exceeds the configured size. Objects which have been pushed
+	 * to persistent store first have their source data freed and
+	 * are then reconsidered with their reduced size and refetch
+	 * cost.
 	 */
-	for (object = llcache->cached_objects;
-	     ((limit < llcache_size) && (object != NULL));
-	     object = next) {
-		next = object->next;
-		if ((object->users == NULL) &&
-		    (object->candidate_count == 0) &&
-		    (object->fetch.fetch == NULL) &&
-		    (object->store_state == LLCACHE_STATE_DISC)) {
+	while ((limit < llcache->total_size) &&
+	       ((object = llcache_heap_peek(LLCACHE_HEAP_EVICT)) != NULL)) {
+		llcache_heap_remove(LLCACHE_HEAP_EVICT, object);
+
+		if ((object->candidate_count != 0) ||
+		    (object->fetch.fetch != NULL)) {
+			/* not discardable yet, reconsider later */
+			object->evict_next = deferred;
+			deferred = object;
+			continue;
+		}
+
+		if ((object->store_state == LLCACHE_STATE_DISC) &&
+		    (object->source_data != NULL)) {
 			guit->llcache->release(object->url, BACKING_STORE_NONE);
 
 			object->source_data = NULL;
 
-			llcache_size -=	object->source_len;
+			llcache_object_update_size(object);
 
 			NSLOG(llcache, DEBUG,
 			      "Freeing source data for %p len:%"PRIssizet,
 			      object, object->source_len);
-		}
-	}
-
-	/* Fresh cacheable objects with no users, no pending fetches
-	 * and pushed to persistent store while the cache exceeds
-	 * the configured size. Effectively just the llcache object metadata.
-	 */
-	for (object = llcache->cached_objects;
-	     ((limit < llcache_size) && (object != NULL));
-	     object = next) {
-		next = object->next;
-		if ((object->users == NULL) &&
-		    (object->candidate_count == 0) &&
-		    (object->fetch.fetch == NULL) &&
-		    (object->store_state == LLCACHE_STATE_DISC) &&
-		    (object->source_data == NULL)) {
-			NSLOG(llcache, DEBUG,
-			     "discarding backed object len:%"PRIssizet" age:%ld (%p) %s",
-			      object->source_len,
-			      (long)(time(NULL) - object->last_used),
-			      object,
-			      nsurl_access(object->url));
-
-			llcache_size -=	total_object_size(object);
-
-			llcache_object_remove_from_list(object,
-						&llcache->cached_objects);
-			llcache_object_destroy(object);
 
+			object->heap_key[LLCACHE_HEAP_EVICT] =
+				llcache->policy->priority(object);
+			llcache_heap_insert(LLCACHE_HEAP_EVICT, object);
+			continue;
 		}
-	}
-
-	/* Fresh cacheable objects with no users or pending fetches
-	 * while the cache exceeds the configured size. These are the
-	 * most valuable objects as replacing them is a full network
-	 * fetch
-	 */
-	for (object = llcache->cached_objects;
-	     ((limit < llcache_size) && (object != NULL));
-	     object = next) {
-		next = object->next;
 
-		if ((object->users == NULL) &&
-		    (object->candidate_count == 0) &&
-		    (object->fetch.fetch == NULL) &&
-		    (object->store_state == LLCACHE_STATE_RAM)) {
-			NSLOG(llcache, DEBUG,
-			      "discarding fresh object len:%"PRIssizet" age:%ld (%p) %s",
-			      object->source_len,
-			      (long)(time(NULL) - object->last_used),
-			      object,
-			      nsurl_access(object->url));
+		NSLOG(llcache, DEBUG,
+		      "discarding %s object len:%"PRIssizet" age:%ld (%p) %s",
+		      (object->store_state == LLCACHE_STATE_DISC) ?
+		      "backed" : "fresh",
+		      object->source_len,
+		      (long)(now - object->last_used),
+		      object,
+		      nsurl_access(object->url));
+
+		if (llcache->policy->evicted != NULL) {
+			llcache->policy->evicted(object);
+		}
+		llcache->evict_count++;
 
-			llcache_size -=	object->source_len + sizeof(*object);
+		llcache_object_remove_from_list(object,
+				&llcache->cached_objects);
+		llcache_object_destroy(object);
+	}
 
-			llcache_object_remove_from_list(object,
-						&llcache->cached_objects);
-			llcache_object_destroy(object);
-		}
+	for (object = deferred; object != NULL; object = next) {
+		next = object->evict_next;
+		object->evict_next = NULL;
+		llcache_heap_insert(LLCACHE_HEAP_EVICT, object);
 	}
 
-	NSLOG(llcache, DEBUG, "Size: %u (limit: %u)", llcache_size, limit);
+	NSLOG(llcache, DEBUG, "Size: %"PRIu64" (limit: %"PRIu64")",
+	      llcache->total_size, limit);
 }
 
 /* Exported interface documented in content/llcache.h */
 nserror
 llcache_initialise(const struct llcache_parameters *prm)
 {
+	struct llcache_store_parameters store;
+
 	llcache = calloc(1, sizeof(struct llcache_s));
 	if (llcache == NULL) {
 		return NSERROR_NOMEM;
@@ -3762,13 +4685,24 @@ llcache_initialise(const struct llcache_parameters *prm)
 	llcache->time_quantum = prm->time_quantum;
 	llcache->fetch_attempts = prm->fetch_attempts;
 	llcache->all_caught_up = true;
+	llcache->policy = &llcache_evict_policies[prm->evict_policy];
+
+	llcache->url_index = hashmap_create(&llcache_url_index_parameters);
+	if (llcache->url_index == NULL) {
+		free(llcache);
+		llcache = NULL;
+		return NSERROR_NOMEM;
+	}
 
 	NSLOG(llcache, INFO,
-	      "llcache initialising with a limit of %d bytes",
-	      llcache->limit);
+	      "llcache initialising with a limit of %d bytes using %s eviction",
+	      llcache->limit, llcache->policy->name);
 
 	/* backing store initialisation */
-	return guit->llcache->initialise(&prm->store);
+	store = prm->store;
+	store.written = llcache_persist_written;
+
+	return guit->llcache->initialise(&store);
 }
 
 
@@ -3827,6 +4761,7 @@ void llcache_finalise(void)
 
 	/* backing store finalisation */
 	guit->llcache->finalise();
+	guit->misc->schedule(-1, llcache_persist_slowcheck, NULL);
 
 	if (llcache->total_elapsed > 0) {
 		total_bandwidth = (llcache->total_written * 1000) /
@@ -3839,6 +4774,17 @@ void llcache_finalise(void)
 	      llcache->total_elapsed,
 	      total_bandwidth);
 
+	NSLOG(llcache, INFO,
+	      "Memory cache hits:%"PRIu64" revalidations:%"PRIu64" misses:%"PRIu64" evictions:%"PRIu64,
+	      llcache->hit_count,
+	      llcache->revalidate_count,
+	      llcache->miss_count,
+	      llcache->evict_count);
+
+	hashmap_destroy(llcache->url_index);
+	free(llcache->heap[LLCACHE_HEAP_EXPIRY].entries);
+	free(llcache->heap[LLCACHE_HEAP_EVICT].entries);
+
 	free(llcache);
 	llcache = NULL;
 }
@@ -3924,6 +4870,14 @@ nserror llcache_handle_retrieve(nsurl *url, uint32_t flags,
 		return error;
 	}
 
+	/* A shared object being fetched goes at the most urgent
+	 * priority any of its users asked for.
+	 */
+	if (llcache_flags_priority(flags) <
+	    llcache_flags_priority(object->fetch.flags)) {
+		llcache_object_set_priority(object, flags);
+	}
+
 	/* Add user to object */
 	llcache_object_add_user(object, user);
 
@@ -4051,6 +5005,18 @@ nserror llcache_handle_abort(llcache_handle *handle)
 	return error;
 }
 
+/* See llcache.h for documentation */
+nserror llcache_handle_set_priority(llcache_handle *handle, uint32_t flags)
+{
+	/* Other users of the object may need it more urgently */
+	if (llcache_flags_priority(flags) <
+	    llcache_flags_priority(handle->object->fetch.flags)) {
+		llcache_object_set_priority(handle->object, flags);
+	}
+
+	return NSERROR_OK;
+}
+
 /* See llcache.h for documentation */
 nserror llcache_handle_force_stream(llcache_handle *handle)
 {
@@ -4101,6 +5067,27 @@ const uint8_t *llcache_handle_get_source_data(const llcache_handle *handle,
 	return handle->object != NULL ? handle->object->source_data : NULL;
 }
 
+/* See llcache.h for documentation */
+const uint8_t *llcache_handle_get_source_chunk(const llcache_handle *handle,
+		size_t offset, size_t *size)
+{
+	const llcache_object *object = handle->object;
+
+	if ((object == NULL) ||
+	    (object->source_data == NULL) ||
+	    (offset >= object->source_len)) {
+		*size = 0;
+		return NULL;
+	}
+
+	/* source data is held contiguously so the chunk is all the
+	 * data remaining after the offset.
+	 */
+	*size = object->source_len - offset;
+
+	return object->source_data + offset;
+}
+
 /* See llcache.h for documentation */
 const char *llcache_handle_get_header(const llcache_handle *handle,
 		const char *key)
@@ -4120,6 +5107,13 @@ const char *llcache_handle_get_header(const llcache_handle *handle,
 	return NULL;
 }
 
+/* See llcache.h for documentation */
+bool llcache_handle_is_fresh(const llcache_handle *handle)
+{
+	return (handle->object != NULL) &&
+		llcache_object_is_fresh(handle->object);
+}
+
 /* See llcache.h for documentation */
 bool llcache_handle_references_same_object(const llcache_handle *a,
 		const llcache_handle *b)
@@ -60,9 +60,21 @@ enum llcache_retrieve_flag {
 	/**< No error pages */
 	LLCACHE_RETRIEVE_NO_ERROR_PAGES = (1 << 2),
 	/**< Stream data (implies that object is not cacheable) */
-	LLCACHE_RETRIEVE_STREAM_DATA    = (1 << 3)
+	LLCACHE_RETRIEVE_STREAM_DATA    = (1 << 3),
+	/** Fetch blocks rendering. Without a priority flag the fetch
+	 * has normal priority. */
+	LLCACHE_RETRIEVE_PRIORITY_BLOCKING = (1 << 4),
+	/** Fetch is needed soon */
+	LLCACHE_RETRIEVE_PRIORITY_HIGH  = (1 << 5),
+	/** Fetch is not yet needed */
+	LLCACHE_RETRIEVE_PRIORITY_LOW   = (1 << 6)
 };
 
+/** Mask of the priority retrieval flags */
+#define LLCACHE_RETRIEVE_PRIORITY_MASK (LLCACHE_RETRIEVE_PRIORITY_BLOCKING | \
+					LLCACHE_RETRIEVE_PRIORITY_HIGH |     \
+					LLCACHE_RETRIEVE_PRIORITY_LOW)
+
 /** Low-level cache event types */
 typedef enum {
 	LLCACHE_EVENT_GOT_CERTS,        /**< SSL certificates arrived */
@@ -113,6 +125,44 @@ typedef struct {
 typedef nserror (*llcache_handle_callback)(llcache_handle *handle,
 		const llcache_event *event, void *pw);
 
+/**
+ * Low level cache memory eviction policies.
+ *
+ * The policy determines the order in which unused objects are
+ * discarded when the RAM cache exceeds its size limit.
+ */
+typedef enum {
+	/** Discard least recently used objects first */
+	LLCACHE_EVICT_LRU = 0,
+	/** Discard least frequently used objects first, with frequency
+	 * tracked across evictions by an aging sketch (TinyLFU)
+	 */
+	LLCACHE_EVICT_TINYLFU,
+	/** Greedy-dual size frequency, discard objects with the lowest
+	 * frequency and refetch cost per byte first.
+	 */
+	LLCACHE_EVICT_GDSF,
+
+	LLCACHE_EVICT_COUNT /**< Number of eviction policies */
+} llcache_evict_policy;
+
+/**
+ * Backing store synchronisation policy.
+ *
+ * Controls when the backing store waits for written data to reach
+ * the storage device.
+ */
+typedef enum {
+	/** Leave writeback entirely to the operating system */
+	LLCACHE_STORE_SYNC_NONE = 0,
+	/** Synchronise control data before it replaces the previous copy */
+	LLCACHE_STORE_SYNC_CONTROL,
+	/** Synchronise all written data before control data is replaced */
+	LLCACHE_STORE_SYNC_ALL,
+
+	LLCACHE_STORE_SYNC_COUNT /**< Number of synchronisation policies */
+} llcache_store_sync;
+
 /**
  * Parameters to configure the low level cache backing store.
  */
@@ -121,6 +171,23 @@ struct llcache_store_parameters {
 
 	size_t limit; /**< The backing store upper bound target size */
 	size_t hysteresis; /**< The hysteresis around the target size */
+
+	llcache_store_sync sync; /**< The synchronisation policy */
+	bool compress; /**< Compress stored data where worthwhile */
+
+	/**
+	 * Report a completed write.
+	 *
+	 * Backing stores which complete writes after the store
+	 * operation returns call this as each write completes so the
+	 * write bandwidth reflects the time actually taken. Set by
+	 * the low level cache.
+	 *
+	 * \param written The number of bytes stored, before any compression.
+	 * \param elapsed The time taken to write them in ms, excluding
+	 *                any compression.
+	 */
+	void (*written)(size_t written, unsigned long elapsed);
 };
 
 /**
@@ -150,6 +217,9 @@ struct llcache_parameters {
 	/** The number of fetches to attempt when timing out */
 	uint32_t fetch_attempts;
 
+	/** The policy used to select objects to discard from RAM */
+	llcache_evict_policy evict_policy;
+
 	struct llcache_store_parameters store;
 };
 
@@ -231,6 +301,19 @@ nserror llcache_handle_clone(llcache_handle *handle, llcache_handle **result);
  */
 nserror llcache_handle_abort(llcache_handle *handle);
 
+/**
+ * Raise the fetch priority of a low-level cache handle's object
+ *
+ * The fetch is shared by all users of the object so its priority is
+ * only ever raised; a request for a less urgent priority is ignored.
+ * Has no effect once the object's fetch has started.
+ *
+ * \param handle  Handle to change priority of
+ * \param flags   Retrieval flags holding the new priority
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+nserror llcache_handle_set_priority(llcache_handle *handle, uint32_t flags);
+
 /**
  * Force a low-level cache handle into streaming mode
  *
@@ -265,6 +348,23 @@ nsurl *llcache_handle_get_url(const llcache_handle *handle);
 const uint8_t *llcache_handle_get_source_data(const llcache_handle *handle,
 		size_t *size);
 
+/**
+ * Retrieve a chunk of the source data of a low-level cache object
+ *
+ * Source data may be iterated in chunks, starting at offset zero and
+ * advancing the offset by the returned chunk size until NULL is
+ * returned. Callers which can process the data incrementally should
+ * use this in preference to ::llcache_handle_get_source_data as it
+ * never requires the source data to be contiguous.
+ *
+ * \param handle  Handle to retrieve source data from
+ * \param offset  Byte offset of the chunk within the source data
+ * \param size    Pointer to location to receive byte length of chunk
+ * \return Pointer to chunk data, or NULL if there is no data at offset
+ */
+const uint8_t *llcache_handle_get_source_chunk(const llcache_handle *handle,
+		size_t offset, size_t *size);
+
 /**
  * Retrieve a header value associated with a low-level cache object
  *
@@ -281,6 +381,17 @@ const uint8_t *llcache_handle_get_source_data(const llcache_handle *handle,
 const char *llcache_handle_get_header(const llcache_handle *handle,
 		const char *key);
 
+/**
+ * Determine if the object referenced by a handle is fresh
+ *
+ * An object is fresh if it may be used without revalidation or is
+ * still being fetched.
+ *
+ * \param handle  Handle to examine
+ * \return True if the object is fresh, false otherwise
+ */
+bool llcache_handle_is_fresh(const llcache_handle *handle);
+
 /**
  * Determine if the same underlying object is referenced by the given handles
  *
@@ -82,11 +82,20 @@
  * simpler implementation. Entries in this tree comprise pointers to the
  * leaf nodes of the host tree described above.
  *
+ * The database is saved as a binary snapshot holding a string table,
+ * flat arrays of host and URL records and the URL bloom filter. Loading
+ * a snapshot maps it and only creates the host tree; the paths of each
+ * host are added from the snapshot the first time the host's paths are
+ * used. The original line based text format is still read by
+ * urldb_load() and written by urldb_export().
+ *
  * REALLY IMPORTANT NOTE: urldb expects all URLs to be normalised. Use of
  * non-normalised URLs with urldb will result in undefined behaviour and
  * potential crashes.
  */
 
+#include "utils/config.h"
+
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -94,6 +103,12 @@
 #include <string.h>
 #include <strings.h>
 #include <time.h>
+#include <unistd.h>
+#ifdef HAVE_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
 #ifdef WITH_NSPSL
 #include <nspsl.h>
 #endif
@@ -105,6 +120,7 @@
 #include "utils/url.h"
 #include "utils/utils.h"
 #include "utils/bloom.h"
+#include "utils/hashmap.h"
 #include "utils/time.h"
 #include "utils/nsurl.h"
 #include "utils/ascii.h"
@@ -147,6 +163,10 @@ struct cookie_internal_data {
 	bool no_destroy;	/**< Never destroy this cookie,
 				 * unless it's expired */
 
+	/* Fields below are not part of the public interface */
+
+	struct cookie_internal_data *domain_prev; /**< Previous in domain */
+	struct cookie_internal_data *domain_next; /**< Next in domain */
 };
 
 
@@ -226,6 +246,15 @@ struct path_data {
 	struct path_data *parent; /**< Parent path segment */
 	struct path_data *children; /**< Child path segments */
 	struct path_data *last; /**< Last child */
+
+	unsigned int child_count; /**< Number of child path segments */
+	/**
+	 * Hash table of child path segments keyed on segment, scheme
+	 * and port. Only present once there are more than
+	 * URLDB_PATH_INDEX_MIN children.
+	 */
+	struct path_data **child_index;
+	unsigned int child_index_size; /**< Number of child_index slots */
 };
 
 struct hsts_data {
@@ -258,6 +287,12 @@ struct host_part {
 	 */
 	struct prot_space_data *prot_space;
 
+	/**
+	 * URLs on this host in the loaded snapshot which have not yet
+	 * been added to the paths. NULL once the paths are complete.
+	 */
+	const struct urldb_snapshot_host *snapshot;
+
 	struct host_part *next;	/**< Next sibling */
 	struct host_part *prev;	/**< Previous sibling */
 	struct host_part *parent; /**< Parent host part */
@@ -293,6 +328,40 @@ static struct search_node *search_trees[NUM_SEARCH_TREES] = {
 	&empty, &empty, &empty, &empty
 };
 
+/**
+ * Cookies with the same domain
+ *
+ * Host cookies are indexed by their host name and domain cookies by
+ * their domain including the leading dot. The list is in the order
+ * the cookies were added.
+ */
+struct urldb_cookie_domain {
+	struct cookie_internal_data *cookies; /**< First cookie */
+	struct cookie_internal_data *cookies_end; /**< Last cookie */
+};
+
+/** Cookies indexed by domain */
+static hashmap_t *cookie_domains;
+
+/**
+ * A cached Cookie header
+ *
+ * Keyed on whether the request is secure, whether HttpOnly cookies are
+ * included, the host and the path.
+ */
+struct urldb_cookie_header {
+	char *header; /**< Header value or NULL if no cookies match */
+	struct cookie_internal_data **cookies; /**< Cookies in header */
+	unsigned int count; /**< Number of cookies in header */
+	time_t expires; /**< Earliest expiry of the cookies or -1 */
+};
+
+/** Cached Cookie headers */
+static hashmap_t *cookie_headers;
+
+/** Maximum number of cached Cookie headers */
+#define URLDB_COOKIE_HEADER_MAX 512
+
 /** Minimum cookie database file version */
 #define MIN_COOKIE_FILE_VERSION 100
 /** Current cookie database file version */
@@ -317,11 +386,103 @@ static int loaded_cookie_file_version;
  * shockingly wasteful on memory.
  */
 static struct bloom_filter *url_bloom;
+
+/**
+ * Generation of the visit data, advanced whenever any URL's visit
+ * count may have changed.  Never zero so callers can use zero as
+ * "not yet known".
+ */
+static unsigned int url_visit_generation = 1;
+
+/**
+ * Advance the visit data generation
+ */
+static inline void urldb_visits_changed(void)
+{
+	if (++url_visit_generation == 0) {
+		url_visit_generation = 1;
+	}
+}
 /**
  * Size of url filter
  */
 #define BLOOM_SIZE (1024 * 32)
 
+/**
+ * Number of children a path segment has before they are indexed
+ *
+ * Below this a walk of the sibling list is as quick as hashing.
+ */
+#define URLDB_PATH_INDEX_MIN 16
+
+/** Binary URL database snapshot identifier */
+#define URLDB_SNAPSHOT_MAGIC "NSUD"
+/** Current binary URL database snapshot version */
+#define URLDB_SNAPSHOT_VERSION 1
+/** Value used to reject snapshots written with another byte order */
+#define URLDB_SNAPSHOT_BYTE_ORDER 0x01020304
+
+/**
+ * Binary URL database snapshot header
+ *
+ * The header is followed by the host records, the URL records, the
+ * bloom filter data padded to eight bytes and the string table.
+ * Strings are referenced by their offset in the string table which
+ * starts with an empty string.
+ */
+struct urldb_snapshot_header {
+	char magic[4];		/**< URLDB_SNAPSHOT_MAGIC */
+	uint32_t version;	/**< URLDB_SNAPSHOT_VERSION */
+	uint32_t byte_order;	/**< URLDB_SNAPSHOT_BYTE_ORDER */
+	uint32_t host_count;	/**< Number of host records */
+	uint32_t url_count;	/**< Number of URL records */
+	uint32_t strings_size;	/**< Size of string table in bytes */
+	uint32_t bloom_size;	/**< Size of bloom filter data in bytes */
+	uint32_t bloom_items;	/**< Number of items in bloom filter */
+};
+
+/**
+ * Binary URL database snapshot host record
+ */
+struct urldb_snapshot_host {
+	uint32_t host;		/**< Host name string */
+	uint32_t first_url;	/**< Index of first URL record of host */
+	uint32_t url_count;	/**< Number of URL records of host */
+	uint32_t hsts_include_sub_domains; /**< HSTS policy includes subdomains */
+	int64_t hsts_expires;	/**< HSTS policy expiry time */
+};
+
+/**
+ * Binary URL database snapshot URL record
+ */
+struct urldb_snapshot_url {
+	uint32_t scheme;	/**< Scheme string */
+	uint32_t path;		/**< Path and query string */
+	uint32_t title;		/**< Title string */
+	uint32_t port;		/**< Port number or 0 for scheme default */
+	uint32_t visits;	/**< Visit count */
+	uint32_t type;		/**< Type of resource */
+	int64_t last_visit;	/**< Last visit time */
+};
+
+/**
+ * The loaded URL database snapshot
+ *
+ * Kept until the paths of every host referencing it have been added.
+ */
+static struct urldb_snapshot {
+	void *data;		/**< Snapshot data */
+	size_t size;		/**< Size of snapshot data */
+	bool mapped;		/**< Snapshot data is mapped from file */
+	unsigned int host_count; /**< Number of host records */
+	const struct urldb_snapshot_host *hosts; /**< Host records */
+	const struct urldb_snapshot_url *urls; /**< URL records */
+	const char *strings;	/**< String table */
+	unsigned int pending;	/**< Number of hosts with paths to add */
+} urldb_snapshot;
+
+static nserror urldb_host_materialise(const struct host_part *host);
+
 
 /**
  * write a time_t to a file portably
@@ -511,6 +672,33 @@ urldb_count_urls(const struct path_data *root,
 }
 
 
+/**
+ * Construct the name of a host from its parts
+ *
+ * \param host The host
+ * \param name Buffer to place the name in
+ * \param size Size of the buffer
+ * \return true on success or false on failure
+ */
+static bool
+urldb_host_name(const struct host_part *host, char *name, size_t size)
+{
+	const struct host_part *h;
+	char *p, *end;
+
+	for (h = host, p = name, end = name + size;
+	     h && h != &db_root && p < end; h = h->parent) {
+		int written = snprintf(p, end - p, "%s%s", h->part,
+				       (h->parent && h->parent->parent) ? "." : "");
+		if (written < 0) {
+			return false;
+		}
+		p += written;
+	}
+	return true;
+}
+
+
 /**
  * Save a search (sub)tree
  *
@@ -522,7 +710,7 @@ static void urldb_save_search_tree(struct search_node *parent, FILE *fp)
 	char host[256];
 	const struct host_part *h;
 	unsigned int path_count = 0;
-	char *path, *p, *end;
+	char *path;
 	int path_alloc = 64, path_used = 1;
 	time_t expiry, hsts_expiry = 0;
 	int hsts_include_subdomains = 0;
@@ -540,15 +728,9 @@ static void urldb_save_search_tree(struct search_node *parent, FILE *fp)
 
 	path[0] = '\0';
 
-	for (h = parent->data, p = host, end = host + sizeof host;
-	     h && h != &db_root && p < end; h = h->parent) {
-		int written = snprintf(p, end - p, "%s%s", h->part,
-				       (h->parent && h->parent->parent) ? "." : "");
-		if (written < 0) {
-			free(path);
-			return;
-		}
-		p += written;
+	if (!urldb_host_name(parent->data, host, sizeof host)) {
+		free(path);
+		return;
 	}
 
 	h = parent->data;
@@ -850,6 +1032,8 @@ urldb_iterate_partial_host(struct search_node *root,
 			return false;
 		}
 
+		urldb_host_materialise(root->data);
+
 		if (root->data->paths.children) {
 			/* and extract all paths attached to this host */
 			if (!urldb_iterate_entries_path(&root->data->paths,
@@ -980,6 +1164,8 @@ urldb_iterate_entries_host(struct search_node *parent,
 		return false;
 	}
 
+	urldb_host_materialise(parent->data);
+
 	if ((parent->data->paths.children) ||
 	    ((cookie_callback) &&
 	     (parent->data->paths.cookies))) {
@@ -1096,6 +1282,182 @@ urldb_add_path_fragment(struct path_data *segment, lwc_string *fragment)
 }
 
 
+/**
+ * Compute the child index hash of a path segment
+ *
+ * \param segment The segment
+ * \param len Length of the segment
+ * \param scheme The URL scheme of the segment
+ * \param port The port of the segment
+ * \return The hash value
+ */
+static uint32_t
+urldb_path_hash(const char *segment,
+		size_t len,
+		lwc_string *scheme,
+		unsigned int port)
+{
+	uint32_t hash = 0x811c9dc5;
+
+	while (len-- > 0) {
+		hash ^= (uint8_t)*segment++;
+		hash *= 0x01000193;
+	}
+
+	hash ^= lwc_string_hash_value(scheme);
+	hash *= 0x01000193;
+	hash ^= port;
+	hash *= 0x01000193;
+
+	return hash;
+}
+
+
+/**
+ * Check if a path segment node matches a segment, scheme and port
+ */
+static inline bool
+urldb_path_match(const struct path_data *p,
+		 const char *segment,
+		 size_t len,
+		 lwc_string *scheme,
+		 unsigned int port)
+{
+	bool match;
+
+	return (p->port == port &&
+		strncmp(p->segment, segment, len) == 0 &&
+		p->segment[len] == '\0' &&
+		lwc_string_isequal(p->scheme, scheme, &match) == lwc_error_ok &&
+		match == true);
+}
+
+
+/**
+ * Find the child of a path segment node
+ *
+ * \param parent The node to search the children of
+ * \param segment The child segment, which need not be NUL terminated
+ * \param len Length of the segment
+ * \param scheme The URL scheme of the child
+ * \param port The port of the child
+ * \return The child node or NULL if not found
+ */
+static struct path_data *
+urldb_find_child(const struct path_data *parent,
+		 const char *segment,
+		 size_t len,
+		 lwc_string *scheme,
+		 unsigned int port)
+{
+	struct path_data *p;
+
+	if (parent->child_index != NULL) {
+		unsigned int mask = parent->child_index_size - 1;
+		unsigned int slot;
+
+		slot = urldb_path_hash(segment, len, scheme, port) & mask;
+		while ((p = parent->child_index[slot]) != NULL) {
+			if (urldb_path_match(p, segment, len, scheme, port)) {
+				return p;
+			}
+			slot = (slot + 1) & mask;
+		}
+		return NULL;
+	}
+
+	for (p = parent->children; p != NULL; p = p->next) {
+		if (urldb_path_match(p, segment, len, scheme, port)) {
+			return p;
+		}
+	}
+	return NULL;
+}
+
+
+/**
+ * Add a path segment node to a child index
+ *
+ * \param index The index to add to
+ * \param size The number of slots in the index
+ * \param child The node to add
+ */
+static void
+urldb_child_index_insert(struct path_data **index,
+			 unsigned int size,
+			 struct path_data *child)
+{
+	unsigned int slot;
+
+	slot = urldb_path_hash(child->segment,
+			       strlen(child->segment),
+			       child->scheme,
+			       child->port) & (size - 1);
+	while (index[slot] != NULL) {
+		slot = (slot + 1) & (size - 1);
+	}
+	index[slot] = child;
+}
+
+
+/**
+ * Account for a new child of a path segment node
+ *
+ * Once there are enough children they are placed in a hash table which
+ * is grown to remain at most three quarters full. If the table cannot
+ * be allocated lookups fall back to walking the children.
+ *
+ * \param parent The node the child was added to
+ * \param child The new child node
+ */
+static void
+urldb_child_index_add(struct path_data *parent, struct path_data *child)
+{
+	struct path_data **index;
+	struct path_data *p;
+	unsigned int size;
+
+	parent->child_count++;
+
+	if (parent->child_count <= URLDB_PATH_INDEX_MIN) {
+		return;
+	}
+
+	if ((parent->child_index != NULL) &&
+	    (parent->child_count * 4 <= parent->child_index_size * 3)) {
+		urldb_child_index_insert(parent->child_index,
+					 parent->child_index_size,
+					 child);
+		return;
+	}
+
+	/* (re)build the index from the children */
+	size = parent->child_index_size;
+	if (size == 0) {
+		size = URLDB_PATH_INDEX_MIN * 2;
+	}
+	while (parent->child_count * 4 > size * 3) {
+		size *= 2;
+	}
+
+	free(parent->child_index);
+	parent->child_index = NULL;
+	parent->child_index_size = 0;
+
+	index = calloc(size, sizeof(*index));
+	if (index == NULL) {
+		return;
+	}
+
+	for (p = parent->children; p != NULL; p = p->next) {
+		urldb_child_index_insert(index, size, p);
+	}
+
+	parent->child_index = index;
+	parent->child_index_size = size;
+}
+
+
 /**
  * Add a path node to the tree
  *
@@ -1165,6 +1527,8 @@ urldb_add_path_node(lwc_string *scheme,
 	}
 	d->parent = parent;
 
+	urldb_child_index_add(parent, d);
+
 	return d;
 }
 
@@ -1312,7 +1676,6 @@ urldb_match_path(const struct path_data *parent,
 {
 	const struct path_data *p;
 	const char *slash;
-	bool match;
 
 	assert(parent != NULL);
 	assert(parent->segment == NULL);
@@ -1324,34 +1687,21 @@ urldb_match_path(const struct path_data *parent,
 	assert(path[0] == '/');
 
 	/* Start with children, as parent has no segment */
-	p = parent->children;
+	p = parent;
 
-	while (p != NULL) {
+	do {
 		slash = strchr(path + 1, '/');
 		if (!slash) {
 			slash = path + strlen(path);
 		}
 
-		if (strncmp(p->segment, path + 1, slash - path - 1) == 0 &&
-		    lwc_string_isequal(p->scheme, scheme, &match) == lwc_error_ok &&
-		    match == true &&
-		    p->port == port) {
-			if (*slash == '\0') {
-				/* Complete match */
-				return (struct path_data *) p;
-			}
-
-			/* Match so far, go down tree */
-			p = p->children;
+		p = urldb_find_child(p, path + 1, slash - path - 1,
+				     scheme, port);
 
-			path = slash;
-		} else {
-			/* No match, try next sibling */
-			p = p->next;
-		}
-	}
+		path = slash;
+	} while ((p != NULL) && (*slash != '\0'));
 
-	return NULL;
+	return (struct path_data *) p;
 }
 
 
@@ -1412,6 +1762,8 @@ static struct path_data *urldb_find_url(nsurl *url)
 		return NULL;
 	}
 
+	urldb_host_materialise(h);
+
 	/* generate plq (path, leaf, query) */
 	if (nsurl_get(url, NSURL_PATH | NSURL_QUERY, &plq, &len) != NSERROR_OK) {
 		lwc_string_unref(scheme);
@@ -2096,10 +2448,11 @@ urldb_add_path(lwc_string *scheme,
 	struct path_data *d, *e;
 	char *buf = path_query;
 	char *segment, *slash;
-	bool match;
 
 	assert(scheme && host && url);
 
+	urldb_host_materialise(host);
+
 	d = (struct path_data *) &host->paths;
 
 	/* skip leading '/' */
@@ -2113,14 +2466,8 @@ urldb_add_path(lwc_string *scheme,
 		if (!slash) {
 			/* last segment */
 			/* look for existing entry */
-			for (e = d->children; e; e = e->next)
-				if (strcmp(segment, e->segment) == 0 &&
-				    lwc_string_isequal(scheme,
-						       e->scheme, &match) ==
-				    lwc_error_ok &&
-				    match == true &&
-				    e->port == port)
-					break;
+			e = urldb_find_child(d, segment, strlen(segment),
+					     scheme, port);
 
 			d = e ? urldb_add_path_fragment(e, fragment) :
 				urldb_add_path_node(scheme, port,
@@ -2131,13 +2478,8 @@ urldb_add_path(lwc_string *scheme,
 		*slash = '\0';
 
 		/* look for existing entry */
-		for (e = d->children; e; e = e->next)
-			if (strcmp(segment, e->segment) == 0 &&
-			    lwc_string_isequal(scheme, e->scheme,
-					       &match) == lwc_error_ok &&
-			    match == true &&
-			    e->port == port)
-				break;
+		e = urldb_find_child(d, segment, strlen(segment),
+				     scheme, port);
 
 		d = e ? e : urldb_add_path_node(scheme, port, segment, NULL, d);
 		if (!d)
@@ -2249,75 +2591,423 @@ static struct host_part *urldb_add_host(const char *host)
 
 
 /**
- * Insert a cookie into the database
- *
- * \param c The cookie to insert
- * \param scheme URL scheme associated with cookie path
- * \param url URL (sans fragment) associated with cookie
- * \return true on success, false on memory exhaustion (c will be freed)
+ * Hash a cookie domain ignoring case
  */
-static bool
-urldb_insert_cookie(struct cookie_internal_data *c,
-		    lwc_string *scheme,
-		    nsurl *url)
+static uint32_t urldb_cookie_domain_hash(void *key)
 {
-	struct cookie_internal_data *d;
-	const struct host_part *h;
-	struct path_data *p;
-	time_t now = time(NULL);
+	const char *domain = key;
+	uint32_t hash = 0x811c9dc5;
 
-	assert(c);
+	while (*domain != '\0') {
+		hash ^= (uint8_t)ascii_to_lower(*domain++);
+		hash *= 0x01000193;
+	}
+	return hash;
+}
 
-	if (c->domain[0] == '.') {
-		h = urldb_search_find(
-			urldb_get_search_tree(&(c->domain[1])),
-			c->domain + 1);
-		if (!h) {
-			h = urldb_add_host(c->domain + 1);
-			if (!h) {
-				urldb_free_cookie(c);
-				return false;
-			}
-		}
+static void *urldb_cookie_key_clone(void *key)
+{
+	return strdup(key);
+}
 
-		p = (struct path_data *) &h->paths;
-	} else {
-		/* Need to have a URL and scheme, if it's not a domain cookie */
-		assert(url != NULL);
-		assert(scheme != NULL);
+static void urldb_cookie_key_destroy(void *key)
+{
+	free(key);
+}
 
-		h = urldb_search_find(
-			urldb_get_search_tree(c->domain),
-			c->domain);
+static bool urldb_cookie_domain_eq(void *key1, void *key2)
+{
+	return strcasecmp(key1, key2) == 0;
+}
 
-		if (!h) {
-			h = urldb_add_host(c->domain);
-			if (!h) {
-				urldb_free_cookie(c);
-				return false;
-			}
-		}
+static void *urldb_cookie_domain_alloc(void *key)
+{
+	return calloc(1, sizeof(struct urldb_cookie_domain));
+}
 
-		/* find path */
-		p = urldb_add_path(scheme, 0, h,
-				   strdup(c->path), NULL, url);
-		if (!p) {
-			urldb_free_cookie(c);
-			return false;
-		}
-	}
+static void urldb_cookie_domain_destroy(void *value)
+{
+	/* the cookies are owned by the path tree */
+	free(value);
+}
 
-	/* add cookie */
-	for (d = p->cookies; d; d = d->next) {
-		if (!strcmp(d->domain, c->domain) &&
-		    !strcmp(d->path, c->path) &&
-		    !strcmp(d->name, c->name))
-			break;
+/**
+ * Parameters for the cookie domain index
+ */
+static hashmap_parameters_t urldb_cookie_domain_parameters = {
+	.key_clone = urldb_cookie_key_clone,
+	.key_hash = urldb_cookie_domain_hash,
+	.key_eq = urldb_cookie_domain_eq,
+	.key_destroy = urldb_cookie_key_destroy,
+	.value_alloc = urldb_cookie_domain_alloc,
+	.value_destroy = urldb_cookie_domain_destroy,
+};
+
+static uint32_t urldb_cookie_header_hash(void *key)
+{
+	const char *str = key;
+	uint32_t hash = 0x811c9dc5;
+
+	while (*str != '\0') {
+		hash ^= (uint8_t)*str++;
+		hash *= 0x01000193;
 	}
+	return hash;
+}
 
-	if (d) {
+static bool urldb_cookie_header_eq(void *key1, void *key2)
+{
+	return strcmp(key1, key2) == 0;
+}
+
+static void *urldb_cookie_header_alloc(void *key)
+{
+	return calloc(1, sizeof(struct urldb_cookie_header));
+}
+
+static void urldb_cookie_header_destroy(void *value)
+{
+	struct urldb_cookie_header *ch = value;
+
+	free(ch->header);
+	free(ch->cookies);
+	free(ch);
+}
+
+/**
+ * Parameters for the Cookie header cache
+ */
+static hashmap_parameters_t urldb_cookie_header_parameters = {
+	.key_clone = urldb_cookie_key_clone,
+	.key_hash = urldb_cookie_header_hash,
+	.key_eq = urldb_cookie_header_eq,
+	.key_destroy = urldb_cookie_key_destroy,
+	.value_alloc = urldb_cookie_header_alloc,
+	.value_destroy = urldb_cookie_header_destroy,
+};
+
+
+/**
+ * Discard every cached Cookie header
+ *
+ * Must be called whenever a cookie is added, replaced or removed.
+ */
+static void urldb_cookie_headers_flush(void)
+{
+	if (cookie_headers != NULL) {
+		hashmap_destroy(cookie_headers);
+		cookie_headers = NULL;
+	}
+}
+
+
+/**
+ * Add a cookie to the end of the domain index
+ *
+ * \param c The cookie to add
+ * \return true on success, false on memory exhaustion
+ */
+static bool urldb_cookie_index_add(struct cookie_internal_data *c)
+{
+	struct urldb_cookie_domain *cd;
+
+	urldb_cookie_headers_flush();
+
+	if (cookie_domains == NULL) {
+		cookie_domains = hashmap_create(&urldb_cookie_domain_parameters);
+		if (cookie_domains == NULL) {
+			return false;
+		}
+	}
+
+	cd = hashmap_lookup(cookie_domains, c->domain);
+	if (cd == NULL) {
+		cd = hashmap_insert(cookie_domains, c->domain);
+		if (cd == NULL) {
+			return false;
+		}
+	}
+
+	c->domain_prev = cd->cookies_end;
+	c->domain_next = NULL;
+	if (cd->cookies_end != NULL) {
+		cd->cookies_end->domain_next = c;
+	} else {
+		cd->cookies = c;
+	}
+	cd->cookies_end = c;
+
+	return true;
+}
+
+
+/**
+ * Remove a cookie from the domain index
+ *
+ * \param c The cookie to remove
+ */
+static void urldb_cookie_index_remove(struct cookie_internal_data *c)
+{
+	struct urldb_cookie_domain *cd;
+
+	urldb_cookie_headers_flush();
+
+	if (cookie_domains == NULL) {
+		return;
+	}
+
+	cd = hashmap_lookup(cookie_domains, c->domain);
+	if (cd == NULL) {
+		return;
+	}
+
+	if (c->domain_prev != NULL) {
+		c->domain_prev->domain_next = c->domain_next;
+	} else if (cd->cookies == c) {
+		cd->cookies = c->domain_next;
+	} else {
+		/* not in the index */
+		return;
+	}
+
+	if (c->domain_next != NULL) {
+		c->domain_next->domain_prev = c->domain_prev;
+	} else {
+		cd->cookies_end = c->domain_prev;
+	}
+
+	c->domain_prev = c->domain_next = NULL;
+
+	if (cd->cookies == NULL) {
+		hashmap_remove(cookie_domains, c->domain);
+	}
+}
+
+
+/**
+ * Replace a cookie in the domain index keeping its position
+ *
+ * \param d The cookie being replaced
+ * \param c The replacement cookie, which has the same domain
+ */
+static void
+urldb_cookie_index_replace(struct cookie_internal_data *d,
+			   struct cookie_internal_data *c)
+{
+	struct urldb_cookie_domain *cd;
+
+	urldb_cookie_headers_flush();
+
+	cd = NULL;
+	if (cookie_domains != NULL) {
+		cd = hashmap_lookup(cookie_domains, d->domain);
+	}
+	if ((cd == NULL) ||
+	    ((d->domain_prev == NULL) && (cd->cookies != d))) {
+		/* not in the index */
+		urldb_cookie_index_add(c);
+		return;
+	}
+
+	c->domain_prev = d->domain_prev;
+	c->domain_next = d->domain_next;
+	if (c->domain_prev != NULL) {
+		c->domain_prev->domain_next = c;
+	} else {
+		cd->cookies = c;
+	}
+	if (c->domain_next != NULL) {
+		c->domain_next->domain_prev = c;
+	} else {
+		cd->cookies_end = c;
+	}
+
+	d->domain_prev = d->domain_next = NULL;
+}
+
+
+/**
+ * Check if a cookie path matches a request path
+ *
+ * \param cookie_path The path of the cookie
+ * \param path The path of the request
+ * \return true if the cookie applies to the path
+ */
+static bool
+urldb_cookie_path_match(const char *cookie_path, const char *path)
+{
+	size_t len = strlen(cookie_path);
+
+	if (strncmp(cookie_path, path, len) != 0) {
+		return false;
+	}
+
+	return ((path[len] == '\0') ||
+		(path[len] == '/') ||
+		((len > 0) && (cookie_path[len - 1] == '/')));
+}
+
+
+/**
+ * Note a cookie has been sent in a request
+ *
+ * \param c The cookie used
+ * \param now The current time
+ */
+static void urldb_cookie_used(struct cookie_internal_data *c, time_t now)
+{
+	if (c->last_used != now) {
+		c->last_used = now;
+		cookie_manager_add((struct cookie_data *)c);
+	}
+}
+
+
+/**
+ * Add the cookies of a domain which apply to a request to a list
+ *
+ * \param domain The cookie domain
+ * \param path The path of the request
+ * \param secure The request is secure
+ * \param include_http_only Whether to include HttpOnly cookies
+ * \param now The current time
+ * \param matched The list of cookies, updated on return
+ * \param count The number of cookies in the list, updated on return
+ * \param alloc The allocated size of the list, updated on return
+ * \return true on success, false on memory exhaustion
+ */
+static bool
+urldb_cookie_match_domain(const char *domain,
+			  const char *path,
+			  bool secure,
+			  bool include_http_only,
+			  time_t now,
+			  struct cookie_internal_data ***matched,
+			  unsigned int *count,
+			  unsigned int *alloc)
+{
+	struct urldb_cookie_domain *cd;
+	struct cookie_internal_data *c;
+
+	if (cookie_domains == NULL) {
+		return true;
+	}
+
+	cd = hashmap_lookup(cookie_domains, (void *)domain);
+	if (cd == NULL) {
+		return true;
+	}
+
+	for (c = cd->cookies; c != NULL; c = c->domain_next) {
+		if (c->expires != -1 && c->expires < now)
+			/* cookie has expired => ignore */
+			continue;
+
+		if (!urldb_cookie_path_match(c->path, path))
+			/* paths don't match => ignore */
+			continue;
+
+		if (c->secure && !secure)
+			/* secure cookie for insecure host. ignore */
+			continue;
+
+		if (c->http_only && !include_http_only)
+			/* Ignore HttpOnly */
+			continue;
+
+		if (*count == *alloc) {
+			struct cookie_internal_data **temp;
+			unsigned int size = *alloc * 2 + 16;
+
+			temp = realloc(*matched, size * sizeof(*temp));
+			if (temp == NULL) {
+				return false;
+			}
+			*matched = temp;
+			*alloc = size;
+		}
+
+		(*matched)[(*count)++] = c;
+	}
+
+	return true;
+}
+
+
+/**
+ * Insert a cookie into the database
+ *
+ * \param c The cookie to insert
+ * \param scheme URL scheme associated with cookie path
+ * \param url URL (sans fragment) associated with cookie
+ * \return true on success, false on memory exhaustion (c will be freed)
+ */
+static bool
+urldb_insert_cookie(struct cookie_internal_data *c,
+		    lwc_string *scheme,
+		    nsurl *url)
+{
+	struct cookie_internal_data *d;
+	const struct host_part *h;
+	struct path_data *p;
+	time_t now = time(NULL);
+
+	assert(c);
+
+	if (c->domain[0] == '.') {
+		h = urldb_search_find(
+			urldb_get_search_tree(&(c->domain[1])),
+			c->domain + 1);
+		if (!h) {
+			h = urldb_add_host(c->domain + 1);
+			if (!h) {
+				urldb_free_cookie(c);
+				return false;
+			}
+		}
+
+		urldb_host_materialise(h);
+
+		p = (struct path_data *) &h->paths;
+	} else {
+		/* Need to have a URL and scheme, if it's not a domain cookie */
+		assert(url != NULL);
+		assert(scheme != NULL);
+
+		h = urldb_search_find(
+			urldb_get_search_tree(c->domain),
+			c->domain);
+
+		if (!h) {
+			h = urldb_add_host(c->domain);
+			if (!h) {
+				urldb_free_cookie(c);
+				return false;
+			}
+		}
+
+		/* find path */
+		p = urldb_add_path(scheme, 0, h,
+				   strdup(c->path), NULL, url);
+		if (!p) {
+			urldb_free_cookie(c);
+			return false;
+		}
+	}
+
+	/* add cookie */
+	for (d = p->cookies; d; d = d->next) {
+		if (!strcmp(d->domain, c->domain) &&
+		    !strcmp(d->path, c->path) &&
+		    !strcmp(d->name, c->name))
+			break;
+	}
+
+	if (d) {
 		if (c->expires != -1 && c->expires < now) {
 			/* remove cookie */
+			urldb_cookie_index_remove(d);
+
 			if (d->next)
 				d->next->prev = d->prev;
 			else
@@ -2333,6 +3023,8 @@ urldb_insert_cookie(struct cookie_internal_data *c,
 			urldb_free_cookie(c);
 		} else {
 			/* replace d with c */
+			urldb_cookie_index_replace(d, c);
+
 			c->prev = d->prev;
 			c->next = d->next;
 			if (c->next)
@@ -2350,6 +3042,11 @@ urldb_insert_cookie(struct cookie_internal_data *c,
 			cookie_manager_add((struct cookie_data *)c);
 		}
 	} else {
+		if (!urldb_cookie_index_add(c)) {
+			urldb_free_cookie(c);
+			return false;
+		}
+
 		c->prev = p->cookies_end;
 		c->next = NULL;
 		if (p->cookies_end)
@@ -2553,6 +3250,8 @@ urldb_delete_cookie_paths(const char *domain,
 			if (strcmp(c->domain, domain) == 0 &&
 			    strcmp(c->path, path) == 0 &&
 			    strcmp(c->name, name) == 0) {
+				urldb_cookie_index_remove(c);
+
 				if (c->prev) {
 					c->prev->next = c->next;
 				} else {
@@ -2729,6 +3428,8 @@ static void urldb_destroy_path_node_content(struct path_data *node)
 
 	free(node->urld.title);
 
+	free(node->child_index);
+
 	for (a = node->cookies; a; a = b) {
 		b = a->next;
 		urldb_destroy_cookie(a);
@@ -2743,103 +3444,823 @@ static void urldb_destroy_path_node_content(struct path_data *node)
  */
 static void urldb_destroy_prot_space(struct prot_space_data *space)
 {
-	lwc_string_unref(space->scheme);
-	free(space->realm);
-	free(space->auth);
+	lwc_string_unref(space->scheme);
+	free(space->realm);
+	free(space->auth);
+
+	free(space);
+}
+
+
+/**
+ * Destroy a path tree
+ *
+ * \param root Root node of tree to destroy
+ */
+static void urldb_destroy_path_tree(struct path_data *root)
+{
+	struct path_data *p = root;
+
+	do {
+		if (p->children != NULL) {
+			p = p->children;
+		} else {
+			struct path_data *q = p;
+
+			while (p != root) {
+				if (p->next != NULL) {
+					p = p->next;
+					break;
+				}
+
+				p = p->parent;
+
+				urldb_destroy_path_node_content(q);
+				free(q);
+
+				q = p;
+			}
+
+			urldb_destroy_path_node_content(q);
+			free(q);
+		}
+	} while (p != root);
+}
+
+
+/**
+ * Destroy a host tree
+ *
+ * \param root Root node of tree to destroy
+ */
+static void urldb_destroy_host_tree(struct host_part *root)
+{
+	struct host_part *a, *b;
+	struct path_data *p, *q;
+	struct prot_space_data *s, *t;
+
+	/* Destroy children */
+	for (a = root->children; a; a = b) {
+		b = a->next;
+		urldb_destroy_host_tree(a);
+	}
+
+	/* Now clean up paths */
+	for (p = root->paths.children; p; p = q) {
+		q = p->next;
+		urldb_destroy_path_tree(p);
+	}
+
+	/* Root path */
+	urldb_destroy_path_node_content(&root->paths);
+
+	/* Proctection space data */
+	for (s = root->prot_space; s; s = t) {
+		t = s->next;
+		urldb_destroy_prot_space(s);
+	}
+
+	/* And ourselves */
+	free(root->part);
+	free(root);
+}
+
+
+/**
+ * Destroy a search tree
+ *
+ * \param root Root node of tree to destroy
+ */
+static void urldb_destroy_search_tree(struct search_node *root)
+{
+	/* Destroy children */
+	if (root->left != &empty)
+		urldb_destroy_search_tree(root->left);
+	if (root->right != &empty)
+		urldb_destroy_search_tree(root->right);
+
+	/* And destroy ourselves */
+	free(root);
+}
+
+
+/**
+ * Add an URL read from a saved database
+ *
+ * \param h The host part the URL belongs to
+ * \param host The host name
+ * \param scheme The URL scheme
+ * \param port The URL port or 0 for the scheme default
+ * \param path The URL path and query
+ * \param p_out Updated with the path data of the URL on success
+ * \return NSERROR_OK on success or error code on failure
+ */
+static nserror
+urldb_load_url(struct host_part *h,
+	       const char *host,
+	       const char *scheme,
+	       unsigned int port,
+	       const char *path,
+	       struct path_data **p_out)
+{
+	char url[64 + 3 + 256 + 6 + 4096 + 1 + 1];
+	bool is_file = false;
+	nsurl *nsurl;
+	lwc_string *scheme_lwc, *fragment_lwc;
+	char *path_query;
+	size_t len;
+	struct path_data *p;
+	char ports[12];
+
+	if (!strcasecmp(host, "localhost") &&
+	    !strcasecmp(scheme, "file"))
+		is_file = true;
+
+	snprintf(ports, sizeof ports, "%u", port);
+	snprintf(url, sizeof url, "%s://%s%s%s%s",
+		 scheme,
+		 /* file URLs have no host */
+		 (is_file ? "" : host),
+		 (port ? ":" : ""),
+		 (port ? ports : ""),
+		 path);
+
+	if (nsurl_create(url, &nsurl) != NSERROR_OK) {
+		NSLOG(netsurf, INFO, "Failed inserting '%s'", url);
+		return NSERROR_NOMEM;
+	}
+
+	if (url_bloom != NULL) {
+		uint32_t hash = nsurl_hash(nsurl);
+		bloom_insert_hash(url_bloom, hash);
+	}
+
+	/* Copy and merge path/query strings */
+	if (nsurl_get(nsurl, NSURL_PATH | NSURL_QUERY,
+		      &path_query, &len) != NSERROR_OK) {
+		NSLOG(netsurf, INFO, "Failed inserting '%s'", url);
+		nsurl_unref(nsurl);
+		return NSERROR_NOMEM;
+	}
+
+	scheme_lwc = nsurl_get_component(nsurl, NSURL_SCHEME);
+	fragment_lwc = nsurl_get_component(nsurl, NSURL_FRAGMENT);
+	p = urldb_add_path(scheme_lwc, port, h, path_query,
+			   fragment_lwc, nsurl);
+	nsurl_unref(nsurl);
+	lwc_string_unref(scheme_lwc);
+	if (fragment_lwc != NULL)
+		lwc_string_unref(fragment_lwc);
+
+	if (!p) {
+		NSLOG(netsurf, INFO, "Failed inserting '%s'", url);
+		return NSERROR_NOMEM;
+	}
+
+	*p_out = p;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Release the loaded URL database snapshot
+ *
+ * Any host still referencing the snapshot must have been destroyed.
+ */
+static void urldb_snapshot_release(void)
+{
+	if (urldb_snapshot.data == NULL) {
+		return;
+	}
+
+#ifdef HAVE_MMAP
+	if (urldb_snapshot.mapped) {
+		munmap(urldb_snapshot.data, urldb_snapshot.size);
+	} else {
+		free(urldb_snapshot.data);
+	}
+#else
+	free(urldb_snapshot.data);
+#endif
+
+	memset(&urldb_snapshot, 0, sizeof(urldb_snapshot));
+}
+
+
+/**
+ * Add the URLs of a host held in the loaded snapshot to its paths
+ *
+ * This must be called before the paths of a host are used, including
+ * by cookie handling as domain cookies are attached to a host's root
+ * path.
+ *
+ * \param host The host to materialise
+ * \return NSERROR_OK on success or error code on failure
+ */
+static nserror urldb_host_materialise(const struct host_part *host)
+{
+	/* the host data is unchanged, its paths are only completed */
+	struct host_part *h = (struct host_part *)host;
+	const struct urldb_snapshot_host *sh = h->snapshot;
+	const char *strings = urldb_snapshot.strings;
+	const char *name;
+	uint32_t u;
+	nserror res = NSERROR_OK;
+
+	if (sh == NULL) {
+		return NSERROR_OK;
+	}
+
+	/* detach first as adding the paths uses them */
+	h->snapshot = NULL;
+
+	name = strings + sh->host;
+
+	for (u = sh->first_url; u < sh->first_url + sh->url_count; u++) {
+		const struct urldb_snapshot_url *su = &urldb_snapshot.urls[u];
+		struct path_data *p;
+
+		res = urldb_load_url(h, name,
+				     strings + su->scheme,
+				     su->port,
+				     strings + su->path,
+				     &p);
+		if (res != NSERROR_OK) {
+			break;
+		}
+
+		p->urld.visits = su->visits;
+		p->urld.last_visit = (time_t)su->last_visit;
+		p->urld.type = (content_type)su->type;
+
+		if ((strings[su->title] != '\0') && (p->urld.title == NULL)) {
+			p->urld.title = strdup(strings + su->title);
+		}
+	}
+
+	urldb_snapshot.pending--;
+	if (urldb_snapshot.pending == 0) {
+		urldb_snapshot_release();
+	}
+
+	return res;
+}
+
+
+/**
+ * Add the URLs of every host held in the loaded snapshot
+ */
+static void urldb_snapshot_materialise_all(void)
+{
+	unsigned int i;
+
+	for (i = 0;
+	     (urldb_snapshot.data != NULL) && (i < urldb_snapshot.host_count);
+	     i++) {
+		const struct urldb_snapshot_host *sh = &urldb_snapshot.hosts[i];
+		const char *name = urldb_snapshot.strings + sh->host;
+		const struct host_part *h;
+
+		h = urldb_search_find(urldb_get_search_tree(name), name);
+		if (h != NULL) {
+			urldb_host_materialise(h);
+		}
+	}
+}
+
+
+/**
+ * Read a binary URL database snapshot into memory
+ *
+ * \param filename The snapshot file
+ * \return NSERROR_OK on success or error code on failure
+ */
+static nserror urldb_snapshot_map(const char *filename)
+{
+#ifdef HAVE_MMAP
+	struct stat sb;
+	void *data;
+	int fd;
+
+	fd = open(filename, O_RDONLY);
+	if (fd < 0) {
+		return NSERROR_NOT_FOUND;
+	}
+
+	if ((fstat(fd, &sb) != 0) || (sb.st_size == 0)) {
+		close(fd);
+		return NSERROR_NOT_FOUND;
+	}
+
+	data = mmap(NULL, sb.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (data == MAP_FAILED) {
+		return NSERROR_NOMEM;
+	}
+
+	urldb_snapshot.data = data;
+	urldb_snapshot.size = sb.st_size;
+	urldb_snapshot.mapped = true;
+#else
+	FILE *fp;
+	long size;
+	void *data;
+
+	fp = fopen(filename, "rb");
+	if (fp == NULL) {
+		return NSERROR_NOT_FOUND;
+	}
+
+	if ((fseek(fp, 0, SEEK_END) != 0) ||
+	    ((size = ftell(fp)) <= 0) ||
+	    (fseek(fp, 0, SEEK_SET) != 0)) {
+		fclose(fp);
+		return NSERROR_NOT_FOUND;
+	}
+
+	data = malloc(size);
+	if (data == NULL) {
+		fclose(fp);
+		return NSERROR_NOMEM;
+	}
+
+	if (fread(data, size, 1, fp) != 1) {
+		free(data);
+		fclose(fp);
+		return NSERROR_NOT_FOUND;
+	}
+	fclose(fp);
+
+	urldb_snapshot.data = data;
+	urldb_snapshot.size = size;
+	urldb_snapshot.mapped = false;
+#endif
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Check the records of the loaded snapshot are consistent
+ *
+ * \param hdr The snapshot header
+ * \return true if the snapshot is usable
+ */
+static bool urldb_snapshot_valid(const struct urldb_snapshot_header *hdr)
+{
+	uint32_t i;
+
+	if ((hdr->strings_size == 0) ||
+	    (urldb_snapshot.strings[hdr->strings_size - 1] != '\0')) {
+		return false;
+	}
+
+	for (i = 0; i < hdr->host_count; i++) {
+		const struct urldb_snapshot_host *sh = &urldb_snapshot.hosts[i];
+
+		if ((sh->host >= hdr->strings_size) ||
+		    (sh->first_url > hdr->url_count) ||
+		    (sh->url_count > hdr->url_count - sh->first_url)) {
+			return false;
+		}
+	}
+
+	for (i = 0; i < hdr->url_count; i++) {
+		const struct urldb_snapshot_url *su = &urldb_snapshot.urls[i];
+
+		if ((su->scheme >= hdr->strings_size) ||
+		    (su->path >= hdr->strings_size) ||
+		    (su->title >= hdr->strings_size)) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * Load a binary URL database snapshot
+ *
+ * The hosts are added to the database immediately, their paths are
+ * added when first used.
+ *
+ * \param filename The snapshot file
+ * \return NSERROR_OK on success or error code on failure
+ */
+static nserror urldb_load_snapshot(const char *filename)
+{
+	const struct urldb_snapshot_header *hdr;
+	const uint8_t *data;
+	size_t offset;
+	bool merged = false;
+	uint32_t i;
+	nserror res;
+
+	/* only one snapshot may be referenced at a time */
+	urldb_snapshot_materialise_all();
+	urldb_snapshot_release();
+
+	res = urldb_snapshot_map(filename);
+	if (res != NSERROR_OK) {
+		NSLOG(netsurf, INFO, "Failed to read URL snapshot '%s'",
+		      filename);
+		return res;
+	}
+
+	data = urldb_snapshot.data;
+	hdr = urldb_snapshot.data;
+
+	if ((urldb_snapshot.size < sizeof(*hdr)) ||
+	    (hdr->version != URLDB_SNAPSHOT_VERSION) ||
+	    (hdr->byte_order != URLDB_SNAPSHOT_BYTE_ORDER)) {
+		NSLOG(netsurf, INFO, "Unsupported URL snapshot version.");
+		urldb_snapshot_release();
+		return NSERROR_INVALID;
+	}
+
+	/* locate the sections */
+	offset = sizeof(*hdr);
+	urldb_snapshot.hosts = (const void *)(data + offset);
+	offset += (size_t)hdr->host_count * sizeof(struct urldb_snapshot_host);
+	urldb_snapshot.urls = (const void *)(data + offset);
+	offset += (size_t)hdr->url_count * sizeof(struct urldb_snapshot_url);
+	offset += (hdr->bloom_size + 7) & ~7;
+	urldb_snapshot.strings = (const char *)(data + offset);
+	offset += hdr->strings_size;
+
+	if ((offset > urldb_snapshot.size) || !urldb_snapshot_valid(hdr)) {
+		NSLOG(netsurf, INFO, "Corrupt URL snapshot.");
+		urldb_snapshot_release();
+		return NSERROR_INVALID;
+	}
+	urldb_snapshot.host_count = hdr->host_count;
+
+	/* the stored filter covers every URL without materialising them */
+	if (url_bloom == NULL)
+		url_bloom = bloom_create(BLOOM_SIZE);
+
+	if (url_bloom != NULL) {
+		merged = bloom_merge(url_bloom,
+				     (const uint8_t *)(urldb_snapshot.urls +
+						       hdr->url_count),
+				     hdr->bloom_size,
+				     hdr->bloom_items);
+	}
+
+	for (i = 0; i < hdr->host_count; i++) {
+		const struct urldb_snapshot_host *sh = &urldb_snapshot.hosts[i];
+		struct host_part *h;
+
+		h = urldb_add_host(urldb_snapshot.strings + sh->host);
+		if (!h) {
+			NSLOG(netsurf, INFO, "Failed adding host: '%s'",
+			      urldb_snapshot.strings + sh->host);
+			urldb_snapshot_materialise_all();
+			return NSERROR_NOMEM;
+		}
+		h->hsts.expires = (time_t)sh->hsts_expires;
+		h->hsts.include_sub_domains = sh->hsts_include_sub_domains;
+
+		if (sh->url_count > 0) {
+			h->snapshot = sh;
+			urldb_snapshot.pending++;
+		}
+	}
+
+	if (urldb_snapshot.pending == 0) {
+		urldb_snapshot_release();
+	} else if (!merged) {
+		/* filter unusable so the URLs must be inserted now */
+		urldb_snapshot_materialise_all();
+	}
+
+	NSLOG(netsurf, INFO, "Loaded URL snapshot with %u hosts and %u URLs",
+	      hdr->host_count, hdr->url_count);
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Context used while building a URL database snapshot
+ */
+struct urldb_snapshot_builder {
+	struct urldb_snapshot_host *hosts; /**< Host records */
+	uint32_t host_count; /**< Number of host records */
+	uint32_t host_alloc; /**< Number of allocated host records */
+
+	struct urldb_snapshot_url *urls; /**< URL records */
+	uint32_t url_count; /**< Number of URL records */
+	uint32_t url_alloc; /**< Number of allocated URL records */
+
+	char *strings; /**< String table */
+	uint32_t strings_size; /**< Used size of string table */
+	uint32_t strings_alloc; /**< Allocated size of string table */
+
+	lwc_string *scheme; /**< Scheme of previous URL record */
+	uint32_t scheme_string; /**< String of previous URL record scheme */
+
+	struct bloom_filter *bloom; /**< Filter of saved URLs */
+	time_t expiry; /**< Expiry time of URLs */
+};
+
+
+/**
+ * Add a string to a snapshot string table
+ *
+ * \param b The snapshot builder
+ * \param str The string to add
+ * \param offset Updated with the offset of the string in the table
+ * \return NSERROR_OK on success or NSERROR_NOMEM on allocation failure
+ */
+static nserror
+urldb_snapshot_add_string(struct urldb_snapshot_builder *b,
+			  const char *str,
+			  uint32_t *offset)
+{
+	size_t len = strlen(str) + 1;
 
-	free(space);
+	if (len == 1) {
+		/* the table always starts with the empty string */
+		*offset = 0;
+		return NSERROR_OK;
+	}
+
+	if (b->strings_size + len > b->strings_alloc) {
+		uint32_t alloc = b->strings_alloc * 2 + len;
+		char *strings;
+
+		strings = realloc(b->strings, alloc);
+		if (strings == NULL) {
+			return NSERROR_NOMEM;
+		}
+		b->strings = strings;
+		b->strings_alloc = alloc;
+	}
+
+	memcpy(b->strings + b->strings_size, str, len);
+	*offset = b->strings_size;
+	b->strings_size += len;
+
+	return NSERROR_OK;
 }
 
 
 /**
- * Destroy a path tree
+ * Add the URLs to be saved from a path tree to a snapshot
  *
- * \param root Root node of tree to destroy
+ * \param b The snapshot builder
+ * \param root Root of path data tree
+ * \return NSERROR_OK on success or error code on failure
  */
-static void urldb_destroy_path_tree(struct path_data *root)
+static nserror
+urldb_snapshot_add_paths(struct urldb_snapshot_builder *b,
+			 const struct path_data *root)
 {
-	struct path_data *p = root;
+	const struct path_data *p = root;
+	nserror res;
 
 	do {
 		if (p->children != NULL) {
+			/* Drill down into children */
 			p = p->children;
-		} else {
-			struct path_data *q = p;
+			continue;
+		}
 
-			while (p != root) {
-				if (p->next != NULL) {
-					p = p->next;
-					break;
+		if ((p->url != NULL) &&
+		    (p->persistent ||
+		     ((p->urld.last_visit > b->expiry) &&
+		      (p->urld.visits > 0)))) {
+			struct urldb_snapshot_url *su;
+			char *path_query;
+			size_t len;
+
+			if (b->url_count == b->url_alloc) {
+				uint32_t alloc = b->url_alloc * 2 + 64;
+
+				su = realloc(b->urls, alloc * sizeof(*su));
+				if (su == NULL) {
+					return NSERROR_NOMEM;
 				}
+				b->urls = su;
+				b->url_alloc = alloc;
+			}
+			su = &b->urls[b->url_count];
+
+			if (p->scheme != b->scheme) {
+				res = urldb_snapshot_add_string(b,
+						lwc_string_data(p->scheme),
+						&b->scheme_string);
+				if (res != NSERROR_OK) {
+					return res;
+				}
+				b->scheme = p->scheme;
+			}
+			su->scheme = b->scheme_string;
 
-				p = p->parent;
+			res = nsurl_get(p->url, NSURL_PATH | NSURL_QUERY,
+					&path_query, &len);
+			if (res != NSERROR_OK) {
+				return res;
+			}
+			res = urldb_snapshot_add_string(b, path_query,
+							&su->path);
+			free(path_query);
+			if (res != NSERROR_OK) {
+				return res;
+			}
 
-				urldb_destroy_path_node_content(q);
-				free(q);
+			res = urldb_snapshot_add_string(b,
+					p->urld.title != NULL ?
+					p->urld.title : "",
+					&su->title);
+			if (res != NSERROR_OK) {
+				return res;
+			}
 
-				q = p;
+			su->port = p->port;
+			su->visits = p->urld.visits;
+			su->type = p->urld.type;
+			su->last_visit = p->urld.last_visit;
+
+			bloom_insert_hash(b->bloom, nsurl_hash(p->url));
+
+			b->url_count++;
+		}
+
+		/* Now, find next node to process. */
+		while (p != root) {
+			if (p->next != NULL) {
+				/* Have a sibling, process that */
+				p = p->next;
+				break;
 			}
 
-			urldb_destroy_path_node_content(q);
-			free(q);
+			/* Ascend tree */
+			p = p->parent;
 		}
 	} while (p != root);
+
+	return NSERROR_OK;
 }
 
 
 /**
- * Destroy a host tree
+ * Add a search (sub)tree to a snapshot
  *
- * \param root Root node of tree to destroy
+ * \param b The snapshot builder
+ * \param parent root node of search tree to add.
+ * \return NSERROR_OK on success or error code on failure
  */
-static void urldb_destroy_host_tree(struct host_part *root)
+static nserror
+urldb_snapshot_add_search_tree(struct urldb_snapshot_builder *b,
+			       struct search_node *parent)
 {
-	struct host_part *a, *b;
-	struct path_data *p, *q;
-	struct prot_space_data *s, *t;
+	const struct host_part *h;
+	struct urldb_snapshot_host *sh;
+	char host[256];
+	uint32_t first_url;
+	time_t hsts_expiry = 0;
+	bool hsts_include_sub_domains = false;
+	nserror res;
 
-	/* Destroy children */
-	for (a = root->children; a; a = b) {
-		b = a->next;
-		urldb_destroy_host_tree(a);
+	if (parent == &empty)
+		return NSERROR_OK;
+
+	res = urldb_snapshot_add_search_tree(b, parent->left);
+	if (res != NSERROR_OK) {
+		return res;
 	}
 
-	/* Now clean up paths */
-	for (p = root->paths.children; p; p = q) {
-		q = p->next;
-		urldb_destroy_path_tree(p);
+	h = parent->data;
+	if (h->hsts.expires > b->expiry) {
+		hsts_expiry = h->hsts.expires;
+		hsts_include_sub_domains = h->hsts.include_sub_domains;
 	}
 
-	/* Root path */
-	urldb_destroy_path_node_content(&root->paths);
+	first_url = b->url_count;
+	res = urldb_snapshot_add_paths(b, &h->paths);
+	if (res != NSERROR_OK) {
+		return res;
+	}
 
-	/* Proctection space data */
-	for (s = root->prot_space; s; s = t) {
-		t = s->next;
-		urldb_destroy_prot_space(s);
+	if ((b->url_count > first_url) || (hsts_expiry != 0)) {
+		if (!urldb_host_name(h, host, sizeof host)) {
+			return NSERROR_SAVE_FAILED;
+		}
+
+		if (b->host_count == b->host_alloc) {
+			uint32_t alloc = b->host_alloc * 2 + 16;
+
+			sh = realloc(b->hosts, alloc * sizeof(*sh));
+			if (sh == NULL) {
+				return NSERROR_NOMEM;
+			}
+			b->hosts = sh;
+			b->host_alloc = alloc;
+		}
+		sh = &b->hosts[b->host_count];
+
+		res = urldb_snapshot_add_string(b, host, &sh->host);
+		if (res != NSERROR_OK) {
+			return res;
+		}
+		sh->first_url = first_url;
+		sh->url_count = b->url_count - first_url;
+		sh->hsts_include_sub_domains = hsts_include_sub_domains;
+		sh->hsts_expires = hsts_expiry;
+
+		b->host_count++;
 	}
 
-	/* And ourselves */
-	free(root->part);
-	free(root);
+	return urldb_snapshot_add_search_tree(b, parent->right);
 }
 
 
 /**
- * Destroy a search tree
+ * Write a URL database snapshot to file
  *
- * \param root Root node of tree to destroy
+ * The snapshot is written to a temporary file which then replaces the
+ * file, so another instance with the previous snapshot mapped keeps
+ * it intact and a failed write loses nothing.
+ *
+ * \param b The snapshot builder
+ * \param filename The file to write
+ * \return NSERROR_OK on success or error code on failure
  */
-static void urldb_destroy_search_tree(struct search_node *root)
+static nserror
+urldb_snapshot_write(struct urldb_snapshot_builder *b, const char *filename)
 {
-	/* Destroy children */
-	if (root->left != &empty)
-		urldb_destroy_search_tree(root->left);
-	if (root->right != &empty)
-		urldb_destroy_search_tree(root->right);
+	static const uint8_t padding[8];
+	struct urldb_snapshot_header hdr;
+	const uint8_t *bloom;
+	size_t bloom_size;
+	size_t tname_size;
+	char *tname;
+	bool ok;
+	FILE *fp;
 
-	/* And destroy ourselves */
-	free(root);
+	bloom = bloom_data(b->bloom, &bloom_size);
+
+	memset(&hdr, 0, sizeof(hdr));
+	memcpy(hdr.magic, URLDB_SNAPSHOT_MAGIC, sizeof(hdr.magic));
+	hdr.version = URLDB_SNAPSHOT_VERSION;
+	hdr.byte_order = URLDB_SNAPSHOT_BYTE_ORDER;
+	hdr.host_count = b->host_count;
+	hdr.url_count = b->url_count;
+	hdr.strings_size = b->strings_size;
+	hdr.bloom_size = bloom_size;
+	hdr.bloom_items = bloom_items(b->bloom);
+
+	tname_size = strlen(filename) + sizeof(".tmp");
+	tname = malloc(tname_size);
+	if (tname == NULL) {
+		return NSERROR_NOMEM;
+	}
+	snprintf(tname, tname_size, "%s.tmp", filename);
+
+	fp = fopen(tname, "wb");
+	if (!fp) {
+		NSLOG(netsurf, INFO, "Failed to open file '%s' for writing",
+		      tname);
+		free(tname);
+		return NSERROR_SAVE_FAILED;
+	}
+
+	ok = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1) &&
+		(fwrite(b->hosts, sizeof(*b->hosts), b->host_count, fp) ==
+		 b->host_count) &&
+		(fwrite(b->urls, sizeof(*b->urls), b->url_count, fp) ==
+		 b->url_count) &&
+		(fwrite(bloom, 1, bloom_size, fp) == bloom_size) &&
+		(fwrite(padding, 1, -bloom_size & 7, fp) == (-bloom_size & 7)) &&
+		(fwrite(b->strings, 1, b->strings_size, fp) == b->strings_size) &&
+		(fflush(fp) == 0) &&
+		(fsync(fileno(fp)) == 0);
+
+	if ((fclose(fp) != 0) || !ok) {
+		NSLOG(netsurf, INFO, "Failed writing URL snapshot '%s'",
+		      tname);
+		unlink(tname);
+		free(tname);
+		return NSERROR_SAVE_FAILED;
+	}
+
+	/* remove() call is to handle non-POSIX rename() implementations */
+	(void)remove(filename);
+	if (rename(tname, filename) != 0) {
+		NSLOG(netsurf, INFO, "Failed replacing URL snapshot '%s'",
+		      filename);
+		unlink(tname);
+		free(tname);
+		return NSERROR_SAVE_FAILED;
+	}
+
+	free(tname);
+
+	return NSERROR_OK;
 }
 
 
@@ -2866,6 +4287,17 @@ void urldb_destroy(void)
 		urldb_destroy_host_tree(a);
 	}
 	memset(&db_root, 0, sizeof(db_root));
+	urldb_visits_changed();
+
+	/* And the snapshot the hosts were loaded from */
+	urldb_snapshot_release();
+
+	/* And the cookie indexes */
+	urldb_cookie_headers_flush();
+	if (cookie_domains != NULL) {
+		hashmap_destroy(cookie_domains);
+		cookie_domains = NULL;
+	}
 
 	/* And the bloom filter */
 	if (url_bloom != NULL) {
@@ -2892,6 +4324,9 @@ nserror urldb_load(const char *filename)
 
 	NSLOG(netsurf, INFO, "Loading URL file %s", filename);
 
+	/* Visit counts of already resolved links may be about to change */
+	urldb_visits_changed();
+
 	if (url_bloom == NULL)
 		url_bloom = bloom_create(BLOOM_SIZE);
 
@@ -2907,6 +4342,11 @@ nserror urldb_load(const char *filename)
 		return NSERROR_NEED_DATA;
 	}
 
+	if (strncmp(s, URLDB_SNAPSHOT_MAGIC, 4) == 0) {
+		fclose(fp);
+		return urldb_load_snapshot(filename);
+	}
+
 	version = atoi(s);
 	if (version < MIN_URL_FILE_VERSION) {
 		NSLOG(netsurf, INFO, "Unsupported URL file version.");
@@ -2974,13 +4414,8 @@ nserror urldb_load(const char *filename)
 		for (i = 0; i < urls; i++) {
 			struct path_data *p = NULL;
 			char scheme[64], ports[10];
-			char url[64 + 3 + 256 + 6 + 4096 + 1 + 1];
 			unsigned int port;
-			bool is_file = false;
-			nsurl *nsurl;
-			lwc_string *scheme_lwc, *fragment_lwc;
-			char *path_query;
-			size_t len;
+			nserror res;
 
 			if (!fgets(scheme, sizeof scheme, fp))
 				break;
@@ -2998,59 +4433,11 @@ nserror urldb_load(const char *filename)
 			length = strlen(s) - 1;
 			s[length] = '\0';
 
-			if (!strcasecmp(host, "localhost") &&
-			    !strcasecmp(scheme, "file"))
-				is_file = true;
-
-			snprintf(url, sizeof url, "%s://%s%s%s%s",
-				 scheme,
-				 /* file URLs have no host */
-				 (is_file ? "" : host),
-				 (port ? ":" : ""),
-				 (port ? ports : ""),
-				 s);
-
-			/* TODO: store URLs in pre-parsed state, and make
-			 *       a nsurl_load to generate the nsurl more
-			 *       swiftly.
-			 *       Need a nsurl_save too.
-			 */
-			if (nsurl_create(url, &nsurl) != NSERROR_OK) {
-				NSLOG(netsurf, INFO, "Failed inserting '%s'",
-				      url);
-				fclose(fp);
-				return NSERROR_NOMEM;
-			}
-
-			if (url_bloom != NULL) {
-				uint32_t hash = nsurl_hash(nsurl);
-				bloom_insert_hash(url_bloom, hash);
-			}
-
-			/* Copy and merge path/query strings */
-			if (nsurl_get(nsurl, NSURL_PATH | NSURL_QUERY,
-				      &path_query, &len) != NSERROR_OK) {
-				NSLOG(netsurf, INFO, "Failed inserting '%s'",
-				      url);
+			res = urldb_load_url(h, host, scheme, port, s, &p);
+			if (res != NSERROR_OK) {
 				fclose(fp);
-				return NSERROR_NOMEM;
-			}
-
-			scheme_lwc = nsurl_get_component(nsurl, NSURL_SCHEME);
-			fragment_lwc = nsurl_get_component(nsurl,
-							   NSURL_FRAGMENT);
-			p = urldb_add_path(scheme_lwc, port, h, path_query,
-					   fragment_lwc, nsurl);
-			if (!p) {
-				NSLOG(netsurf, INFO, "Failed inserting '%s'",
-				      url);
-				fclose(fp);
-				return NSERROR_NOMEM;
+				return res;
 			}
-			nsurl_unref(nsurl);
-			lwc_string_unref(scheme_lwc);
-			if (fragment_lwc != NULL)
-				lwc_string_unref(fragment_lwc);
 
 			if (!fgets(s, MAXIMUM_URL_LENGTH, fp))
 				break;
@@ -3095,12 +4482,61 @@ nserror urldb_load(const char *filename)
 
 /* exported interface documented in netsurf/url_db.h */
 nserror urldb_save(const char *filename)
+{
+	struct urldb_snapshot_builder b;
+	nserror res = NSERROR_OK;
+	int i;
+
+	assert(filename);
+
+	/* the trees must hold every URL to be saved */
+	urldb_snapshot_materialise_all();
+
+	memset(&b, 0, sizeof(b));
+	b.expiry = time(NULL) - ((60 * 60 * 24) * nsoption_int(expire_url));
+
+	b.strings_alloc = 4096;
+	b.strings = malloc(b.strings_alloc);
+	b.bloom = bloom_create(BLOOM_SIZE);
+	if ((b.strings == NULL) || (b.bloom == NULL)) {
+		res = NSERROR_NOMEM;
+		goto urldb_save_out;
+	}
+	b.strings[0] = '\0';
+	b.strings_size = 1;
+
+	for (i = 0; i != NUM_SEARCH_TREES; i++) {
+		res = urldb_snapshot_add_search_tree(&b, search_trees[i]);
+		if (res != NSERROR_OK) {
+			goto urldb_save_out;
+		}
+	}
+
+	res = urldb_snapshot_write(&b, filename);
+
+urldb_save_out:
+	if (b.bloom != NULL) {
+		bloom_destroy(b.bloom);
+	}
+	free(b.strings);
+	free(b.urls);
+	free(b.hosts);
+
+	return res;
+}
+
+
+/* exported interface documented in netsurf/url_db.h */
+nserror urldb_export(const char *filename)
 {
 	FILE *fp;
 	int i;
 
 	assert(filename);
 
+	/* the trees must hold every URL to be exported */
+	urldb_snapshot_materialise_all();
+
 	fp = fopen(filename, "w");
 	if (!fp) {
 		NSLOG(netsurf, INFO, "Failed to open file '%s' for writing",
@@ -3287,6 +4723,7 @@ nserror urldb_update_url_visit_data(nsurl *url)
 
 	p->urld.last_visit = time(NULL);
 	p->urld.visits++;
+	urldb_visits_changed();
 
 	return NSERROR_OK;
 }
@@ -3305,6 +4742,14 @@ void urldb_reset_url_visit_data(nsurl *url)
 
 	p->urld.last_visit = (time_t)0;
 	p->urld.visits = 0;
+	urldb_visits_changed();
+}
+
+
+/* exported interface documented in content/urldb.h */
+unsigned int urldb_get_visit_generation(void)
+{
+	return url_visit_generation;
 }
 
 
@@ -3675,6 +5120,8 @@ urldb_iterate_partial(const char *prefix,
 				return;
 		}
 
+		urldb_host_materialise(h);
+
 		if (h->paths.children) {
 			/* Have paths, iterate them */
 			urldb_iterate_partial_path(&h->paths, slash + 1,
@@ -3999,276 +5446,201 @@ error:
 /* exported interface documented in content/urldb.h */
 char *urldb_get_cookie(nsurl *url, bool include_http_only)
 {
-	const struct path_data *p, *q;
-	const struct host_part *h;
-	lwc_string *path_lwc;
-	struct cookie_internal_data *c;
-	int count = 0, version = COOKIE_RFC2965;
-	struct cookie_internal_data **matched_cookies;
-	int matched_cookies_size = 20;
+	struct urldb_cookie_header *ch;
+	struct cookie_internal_data **matched_cookies = NULL;
+	unsigned int count = 0, matched_cookies_size = 0;
+	unsigned int host_count, i, j;
+	int version = COOKIE_RFC2965;
 	int ret_alloc = 4096, ret_used = 1;
-	const char *path;
-	char *ret;
-	lwc_string *scheme;
-	time_t now;
-	int i;
-	bool match;
+	lwc_string *scheme, *host_lwc, *path_lwc;
+	const char *host, *path, *suffix;
+	char domain[256 + 2];
+	char *key;
+	size_t key_len;
+	char *ret = NULL;
+	time_t now, expires = -1;
+	bool secure, is_file, match;
 
 	assert(url != NULL);
 
-	/* The URL must exist in the db in order to find relevant cookies, since
-	 * we search up the tree from the URL node, and cookies from further
-	 * up also apply. */
-	urldb_add_url(url);
-
-	p = urldb_find_url(url);
-	if (!p)
+	scheme = nsurl_get_component(url, NSURL_SCHEME);
+	if (scheme == NULL)
 		return NULL;
 
-	scheme = p->scheme;
-
-	matched_cookies = malloc(matched_cookies_size *
-				 sizeof(struct cookie_internal_data *));
-	if (!matched_cookies)
-		return NULL;
+	secure = (lwc_string_isequal(scheme, corestring_lwc_https, &match) ==
+		  lwc_error_ok && match == true);
+	is_file = (lwc_string_isequal(scheme, corestring_lwc_file, &match) ==
+		   lwc_error_ok && match == true);
+	lwc_string_unref(scheme);
 
-#define GROW_MATCHED_COOKIES						\
-	do {								\
-		if (count == matched_cookies_size) {			\
-			struct cookie_internal_data **temp;		\
-			temp = realloc(matched_cookies,			\
-				       (matched_cookies_size + 20) *	\
-				       sizeof(struct cookie_internal_data *)); \
-									\
-			if (temp == NULL) {				\
-				free(ret);				\
-				free(matched_cookies);			\
-				return NULL;				\
-			}						\
-									\
-			matched_cookies = temp;				\
-			matched_cookies_size += 20;			\
-		}							\
-	} while(0)
-
-	ret = malloc(ret_alloc);
-	if (!ret) {
-		free(matched_cookies);
+	host_lwc = nsurl_get_component(url, NSURL_HOST);
+	if (host_lwc != NULL) {
+		host = lwc_string_data(host_lwc);
+		lwc_string_unref(host_lwc);
+	} else if (is_file) {
+		host = "localhost";
+	} else {
 		return NULL;
 	}
 
-	ret[0] = '\0';
-
 	path_lwc = nsurl_get_component(url, NSURL_PATH);
-	if (path_lwc == NULL) {
-		free(ret);
-		free(matched_cookies);
+	if (path_lwc == NULL)
 		return NULL;
-	}
 	path = lwc_string_data(path_lwc);
 	lwc_string_unref(path_lwc);
 
 	now = time(NULL);
 
-	if (*(p->segment) != '\0') {
-		/* Match exact path, unless directory, when prefix matching
-		 * will handle this case for us. */
-		for (q = p->parent->children; q; q = q->next) {
-			if (strcmp(q->segment, p->segment))
-				continue;
-
-			/* Consider all cookies associated with
-			 * this exact path */
-			for (c = q->cookies; c; c = c->next) {
-				if (c->expires != -1 && c->expires < now)
-					/* cookie has expired => ignore */
-					continue;
-
-				if (c->secure && lwc_string_isequal(
-					    q->scheme,
-					    corestring_lwc_https,
-					    &match) &&
-				    match == false)
-					/* secure cookie for insecure host.
-					 * ignore */
-					continue;
-
-				if (c->http_only && !include_http_only)
-					/* Ignore HttpOnly */
-					continue;
-
-				matched_cookies[count++] = c;
-
-				GROW_MATCHED_COOKIES;
-
-				if (c->version < (unsigned int)version)
-					version = c->version;
+	/* look for a previously built header */
+	key_len = 2 + strlen(host) + strlen(path) + 1;
+	key = malloc(key_len);
+	if (key == NULL)
+		return NULL;
+	snprintf(key, key_len, "%c%c%s%s",
+		 secure ? 's' : '-',
+		 include_http_only ? 'h' : '-',
+		 host, path);
+
+	if (cookie_headers != NULL) {
+		ch = hashmap_lookup(cookie_headers, key);
+		if ((ch != NULL) &&
+		    ((ch->expires == -1) || (ch->expires >= now))) {
+			free(key);
+
+			for (i = 0; i < ch->count; i++) {
+				urldb_cookie_used(ch->cookies[i], now);
+			}
 
-				c->last_used = now;
+			if (ch->header == NULL)
+				return NULL;
 
-				cookie_manager_add((struct cookie_data *)c);
-			}
+			return strdup(ch->header);
 		}
 	}
 
-	/* Now consider cookies whose paths prefix-match ours */
-	for (p = p->parent; p; p = p->parent) {
-		/* Find directory's path entry(ies) */
-		/* There are potentially multiple due to differing schemes */
-		for (q = p->children; q; q = q->next) {
-			if (*(q->segment) != '\0')
-				continue;
-
-			for (c = q->cookies; c; c = c->next) {
-				if (c->expires != -1 && c->expires < now)
-					/* cookie has expired => ignore */
-					continue;
-
-				if (c->secure && lwc_string_isequal(
-					    q->scheme,
-					    corestring_lwc_https,
-					    &match) &&
-				    match == false)
-					/* Secure cookie for insecure server
-					 * => ignore */
-					continue;
-
-				matched_cookies[count++] = c;
-
-				GROW_MATCHED_COOKIES;
+	/* Cookies for this host, most specific path first */
+	if (!urldb_cookie_match_domain(host, path, secure, include_http_only,
+				       now, &matched_cookies, &count,
+				       &matched_cookies_size))
+		goto urldb_get_cookie_nomem;
 
-				if (c->version < (unsigned int) version)
-					version = c->version;
+	host_count = count;
+	for (i = 1; i < host_count; i++) {
+		struct cookie_internal_data *c = matched_cookies[i];
+		size_t len = strlen(c->path);
 
-				c->last_used = now;
-
-				cookie_manager_add((struct cookie_data *)c);
-			}
+		for (j = i; j > 0 &&
+			     strlen(matched_cookies[j - 1]->path) < len; j--) {
+			matched_cookies[j] = matched_cookies[j - 1];
 		}
+		matched_cookies[j] = c;
+	}
 
-		if (!p->parent) {
-			/* No parent, so bail here. This can't go in
-			 * the loop exit condition as we also want to
-			 * process the top-level node.
-			 *
-			 * If p->parent is NULL then p->cookies are
-			 * the domain cookies and thus we don't even
-			 * try matching against them.
-			 */
+	/* Then domain cookies for domains which domain match ours */
+	suffix = host;
+	do {
+		snprintf(domain, sizeof domain, ".%s", suffix);
+		if (!urldb_cookie_match_domain(domain, path, secure,
+					       include_http_only, now,
+					       &matched_cookies, &count,
+					       &matched_cookies_size))
+			goto urldb_get_cookie_nomem;
+
+		if (urldb__host_is_ip_address(host))
+			/* IP addresses have no parent domain */
 			break;
-		}
-
-		/* Consider p itself - may be the result of Path=/foo */
-		for (c = p->cookies; c; c = c->next) {
-			if (c->expires != -1 && c->expires < now)
-				/* cookie has expired => ignore */
-				continue;
-
-			/* Ensure cookie path is a prefix of the resource */
-			if (strncmp(c->path, path, strlen(c->path)) != 0)
-				/* paths don't match => ignore */
-				continue;
 
-			if (c->secure && lwc_string_isequal(p->scheme,
-							    corestring_lwc_https,
-							    &match) &&
-			    match == false)
-				/* Secure cookie for insecure server
-				 * => ignore */
-				continue;
-
-			matched_cookies[count++] = c;
+		suffix = strchr(suffix, '.');
+		if (suffix != NULL)
+			suffix++;
+	} while (suffix != NULL);
 
-			GROW_MATCHED_COOKIES;
-
-			if (c->version < (unsigned int) version)
-				version = c->version;
+	for (i = 0; i < count; i++) {
+		struct cookie_internal_data *c = matched_cookies[i];
 
-			c->last_used = now;
+		if (c->version < (unsigned int)version)
+			version = c->version;
 
-			cookie_manager_add((struct cookie_data *)c);
-		}
+		if ((c->expires != -1) &&
+		    ((expires == -1) || (c->expires < expires)))
+			expires = c->expires;
 
+		urldb_cookie_used(c, now);
 	}
 
-	/* Finally consider domain cookies for hosts which domain match ours */
-	for (h = (const struct host_part *)p; h && h != &db_root;
-	     h = h->parent) {
-		for (c = h->paths.cookies; c; c = c->next) {
-			if (c->expires != -1 && c->expires < now)
-				/* cookie has expired => ignore */
-				continue;
-
-			/* Ensure cookie path is a prefix of the resource */
-			if (strncmp(c->path, path, strlen(c->path)) != 0)
-				/* paths don't match => ignore */
-				continue;
-
-			if (c->secure && lwc_string_isequal(scheme,
-							    corestring_lwc_https,
-							    &match) &&
-			    match == false)
-				/* secure cookie for insecure host. ignore */
-				continue;
-
-			matched_cookies[count++] = c;
+	if (count > 0) {
+		ret = malloc(ret_alloc);
+		if (!ret)
+			goto urldb_get_cookie_nomem;
 
-			GROW_MATCHED_COOKIES;
+		ret[0] = '\0';
 
-			if (c->version < (unsigned int)version)
-				version = c->version;
-
-			c->last_used = now;
+		/* and build output string */
+		if (version > COOKIE_NETSCAPE) {
+			sprintf(ret, "$Version=%d", version);
+			ret_used = strlen(ret) + 1;
+		}
 
-			cookie_manager_add((struct cookie_data *)c);
+		for (i = 0; i < count; i++) {
+			if (!urldb_concat_cookie(matched_cookies[i], version,
+						 &ret_used, &ret_alloc, &ret)) {
+				free(ret);
+				goto urldb_get_cookie_nomem;
+			}
 		}
-	}
 
-	if (count == 0) {
-		/* No cookies found */
-		free(ret);
-		free(matched_cookies);
-		return NULL;
-	}
+		if (version == COOKIE_NETSCAPE) {
+			/* Old-style cookies => no version & skip "; " */
+			memmove(ret, ret + 2, ret_used - 2);
+			ret_used -= 2;
+		}
 
-	/* and build output string */
-	if (version > COOKIE_NETSCAPE) {
-		sprintf(ret, "$Version=%d", version);
-		ret_used = strlen(ret) + 1;
-	}
+		/* Now, shrink the output buffer to the required size */
+		{
+			char *temp = realloc(ret, ret_used);
+			if (!temp) {
+				free(ret);
+				goto urldb_get_cookie_nomem;
+			}
 
-	for (i = 0; i < count; i++) {
-		if (!urldb_concat_cookie(matched_cookies[i], version,
-					 &ret_used, &ret_alloc, &ret)) {
-			free(ret);
-			free(matched_cookies);
-			return NULL;
+			ret = temp;
 		}
 	}
 
-	if (version == COOKIE_NETSCAPE) {
-		/* Old-style cookies => no version & skip "; " */
-		memmove(ret, ret + 2, ret_used - 2);
-		ret_used -= 2;
+	/* remember the header for further requests */
+	if ((cookie_headers != NULL) &&
+	    (hashmap_count(cookie_headers) >= URLDB_COOKIE_HEADER_MAX)) {
+		urldb_cookie_headers_flush();
 	}
-
-	/* Now, shrink the output buffer to the required size */
-	{
-		char *temp = realloc(ret, ret_used);
-		if (!temp) {
-			free(ret);
-			free(matched_cookies);
-			return NULL;
+	if (cookie_headers == NULL) {
+		cookie_headers = hashmap_create(&urldb_cookie_header_parameters);
+	}
+	if (cookie_headers != NULL) {
+		ch = hashmap_insert(cookie_headers, key);
+		if (ch != NULL) {
+			if (ret != NULL) {
+				ch->header = strdup(ret);
+			}
+			if ((ret != NULL) && (ch->header == NULL)) {
+				hashmap_remove(cookie_headers, key);
+			} else {
+				ch->cookies = matched_cookies;
+				ch->count = count;
+				ch->expires = expires;
+				matched_cookies = NULL;
+			}
 		}
-
-		ret = temp;
 	}
 
+	free(key);
 	free(matched_cookies);
 
 	return ret;
 
-#undef GROW_MATCHED_COOKIES
+urldb_get_cookie_nomem:
+	free(key);
+	free(matched_cookies);
+	return NULL;
 }
 
 
@@ -112,6 +112,18 @@ nserror urldb_update_url_visit_data(struct nsurl *url);
 void urldb_reset_url_visit_data(struct nsurl *url);
 
 
+/**
+ * Get the current generation of the URL visit data
+ *
+ * The generation changes whenever the visit data of any URL in the
+ * database may have changed, allowing callers to cache the result of
+ * urldb_get_url_data() visit lookups.
+ *
+ * \return Non-zero generation number
+ */
+unsigned int urldb_get_visit_generation(void);
+
+
 /**
  * Extract an URL from the db
  *
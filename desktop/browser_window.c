@@ -44,6 +44,7 @@
 #include "utils/utils.h"
 #include "utils/utf8.h"
 #include "utils/nsoption.h"
+#include "utils/perf.h"
 #include "netsurf/misc.h"
 #include "netsurf/window.h"
 #include "netsurf/search.h"
@@ -610,7 +611,8 @@ browser_window_update_favicon(hlcache_handle *c,
 	}
 
 	res = hlcache_handle_retrieve(nsurl,
-				      HLCACHE_RETRIEVE_SNIFF_TYPE,
+				      HLCACHE_RETRIEVE_SNIFF_TYPE |
+				      LLCACHE_RETRIEVE_PRIORITY_LOW,
 				      nsref,
 				      NULL,
 				      browser_window_favicon_callback,
@@ -2545,6 +2547,7 @@ browser_window_redraw(struct browser_window *bw,
 	content_type content_type;
 	struct content_redraw_data data;
 	struct rect content_clip;
+	uint64_t perf_start = 0;
 	nserror res;
 
 	x /= bw->scale;
@@ -2555,6 +2558,11 @@ browser_window_redraw(struct browser_window *bw,
 		return false;
 	}
 
+	if (bw->window != NULL) {
+		/* Root browser window: frames are timed as part of it */
+		perf_start = perf_begin();
+	}
+
 	if ((bw->current_content == NULL) &&
 	    (bw->children == NULL)) {
 		/* Browser window has no content, render blank fill */
@@ -2628,6 +2636,8 @@ browser_window_redraw(struct browser_window *bw,
 			knockout_plot_end(ctx);
 		}
 
+		perf_end(PERF_PHASE_REDRAW, perf_start);
+
 		return plot_ok;
 	}
 
@@ -2710,6 +2720,8 @@ browser_window_redraw(struct browser_window *bw,
 		knockout_plot_end(ctx);
 	}
 
+	perf_end(PERF_PHASE_REDRAW, perf_start);
+
 	return plot_ok;
 }
 
@@ -3501,7 +3513,9 @@ navigate_internal_real(struct browser_window *bw,
 	}
 
 	res = hlcache_handle_retrieve(params->url,
-				      fetch_flags | HLCACHE_RETRIEVE_SNIFF_TYPE,
+				      fetch_flags |
+				      HLCACHE_RETRIEVE_SNIFF_TYPE |
+				      LLCACHE_RETRIEVE_PRIORITY_BLOCKING,
 				      params->referrer,
 				      fetch_is_post ? &post : NULL,
 				      browser_window_callback,
@@ -0,0 +1,1529 @@
+/*
+ * Copyright 2026 The NetSurf Developers
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Display list recording and replay (implementation).
+ *
+ * Plot operations are recorded, along with any text, points or names
+ * they refer to, into a single buffer.  Each operation is followed
+ * directly by its trailing data, and records its total size so the
+ * buffer may be walked in order on replay.
+ *
+ * Tile sets keep a fixed number of display lists, each recorded for a
+ * square of a plane, and replace the least recently used when full.
+ */
+
+#include <assert.h>
+#include <ctype.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+
+#include "utils/utils.h"
+#include "utils/errors.h"
+#include "utils/nsurl.h"
+#include "netsurf/types.h"
+#include "netsurf/content.h"
+#include "netsurf/plotters.h"
+
+#include "desktop/display_list.h"
+
+/** Alignment of recorded operations within the buffer */
+#define DISPLAY_LIST_ALIGN 8
+
+/** Initial size of the buffer, in bytes */
+#define DISPLAY_LIST_INITIAL_SIZE 4096
+
+/** Initial size of the line buffer used when loading, in bytes */
+#define DISPLAY_LIST_LINE_SIZE 256
+
+/**
+ * Type of a recorded operation
+ */
+enum display_list_op_type {
+	DISPLAY_LIST_CLIP,
+	DISPLAY_LIST_ARC,
+	DISPLAY_LIST_DISC,
+	DISPLAY_LIST_LINE,
+	DISPLAY_LIST_RECTANGLE,
+	DISPLAY_LIST_POLYGON,
+	DISPLAY_LIST_PATH,
+	DISPLAY_LIST_BITMAP,
+	DISPLAY_LIST_TEXT,
+	DISPLAY_LIST_GROUP_START,
+	DISPLAY_LIST_GROUP_END,
+	DISPLAY_LIST_CONTENT,
+};
+
+/**
+ * A recorded operation
+ */
+struct display_list_op {
+	enum display_list_op_type type; /**< type of operation */
+	size_t size; /**< size of operation and its trailing data */
+
+	union {
+		struct rect clip;
+		struct {
+			plot_style_t style;
+			int x, y, radius, angle1, angle2;
+		} arc;
+		struct {
+			plot_style_t style;
+			int x, y, radius;
+		} disc;
+		struct {
+			plot_style_t style;
+			struct rect rect;
+		} rect; /**< line or rectangle */
+		struct {
+			plot_style_t style;
+			unsigned int n; /**< vertex count; 2n ints follow */
+		} polygon;
+		struct {
+			plot_style_t style;
+			unsigned int n; /**< element count; n floats follow */
+			float transform[6];
+		} path;
+		struct {
+			struct bitmap *bitmap;
+			int x, y, width, height;
+			colour bg;
+			bitmap_flags_t flags;
+		} bitmap;
+		struct {
+			plot_font_style_t fstyle;
+			int x, y;
+			size_t length; /**< text length; the text follows */
+		} text;
+		struct {
+			struct hlcache_handle *h;
+			struct content_redraw_data data;
+			struct rect clip;
+		} content;
+	} u;
+};
+
+/**
+ * A display list
+ */
+struct display_list {
+	uint8_t *data; /**< recorded operations */
+	size_t used; /**< bytes of data in use */
+	size_t alloc; /**< bytes of data allocated */
+	unsigned int count; /**< number of recorded operations */
+	bool cacheable; /**< no bitmaps were plotted directly */
+};
+
+/**
+ * A tile of a tile set
+ */
+struct display_list_tile {
+	struct display_list *dl; /**< recorded display list, or NULL */
+	int col; /**< column of the tile */
+	int row; /**< row of the tile */
+	unsigned int used; /**< redraw in which the tile was last used */
+	bool valid; /**< whether the display list may be replayed */
+};
+
+/**
+ * A tile set
+ */
+struct display_list_tiles {
+	int size; /**< width and height of each tile */
+	unsigned int count; /**< number of tiles */
+	unsigned int redraw; /**< count of redraws which used the set */
+	struct display_list_tile tile[]; /**< the tiles */
+};
+
+
+/**
+ * Append an operation to the display list being recorded.
+ *
+ * \param ctx recording redraw context
+ * \param type type of operation
+ * \param extra size of the trailing data
+ * \return the new operation, or NULL on memory exhaustion
+ */
+static struct display_list_op *
+display_list_append(const struct redraw_context *ctx,
+		    enum display_list_op_type type,
+		    size_t extra)
+{
+	struct display_list *dl = ctx->priv;
+	struct display_list_op *op;
+	size_t size;
+
+	size = (sizeof(*op) + extra + DISPLAY_LIST_ALIGN - 1) &
+			~((size_t)DISPLAY_LIST_ALIGN - 1);
+
+	if (dl->used + size > dl->alloc) {
+		size_t alloc = dl->alloc ? dl->alloc : DISPLAY_LIST_INITIAL_SIZE;
+		uint8_t *data;
+
+		while (alloc < dl->used + size)
+			alloc *= 2;
+
+		data = realloc(dl->data, alloc);
+		if (data == NULL)
+			return NULL;
+
+		dl->data = data;
+		dl->alloc = alloc;
+	}
+
+	op = (struct display_list_op *)(void *)(dl->data + dl->used);
+	op->type = type;
+	op->size = size;
+
+	dl->used += size;
+	dl->count++;
+
+	return op;
+}
+
+
+/**
+ * Record a clip rectangle.
+ *
+ * \param ctx recording redraw context
+ * \param clip clip rectangle
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_plot_clip(const struct redraw_context *ctx,
+		       const struct rect *clip)
+{
+	struct display_list_op *op;
+
+	op = display_list_append(ctx, DISPLAY_LIST_CLIP, 0);
+	if (op == NULL)
+		return NSERROR_NOMEM;
+
+	op->u.clip = *clip;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record an arc.
+ *
+ * \param ctx recording redraw context
+ * \param style style of the arc
+ * \param x x coordinate of the arc
+ * \param y y coordinate of the arc
+ * \param radius radius of the arc
+ * \param angle1 start angle of the arc
+ * \param angle2 finish angle of the arc
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_plot_arc(const struct redraw_context *ctx,
+		      const plot_style_t *style,
+		      int x, int y, int radius, int angle1, int angle2)
+{
+	struct display_list_op *op;
+
+	op = display_list_append(ctx, DISPLAY_LIST_ARC, 0);
+	if (op == NULL)
+		return NSERROR_NOMEM;
+
+	op->u.arc.style = *style;
+	op->u.arc.x = x;
+	op->u.arc.y = y;
+	op->u.arc.radius = radius;
+	op->u.arc.angle1 = angle1;
+	op->u.arc.angle2 = angle2;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record a circle.
+ *
+ * \param ctx recording redraw context
+ * \param style style of the circle
+ * \param x x coordinate of the centre
+ * \param y y coordinate of the centre
+ * \param radius radius of the circle
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_plot_disc(const struct redraw_context *ctx,
+		       const plot_style_t *style,
+		       int x, int y, int radius)
+{
+	struct display_list_op *op;
+
+	op = display_list_append(ctx, DISPLAY_LIST_DISC, 0);
+	if (op == NULL)
+		return NSERROR_NOMEM;
+
+	op->u.disc.style = *style;
+	op->u.disc.x = x;
+	op->u.disc.y = y;
+	op->u.disc.radius = radius;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record a line or a rectangle.
+ *
+ * \param ctx recording redraw context
+ * \param type DISPLAY_LIST_LINE or DISPLAY_LIST_RECTANGLE
+ * \param style style of the plot
+ * \param rect line end points or rectangle
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_plot_rect(const struct redraw_context *ctx,
+		       enum display_list_op_type type,
+		       const plot_style_t *style,
+		       const struct rect *rect)
+{
+	struct display_list_op *op;
+
+	op = display_list_append(ctx, type, 0);
+	if (op == NULL)
+		return NSERROR_NOMEM;
+
+	op->u.rect.style = *style;
+	op->u.rect.rect = *rect;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record a line.
+ *
+ * \param ctx recording redraw context
+ * \param style style of the line
+ * \param line line end points
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_plot_line(const struct redraw_context *ctx,
+		       const plot_style_t *style,
+		       const struct rect *line)
+{
+	return display_list_plot_rect(ctx, DISPLAY_LIST_LINE, style, line);
+}
+
+
+/**
+ * Record a rectangle.
+ *
+ * \param ctx recording redraw context
+ * \param style style of the rectangle
+ * \param rectangle the rectangle
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_plot_rectangle(const struct redraw_context *ctx,
+			    const plot_style_t *style,
+			    const struct rect *rectangle)
+{
+	return display_list_plot_rect(ctx, DISPLAY_LIST_RECTANGLE,
+			style, rectangle);
+}
+
+
+/**
+ * Record a polygon.
+ *
+ * \param ctx recording redraw context
+ * \param style style of the polygon
+ * \param p vertices of the polygon
+ * \param n number of vertices
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_plot_polygon(const struct redraw_context *ctx,
+			  const plot_style_t *style,
+			  const int *p,
+			  unsigned int n)
+{
+	struct display_list_op *op;
+
+	op = display_list_append(ctx, DISPLAY_LIST_POLYGON,
+			n * 2 * sizeof(int));
+	if (op == NULL)
+		return NSERROR_NOMEM;
+
+	op->u.polygon.style = *style;
+	op->u.polygon.n = n;
+	memcpy(op + 1, p, n * 2 * sizeof(int));
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record a path.
+ *
+ * \param ctx recording redraw context
+ * \param style style of the path
+ * \param p elements of the path
+ * \param n number of elements
+ * \param transform transform to apply to the path
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_plot_path(const struct redraw_context *ctx,
+		       const plot_style_t *style,
+		       const float *p,
+		       unsigned int n,
+		       const float transform[6])
+{
+	struct display_list_op *op;
+
+	op = display_list_append(ctx, DISPLAY_LIST_PATH, n * sizeof(float));
+	if (op == NULL)
+		return NSERROR_NOMEM;
+
+	op->u.path.style = *style;
+	op->u.path.n = n;
+	memcpy(op->u.path.transform, transform,
+			sizeof(op->u.path.transform));
+	memcpy(op + 1, p, n * sizeof(float));
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record a bitmap.
+ *
+ * The bitmap is not copied, so the display list may only be replayed
+ * while the bitmap exists.
+ *
+ * \param ctx recording redraw context
+ * \param bitmap bitmap to plot
+ * \param x x coordinate of the bitmap
+ * \param y y coordinate of the bitmap
+ * \param width width to plot the bitmap at
+ * \param height height to plot the bitmap at
+ * \param bg background colour to blend into
+ * \param flags flags controlling tiling
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_plot_bitmap(const struct redraw_context *ctx,
+			 struct bitmap *bitmap,
+			 int x, int y,
+			 int width,
+			 int height,
+			 colour bg,
+			 bitmap_flags_t flags)
+{
+	struct display_list *dl = ctx->priv;
+	struct display_list_op *op;
+
+	op = display_list_append(ctx, DISPLAY_LIST_BITMAP, 0);
+	if (op == NULL)
+		return NSERROR_NOMEM;
+
+	op->u.bitmap.bitmap = bitmap;
+	op->u.bitmap.x = x;
+	op->u.bitmap.y = y;
+	op->u.bitmap.width = width;
+	op->u.bitmap.height = height;
+	op->u.bitmap.bg = bg;
+	op->u.bitmap.flags = flags;
+
+	dl->cacheable = false;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record text.
+ *
+ * The text is copied.  The font families of the style are not, and
+ * must outlive the display list.
+ *
+ * \param ctx recording redraw context
+ * \param fstyle style of the text
+ * \param x x coordinate of the text baseline
+ * \param y y coordinate of the text baseline
+ * \param text UTF-8 string to plot
+ * \param length length of string, in bytes
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_plot_text(const struct redraw_context *ctx,
+		       const plot_font_style_t *fstyle,
+		       int x,
+		       int y,
+		       const char *text,
+		       size_t length)
+{
+	struct display_list_op *op;
+
+	op = display_list_append(ctx, DISPLAY_LIST_TEXT, length);
+	if (op == NULL)
+		return NSERROR_NOMEM;
+
+	op->u.text.fstyle = *fstyle;
+	op->u.text.x = x;
+	op->u.text.y = y;
+	op->u.text.length = length;
+	memcpy(op + 1, text, length);
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record the start of a group.
+ *
+ * \param ctx recording redraw context
+ * \param name name of the group
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_plot_group_start(const struct redraw_context *ctx,
+			      const char *name)
+{
+	struct display_list_op *op;
+	size_t length = strlen(name) + 1;
+
+	op = display_list_append(ctx, DISPLAY_LIST_GROUP_START, length);
+	if (op == NULL)
+		return NSERROR_NOMEM;
+
+	memcpy(op + 1, name, length);
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Record the end of a group.
+ *
+ * \param ctx recording redraw context
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror display_list_plot_group_end(const struct redraw_context *ctx)
+{
+	if (display_list_append(ctx, DISPLAY_LIST_GROUP_END, 0) == NULL)
+		return NSERROR_NOMEM;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * display list recording plotter operation table
+ */
+static const struct plotter_table display_list_plotters = {
+	.clip = display_list_plot_clip,
+	.arc = display_list_plot_arc,
+	.disc = display_list_plot_disc,
+	.line = display_list_plot_line,
+	.rectangle = display_list_plot_rectangle,
+	.polygon = display_list_plot_polygon,
+	.path = display_list_plot_path,
+	.bitmap = display_list_plot_bitmap,
+	.text = display_list_plot_text,
+	.group_start = display_list_plot_group_start,
+	.group_end = display_list_plot_group_end,
+	.option_knockout = false,
+};
+
+
+/**
+ * Offset a rectangle and intersect it with a clip rectangle.
+ *
+ * \param r rectangle to offset, updated to the intersection
+ * \param x offset to add to x coordinates
+ * \param y offset to add to y coordinates
+ * \param clip clip rectangle
+ * \return true if the intersection is not empty
+ */
+static inline bool
+display_list_clip_rect(struct rect *r, int x, int y, const struct rect *clip)
+{
+	r->x0 = max(r->x0 + x, clip->x0);
+	r->y0 = max(r->y0 + y, clip->y0);
+	r->x1 = min(r->x1 + x, clip->x1);
+	r->y1 = min(r->y1 + y, clip->y1);
+
+	return (r->x0 < r->x1) && (r->y0 < r->y1);
+}
+
+
+/**
+ * Replay a polygon.
+ *
+ * \param op polygon operation
+ * \param x offset to add to x coordinates
+ * \param y offset to add to y coordinates
+ * \param ctx redraw context to plot through
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_replay_polygon(const struct display_list_op *op,
+			    int x, int y,
+			    const struct redraw_context *ctx)
+{
+	const int *p = (const int *)(const void *)(op + 1);
+	unsigned int n = op->u.polygon.n;
+	unsigned int i;
+	nserror res;
+	int *q;
+
+	q = malloc(n * 2 * sizeof(int));
+	if (q == NULL)
+		return NSERROR_NOMEM;
+
+	for (i = 0; i < n; i++) {
+		q[i * 2] = p[i * 2] + x;
+		q[i * 2 + 1] = p[i * 2 + 1] + y;
+	}
+
+	res = ctx->plot->polygon(ctx, &op->u.polygon.style, q, n);
+
+	free(q);
+
+	return res;
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+nserror display_list_create(struct display_list **dl_out)
+{
+	struct display_list *dl;
+
+	dl = calloc(1, sizeof(*dl));
+	if (dl == NULL)
+		return NSERROR_NOMEM;
+
+	dl->cacheable = true;
+
+	*dl_out = dl;
+
+	return NSERROR_OK;
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+void display_list_destroy(struct display_list *dl)
+{
+	if (dl == NULL)
+		return;
+
+	free(dl->data);
+	free(dl);
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+void display_list_record(struct display_list *dl,
+		const struct redraw_context *ctx,
+		struct redraw_context *rec_ctx)
+{
+	*rec_ctx = *ctx;
+	rec_ctx->plot = &display_list_plotters;
+	rec_ctx->priv = dl;
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+bool display_list_recording(const struct redraw_context *ctx)
+{
+	return ctx->plot == &display_list_plotters;
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+nserror display_list_content(const struct redraw_context *ctx,
+		struct hlcache_handle *h,
+		const struct content_redraw_data *data,
+		const struct rect *clip)
+{
+	struct display_list_op *op;
+
+	op = display_list_append(ctx, DISPLAY_LIST_CONTENT, 0);
+	if (op == NULL)
+		return NSERROR_NOMEM;
+
+	op->u.content.h = h;
+	op->u.content.data = *data;
+	op->u.content.clip = *clip;
+
+	return NSERROR_OK;
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+bool display_list_cacheable(const struct display_list *dl)
+{
+	return dl->cacheable;
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+size_t display_list_size(const struct display_list *dl)
+{
+	return sizeof(*dl) + dl->alloc;
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+nserror display_list_replay(const struct display_list *dl,
+		int x, int y,
+		const struct rect *clip,
+		const struct redraw_context *ctx)
+{
+	const struct plotter_table *plot = ctx->plot;
+	const struct display_list_op *op;
+	struct rect cur = *clip;
+	struct content_redraw_data data;
+	float transform[6];
+	bool visible;
+	struct rect r;
+	size_t pos;
+	nserror res;
+
+	visible = (cur.x0 < cur.x1) && (cur.y0 < cur.y1);
+	if (!visible)
+		return NSERROR_OK;
+
+	res = plot->clip(ctx, &cur);
+
+	for (pos = 0; pos < dl->used && res == NSERROR_OK; pos += op->size) {
+		op = (const struct display_list_op *)(const void *)
+				(dl->data + pos);
+
+		if (op->type == DISPLAY_LIST_CLIP) {
+			cur = op->u.clip;
+			visible = display_list_clip_rect(&cur, x, y, clip);
+			if (visible)
+				res = plot->clip(ctx, &cur);
+			continue;
+		}
+
+		if (!visible &&
+		    op->type != DISPLAY_LIST_GROUP_START &&
+		    op->type != DISPLAY_LIST_GROUP_END)
+			continue;
+
+		switch (op->type) {
+		case DISPLAY_LIST_ARC:
+			res = plot->arc(ctx, &op->u.arc.style,
+					op->u.arc.x + x, op->u.arc.y + y,
+					op->u.arc.radius,
+					op->u.arc.angle1, op->u.arc.angle2);
+			break;
+
+		case DISPLAY_LIST_DISC:
+			res = plot->disc(ctx, &op->u.disc.style,
+					op->u.disc.x + x, op->u.disc.y + y,
+					op->u.disc.radius);
+			break;
+
+		case DISPLAY_LIST_LINE:
+		case DISPLAY_LIST_RECTANGLE:
+			r.x0 = op->u.rect.rect.x0 + x;
+			r.y0 = op->u.rect.rect.y0 + y;
+			r.x1 = op->u.rect.rect.x1 + x;
+			r.y1 = op->u.rect.rect.y1 + y;
+			if (op->type == DISPLAY_LIST_LINE) {
+				res = plot->line(ctx, &op->u.rect.style, &r);
+			} else {
+				res = plot->rectangle(ctx,
+						&op->u.rect.style, &r);
+			}
+			break;
+
+		case DISPLAY_LIST_POLYGON:
+			res = display_list_replay_polygon(op, x, y, ctx);
+			break;
+
+		case DISPLAY_LIST_PATH:
+			memcpy(transform, op->u.path.transform,
+					sizeof(transform));
+			transform[4] += x;
+			transform[5] += y;
+			res = plot->path(ctx, &op->u.path.style,
+					(const float *)(const void *)(op + 1),
+					op->u.path.n, transform);
+			break;
+
+		case DISPLAY_LIST_BITMAP:
+			res = plot->bitmap(ctx, op->u.bitmap.bitmap,
+					op->u.bitmap.x + x, op->u.bitmap.y + y,
+					op->u.bitmap.width,
+					op->u.bitmap.height,
+					op->u.bitmap.bg, op->u.bitmap.flags);
+			break;
+
+		case DISPLAY_LIST_TEXT:
+			res = plot->text(ctx, &op->u.text.fstyle,
+					op->u.text.x + x, op->u.text.y + y,
+					(const char *)(op + 1),
+					op->u.text.length);
+			break;
+
+		case DISPLAY_LIST_GROUP_START:
+			if (plot->group_start != NULL)
+				res = plot->group_start(ctx,
+						(const char *)(op + 1));
+			break;
+
+		case DISPLAY_LIST_GROUP_END:
+			if (plot->group_end != NULL)
+				res = plot->group_end(ctx);
+			break;
+
+		case DISPLAY_LIST_CONTENT:
+			r = op->u.content.clip;
+			if (!display_list_clip_rect(&r, x, y, &cur))
+				break;
+
+			data = op->u.content.data;
+			data.x += x;
+			data.y += y;
+
+			/* A content which fails to redraw is just left out,
+			 * as nothing was recorded to stand in for it */
+			content_redraw(op->u.content.h, &data, &r, ctx);
+
+			/* The content may have changed the clip rectangle */
+			res = plot->clip(ctx, &cur);
+			break;
+
+		case DISPLAY_LIST_CLIP:
+			break;
+		}
+	}
+
+	return res;
+}
+
+
+/**
+ * Write a plot style out as text.
+ *
+ * \param style plot style to write
+ * \param fh file to write to
+ */
+static void display_list_dump_style(const plot_style_t *style, FILE *fh)
+{
+	fprintf(fh, " stroke=%d,%d,%06x fill=%d,%06x",
+			style->stroke_type,
+			plot_style_fixed_to_int(style->stroke_width),
+			style->stroke_colour,
+			style->fill_type,
+			style->fill_colour);
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+nserror display_list_dump(const struct display_list *dl, FILE *fh)
+{
+	const struct display_list_op *op;
+	const char *text;
+	const int *p;
+	const float *f;
+	nsurl *url;
+	size_t pos;
+	size_t i;
+
+	for (pos = 0; pos < dl->used; pos += op->size) {
+		op = (const struct display_list_op *)(const void *)
+				(dl->data + pos);
+
+		switch (op->type) {
+		case DISPLAY_LIST_CLIP:
+			fprintf(fh, "clip %d %d %d %d",
+					op->u.clip.x0, op->u.clip.y0,
+					op->u.clip.x1, op->u.clip.y1);
+			break;
+
+		case DISPLAY_LIST_ARC:
+			fprintf(fh, "arc %d %d %d %d %d",
+					op->u.arc.x, op->u.arc.y,
+					op->u.arc.radius,
+					op->u.arc.angle1, op->u.arc.angle2);
+			display_list_dump_style(&op->u.arc.style, fh);
+			break;
+
+		case DISPLAY_LIST_DISC:
+			fprintf(fh, "disc %d %d %d",
+					op->u.disc.x, op->u.disc.y,
+					op->u.disc.radius);
+			display_list_dump_style(&op->u.disc.style, fh);
+			break;
+
+		case DISPLAY_LIST_LINE:
+		case DISPLAY_LIST_RECTANGLE:
+			fprintf(fh, "%s %d %d %d %d",
+					op->type == DISPLAY_LIST_LINE ?
+					"line" : "rectangle",
+					op->u.rect.rect.x0, op->u.rect.rect.y0,
+					op->u.rect.rect.x1, op->u.rect.rect.y1);
+			display_list_dump_style(&op->u.rect.style, fh);
+			break;
+
+		case DISPLAY_LIST_POLYGON:
+			p = (const int *)(const void *)(op + 1);
+			fprintf(fh, "polygon %u", op->u.polygon.n);
+			for (i = 0; i < op->u.polygon.n * 2; i++)
+				fprintf(fh, " %d", p[i]);
+			display_list_dump_style(&op->u.polygon.style, fh);
+			break;
+
+		case DISPLAY_LIST_PATH:
+			f = (const float *)(const void *)(op + 1);
+			fprintf(fh, "path %u", op->u.path.n);
+			for (i = 0; i < op->u.path.n; i++)
+				fprintf(fh, " %.9g", f[i]);
+			fprintf(fh, " transform=%.9g,%.9g,%.9g,%.9g,%.9g,%.9g",
+					op->u.path.transform[0],
+					op->u.path.transform[1],
+					op->u.path.transform[2],
+					op->u.path.transform[3],
+					op->u.path.transform[4],
+					op->u.path.transform[5]);
+			display_list_dump_style(&op->u.path.style, fh);
+			break;
+
+		case DISPLAY_LIST_BITMAP:
+			fprintf(fh, "bitmap %d %d %d %d bg=%06x flags=%lu",
+					op->u.bitmap.x, op->u.bitmap.y,
+					op->u.bitmap.width,
+					op->u.bitmap.height,
+					op->u.bitmap.bg,
+					op->u.bitmap.flags);
+			break;
+
+		case DISPLAY_LIST_TEXT:
+			fprintf(fh, "text %d %d family=%d size=%d weight=%d "
+					"flags=%d fg=%06x bg=%06x \"",
+					op->u.text.x, op->u.text.y,
+					op->u.text.fstyle.family,
+					plot_style_fixed_to_int(
+						op->u.text.fstyle.size),
+					op->u.text.fstyle.weight,
+					op->u.text.fstyle.flags,
+					op->u.text.fstyle.foreground,
+					op->u.text.fstyle.background);
+			text = (const char *)(op + 1);
+			for (i = 0; i < op->u.text.length; i++) {
+				unsigned char c = text[i];
+
+				if (c == '"' || c == '\\')
+					fprintf(fh, "\\%c", c);
+				else if (c < 0x20 || c == 0x7f)
+					fprintf(fh, "\\x%02x", c);
+				else
+					fputc(c, fh);
+			}
+			fputc('"', fh);
+			break;
+
+		case DISPLAY_LIST_GROUP_START:
+			fprintf(fh, "group_start %s", (const char *)(op + 1));
+			break;
+
+		case DISPLAY_LIST_GROUP_END:
+			fprintf(fh, "group_end");
+			break;
+
+		case DISPLAY_LIST_CONTENT:
+			url = hlcache_handle_get_url(op->u.content.h);
+			fprintf(fh, "content %d %d %d %d scale=%g "
+					"repeat=%d,%d bg=%06x clip=%d,%d,%d,%d %s",
+					op->u.content.data.x,
+					op->u.content.data.y,
+					op->u.content.data.width,
+					op->u.content.data.height,
+					op->u.content.data.scale,
+					op->u.content.data.repeat_x,
+					op->u.content.data.repeat_y,
+					op->u.content.data.background_colour,
+					op->u.content.clip.x0,
+					op->u.content.clip.y0,
+					op->u.content.clip.x1,
+					op->u.content.clip.y1,
+					url != NULL ? nsurl_access(url) : "-");
+			break;
+		}
+
+		if (fputc('\n', fh) == EOF)
+			return NSERROR_SAVE_FAILED;
+	}
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Read a line of a display list dump.
+ *
+ * \param fh file to read from
+ * \param buf buffer, reallocated as needed
+ * \param alloc size of buffer, updated if it is reallocated
+ * \return NSERROR_OK on success, NSERROR_NOT_FOUND at the end of the file,
+ *         or another appropriate error
+ */
+static nserror
+display_list_load_line(FILE *fh, char **buf, size_t *alloc)
+{
+	size_t len = 0;
+	char *nbuf;
+
+	for (;;) {
+		if (*alloc - len < 2) {
+			nbuf = realloc(*buf, *alloc * 2);
+			if (nbuf == NULL)
+				return NSERROR_NOMEM;
+			*buf = nbuf;
+			*alloc *= 2;
+		}
+
+		if (fgets(*buf + len, *alloc - len, fh) == NULL) {
+			if (ferror(fh))
+				return NSERROR_INVALID;
+			if (len == 0)
+				return NSERROR_NOT_FOUND;
+			break;
+		}
+
+		len += strlen(*buf + len);
+		if (len > 0 && (*buf)[len - 1] == '\n') {
+			(*buf)[len - 1] = '\0';
+			break;
+		}
+	}
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Parse a plot style written by display_list_dump_style.
+ *
+ * \param s text following the operation's parameters
+ * \param style updated to the parsed style
+ * \return true if s held only the style
+ */
+static bool display_list_load_style(const char *s, plot_style_t *style)
+{
+	int stroke_type, stroke_width, fill_type;
+	unsigned int stroke_colour, fill_colour;
+	int n = -1;
+
+	sscanf(s, " stroke=%d,%d,%x fill=%d,%x%n",
+			&stroke_type, &stroke_width, &stroke_colour,
+			&fill_type, &fill_colour, &n);
+	if (n < 0 || s[n] != '\0')
+		return false;
+
+	style->stroke_type = stroke_type;
+	style->stroke_width = plot_style_int_to_fixed(stroke_width);
+	style->stroke_colour = stroke_colour;
+	style->fill_type = fill_type;
+	style->fill_colour = fill_colour;
+
+	return true;
+}
+
+
+/**
+ * Parse and record a polygon written by display_list_dump.
+ *
+ * \param ctx recording redraw context
+ * \param s text following the operation name
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_load_polygon(const struct redraw_context *ctx, const char *s)
+{
+	plot_style_t style;
+	unsigned int n, i;
+	nserror res;
+	int *p;
+	int len = -1;
+
+	sscanf(s, "%u%n", &n, &len);
+	if (len < 0 || n > (UINT_MAX / 2) / sizeof(int))
+		return NSERROR_INVALID;
+	s += len;
+
+	p = malloc(n * 2 * sizeof(int) + 1);
+	if (p == NULL)
+		return NSERROR_NOMEM;
+
+	for (i = 0; i < n * 2; i++) {
+		len = -1;
+		sscanf(s, " %d%n", &p[i], &len);
+		if (len < 0)
+			break;
+		s += len;
+	}
+
+	if (i < n * 2 || !display_list_load_style(s, &style)) {
+		res = NSERROR_INVALID;
+	} else {
+		res = display_list_plot_polygon(ctx, &style, p, n);
+	}
+
+	free(p);
+
+	return res;
+}
+
+
+/**
+ * Parse and record a path written by display_list_dump.
+ *
+ * \param ctx recording redraw context
+ * \param s text following the operation name
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_load_path(const struct redraw_context *ctx, const char *s)
+{
+	plot_style_t style;
+	float transform[6];
+	unsigned int n, i;
+	nserror res;
+	float *p;
+	int len = -1;
+
+	sscanf(s, "%u%n", &n, &len);
+	if (len < 0 || n > UINT_MAX / sizeof(float))
+		return NSERROR_INVALID;
+	s += len;
+
+	p = malloc(n * sizeof(float) + 1);
+	if (p == NULL)
+		return NSERROR_NOMEM;
+
+	for (i = 0; i < n; i++) {
+		len = -1;
+		sscanf(s, " %f%n", &p[i], &len);
+		if (len < 0)
+			break;
+		s += len;
+	}
+
+	len = -1;
+	if (i == n) {
+		sscanf(s, " transform=%f,%f,%f,%f,%f,%f%n",
+				&transform[0], &transform[1], &transform[2],
+				&transform[3], &transform[4], &transform[5],
+				&len);
+	}
+
+	if (len < 0 || !display_list_load_style(s + len, &style)) {
+		res = NSERROR_INVALID;
+	} else {
+		res = display_list_plot_path(ctx, &style, p, n, transform);
+	}
+
+	free(p);
+
+	return res;
+}
+
+
+/**
+ * Parse and record text written by display_list_dump.
+ *
+ * \param ctx recording redraw context
+ * \param s text following the operation name
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_load_text(const struct redraw_context *ctx, const char *s)
+{
+	plot_font_style_t fstyle;
+	int x, y, family, size, weight, flags;
+	unsigned int fg, bg, c;
+	size_t length = 0;
+	nserror res;
+	char *text;
+	int len = -1;
+
+	sscanf(s, "%d %d family=%d size=%d weight=%d flags=%d "
+			"fg=%x bg=%x \"%n",
+			&x, &y, &family, &size, &weight, &flags,
+			&fg, &bg, &len);
+	if (len < 0)
+		return NSERROR_INVALID;
+	s += len;
+
+	/* Unescaping never lengthens the text */
+	text = malloc(strlen(s) + 1);
+	if (text == NULL)
+		return NSERROR_NOMEM;
+
+	while (*s != '"' && *s != '\0') {
+		if (*s != '\\') {
+			text[length++] = *s++;
+		} else if (s[1] == '"' || s[1] == '\\') {
+			text[length++] = s[1];
+			s += 2;
+		} else if (s[1] == 'x' && sscanf(s + 2, "%2x", &c) == 1 &&
+				isxdigit((unsigned char)s[3])) {
+			text[length++] = c;
+			s += 4;
+		} else {
+			break;
+		}
+	}
+
+	if (s[0] != '"' || s[1] != '\0') {
+		free(text);
+		return NSERROR_INVALID;
+	}
+
+	fstyle.families = NULL;
+	fstyle.family = family;
+	fstyle.size = plot_style_int_to_fixed(size);
+	fstyle.weight = weight;
+	fstyle.flags = flags;
+	fstyle.foreground = fg;
+	fstyle.background = bg;
+
+	res = display_list_plot_text(ctx, &fstyle, x, y, text, length);
+
+	free(text);
+
+	return res;
+}
+
+
+/**
+ * Parse and record an operation written by display_list_dump.
+ *
+ * \param ctx recording redraw context
+ * \param line line holding the operation
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+static nserror
+display_list_load_op(const struct redraw_context *ctx, const char *line)
+{
+	plot_style_t style;
+	struct rect r;
+	int x, y, radius, angle1, angle2;
+	int len = -1;
+
+	if (strncmp(line, "clip ", 5) == 0) {
+		sscanf(line + 5, "%d %d %d %d%n",
+				&r.x0, &r.y0, &r.x1, &r.y1, &len);
+		if (len < 0 || line[5 + len] != '\0')
+			return NSERROR_INVALID;
+		return display_list_plot_clip(ctx, &r);
+
+	} else if (strncmp(line, "arc ", 4) == 0) {
+		sscanf(line + 4, "%d %d %d %d %d%n",
+				&x, &y, &radius, &angle1, &angle2, &len);
+		if (len < 0 || !display_list_load_style(line + 4 + len, &style))
+			return NSERROR_INVALID;
+		return display_list_plot_arc(ctx, &style,
+				x, y, radius, angle1, angle2);
+
+	} else if (strncmp(line, "disc ", 5) == 0) {
+		sscanf(line + 5, "%d %d %d%n", &x, &y, &radius, &len);
+		if (len < 0 || !display_list_load_style(line + 5 + len, &style))
+			return NSERROR_INVALID;
+		return display_list_plot_disc(ctx, &style, x, y, radius);
+
+	} else if (strncmp(line, "line ", 5) == 0) {
+		sscanf(line + 5, "%d %d %d %d%n",
+				&r.x0, &r.y0, &r.x1, &r.y1, &len);
+		if (len < 0 || !display_list_load_style(line + 5 + len, &style))
+			return NSERROR_INVALID;
+		return display_list_plot_line(ctx, &style, &r);
+
+	} else if (strncmp(line, "rectangle ", 10) == 0) {
+		sscanf(line + 10, "%d %d %d %d%n",
+				&r.x0, &r.y0, &r.x1, &r.y1, &len);
+		if (len < 0 ||
+		    !display_list_load_style(line + 10 + len, &style))
+			return NSERROR_INVALID;
+		return display_list_plot_rectangle(ctx, &style, &r);
+
+	} else if (strncmp(line, "polygon ", 8) == 0) {
+		return display_list_load_polygon(ctx, line + 8);
+
+	} else if (strncmp(line, "path ", 5) == 0) {
+		return display_list_load_path(ctx, line + 5);
+
+	} else if (strncmp(line, "text ", 5) == 0) {
+		return display_list_load_text(ctx, line + 5);
+
+	} else if (strncmp(line, "group_start ", 12) == 0) {
+		return display_list_plot_group_start(ctx, line + 12);
+
+	} else if (strcmp(line, "group_end") == 0) {
+		return display_list_plot_group_end(ctx);
+
+	} else if (strncmp(line, "bitmap ", 7) == 0 ||
+		   strncmp(line, "content ", 8) == 0) {
+		/* The objects these refer to were not written out */
+		return NSERROR_OK;
+	}
+
+	return NSERROR_INVALID;
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+nserror display_list_load(FILE *fh, struct display_list **dl_out)
+{
+	struct redraw_context ctx = {
+		.interactive = false,
+		.background_images = true,
+		.plot = &display_list_plotters,
+	};
+	struct display_list *dl;
+	size_t alloc = DISPLAY_LIST_LINE_SIZE;
+	char *line;
+	nserror res;
+
+	line = malloc(alloc);
+	if (line == NULL)
+		return NSERROR_NOMEM;
+
+	res = display_list_create(&dl);
+	if (res != NSERROR_OK) {
+		free(line);
+		return res;
+	}
+	ctx.priv = dl;
+
+	while ((res = display_list_load_line(fh, &line, &alloc)) ==
+			NSERROR_OK) {
+		res = display_list_load_op(&ctx, line);
+		if (res != NSERROR_OK)
+			break;
+	}
+
+	free(line);
+
+	if (res != NSERROR_NOT_FOUND) {
+		display_list_destroy(dl);
+		return res;
+	}
+
+	*dl_out = dl;
+
+	return NSERROR_OK;
+}
+
+
+/**
+ * Find a valid tile of a tile set.
+ *
+ * \param tiles tile set
+ * \param col column of the tile
+ * \param row row of the tile
+ * \return the tile, or NULL if it is not recorded
+ */
+static struct display_list_tile *
+display_list_tiles_lookup(struct display_list_tiles *tiles, int col, int row)
+{
+	struct display_list_tile *tile;
+	unsigned int i;
+
+	for (i = 0; i < tiles->count; i++) {
+		tile = &tiles->tile[i];
+		if (tile->dl != NULL && tile->valid &&
+		    tile->col == col && tile->row == row)
+			return tile;
+	}
+
+	return NULL;
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+nserror display_list_tiles_create(int size, unsigned int count,
+		struct display_list_tiles **tiles_out)
+{
+	struct display_list_tiles *tiles;
+
+	assert(size > 0);
+
+	tiles = calloc(1, sizeof(*tiles) + count * sizeof(tiles->tile[0]));
+	if (tiles == NULL)
+		return NSERROR_NOMEM;
+
+	tiles->size = size;
+	tiles->count = count;
+
+	*tiles_out = tiles;
+
+	return NSERROR_OK;
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+void display_list_tiles_destroy(struct display_list_tiles *tiles)
+{
+	unsigned int i;
+
+	if (tiles == NULL)
+		return;
+
+	for (i = 0; i < tiles->count; i++)
+		display_list_destroy(tiles->tile[i].dl);
+
+	free(tiles);
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+void display_list_tiles_start(struct display_list_tiles *tiles)
+{
+	struct display_list_tile *tile;
+	unsigned int i;
+
+	tiles->redraw++;
+
+	for (i = 0; i < tiles->count; i++) {
+		tile = &tiles->tile[i];
+		if (tile->dl != NULL && !tile->valid) {
+			display_list_destroy(tile->dl);
+			tile->dl = NULL;
+		}
+	}
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+struct display_list *display_list_tiles_find(struct display_list_tiles *tiles,
+		int col, int row)
+{
+	struct display_list_tile *tile;
+
+	tile = display_list_tiles_lookup(tiles, col, row);
+	if (tile == NULL)
+		return NULL;
+
+	tile->used = tiles->redraw;
+
+	return tile->dl;
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+nserror display_list_tiles_add(struct display_list_tiles *tiles,
+		int col, int row, struct display_list **dl_out)
+{
+	struct display_list_tile *victim = NULL;
+	struct display_list_tile *tile;
+	struct display_list *dl;
+	unsigned int i;
+	nserror res;
+
+	for (i = 0; i < tiles->count; i++) {
+		tile = &tiles->tile[i];
+
+		if (tile->dl == NULL) {
+			if (victim == NULL || victim->dl != NULL)
+				victim = tile;
+			continue;
+		}
+
+		/* Tiles used during this redraw may still be referenced
+		 * by the plotters, so are not reused */
+		if (tile->used == tiles->redraw)
+			continue;
+
+		if (victim == NULL ||
+		    (victim->dl != NULL && tile->used < victim->used))
+			victim = tile;
+	}
+
+	if (victim == NULL)
+		return NSERROR_NOSPACE;
+
+	res = display_list_create(&dl);
+	if (res != NSERROR_OK)
+		return res;
+
+	display_list_destroy(victim->dl);
+	victim->dl = dl;
+	victim->col = col;
+	victim->row = row;
+	victim->used = tiles->redraw;
+	victim->valid = true;
+
+	*dl_out = dl;
+
+	return NSERROR_OK;
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+void display_list_tiles_invalidate(struct display_list_tiles *tiles,
+		const struct rect *area)
+{
+	struct display_list_tile *tile;
+	unsigned int i;
+	int x0, y0;
+
+	if (tiles == NULL)
+		return;
+
+	/* Display lists are only marked here, as they may be in use by
+	 * a redraw in progress */
+	for (i = 0; i < tiles->count; i++) {
+		tile = &tiles->tile[i];
+		if (tile->dl == NULL || !tile->valid)
+			continue;
+
+		x0 = tile->col * tiles->size;
+		y0 = tile->row * tiles->size;
+
+		if (area == NULL ||
+		    (area->x0 < x0 + tiles->size &&
+		     x0 < area->x1 &&
+		     area->y0 < y0 + tiles->size &&
+		     y0 < area->y1))
+			tile->valid = false;
+	}
+}
+
+
+/* exported interface documented in desktop/display_list.h */
+void display_list_tiles_discard(struct display_list_tiles *tiles,
+		int col, int row)
+{
+	struct display_list_tile *tile;
+
+	tile = display_list_tiles_lookup(tiles, col, row);
+	if (tile != NULL)
+		tile->valid = false;
+}
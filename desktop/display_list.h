@@ -0,0 +1,232 @@
+/*
+ * Copyright 2026 The NetSurf Developers
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Display list recording and replay (interface).
+ *
+ * A display list is a recording of the plot operations made through a
+ * redraw context.  It may be replayed, offset, through any plotter
+ * table, or written out as text and read back.  Display lists may be
+ * kept for square tiles of a plane, to be replayed by later redraws.
+ */
+
+#ifndef NETSURF_DESKTOP_DISPLAY_LIST_H_
+#define NETSURF_DESKTOP_DISPLAY_LIST_H_
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "netsurf/plotters.h"
+
+struct display_list;
+struct display_list_tiles;
+struct hlcache_handle;
+struct content_redraw_data;
+
+/**
+ * Create an empty display list.
+ *
+ * \param dl_out updated to the new display list
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+nserror display_list_create(struct display_list **dl_out);
+
+/**
+ * Destroy a display list.
+ *
+ * \param dl display list to destroy
+ */
+void display_list_destroy(struct display_list *dl);
+
+/**
+ * Make a redraw context which records into a display list.
+ *
+ * \param dl display list to record into
+ * \param ctx redraw context to base the recording context on
+ * \param rec_ctx updated to the recording context
+ */
+void display_list_record(struct display_list *dl,
+		const struct redraw_context *ctx,
+		struct redraw_context *rec_ctx);
+
+/**
+ * Find whether a redraw context is recording into a display list.
+ *
+ * \param ctx redraw context
+ * \return true if plot operations through ctx are being recorded
+ */
+bool display_list_recording(const struct redraw_context *ctx);
+
+/**
+ * Record the redraw of a content.
+ *
+ * The content is redrawn when the display list is replayed, so the
+ * recording does not hold on to any bitmap the content plots.  The
+ * content must outlive the display list.
+ *
+ * \param ctx recording redraw context
+ * \param h content to redraw
+ * \param data redraw data for the content
+ * \param clip clip rectangle for the content redraw
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+nserror display_list_content(const struct redraw_context *ctx,
+		struct hlcache_handle *h,
+		const struct content_redraw_data *data,
+		const struct rect *clip);
+
+/**
+ * Find whether a display list may be kept for later replay.
+ *
+ * Display lists which plot bitmaps directly may only be replayed
+ * while those bitmaps are known to exist.
+ *
+ * \param dl display list
+ * \return true if the display list may be kept
+ */
+bool display_list_cacheable(const struct display_list *dl);
+
+/**
+ * Get the memory used by a display list.
+ *
+ * \param dl display list
+ * \return size of the display list, in bytes
+ */
+size_t display_list_size(const struct display_list *dl);
+
+/**
+ * Replay a display list.
+ *
+ * Every recorded clip rectangle is intersected with the given clip.
+ *
+ * \param dl display list to replay
+ * \param x offset to add to recorded x coordinates
+ * \param y offset to add to recorded y coordinates
+ * \param clip clip rectangle to replay within, in target coordinates
+ * \param ctx redraw context to plot through
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+nserror display_list_replay(const struct display_list *dl,
+		int x, int y,
+		const struct rect *clip,
+		const struct redraw_context *ctx);
+
+/**
+ * Write a display list out as text, one plot operation per line.
+ *
+ * \param dl display list to write
+ * \param fh file to write to
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+nserror display_list_dump(const struct display_list *dl, FILE *fh);
+
+/**
+ * Read a display list written by display_list_dump.
+ *
+ * Bitmap and content operations refer to objects which are not
+ * written out, so are left out of the loaded display list.  Font
+ * families are not written out either, and loaded text is plotted
+ * with its generic family.
+ *
+ * \param fh file to read from
+ * \param dl_out updated to the loaded display list
+ * \return NSERROR_OK on success, NSERROR_INVALID if a line could not
+ *         be parsed, or another appropriate error otherwise
+ */
+nserror display_list_load(FILE *fh, struct display_list **dl_out);
+
+/**
+ * Create a set of display lists recorded for square tiles of a plane.
+ *
+ * \param size width and height of each tile
+ * \param count maximum number of tiles kept
+ * \param tiles_out updated to the new tile set
+ * \return NSERROR_OK on success, appropriate error otherwise
+ */
+nserror display_list_tiles_create(int size, unsigned int count,
+		struct display_list_tiles **tiles_out);
+
+/**
+ * Destroy a tile set and every display list it holds.
+ *
+ * \param tiles tile set to destroy
+ */
+void display_list_tiles_destroy(struct display_list_tiles *tiles);
+
+/**
+ * Start a redraw using a tile set.
+ *
+ * Display lists of invalidated tiles are destroyed, so this must only
+ * be called when no display list of the set is being replayed.  Tiles
+ * used by the redraw are not reused before the next call.
+ *
+ * \param tiles tile set
+ */
+void display_list_tiles_start(struct display_list_tiles *tiles);
+
+/**
+ * Find the display list recorded for a tile.
+ *
+ * \param tiles tile set
+ * \param col column of the tile
+ * \param row row of the tile
+ * \return the tile's display list, or NULL if it is not recorded
+ */
+struct display_list *display_list_tiles_find(struct display_list_tiles *tiles,
+		int col, int row);
+
+/**
+ * Add an empty display list for a tile, to be recorded into.
+ *
+ * The least recently used tile not used by the current redraw is
+ * replaced if the set is full.
+ *
+ * \param tiles tile set
+ * \param col column of the tile
+ * \param row row of the tile
+ * \param dl_out updated to the tile's display list
+ * \return NSERROR_OK on success, NSERROR_NOSPACE if every tile is in
+ *         use by the current redraw, or another appropriate error
+ */
+nserror display_list_tiles_add(struct display_list_tiles *tiles,
+		int col, int row, struct display_list **dl_out);
+
+/**
+ * Invalidate the tiles overlapping an area.
+ *
+ * Invalidated tiles are not found again, and their display lists are
+ * destroyed at the start of the next redraw.
+ *
+ * \param tiles tile set
+ * \param area area to invalidate, or NULL for every tile
+ */
+void display_list_tiles_invalidate(struct display_list_tiles *tiles,
+		const struct rect *area);
+
+/**
+ * Invalidate a single tile.
+ *
+ * \param tiles tile set
+ * \param col column of the tile
+ * \param row row of the tile
+ */
+void display_list_tiles_discard(struct display_list_tiles *tiles,
+		int col, int row);
+
+#endif
@@ -154,21 +154,50 @@ nserror netsurf_init(const char *store_path)
 	/* Set up the max attempts made to fetch a timing out resource */
 	hlcache_parameters.llcache.fetch_attempts = nsoption_uint(max_retried_fetches);
 
+	/* select the memory cache eviction policy */
+	if ((nsoption_int(memory_cache_policy) >= 0) &&
+	    (nsoption_int(memory_cache_policy) < LLCACHE_EVICT_COUNT)) {
+		hlcache_parameters.llcache.evict_policy =
+			nsoption_int(memory_cache_policy);
+	} else {
+		hlcache_parameters.llcache.evict_policy = LLCACHE_EVICT_GDSF;
+	}
+
 	/* image cache is 25% of total memory cache size */
 	image_cache_parameters.limit = (hlcache_parameters.llcache.limit * 25) / 100;
 
 	/* image cache hysteresis is 20% of the image cache size */
 	image_cache_parameters.hysteresis = (image_cache_parameters.limit * 20) / 100;
 
+	/* unused content retention is 10% of total memory cache size */
+	hlcache_parameters.limit = (hlcache_parameters.llcache.limit * 10) / 100;
+
 	/* account for image cache use from total */
 	hlcache_parameters.llcache.limit -= image_cache_parameters.limit;
 
+	/* account for unused content retention from total */
+	hlcache_parameters.llcache.limit -= hlcache_parameters.limit;
+
 	/* set backing store target limit */
 	hlcache_parameters.llcache.store.limit = nsoption_uint(disc_cache_size);
 
 	/* set backing store hysterissi to 20% */
 	hlcache_parameters.llcache.store.hysteresis = (hlcache_parameters.llcache.store.limit * 20) / 100;;
 
+	/* select the backing store synchronisation policy */
+	if ((nsoption_int(disc_cache_sync) >= 0) &&
+	    (nsoption_int(disc_cache_sync) < LLCACHE_STORE_SYNC_COUNT)) {
+		hlcache_parameters.llcache.store.sync =
+			nsoption_int(disc_cache_sync);
+	} else {
+		hlcache_parameters.llcache.store.sync =
+			LLCACHE_STORE_SYNC_CONTROL;
+	}
+
+	/* compress data in the backing store */
+	hlcache_parameters.llcache.store.compress =
+		nsoption_bool(disc_cache_compress);
+
 	/* set the path to the backing store */
 	hlcache_parameters.llcache.store.path =
 		nsoption_charp(disc_cache_path) ?
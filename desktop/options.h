@@ -92,6 +92,9 @@ NSOPTION_STRING(accept_charset, NULL)
 /** Preferred maximum size of memory cache / bytes. */
 NSOPTION_INTEGER(memory_cache_size, 12 * 1024 * 1024)
 
+/** Memory cache eviction policy (0 = LRU, 1 = TinyLFU, 2 = GDSF) */
+NSOPTION_INTEGER(memory_cache_policy, 2)
+
 /** Preferred location of disc cache, or NULL for system provided location */
 NSOPTION_STRING(disc_cache_path, NULL)
 
@@ -101,6 +104,12 @@ NSOPTION_UINT(disc_cache_size, 1024 * 1024 * 1024)
 /** Preferred expiry age of disc cache / days. */
 NSOPTION_INTEGER(disc_cache_age, 28)
 
+/** Disc cache synchronisation (0 = none, 1 = control data, 2 = all data) */
+NSOPTION_INTEGER(disc_cache_sync, 1)
+
+/** Whether to compress data stored in the disc cache */
+NSOPTION_BOOL(disc_cache_compress, true)
+
 /** Whether to block advertisements */
 NSOPTION_BOOL(block_advertisements, false)
 
@@ -21,12 +21,14 @@
 #include <string.h>
 #include <stdbool.h>
 #include <limits.h>
+#include <sys/select.h>
 
 #include "utils/errors.h"
 #include "utils/file.h"
 #include "utils/nsurl.h"
 #include "utils/filepath.h"
 #include "netsurf/fetch.h"
+#include "content/fetch.h"
 
 #include "monkey/filetype.h"
 #include "monkey/fetch.h"
@@ -44,10 +46,130 @@ static nsurl *gui_get_resource_url(const char *path)
 	return url;
 }
 
+/** A file descriptor the fetchers have asked to be watched */
+struct monkey_fd_watch {
+	int fd;
+	enum fetch_fd_events events;
+};
+
+static struct monkey_fd_watch *fd_watches = NULL;
+static unsigned int fd_watch_count = 0;
+static unsigned int fd_watch_alloc = 0;
+
+static nserror gui_watch_fd(int fd, enum fetch_fd_events events)
+{
+	unsigned int idx;
+
+	for (idx = 0; idx < fd_watch_count; idx++) {
+		if (fd_watches[idx].fd == fd) {
+			break;
+		}
+	}
+
+	if (events == FETCH_FD_NONE) {
+		if (idx < fd_watch_count) {
+			fd_watches[idx] = fd_watches[--fd_watch_count];
+		}
+		return NSERROR_OK;
+	}
+
+	if (idx == fd_watch_count) {
+		if (fd_watch_count == fd_watch_alloc) {
+			struct monkey_fd_watch *nw;
+			unsigned int nalloc = fd_watch_alloc ? fd_watch_alloc * 2 : 8;
+
+			nw = realloc(fd_watches, nalloc * sizeof(*nw));
+			if (nw == NULL) {
+				return NSERROR_NOMEM;
+			}
+			fd_watches = nw;
+			fd_watch_alloc = nalloc;
+		}
+		fd_watches[idx].fd = fd;
+		fd_watch_count++;
+	}
+	fd_watches[idx].events = events;
+
+	return NSERROR_OK;
+}
+
+/* exported interface documented in monkey/fetch.h */
+int monkey_fetch_fdset(fd_set *read_fd_set,
+		       fd_set *write_fd_set,
+		       fd_set *exc_fd_set)
+{
+	unsigned int idx;
+	int max_fd = -1;
+
+	for (idx = 0; idx < fd_watch_count; idx++) {
+		int fd = fd_watches[idx].fd;
+
+		if ((fd_watches[idx].events & FETCH_FD_READ) != 0) {
+			FD_SET(fd, read_fd_set);
+		}
+		if ((fd_watches[idx].events & FETCH_FD_WRITE) != 0) {
+			FD_SET(fd, write_fd_set);
+		}
+		FD_SET(fd, exc_fd_set);
+		if (fd > max_fd) {
+			max_fd = fd;
+		}
+	}
+
+	return max_fd;
+}
+
+/* exported interface documented in monkey/fetch.h */
+void monkey_fetch_fdready(fd_set *read_fd_set,
+			  fd_set *write_fd_set,
+			  fd_set *exc_fd_set)
+{
+	struct monkey_fd_watch *ready;
+	unsigned int ready_count = 0;
+	unsigned int idx;
+
+	if (fd_watch_count == 0) {
+		return;
+	}
+
+	/* the watch set changes as the fetchers are notified */
+	ready = malloc(fd_watch_count * sizeof(*ready));
+	if (ready == NULL) {
+		return;
+	}
+
+	for (idx = 0; idx < fd_watch_count; idx++) {
+		int fd = fd_watches[idx].fd;
+		enum fetch_fd_events events = FETCH_FD_NONE;
+
+		if (FD_ISSET(fd, read_fd_set)) {
+			events |= FETCH_FD_READ;
+		}
+		if (FD_ISSET(fd, write_fd_set)) {
+			events |= FETCH_FD_WRITE;
+		}
+		if (FD_ISSET(fd, exc_fd_set)) {
+			events |= FETCH_FD_ERROR;
+		}
+		if (events != FETCH_FD_NONE) {
+			ready[ready_count].fd = fd;
+			ready[ready_count].events = events;
+			ready_count++;
+		}
+	}
+
+	for (idx = 0; idx < ready_count; idx++) {
+		fetch_fd_ready(ready[idx].fd, ready[idx].events);
+	}
+
+	free(ready);
+}
+
 static struct gui_fetch_table fetch_table = {
 	.filetype = monkey_fetch_filetype,
 
 	.get_resource_url = gui_get_resource_url,
+	.watch_fd = gui_watch_fd,
 };
 
 struct gui_fetch_table *monkey_fetch_table = &fetch_table;
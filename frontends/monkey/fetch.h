@@ -21,4 +21,16 @@
 
 extern struct gui_fetch_table *monkey_fetch_table;
 
+/**
+ * Add the file descriptors being watched for the fetchers to fd sets.
+ *
+ * \return The highest file descriptor added or -1 if none.
+ */
+int monkey_fetch_fdset(fd_set *read_fd_set, fd_set *write_fd_set, fd_set *exc_fd_set);
+
+/**
+ * Notify the fetchers of activity on watched file descriptors.
+ */
+void monkey_fetch_fdready(fd_set *read_fd_set, fd_set *write_fd_set, fd_set *exc_fd_set);
+
 #endif /* NS_MONKEY_FETCH_H */
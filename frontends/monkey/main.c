@@ -25,6 +25,7 @@
 #include <string.h>
 #include <errno.h>
 #include <signal.h>
+#include <inttypes.h>
 
 #include "utils/config.h"
 #include "utils/sys_time.h"
@@ -33,6 +34,7 @@
 #include "utils/filepath.h"
 #include "utils/nsoption.h"
 #include "utils/nsurl.h"
+#include "utils/perf.h"
 #include "netsurf/misc.h"
 #include "netsurf/netsurf.h"
 #include "netsurf/url_db.h"
@@ -226,6 +228,52 @@ static void monkey_options_handle_command(int argc, char **argv)
 	nsoption_commandline(&argc, argv, nsoptions);
 }
 
+/**
+ * handle PERF commands
+ *
+ * START discards previous measurements and starts measuring, STOP
+ * stops measuring and REPORT outputs the measurements made.
+ */
+static void monkey_perf_handle_command(int argc, char **argv)
+{
+	const struct perf_stats *stats;
+	int idx;
+
+	if (argc != 2) {
+		moutf(MOUT_ERROR, "PERF ARGS BAD");
+		return;
+	}
+
+	if (strcmp(argv[1], "START") == 0) {
+		perf_reset(true);
+	} else if (strcmp(argv[1], "STOP") == 0) {
+		perf_enabled = false;
+	} else if (strcmp(argv[1], "REPORT") == 0) {
+		stats = perf_get();
+
+		moutf(MOUT_PERF, "REPORT START");
+		for (idx = 0; idx < PERF_PHASE__COUNT; idx++) {
+			moutf(MOUT_PERF, "PHASE %s COUNT %u TIME %"PRIu64,
+			      perf_phase_name(idx),
+			      stats->phase[idx].count,
+			      stats->phase[idx].time);
+		}
+		for (idx = 0; idx < PERF_COUNT__COUNT; idx++) {
+			moutf(MOUT_PERF, "COUNTER %s COUNT %u",
+			      perf_counter_name(idx),
+			      stats->counter[idx]);
+		}
+		for (idx = 0; idx < PERF_MARK__COUNT; idx++) {
+			moutf(MOUT_PERF, "MARK %s TIME %"PRIu64,
+			      perf_mark_name(idx),
+			      stats->mark[idx]);
+		}
+		moutf(MOUT_PERF, "REPORT STOP");
+	} else {
+		moutf(MOUT_ERROR, "PERF COMMAND UNKNOWN %s", argv[1]);
+	}
+}
+
 /**
  * Set option defaults for monkey frontend
  *
@@ -277,8 +325,12 @@ static void monkey_run(void)
 		/* discover the next scheduled event time */
 		schedtm = monkey_schedule_run();
 
-		/* clears fdset */
-		fetch_fdset(&read_fd_set, &write_fd_set, &exc_fd_set, &max_fd);
+		FD_ZERO(&read_fd_set);
+		FD_ZERO(&write_fd_set);
+		FD_ZERO(&exc_fd_set);
+
+		/* add the file descriptors the fetchers are waiting on */
+		max_fd = monkey_fetch_fdset(&read_fd_set, &write_fd_set, &exc_fd_set);
 
 		/* add stdin to the set */
 		if (max_fd < 0) {
@@ -320,6 +372,7 @@ static void monkey_run(void)
 			NSLOG(netsurf, CRITICAL, "Unable to select: %s", strerror(errno));
 			monkey_done = true;
 		} else if (rdy_fd > 0) {
+			monkey_fetch_fdready(&read_fd_set, &write_fd_set, &exc_fd_set);
 			if (FD_ISSET(0, &read_fd_set)) {
 				monkey_process_command();
 			}
@@ -473,6 +526,11 @@ main(int argc, char **argv)
 		die("login handler failed to register");
 	}
 
+	ret = monkey_register_handler("PERF", monkey_perf_handle_command);
+	if (ret != NSERROR_OK) {
+		die("perf handler failed to register");
+	}
+
 
 	moutf(MOUT_GENERIC, "STARTED");
 	monkey_run();
@@ -28,6 +28,8 @@
 #include "utils/nsurl.h"
 #include "netsurf/fetch.h"
 
+#include "tiny/platform.h"
+
 extern char **respaths;
 
 static const char *
@@ -60,6 +62,7 @@ static struct gui_fetch_table fetch_table = {
 	/* get_resource_data */
 	/* release_resource_data */
 	/* mimetype */
+	.watch_fd = platform_watch_fd,
 };
 
 struct gui_fetch_table *tiny_fetch_table = &fetch_table;
@@ -19,6 +19,7 @@
 #ifndef NETSURF_TINY_PLATFORM_H
 #define NETSURF_TINY_PLATFORM_H 1
 
+#include "netsurf/fetch.h"
 #include "netsurf/mouse.h"
 
 struct rect;
@@ -26,6 +27,7 @@ struct rect;
 nserror platform_init(void);
 void platform_run(void);
 void platform_quit(void);
+nserror platform_watch_fd(int fd, enum fetch_fd_events events);
 
 struct platform_window *platform_window_create(struct gui_window *g);
 void platform_window_destroy(struct platform_window *p);
@@ -16,6 +16,7 @@
  * along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 
+#include <errno.h>
 #include <fcntl.h>
 #include <linux/input.h>
 #include <linux/memfd.h>
@@ -39,10 +40,12 @@
 #include "utils/utils.h"
 #include "netsurf/browser.h"
 #include "netsurf/browser_window.h"
+#include "netsurf/fetch.h"
 #include "netsurf/clipboard.h"
 #include "netsurf/keypress.h"
 #include "netsurf/mouse.h"
 #include "netsurf/plotters.h"
+#include "content/fetch.h"
 
 #include "tiny/platform.h"
 #include "tiny/render.h"
@@ -74,6 +77,12 @@ struct selectionwriter {
 	size_t pos;
 };
 
+struct fdwatch {
+	struct eventsource ev;
+	int fd;
+	enum fetch_fd_events events;
+};
+
 struct wlimage {
 	pixman_image_t *pixman;
 	size_t size;
@@ -125,6 +134,11 @@ struct wlstate {
 		struct selectiondata data;
 		struct selectionreader reader;
 	} selection;
+
+	/* indexed by fd; kept until exit since events for a removed
+	 * watch may still be pending in the current epoll batch */
+	struct fdwatch **fdwatch;
+	size_t fdwatchlen;
 };
 
 struct platform_window {
@@ -776,6 +790,87 @@ wldispatch(struct epoll_event *ev)
 	wl_display_dispatch(wl->display);
 }
 
+static void
+fdwatchdispatch(struct epoll_event *ev)
+{
+	struct fdwatch *w;
+	enum fetch_fd_events events = FETCH_FD_NONE;
+
+	w = ev->data.ptr;
+	if (w->events == FETCH_FD_NONE)
+		return;
+	if (ev->events & EPOLLIN)
+		events |= FETCH_FD_READ;
+	if (ev->events & EPOLLOUT)
+		events |= FETCH_FD_WRITE;
+	if (ev->events & (EPOLLERR | EPOLLHUP))
+		events |= FETCH_FD_ERROR;
+	fetch_fd_ready(w->fd, events);
+}
+
+nserror
+platform_watch_fd(int fd, enum fetch_fd_events events)
+{
+	struct fdwatch *w, **newwatch;
+	struct epoll_event ev;
+	size_t len;
+	int op, ret;
+
+	if (fd < 0)
+		return NSERROR_BAD_PARAMETER;
+	if ((size_t)fd >= wl->fdwatchlen) {
+		if (events == FETCH_FD_NONE)
+			return NSERROR_OK;
+		len = MAX(fd + 1, wl->fdwatchlen * 2);
+		newwatch = realloc(wl->fdwatch, len * sizeof(*newwatch));
+		if (!newwatch)
+			return NSERROR_NOMEM;
+		memset(newwatch + wl->fdwatchlen, 0, (len - wl->fdwatchlen) * sizeof(*newwatch));
+		wl->fdwatch = newwatch;
+		wl->fdwatchlen = len;
+	}
+	w = wl->fdwatch[fd];
+	if (!w) {
+		if (events == FETCH_FD_NONE)
+			return NSERROR_OK;
+		w = calloc(1, sizeof(*w));
+		if (!w)
+			return NSERROR_NOMEM;
+		w->ev.dispatch = fdwatchdispatch;
+		w->fd = fd;
+		wl->fdwatch[fd] = w;
+	}
+
+	if (events == FETCH_FD_NONE) {
+		op = EPOLL_CTL_DEL;
+	} else if (w->events == FETCH_FD_NONE) {
+		op = EPOLL_CTL_ADD;
+	} else {
+		op = EPOLL_CTL_MOD;
+	}
+	if (op == EPOLL_CTL_DEL && w->events == FETCH_FD_NONE)
+		return NSERROR_OK;
+
+	ev.events = 0;
+	if (events & FETCH_FD_READ)
+		ev.events |= EPOLLIN;
+	if (events & FETCH_FD_WRITE)
+		ev.events |= EPOLLOUT;
+	ev.data.ptr = w;
+	/* closing an fd removes it from the epoll set, so the fd may
+	 * be gone or have been reused since it was last watched */
+	ret = epoll_ctl(wl->epoll, op, fd, &ev);
+	if (ret < 0 && op == EPOLL_CTL_MOD && errno == ENOENT)
+		ret = epoll_ctl(wl->epoll, EPOLL_CTL_ADD, fd, &ev);
+	if (ret < 0 && op != EPOLL_CTL_DEL) {
+		NSLOG(netsurf, ERROR, "epoll_ctl: %s", strerror(errno));
+		return NSERROR_INIT_FAILED;
+	}
+	w->events = events;
+
+	return NSERROR_OK;
+}
+
 nserror
 platform_init(void)
 {
@@ -27,6 +27,16 @@
 
 struct nsurl;
 
+/**
+ * File descriptor events used by fetcher file descriptor watches.
+ */
+enum fetch_fd_events {
+	FETCH_FD_NONE = 0, /**< no events, the watch is removed */
+	FETCH_FD_READ = 1, /**< file descriptor is readable */
+	FETCH_FD_WRITE = 2, /**< file descriptor is writable */
+	FETCH_FD_ERROR = 4, /**< error condition on file descriptor */
+};
+
 /**
  * function table for fetcher operations.
  */
@@ -99,6 +109,25 @@ struct gui_fetch_table {
 	 */
 	char *(*mimetype)(const char *ro_path);
 
+	/**
+	 * Watch a file descriptor on behalf of the fetchers.
+	 *
+	 * When provided, fetchers which can be driven by file
+	 * descriptor activity request watches through this call
+	 * instead of being polled. The frontend must call
+	 * fetch_fd_ready() whenever a watched file descriptor has
+	 * any of the requested events pending.
+	 *
+	 * A subsequent call for the same file descriptor replaces the
+	 * events being watched for.
+	 *
+	 * \param fd The file descriptor to watch.
+	 * \param events The events to watch for or FETCH_FD_NONE to
+	 *               stop watching the file descriptor.
+	 * \return NSERROR_OK on success else appropriate error code.
+	 */
+	nserror (*watch_fd)(int fd, enum fetch_fd_events events);
+
 };
 
 #endif
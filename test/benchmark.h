@@ -0,0 +1,72 @@
+/*
+ * Copyright 2026 The NetSurf Developers
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Helpers for benchmark test cases.
+ *
+ * Benchmark test cases are only added to a suite when
+ * NETSURF_TEST_BENCHMARK is set in the environment, as by the
+ * benchmark make target.
+ */
+
+#ifndef NETSURF_TEST_BENCHMARK_H_
+#define NETSURF_TEST_BENCHMARK_H_
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <time.h>
+
+/**
+ * Find whether benchmark test cases should be run.
+ *
+ * \return true if NETSURF_TEST_BENCHMARK is set in the environment
+ */
+static inline bool benchmark_enabled(void)
+{
+	return getenv("NETSURF_TEST_BENCHMARK") != NULL;
+}
+
+/**
+ * Start timing a benchmark.
+ *
+ * \return the processor time to pass to benchmark_rate
+ */
+static inline clock_t benchmark_start(void)
+{
+	return clock();
+}
+
+/**
+ * Compute the rate of operations since a benchmark started.
+ *
+ * \param ops number of operations performed
+ * \param start time returned by benchmark_start
+ * \return operations per second, or 0 if no time was measured
+ */
+static inline double benchmark_rate(size_t ops, clock_t start)
+{
+	double secs = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+	if (secs <= 0) {
+		return 0;
+	}
+	return ops / secs;
+}
+
+#endif
@@ -114,6 +114,43 @@ START_TEST(bloom_insert_empty_str_test)
 END_TEST
 
 
+/**
+ * merge stored filter test
+ *
+ * Filter data taken from one filter and merged into another must
+ * match the entries of both.
+ */
+START_TEST(bloom_merge_test)
+{
+	struct bloom_filter *a;
+	struct bloom_filter *b;
+	const uint8_t *data;
+	size_t size;
+
+	a = bloom_create(BLOOM_SIZE);
+	ck_assert(a != NULL);
+	b = bloom_create(BLOOM_SIZE);
+	ck_assert(b != NULL);
+
+	bloom_insert_str(a, "NetSurf", 7);
+	bloom_insert_str(b, "NotSurf", 7);
+
+	data = bloom_data(a, &size);
+	ck_assert(size == BLOOM_SIZE);
+
+	ck_assert(bloom_merge(b, data, size - 1, 1) == false);
+	ck_assert(bloom_merge(b, data, size, bloom_items(a)) == true);
+
+	ck_assert(bloom_search_str(b, "NetSurf", 7));
+	ck_assert(bloom_search_str(b, "NotSurf", 7));
+	ck_assert(bloom_items(b) == 2);
+
+	bloom_destroy(a);
+	bloom_destroy(b);
+}
+END_TEST
+
+
 /**
  * Basic API creation test case
  */
@@ -125,6 +162,7 @@ static TCase *bloom_api_case_create(void)
 
 	tcase_add_test(tc, bloom_create_test);
 	tcase_add_test(tc, bloom_insert_empty_str_test);
+	tcase_add_test(tc, bloom_merge_test);
 
 	return tc;
 }
@@ -0,0 +1,526 @@
+/*
+ * Copyright 2026 The NetSurf Developers
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Tests for display list recording, replay and tile sets.
+ */
+
+#include <assert.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <check.h>
+
+#include "utils/errors.h"
+#include "utils/nsurl.h"
+#include "netsurf/types.h"
+#include "netsurf/content.h"
+#include "netsurf/plotters.h"
+
+#include "desktop/display_list.h"
+
+/** Size of buffer display lists are dumped into */
+#define DUMP_SIZE 4096
+
+/* Stubs */
+
+/** Number of times content_redraw was called */
+static int content_redraw_count;
+
+/** Redraw data of the last content_redraw call */
+static struct content_redraw_data content_redraw_data;
+
+/** Clip rectangle of the last content_redraw call */
+static struct rect content_redraw_clip;
+
+bool content_redraw(struct hlcache_handle *h,
+		struct content_redraw_data *data,
+		const struct rect *clip,
+		const struct redraw_context *ctx)
+{
+	content_redraw_count++;
+	content_redraw_data = *data;
+	content_redraw_clip = *clip;
+	return true;
+}
+
+struct nsurl *hlcache_handle_get_url(const struct hlcache_handle *handle)
+{
+	return NULL;
+}
+
+const char *nsurl_access(const nsurl *url)
+{
+	return "";
+}
+
+/* Helpers */
+
+static const plot_style_t style_fill = {
+	.stroke_type = PLOT_OP_TYPE_NONE,
+	.fill_type = PLOT_OP_TYPE_SOLID,
+	.fill_colour = 0x123456,
+};
+
+static const plot_style_t style_stroke = {
+	.stroke_type = PLOT_OP_TYPE_DASH,
+	.stroke_width = plot_style_int_to_fixed(2),
+	.stroke_colour = 0xabcdef,
+	.fill_type = PLOT_OP_TYPE_NONE,
+};
+
+static const struct redraw_context base_ctx = {
+	.interactive = true,
+	.background_images = true,
+};
+
+/**
+ * Write a display list into a string.
+ */
+static void dump(const struct display_list *dl, char *buf, size_t size)
+{
+	FILE *fh;
+	size_t len;
+
+	fh = tmpfile();
+	ck_assert(fh != NULL);
+
+	ck_assert_int_eq(display_list_dump(dl, fh), NSERROR_OK);
+
+	rewind(fh);
+	len = fread(buf, 1, size - 1, fh);
+	ck_assert(len < size - 1);
+	buf[len] = '\0';
+
+	fclose(fh);
+}
+
+/**
+ * Load a display list from a string.
+ */
+static nserror load(const char *text, struct display_list **dl_out)
+{
+	FILE *fh;
+	nserror res;
+
+	fh = tmpfile();
+	ck_assert(fh != NULL);
+
+	fputs(text, fh);
+	rewind(fh);
+
+	res = display_list_load(fh, dl_out);
+
+	fclose(fh);
+
+	return res;
+}
+
+/**
+ * Record one of each plot operation which may be written out and read back.
+ */
+static void record_all(struct display_list *dl)
+{
+	struct redraw_context ctx;
+	const struct rect clip = { 0, 0, 100, 50 };
+	const struct rect line = { 1, 2, 30, 40 };
+	const struct rect rect = { 5, 6, 25, 26 };
+	const int polygon[6] = { 0, 0, 10, 0, 5, 8 };
+	const float path[5] = { 0.0f, 1.5f, -2.25f, 3.0f, 0.125f };
+	const float transform[6] = { 1, 0, 0, 1, 4, 8 };
+	const plot_font_style_t fstyle = {
+		.family = PLOT_FONT_FAMILY_SERIF,
+		.size = plot_style_int_to_fixed(12),
+		.weight = 700,
+		.flags = FONTF_ITALIC,
+		.background = 0xffffff,
+		.foreground = 0x000000,
+	};
+	const char text[] = "say \"hi\"\\\tbye";
+
+	display_list_record(dl, &base_ctx, &ctx);
+	ck_assert(display_list_recording(&ctx));
+
+	ck_assert_int_eq(ctx.plot->group_start(&ctx, "outer"), NSERROR_OK);
+	ck_assert_int_eq(ctx.plot->clip(&ctx, &clip), NSERROR_OK);
+	ck_assert_int_eq(ctx.plot->arc(&ctx, &style_stroke, 10, 11, 5, 0, 90),
+			NSERROR_OK);
+	ck_assert_int_eq(ctx.plot->disc(&ctx, &style_fill, 20, 21, 6),
+			NSERROR_OK);
+	ck_assert_int_eq(ctx.plot->line(&ctx, &style_stroke, &line),
+			NSERROR_OK);
+	ck_assert_int_eq(ctx.plot->rectangle(&ctx, &style_fill, &rect),
+			NSERROR_OK);
+	ck_assert_int_eq(ctx.plot->polygon(&ctx, &style_fill, polygon, 3),
+			NSERROR_OK);
+	ck_assert_int_eq(ctx.plot->path(&ctx, &style_stroke, path, 5,
+			transform), NSERROR_OK);
+	ck_assert_int_eq(ctx.plot->text(&ctx, &fstyle, 3, 45,
+			text, sizeof(text) - 1), NSERROR_OK);
+	ck_assert_int_eq(ctx.plot->group_end(&ctx), NSERROR_OK);
+}
+
+/* Record and replay tests */
+
+START_TEST(display_list_record_test)
+{
+	struct display_list *dl;
+	struct redraw_context ctx;
+	size_t empty;
+
+	ck_assert_int_eq(display_list_create(&dl), NSERROR_OK);
+	empty = display_list_size(dl);
+
+	record_all(dl);
+
+	ck_assert(display_list_size(dl) > empty);
+	ck_assert(display_list_cacheable(dl));
+	ck_assert(!display_list_recording(&base_ctx));
+
+	/* Bitmaps are not copied, so may not be kept */
+	display_list_record(dl, &base_ctx, &ctx);
+	ck_assert_int_eq(ctx.plot->bitmap(&ctx, (struct bitmap *)dl,
+			0, 0, 10, 10, 0, BITMAPF_NONE), NSERROR_OK);
+	ck_assert(!display_list_cacheable(dl));
+
+	display_list_destroy(dl);
+}
+END_TEST
+
+START_TEST(display_list_replay_test)
+{
+	struct display_list *dl;
+	struct display_list *out;
+	struct redraw_context ctx;
+	const struct rect clip = { 0, 0, 100, 100 };
+	const struct rect rect = { 5, 6, 25, 26 };
+	const struct rect replay_clip = { 20, 0, 60, 35 };
+	char buf[DUMP_SIZE];
+
+	ck_assert_int_eq(display_list_create(&dl), NSERROR_OK);
+	display_list_record(dl, &base_ctx, &ctx);
+	ck_assert_int_eq(ctx.plot->clip(&ctx, &clip), NSERROR_OK);
+	ck_assert_int_eq(ctx.plot->rectangle(&ctx, &style_fill, &rect),
+			NSERROR_OK);
+	ck_assert_int_eq(ctx.plot->disc(&ctx, &style_fill, 20, 21, 6),
+			NSERROR_OK);
+
+	/* Replay offset, recording the plot operations made */
+	ck_assert_int_eq(display_list_create(&out), NSERROR_OK);
+	display_list_record(out, &base_ctx, &ctx);
+	ck_assert_int_eq(display_list_replay(dl, 10, 20, &replay_clip, &ctx),
+			NSERROR_OK);
+
+	dump(out, buf, sizeof(buf));
+	ck_assert_str_eq(buf,
+			"clip 20 0 60 35\n"
+			"clip 20 20 60 35\n"
+			"rectangle 15 26 35 46 stroke=0,0,000000 fill=1,123456\n"
+			"disc 30 41 6 stroke=0,0,000000 fill=1,123456\n");
+	display_list_destroy(out);
+
+	/* Nothing is plotted outside an empty clip rectangle */
+	ck_assert_int_eq(display_list_create(&out), NSERROR_OK);
+	display_list_record(out, &base_ctx, &ctx);
+	ck_assert_int_eq(display_list_replay(dl, 500, 500, &replay_clip,
+			&ctx), NSERROR_OK);
+	dump(out, buf, sizeof(buf));
+	ck_assert_str_eq(buf, "clip 20 0 60 35\n");
+	display_list_destroy(out);
+
+	display_list_destroy(dl);
+}
+END_TEST
+
+START_TEST(display_list_replay_content_test)
+{
+	struct display_list *dl;
+	struct display_list *out;
+	struct redraw_context ctx;
+	struct content_redraw_data data = {
+		.x = 4,
+		.y = 5,
+		.width = 40,
+		.height = 50,
+		.scale = 1.0,
+	};
+	const struct rect clip = { 0, 0, 30, 30 };
+	const struct rect replay_clip = { 0, 0, 1000, 1000 };
+
+	ck_assert_int_eq(display_list_create(&dl), NSERROR_OK);
+	display_list_record(dl, &base_ctx, &ctx);
+	ck_assert_int_eq(display_list_content(&ctx,
+			(struct hlcache_handle *)dl, &data, &clip),
+			NSERROR_OK);
+
+	/* The content is redrawn on replay, offset */
+	content_redraw_count = 0;
+	ck_assert_int_eq(display_list_create(&out), NSERROR_OK);
+	display_list_record(out, &base_ctx, &ctx);
+	ck_assert_int_eq(display_list_replay(dl, 100, 200, &replay_clip,
+			&ctx), NSERROR_OK);
+	display_list_destroy(out);
+
+	ck_assert_int_eq(content_redraw_count, 1);
+	ck_assert_int_eq(content_redraw_data.x, 104);
+	ck_assert_int_eq(content_redraw_data.y, 205);
+	ck_assert_int_eq(content_redraw_clip.x0, 100);
+	ck_assert_int_eq(content_redraw_clip.y0, 200);
+	ck_assert_int_eq(content_redraw_clip.x1, 130);
+	ck_assert_int_eq(content_redraw_clip.y1, 230);
+
+	display_list_destroy(dl);
+}
+END_TEST
+
+static TCase *display_list_record_case_create(void)
+{
+	TCase *tc;
+	tc = tcase_create("Record and replay");
+
+	tcase_add_test(tc, display_list_record_test);
+	tcase_add_test(tc, display_list_replay_test);
+	tcase_add_test(tc, display_list_replay_content_test);
+
+	return tc;
+}
+
+/* Dump and load tests */
+
+START_TEST(display_list_round_trip_test)
+{
+	struct display_list *dl;
+	struct display_list *loaded;
+	char before[DUMP_SIZE];
+	char after[DUMP_SIZE];
+
+	ck_assert_int_eq(display_list_create(&dl), NSERROR_OK);
+	record_all(dl);
+
+	dump(dl, before, sizeof(before));
+	ck_assert_int_eq(load(before, &loaded), NSERROR_OK);
+	dump(loaded, after, sizeof(after));
+
+	ck_assert_str_eq(before, after);
+	ck_assert_int_eq(display_list_size(loaded), display_list_size(dl));
+
+	display_list_destroy(loaded);
+	display_list_destroy(dl);
+}
+END_TEST
+
+START_TEST(display_list_load_skip_test)
+{
+	struct display_list *dl;
+	char buf[DUMP_SIZE];
+
+	/* Bitmaps and contents can not be loaded, so are left out */
+	ck_assert_int_eq(load("clip 0 0 10 10\n"
+			"bitmap 0 0 10 10 bg=ffffff flags=0\n"
+			"content 0 0 10 10 scale=1 repeat=0,0 bg=ffffff "
+			"clip=0,0,10,10 -\n"
+			"group_end\n", &dl), NSERROR_OK);
+	ck_assert(display_list_cacheable(dl));
+
+	dump(dl, buf, sizeof(buf));
+	ck_assert_str_eq(buf, "clip 0 0 10 10\ngroup_end\n");
+
+	display_list_destroy(dl);
+}
+END_TEST
+
+START_TEST(display_list_load_invalid_test)
+{
+	struct display_list *dl = NULL;
+
+	ck_assert_int_eq(load("clip 0 0 10\n", &dl), NSERROR_INVALID);
+	ck_assert_int_eq(load("disc 1 2 3\n", &dl), NSERROR_INVALID);
+	ck_assert_int_eq(load("polygon 3 0 0 1 1 "
+			"stroke=0,0,000000 fill=1,000000\n", &dl),
+			NSERROR_INVALID);
+	ck_assert_int_eq(load("text 0 0 family=0 size=1 weight=400 "
+			"flags=0 fg=000000 bg=ffffff \"open\n", &dl),
+			NSERROR_INVALID);
+	ck_assert_int_eq(load("sprite 0 0\n", &dl), NSERROR_INVALID);
+	ck_assert(dl == NULL);
+
+	ck_assert_int_eq(load("", &dl), NSERROR_OK);
+	ck_assert(dl != NULL);
+	display_list_destroy(dl);
+}
+END_TEST
+
+static TCase *display_list_dump_case_create(void)
+{
+	TCase *tc;
+	tc = tcase_create("Dump and load");
+
+	tcase_add_test(tc, display_list_round_trip_test);
+	tcase_add_test(tc, display_list_load_skip_test);
+	tcase_add_test(tc, display_list_load_invalid_test);
+
+	return tc;
+}
+
+/* Tile set tests */
+
+START_TEST(display_list_tiles_find_test)
+{
+	struct display_list_tiles *tiles;
+	struct display_list *dl;
+	struct display_list *found;
+
+	ck_assert_int_eq(display_list_tiles_create(256, 4, &tiles),
+			NSERROR_OK);
+	display_list_tiles_start(tiles);
+
+	ck_assert(display_list_tiles_find(tiles, 0, 0) == NULL);
+	ck_assert_int_eq(display_list_tiles_add(tiles, 0, 0, &dl),
+			NSERROR_OK);
+	ck_assert_int_eq(display_list_tiles_add(tiles, -1, 2, &found),
+			NSERROR_OK);
+	ck_assert(found != dl);
+
+	display_list_tiles_start(tiles);
+	ck_assert(display_list_tiles_find(tiles, 0, 0) == dl);
+	ck_assert(display_list_tiles_find(tiles, -1, 2) == found);
+	ck_assert(display_list_tiles_find(tiles, 2, -1) == NULL);
+
+	display_list_tiles_destroy(tiles);
+}
+END_TEST
+
+START_TEST(display_list_tiles_invalidate_test)
+{
+	struct display_list_tiles *tiles;
+	struct display_list *dl;
+	const struct rect inside = { 300, 10, 301, 11 };
+	const struct rect edge = { 0, 256, 256, 512 };
+
+	ck_assert_int_eq(display_list_tiles_create(256, 4, &tiles),
+			NSERROR_OK);
+	display_list_tiles_start(tiles);
+	ck_assert_int_eq(display_list_tiles_add(tiles, 0, 0, &dl),
+			NSERROR_OK);
+	ck_assert_int_eq(display_list_tiles_add(tiles, 1, 0, &dl),
+			NSERROR_OK);
+	ck_assert_int_eq(display_list_tiles_add(tiles, -1, -1, &dl),
+			NSERROR_OK);
+
+	/* An area touching only the edge of tiles does not invalidate
+	 * them */
+	display_list_tiles_invalidate(tiles, &edge);
+	ck_assert(display_list_tiles_find(tiles, 0, 0) != NULL);
+	ck_assert(display_list_tiles_find(tiles, 1, 0) != NULL);
+
+	display_list_tiles_invalidate(tiles, &inside);
+	ck_assert(display_list_tiles_find(tiles, 0, 0) != NULL);
+	ck_assert(display_list_tiles_find(tiles, 1, 0) == NULL);
+	ck_assert(display_list_tiles_find(tiles, -1, -1) != NULL);
+
+	display_list_tiles_discard(tiles, -1, -1);
+	ck_assert(display_list_tiles_find(tiles, -1, -1) == NULL);
+
+	display_list_tiles_invalidate(tiles, NULL);
+	ck_assert(display_list_tiles_find(tiles, 0, 0) == NULL);
+
+	/* Invalidated tiles may be recorded again */
+	display_list_tiles_start(tiles);
+	ck_assert_int_eq(display_list_tiles_add(tiles, 1, 0, &dl),
+			NSERROR_OK);
+	ck_assert(display_list_tiles_find(tiles, 1, 0) == dl);
+
+	display_list_tiles_invalidate(NULL, NULL);
+	display_list_tiles_destroy(tiles);
+}
+END_TEST
+
+START_TEST(display_list_tiles_replace_test)
+{
+	struct display_list_tiles *tiles;
+	struct display_list *dl;
+
+	ck_assert_int_eq(display_list_tiles_create(256, 2, &tiles),
+			NSERROR_OK);
+
+	display_list_tiles_start(tiles);
+	ck_assert_int_eq(display_list_tiles_add(tiles, 0, 0, &dl),
+			NSERROR_OK);
+	ck_assert_int_eq(display_list_tiles_add(tiles, 1, 0, &dl),
+			NSERROR_OK);
+
+	/* Tiles used by this redraw are not replaced */
+	ck_assert_int_eq(display_list_tiles_add(tiles, 2, 0, &dl),
+			NSERROR_NOSPACE);
+
+	/* The least recently used tile is replaced */
+	display_list_tiles_start(tiles);
+	ck_assert(display_list_tiles_find(tiles, 1, 0) != NULL);
+	display_list_tiles_start(tiles);
+	ck_assert_int_eq(display_list_tiles_add(tiles, 2, 0, &dl),
+			NSERROR_OK);
+	ck_assert(display_list_tiles_find(tiles, 0, 0) == NULL);
+	ck_assert(display_list_tiles_find(tiles, 1, 0) != NULL);
+	ck_assert(display_list_tiles_find(tiles, 2, 0) == dl);
+
+	display_list_tiles_destroy(tiles);
+}
+END_TEST
+
+static TCase *display_list_tiles_case_create(void)
+{
+	TCase *tc;
+	tc = tcase_create("Tile sets");
+
+	tcase_add_test(tc, display_list_tiles_find_test);
+	tcase_add_test(tc, display_list_tiles_invalidate_test);
+	tcase_add_test(tc, display_list_tiles_replace_test);
+
+	return tc;
+}
+
+
+static Suite *display_list_suite(void)
+{
+	Suite *s;
+	s = suite_create("Display list");
+
+	suite_add_tcase(s, display_list_record_case_create());
+	suite_add_tcase(s, display_list_dump_case_create());
+	suite_add_tcase(s, display_list_tiles_case_create());
+
+	return s;
+}
+
+int main(int argc, char **argv)
+{
+	int number_failed;
+	Suite *s;
+	SRunner *sr;
+
+	s = display_list_suite();
+
+	sr = srunner_create(s);
+	srunner_run_all(sr, CK_ENV);
+
+	number_failed = srunner_ntests_failed(sr);
+	srunner_free(sr);
+
+	return (number_failed == 0) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
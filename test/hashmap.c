@@ -41,6 +41,7 @@
 #include "utils/hashmap.h"
 
 #include "test/malloc_fig.h"
+#include "test/benchmark.h"
 
 /* Low level fixtures */
 
@@ -151,6 +152,19 @@ static hashmap_parameters_t test_params = {
 	.value_destroy = value_destroy,
 };
 
+static hashmap_parameters_t test_flat_params = {
+	.key_clone = key_clone,
+	.key_hash = key_hash,
+	.key_eq = key_eq,
+	.key_destroy = key_destroy,
+	.value_alloc = value_alloc,
+	.value_destroy = value_destroy,
+	.flat = true,
+};
+
+/** parameters used by the fixtures to create the test hashmap */
+static hashmap_parameters_t *fixture_params = &test_params;
+
 /* Iteration helpers */
 
 static size_t iteration_counter = 0;
@@ -174,7 +188,7 @@ basic_fixture_create(void)
 {
 	corestring_create();
 
-	test_hashmap = hashmap_create(&test_params);
+	test_hashmap = hashmap_create(fixture_params);
 
 	ck_assert(test_hashmap != NULL);
 	ck_assert_int_eq(keys, 0);
@@ -193,6 +207,20 @@ basic_fixture_teardown(void)
 	corestring_teardown();
 }
 
+static void
+flat_basic_fixture_create(void)
+{
+	fixture_params = &test_flat_params;
+	basic_fixture_create();
+}
+
+static void
+flat_basic_fixture_teardown(void)
+{
+	basic_fixture_teardown();
+	fixture_params = &test_params;
+}
+
 /* basic api tests */
 
 START_TEST(empty_hashmap_create_destroy)
@@ -276,14 +304,20 @@ START_TEST(iterate_one_and_stop)
 }
 END_TEST
 
-static TCase *basic_api_case_create(void)
+static TCase *basic_api_case_create(bool flat)
 {
 	TCase *tc;
-	tc = tcase_create("Basic API");
+	tc = tcase_create(flat ? "Flat basic API" : "Basic API");
 	
-	tcase_add_unchecked_fixture(tc,
-				    basic_fixture_create,
-				    basic_fixture_teardown);
+	if (flat) {
+		tcase_add_unchecked_fixture(tc,
+					    flat_basic_fixture_create,
+					    flat_basic_fixture_teardown);
+	} else {
+		tcase_add_unchecked_fixture(tc,
+					    basic_fixture_create,
+					    basic_fixture_teardown);
+	}
 	
 	tcase_add_test(tc, empty_hashmap_create_destroy);
 	tcase_add_test(tc, check_not_present);
@@ -355,6 +389,20 @@ chain_fixture_teardown(void)
 	basic_fixture_teardown();
 }
 
+static void
+flat_chain_fixture_create(void)
+{
+	fixture_params = &test_flat_params;
+	chain_fixture_create();
+}
+
+static void
+flat_chain_fixture_teardown(void)
+{
+	chain_fixture_teardown();
+	fixture_params = &test_params;
+}
+
 START_TEST(chain_add_remove_all)
 {
 	case_pair *chain_case;
@@ -479,12 +527,16 @@ END_TEST
 
 #define CHAIN_TEST_MALLOC_COUNT_MAX 60
 
-START_TEST(chain_add_all_remove_all_alloc)
+/* the flat layout does not allocate an entry for each key */
+#define FLAT_TEST_MALLOC_COUNT_MAX 48
+
+static void
+add_all_remove_all_alloc(int limit, int count_max)
 {
 	bool failed = false;
 	case_pair *chain_case;
 		
-	malloc_limit(_i);
+	malloc_limit(limit);
 
 	for (chain_case = chain_pairs;
 	     chain_case->url != NULL;
@@ -513,13 +565,24 @@ START_TEST(chain_add_all_remove_all_alloc)
 	ck_assert_int_eq(keys, 0);
 	ck_assert_int_eq(values, 0);
 	
-	if (_i < CHAIN_TEST_MALLOC_COUNT_MAX) {
+	if (limit < count_max) {
 		ck_assert(failed);
 	} else {
 		ck_assert(!failed);
 	}
 	
 }
+
+START_TEST(chain_add_all_remove_all_alloc)
+{
+	add_all_remove_all_alloc(_i, CHAIN_TEST_MALLOC_COUNT_MAX);
+}
+END_TEST
+
+START_TEST(flat_add_all_remove_all_alloc)
+{
+	add_all_remove_all_alloc(_i, FLAT_TEST_MALLOC_COUNT_MAX);
+}
 END_TEST
 
 static TCase *chain_case_create(void)
@@ -541,6 +604,221 @@ static TCase *chain_case_create(void)
 	return tc;
 }
 
+static TCase *flat_probe_case_create(void)
+{
+	TCase *tc;
+	tc = tcase_create("Flat probe tests");
+	
+	tcase_add_unchecked_fixture(tc,
+				    flat_chain_fixture_create,
+				    flat_chain_fixture_teardown);
+	
+	tcase_add_test(tc, chain_add_remove_all);
+	tcase_add_test(tc, chain_add_all_remove_all);
+	tcase_add_test(tc, chain_add_all_twice_remove_all);
+	tcase_add_test(tc, chain_add_all_twice_remove_all_iterate);
+
+	tcase_add_loop_test(tc, flat_add_all_remove_all_alloc, 0, FLAT_TEST_MALLOC_COUNT_MAX + 1);
+	
+	return tc;
+}
+
+/* Growth and benchmark suite
+ *
+ * These use integer keys so the cost measured is that of the map. The
+ * benchmarks only run when NETSURF_TEST_BENCHMARK is set in the
+ * environment, as by the benchmark make target.
+ */
+
+static uint32_t
+int_key_hash(void *key)
+{
+	uint32_t hash = (uint32_t)(uintptr_t)key;
+
+	hash ^= hash >> 16;
+	hash *= 0x7feb352d;
+	hash ^= hash >> 15;
+	return hash;
+}
+
+static void *
+int_key_clone(void *key)
+{
+	return key;
+}
+
+static void
+int_key_destroy(void *key)
+{
+}
+
+static bool
+int_key_eq(void *key1, void *key2)
+{
+	return key1 == key2;
+}
+
+static void *
+int_value_alloc(void *key)
+{
+	uintptr_t *ret = malloc(sizeof(uintptr_t));
+
+	if (ret == NULL)
+		return NULL;
+
+	*ret = (uintptr_t)key;
+
+	return ret;
+}
+
+static void
+int_value_destroy(void *value)
+{
+	free(value);
+}
+
+static hashmap_parameters_t int_params[] = {
+	{
+		.key_clone = int_key_clone,
+		.key_hash = int_key_hash,
+		.key_eq = int_key_eq,
+		.key_destroy = int_key_destroy,
+		.value_alloc = int_value_alloc,
+		.value_destroy = int_value_destroy,
+	},
+	{
+		.key_clone = int_key_clone,
+		.key_hash = int_key_hash,
+		.key_eq = int_key_eq,
+		.key_destroy = int_key_destroy,
+		.value_alloc = int_value_alloc,
+		.value_destroy = int_value_destroy,
+		.flat = true,
+	},
+};
+
+#define INT_PARAMS_COUNT (sizeof(int_params) / sizeof(int_params[0]))
+
+static bool
+int_iterator_cb(void *key, void *value, void *ctx)
+{
+	ck_assert(*(uintptr_t *)value == (uintptr_t)key);
+	(*(size_t *)ctx)++;
+	return false;
+}
+
+#define GROWTH_TEST_ENTRIES 50000
+
+START_TEST(growth_insert_remove)
+{
+	hashmap_t *map = hashmap_create(&int_params[_i]);
+	uintptr_t key;
+	size_t count = 0;
+
+	ck_assert(map != NULL);
+
+	for (key = 1; key <= GROWTH_TEST_ENTRIES; key++) {
+		ck_assert(hashmap_insert(map, (void *)key) != NULL);
+	}
+	ck_assert_int_eq(hashmap_count(map), GROWTH_TEST_ENTRIES);
+
+	/* remove the odd keys */
+	for (key = 1; key <= GROWTH_TEST_ENTRIES; key += 2) {
+		ck_assert(hashmap_remove(map, (void *)key) == true);
+	}
+	ck_assert_int_eq(hashmap_count(map), GROWTH_TEST_ENTRIES / 2);
+
+	for (key = 1; key <= GROWTH_TEST_ENTRIES; key++) {
+		uintptr_t *value = hashmap_lookup(map, (void *)key);
+		if ((key & 1) == 1) {
+			ck_assert(value == NULL);
+		} else {
+			ck_assert(value != NULL);
+			ck_assert(*value == key);
+		}
+	}
+
+	ck_assert(hashmap_iterate(map, int_iterator_cb, &count) == false);
+	ck_assert_int_eq(count, GROWTH_TEST_ENTRIES / 2);
+
+	hashmap_destroy(map);
+}
+END_TEST
+
+static const size_t benchmark_sizes[] = { 1000, 100000, 1000000 };
+
+#define BENCHMARK_SIZES_COUNT (sizeof(benchmark_sizes) / sizeof(benchmark_sizes[0]))
+
+/** Iterations over the whole map in the iteration benchmark */
+#define BENCHMARK_ITERATIONS 10
+
+START_TEST(benchmark_throughput)
+{
+	hashmap_parameters_t *params = &int_params[_i % INT_PARAMS_COUNT];
+	size_t entries = benchmark_sizes[_i / INT_PARAMS_COUNT];
+	hashmap_t *map;
+	uintptr_t key;
+	size_t count;
+	clock_t start;
+	double insert_rate, lookup_rate, iterate_rate;
+	int iteration;
+
+	map = hashmap_create(params);
+	ck_assert(map != NULL);
+
+	start = benchmark_start();
+	for (key = 1; key <= entries; key++) {
+		ck_assert(hashmap_insert(map, (void *)key) != NULL);
+	}
+	insert_rate = benchmark_rate(entries, start);
+
+	start = benchmark_start();
+	for (key = 1; key <= entries; key++) {
+		ck_assert(hashmap_lookup(map, (void *)key) != NULL);
+	}
+	lookup_rate = benchmark_rate(entries, start);
+
+	start = benchmark_start();
+	for (iteration = 0; iteration < BENCHMARK_ITERATIONS; iteration++) {
+		count = 0;
+		hashmap_iterate(map, int_iterator_cb, &count);
+		ck_assert_int_eq(count, entries);
+	}
+	iterate_rate = benchmark_rate(entries * BENCHMARK_ITERATIONS, start);
+
+	printf("hashmap %-5s %8zu entries: "
+	       "insert %.0f/s lookup %.0f/s iterate %.0f/s\n",
+	       params->flat ? "flat" : "chain", entries,
+	       insert_rate, lookup_rate, iterate_rate);
+
+	hashmap_destroy(map);
+}
+END_TEST
+
+static TCase *growth_case_create(void)
+{
+	TCase *tc;
+	tc = tcase_create("Growth");
+
+	tcase_add_loop_test(tc, growth_insert_remove, 0, INT_PARAMS_COUNT);
+
+	return tc;
+}
+
+static TCase *benchmark_case_create(void)
+{
+	TCase *tc;
+	tc = tcase_create("Benchmarks");
+
+	/* the largest benchmark maps a million entries */
+	tcase_set_timeout(tc, 120);
+
+	tcase_add_loop_test(tc, benchmark_throughput,
+			    0, INT_PARAMS_COUNT * BENCHMARK_SIZES_COUNT);
+
+	return tc;
+}
+
 /*
  * hashmap test suite creation
  */
@@ -549,8 +827,14 @@ static Suite *hashmap_suite_create(void)
 	Suite *s;
 	s = suite_create("Hashmap");
 
-	suite_add_tcase(s, basic_api_case_create());
+	suite_add_tcase(s, basic_api_case_create(false));
+	suite_add_tcase(s, basic_api_case_create(true));
 	suite_add_tcase(s, chain_case_create());
+	suite_add_tcase(s, flat_probe_case_create());
+	suite_add_tcase(s, growth_case_create());
+	if (benchmark_enabled()) {
+		suite_add_tcase(s, benchmark_case_create());
+	}
 
 	return s;
 }
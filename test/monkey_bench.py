@@ -0,0 +1,269 @@
+#!/usr/bin/python3
+#
+# Copyright 2026 The NetSurf Developers
+#
+# This file is part of NetSurf, http://www.netsurf-browser.org/
+#
+# NetSurf is free software; you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation; version 2 of the License.
+#
+# NetSurf is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+"""
+measures page loads in monkey over a corpus of saved pages
+
+Each page is loaded in a newly started browser, redrawn once and the
+time spent in each phase of the load reported by the browser is
+recorded.  The median of several loads of each page is written out as
+JSON and may be compared against a previous run to find regressions.
+"""
+
+# pylint: disable=locally-disabled, missing-docstring
+
+import os
+import sys
+import getopt
+import contextlib
+import json
+import time
+import functools
+import statistics
+import threading
+import http.server
+
+from monkeyfarmer import Browser
+
+
+PAGE_SUFFIXES = (".html", ".htm", ".xhtml")
+
+
+def print_usage():
+    print('Usage:')
+    print('  ' + sys.argv[0] + ' -m <path to monkey> -c <corpus directory> [options]')
+    print('')
+    print('Options:')
+    print('  -n <count>      number of loads of each page (default 5)')
+    print('  -o <file>       write results to file instead of stdout')
+    print('  -b <file>       compare results against a baseline results file')
+    print('  -t <percent>    slowdown treated as a regression (default 10)')
+    print('  -d <us>         smallest slowdown treated as a regression (default 1000)')
+    print('  -s              serve the corpus over local HTTP instead of file:')
+    print('  -O <option>     browser option, e.g. -O enable_javascript=0')
+    print('  -w <wrapper>    wrapper arguments as for monkey_driver.py')
+
+
+def parse_argv(argv):
+    conf = {
+        "monkey": '',
+        "corpus": '',
+        "iterations": 5,
+        "output": None,
+        "baseline": None,
+        "threshold": 10.0,
+        "min_delta": 1000,
+        "serve": False,
+        "options": [],
+        "wrapper": None,
+    }
+    try:
+        opts, _args = getopt.getopt(argv, "hm:c:n:o:b:t:d:sO:w:")
+    except getopt.GetoptError:
+        print_usage()
+        sys.exit(2)
+    for opt, arg in opts:
+        if opt == '-h':
+            print_usage()
+            sys.exit()
+        elif opt == '-m':
+            conf["monkey"] = arg
+        elif opt == '-c':
+            conf["corpus"] = arg
+        elif opt == '-n':
+            conf["iterations"] = int(arg)
+        elif opt == '-o':
+            conf["output"] = arg
+        elif opt == '-b':
+            conf["baseline"] = arg
+        elif opt == '-t':
+            conf["threshold"] = float(arg)
+        elif opt == '-d':
+            conf["min_delta"] = int(arg)
+        elif opt == '-s':
+            conf["serve"] = True
+        elif opt == '-O':
+            conf["options"].append(arg)
+        elif opt == '-w':
+            if conf["wrapper"] is None:
+                conf["wrapper"] = []
+            conf["wrapper"].extend(arg.split())
+
+    if conf["monkey"] == '' or conf["corpus"] == '' or conf["iterations"] < 1:
+        print_usage()
+        sys.exit(2)
+
+    return conf
+
+
+def find_pages(corpus):
+    pages = []
+    for root, _dirs, files in os.walk(corpus):
+        for fname in files:
+            if fname.lower().endswith(PAGE_SUFFIXES):
+                pages.append(os.path.relpath(os.path.join(root, fname), corpus))
+    pages.sort()
+    return pages
+
+
+class QuietHandler(http.server.SimpleHTTPRequestHandler):
+    def log_message(self, *args):
+        pass
+
+
+def start_server(corpus):
+    handler = functools.partial(QuietHandler, directory=corpus)
+    server = http.server.ThreadingHTTPServer(("127.0.0.1", 0), handler)
+    thread = threading.Thread(target=server.serve_forever, daemon=True)
+    thread.start()
+    return server
+
+
+def page_url(conf, server, page):
+    if server is not None:
+        return "http://127.0.0.1:{}/{}".format(
+            server.server_address[1], page.replace(os.sep, "/"))
+    return "file://" + os.path.abspath(os.path.join(conf["corpus"], page))
+
+
+def load_once(conf, url):
+    browser = Browser(monkey_cmd=[conf["monkey"]], quiet=True,
+                      wrapper=conf["wrapper"])
+    assert browser.started
+    for option in conf["options"]:
+        browser.pass_options(option)
+
+    win = browser.new_window()
+    browser.perf_start()
+    start = time.time()
+    win.load_page(url)
+    loaded = time.time()
+    win.redraw()
+    perf = browser.perf_report()
+    browser.perf_stop()
+    assert browser.quit_and_wait()
+
+    perf["load_us"] = int((loaded - start) * 1000000)
+    return perf
+
+
+def summarise(loads):
+    def median(values):
+        return int(statistics.median(values))
+
+    first = loads[0]
+    result = {
+        "load_us": median([load["load_us"] for load in loads]),
+        "first_layout_us": median([load["marks"]["first_layout"] for load in loads]),
+        "phases": {},
+        "counters": {},
+    }
+    for name in first["phases"]:
+        result["phases"][name] = {
+            "count": median([load["phases"][name]["count"] for load in loads]),
+            "time_us": median([load["phases"][name]["time_us"] for load in loads]),
+        }
+    for name in first["counters"]:
+        result["counters"][name] = median([load["counters"][name] for load in loads])
+
+    lookups = sum(result["counters"].get(name, 0) for name in
+                  ("cache_hit", "cache_miss", "cache_revalidate"))
+    if lookups > 0:
+        result["cache_hit_ratio"] = result["counters"].get("cache_hit", 0) / lookups
+    else:
+        result["cache_hit_ratio"] = 0.0
+    return result
+
+
+def run_bench(conf):
+    pages = find_pages(conf["corpus"])
+    if not pages:
+        print("No pages found in {}".format(conf["corpus"]), file=sys.stderr)
+        sys.exit(2)
+
+    server = start_server(conf["corpus"]) if conf["serve"] else None
+
+    results = {
+        "iterations": conf["iterations"],
+        "transport": "http" if server is not None else "file",
+        "pages": {},
+    }
+    try:
+        # keep the farmer's chatter out of results written to stdout
+        with contextlib.redirect_stdout(sys.stderr):
+            for page in pages:
+                url = page_url(conf, server, page)
+                print("Loading {}".format(url))
+                loads = [load_once(conf, url) for _ in range(conf["iterations"])]
+                results["pages"][page] = summarise(loads)
+    finally:
+        if server is not None:
+            server.shutdown()
+
+    return results
+
+
+def timings(page):
+    yield ("load", page["load_us"])
+    yield ("first_layout", page["first_layout_us"])
+    for name, phase in page["phases"].items():
+        yield (name, phase["time_us"])
+
+
+def compare(conf, results):
+    with open(conf["baseline"], 'r') as stream:
+        baseline = json.load(stream)
+
+    regressions = []
+    for page, current in results["pages"].items():
+        base = baseline["pages"].get(page)
+        if base is None:
+            continue
+        base_times = dict(timings(base))
+        for name, taken in timings(current):
+            before = base_times.get(name)
+            if before is None:
+                continue
+            limit = before * (1 + conf["threshold"] / 100)
+            if taken > limit and taken - before >= conf["min_delta"]:
+                regressions.append((page, name, before, taken))
+
+    for (page, name, before, taken) in regressions:
+        print("REGRESSION {} {}: {}us -> {}us".format(page, name, before, taken),
+              file=sys.stderr)
+    return regressions
+
+
+def main(argv):
+    conf = parse_argv(argv)
+    results = run_bench(conf)
+
+    if conf["output"] is None:
+        json.dump(results, sys.stdout, indent=2, sort_keys=True)
+        print()
+    else:
+        with open(conf["output"], 'w') as stream:
+            json.dump(results, stream, indent=2, sort_keys=True)
+
+    if conf["baseline"] is not None and compare(conf, results):
+        sys.exit(1)
+
+
+# Some python weirdness to get to main().
+if __name__ == "__main__":
+    main(sys.argv[1:])
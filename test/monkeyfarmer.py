@@ -220,6 +220,8 @@ class Browser:
         self.started = False
         self.stopped = False
         self.launchurl = None
+        self.perf = None
+        self.perf_reporting = False
         now = time.time()
         timeout = now + 1
 
@@ -291,6 +293,39 @@ class Browser:
         if self.current_draw_target is not None:
             self.current_draw_target.handle_plot(*args)
 
+    def handle_PERF(self, what, *args):
+        if what == 'REPORT':
+            if args[0] == 'START':
+                self.perf = {"phases": {}, "counters": {}, "marks": {}}
+                self.perf_reporting = True
+            else:
+                self.perf_reporting = False
+        elif what == 'PHASE':
+            (name, _count, count, _time, taken) = args
+            self.perf["phases"][name.lower()] = {
+                "count": int(count),
+                "time_us": int(taken),
+            }
+        elif what == 'COUNTER':
+            (name, _count, count) = args
+            self.perf["counters"][name.lower()] = int(count)
+        elif what == 'MARK':
+            (name, _time, taken) = args
+            self.perf["marks"][name.lower()] = int(taken)
+
+    def perf_start(self):
+        self.farmer.tell_monkey("PERF START")
+
+    def perf_stop(self):
+        self.farmer.tell_monkey("PERF STOP")
+
+    def perf_report(self):
+        self.perf = None
+        self.farmer.tell_monkey("PERF REPORT")
+        while self.perf is None or self.perf_reporting:
+            self.farmer.loop(once=True)
+        return self.perf
+
     def new_window(self, url=None):
         if url is None:
             self.farmer.tell_monkey("WINDOW NEW")
@@ -43,6 +43,8 @@
 #include "desktop/gui_internal.h"
 #include "desktop/cookie_manager.h"
 
+#include "test/benchmark.h"
+
 /**
  * url database used as input to test sets
  */
@@ -593,7 +595,7 @@ START_TEST(urldb_session_test)
 
 	/* write database out */
 	outnam = testnam(NULL);
-	res = urldb_save(outnam);
+	res = urldb_export(outnam);
 	ck_assert_int_eq(res, NSERROR_OK);
 
 	/* check the url database file written and the test file match */
@@ -619,6 +621,66 @@ START_TEST(urldb_session_test)
 }
 END_TEST
 
+/**
+ * Session snapshot test case
+ *
+ * The database is saved as a snapshot which is loaded and exported
+ * to give the same result as exporting the original database.
+ */
+START_TEST(urldb_session_snapshot_test)
+{
+	nserror res;
+	char snapnam[64];
+	char *outnam;
+	nsurl *url;
+	const struct url_data *data;
+
+	/* writing output requires options initialising */
+	res = nsoption_init(NULL, NULL, NULL);
+	ck_assert_int_eq(res, NSERROR_OK);
+
+	res = urldb_load(test_urldb_path);
+	ck_assert_int_eq(res, NSERROR_OK);
+
+	/* write snapshot out */
+	snprintf(snapnam, sizeof snapnam, "%s", testnam(NULL));
+	res = urldb_save(snapnam);
+	ck_assert_int_eq(res, NSERROR_OK);
+
+	/* replace the database with the snapshot */
+	urldb_destroy();
+
+	res = urldb_load(snapnam);
+	ck_assert_int_eq(res, NSERROR_OK);
+
+	/* look up an entry before the snapshot is fully loaded */
+	res = nsurl_create("https://en.wikipedia.org/wiki/Main_Page", &url);
+	ck_assert_int_eq(res, NSERROR_OK);
+
+	data = urldb_get_url_data(url);
+	ck_assert(data != NULL);
+	ck_assert_str_eq(data->title, "Wikipedia, the free encyclopedia");
+
+	nsurl_unref(url);
+
+	/* export database */
+	outnam = testnam(NULL);
+	res = urldb_export(outnam);
+	ck_assert_int_eq(res, NSERROR_OK);
+
+	/* check the exported file and the test file match */
+	ck_assert_int_eq(cmp(outnam, test_urldb_out_path), 0);
+
+	/* remove test output */
+	unlink(outnam);
+	unlink(snapnam);
+
+	/* finalise options */
+	res = nsoption_finalise(NULL, NULL);
+	ck_assert_int_eq(res, NSERROR_OK);
+}
+END_TEST
+
 /**
  * Session more extensive test case
  *
@@ -705,6 +767,7 @@ static TCase *urldb_session_case_create(void)
 				  urldb_teardown);
 
 	tcase_add_test(tc, urldb_session_test);
+	tcase_add_test(tc, urldb_session_snapshot_test);
 	tcase_add_test(tc, urldb_session_add_test);
 
 	return tc;
@@ -1019,6 +1082,42 @@ START_TEST(urldb_cookie_delete_test)
 }
 END_TEST
 
+START_TEST(urldb_cookie_header_cache_test)
+{
+	char *cdata; /* cookie data */
+
+	ck_assert(test_urldb_set_cookie("a=b; Path=/\r\n", "http://cache.example.org/dir/page", NULL));
+	cdata = test_urldb_get_cookie("http://cache.example.org/dir/page");
+	ck_assert_str_eq(cdata, "a=b");
+	free(cdata);
+
+	/* repeated request is answered from the cache */
+	cdata = test_urldb_get_cookie("http://cache.example.org/dir/page");
+	ck_assert_str_eq(cdata, "a=b");
+	free(cdata);
+
+	/* adding a cookie replaces the cached header, longest path first */
+	ck_assert(test_urldb_set_cookie("c=d; Path=/dir/\r\n", "http://cache.example.org/dir/page", NULL));
+	cdata = test_urldb_get_cookie("http://cache.example.org/dir/page");
+	ck_assert_str_eq(cdata, "c=d; a=b");
+	free(cdata);
+
+	/* secure cookies are only sent with secure requests */
+	ck_assert(test_urldb_set_cookie("s=t; Path=/; Secure\r\n", "https://cache.example.org/", NULL));
+	cdata = test_urldb_get_cookie("http://cache.example.org/dir/page");
+	ck_assert_str_eq(cdata, "c=d; a=b");
+	free(cdata);
+	cdata = test_urldb_get_cookie("https://cache.example.org/dir/page");
+	ck_assert_str_eq(cdata, "c=d; a=b; s=t");
+	free(cdata);
+
+	/* path matching stops at segment boundaries */
+	cdata = test_urldb_get_cookie("http://cache.example.org/directory");
+	ck_assert_str_eq(cdata, "a=b");
+	free(cdata);
+}
+END_TEST
+
 /**
  * Test case for urldb cookie management
  */
@@ -1035,6 +1134,7 @@ static TCase *urldb_cookie_case_create(void)
 	tcase_add_test(tc, urldb_cookie_create_test);
 	tcase_add_test(tc, urldb_iterate_cookies_test);
 	tcase_add_test(tc, urldb_cookie_delete_test);
+	tcase_add_test(tc, urldb_cookie_header_cache_test);
 
 	return tc;
 }
@@ -1123,6 +1223,188 @@ static TCase *urldb_api_case_create(void)
 	return tc;
 }
 
+/** Number of sibling paths in the fan-out benchmark */
+#define FANOUT_COUNT 10000
+
+/** Number of sibling path segment names in the sibling test */
+#define SIBLING_SEGMENTS 10
+
+/** Scheme and port variants of each sibling path segment */
+static const char *sibling_origins[] = {
+	"http://siblings.example.com",
+	"https://siblings.example.com",
+	"http://siblings.example.com:8080",
+	"https://siblings.example.com:8443",
+};
+
+#define SIBLING_ORIGINS_COUNT \
+	(sizeof(sibling_origins) / sizeof(sibling_origins[0]))
+
+/**
+ * Make a sibling test url
+ */
+static nsurl *make_sibling_url(unsigned int origin, unsigned int segment)
+{
+	char buf[64];
+
+	snprintf(buf, sizeof buf, "%s/segment%u",
+		 sibling_origins[origin], segment);
+	return make_url(buf);
+}
+
+/**
+ * Test finding entries on a host with more sibling paths than are
+ * searched without an index
+ *
+ * Siblings share segment names, and differ only in scheme and port.
+ */
+START_TEST(urldb_path_siblings_test)
+{
+	const struct url_data *data;
+	nsurl *url;
+	char title[32];
+	unsigned int origin, segment;
+
+	/* more siblings than the threshold for indexing them */
+	ck_assert(SIBLING_ORIGINS_COUNT * SIBLING_SEGMENTS > 16);
+
+	for (segment = 0; segment < SIBLING_SEGMENTS; segment++) {
+		for (origin = 0; origin < SIBLING_ORIGINS_COUNT; origin++) {
+			url = make_sibling_url(origin, segment);
+			snprintf(title, sizeof title, "%u-%u", origin, segment);
+			ck_assert(urldb_add_url(url) == true);
+			ck_assert_int_eq(urldb_set_url_title(url, title),
+					 NSERROR_OK);
+			nsurl_unref(url);
+		}
+	}
+
+	for (segment = 0; segment < SIBLING_SEGMENTS; segment++) {
+		for (origin = 0; origin < SIBLING_ORIGINS_COUNT; origin++) {
+			url = make_sibling_url(origin, segment);
+			snprintf(title, sizeof title, "%u-%u", origin, segment);
+
+			ck_assert(urldb_get_url(url) != NULL);
+			ck_assert(nsurl_compare(urldb_get_url(url), url,
+						NSURL_COMPLETE) == true);
+
+			data = urldb_get_url_data(url);
+			ck_assert(data != NULL);
+			ck_assert_str_eq(data->title, title);
+
+			nsurl_unref(url);
+		}
+	}
+
+	/* a segment only added with other schemes and ports */
+	url = make_url("https://siblings.example.com:8080/segment0");
+	ck_assert(urldb_get_url(url) == NULL);
+	ck_assert(urldb_get_url_data(url) == NULL);
+	nsurl_unref(url);
+
+	/* a segment never added */
+	url = make_url("http://siblings.example.com/segment10");
+	ck_assert(urldb_get_url(url) == NULL);
+	ck_assert(urldb_get_url_data(url) == NULL);
+	nsurl_unref(url);
+}
+END_TEST
+
+/**
+ * Test case for hosts with many sibling paths
+ */
+static TCase *urldb_siblings_case_create(void)
+{
+	TCase *tc;
+	tc = tcase_create("Path_siblings");
+
+	tcase_add_checked_fixture(tc,
+				  urldb_create,
+				  urldb_teardown);
+
+	tcase_add_test(tc, urldb_path_siblings_test);
+
+	return tc;
+}
+
+/**
+ * Benchmark finding entries on a host with many sibling paths
+ */
+START_TEST(urldb_path_fanout_benchmark)
+{
+	nserror res;
+	nsurl **urls;
+	nsurl *miss;
+	char buf[64];
+	unsigned int i;
+	clock_t start;
+	double add_rate, find_rate, miss_rate;
+
+	urls = calloc(FANOUT_COUNT, sizeof(*urls));
+	ck_assert(urls != NULL);
+
+	for (i = 0; i < FANOUT_COUNT; i++) {
+		snprintf(buf, sizeof buf,
+			 "http://fanout.example.com/search/%u", i);
+		res = nsurl_create(buf, &urls[i]);
+		ck_assert_int_eq(res, NSERROR_OK);
+	}
+
+	start = benchmark_start();
+	for (i = 0; i < FANOUT_COUNT; i++) {
+		ck_assert(urldb_add_url(urls[i]) == true);
+	}
+	add_rate = benchmark_rate(FANOUT_COUNT, start);
+
+	start = benchmark_start();
+	for (i = 0; i < FANOUT_COUNT; i++) {
+		ck_assert(urldb_get_url_data(urls[i]) != NULL);
+	}
+	find_rate = benchmark_rate(FANOUT_COUNT, start);
+
+	start = benchmark_start();
+	for (i = 0; i < FANOUT_COUNT; i++) {
+		snprintf(buf, sizeof buf,
+			 "http://fanout.example.com/search/%u/more", i);
+		res = nsurl_create(buf, &miss);
+		ck_assert_int_eq(res, NSERROR_OK);
+		ck_assert(urldb_get_url_data(miss) == NULL);
+		nsurl_unref(miss);
+	}
+	miss_rate = benchmark_rate(FANOUT_COUNT, start);
+
+	printf("urldb %u siblings: add %.0f/s find %.0f/s miss %.0f/s\n",
+	       FANOUT_COUNT, add_rate, find_rate, miss_rate);
+
+	for (i = 0; i < FANOUT_COUNT; i++) {
+		nsurl_unref(urls[i]);
+	}
+	free(urls);
+}
+END_TEST
+
+/**
+ * Test case for path lookup performance
+ *
+ * Only run when NETSURF_TEST_BENCHMARK is set in the environment.
+ */
+static TCase *urldb_fanout_case_create(void)
+{
+	TCase *tc;
+	tc = tcase_create("Path_fanout");
+
+	tcase_add_checked_fixture(tc,
+				  urldb_create,
+				  urldb_teardown);
+
+	tcase_add_test(tc, urldb_path_fanout_benchmark);
+
+	tcase_set_timeout(tc, 60);
+
+	return tc;
+}
+
+
 /**
  * Test suite for url database
  */
@@ -1137,6 +1419,10 @@ static Suite *urldb_suite_create(void)
 	suite_add_tcase(s, urldb_case_create());
 	suite_add_tcase(s, urldb_cookie_case_create());
 	suite_add_tcase(s, urldb_original_case_create());
+	suite_add_tcase(s, urldb_siblings_case_create());
+	if (benchmark_enabled()) {
+		suite_add_tcase(s, urldb_fanout_case_create());
+	}
 
 	return s;
 }
@@ -96,4 +96,32 @@ bool bloom_search_hash(struct bloom_filter *b, uint32_t hash);
  */
 uint32_t bloom_items(struct bloom_filter *b);
 
+/**
+ * Get the raw filter data of a bloom filter.
+ *
+ * Allows a filter to be stored and later restored with bloom_merge().
+ *
+ * \param b Bloom filter to examine
+ * \param size Updated with the size of the filter data in bytes
+ * \return Pointer to the filter data
+ */
+const uint8_t *bloom_data(struct bloom_filter *b, size_t *size);
+
+/**
+ * Merge previously stored filter data into a bloom filter.
+ *
+ * After merging the filter will match everything the stored filter
+ * matched as well as its own entries.
+ *
+ * \param b Bloom filter to merge into
+ * \param filter The filter data
+ * \param size Size of the filter data in bytes
+ * \param items Number of items in the filter data
+ * \return true on success or false if the size differs from the filter
+ */
+bool bloom_merge(struct bloom_filter *b,
+		 const uint8_t *filter,
+		 size_t size,
+		 uint32_t items);
+
 #endif
@@ -140,6 +140,11 @@ char *realpath(const char *path, char *resolved_path);
 #undef HAVE_MMAP
 #endif
 
+#define HAVE_PTHREAD
+#if (defined(_WIN32) || defined(__riscos__) || defined(__BEOS__) || defined(__amigaos4__) || defined(__AMIGA__) || defined(__MINT__))
+#undef HAVE_PTHREAD
+#endif
+
 #define HAVE_SCANDIR
 #if (defined(_WIN32) ||				\
      defined(__serenity__))
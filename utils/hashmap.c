@@ -22,10 +22,26 @@
 #include "utils/hashmap.h"
 
 /**
- * The default number of buckets in the hashmaps we create.
+ * The default number of buckets in the chained hashmaps we create.
  */
 #define DEFAULT_HASHMAP_BUCKETS (4091)
 
+/**
+ * The average chain length at which a chained hashmap grows.
+ */
+#define HASHMAP_MAX_CHAIN_LOAD (2)
+
+/**
+ * The log2 of the default number of slots in flat hashmaps.
+ */
+#define DEFAULT_HASHMAP_SLOTS_LOG2 (6)
+
+/**
+ * The proportion of slots, in eighths, which may be used before a flat
+ * hashmap grows.
+ */
+#define HASHMAP_MAX_SLOT_LOAD (7)
+
 /**
  * Hashmaps have chains of entries in buckets.
  */
@@ -37,6 +53,19 @@ typedef struct hashmap_entry_s {
 	uint32_t key_hash;
 } hashmap_entry_t;
 
+/**
+ * Flat hashmaps hold their entries inline in an array of slots.
+ *
+ * Collisions are resolved with robin hood linear probing, each slot
+ * recording how far its entry is from its home slot.
+ */
+typedef struct hashmap_slot_s {
+	void *key;
+	void *value;
+	uint32_t key_hash;
+	uint32_t distance; /**< Distance from home slot plus one, 0 if empty */
+} hashmap_slot_t;
+
 /**
  * The content of a hashmap
  */
@@ -56,12 +85,169 @@ struct hashmap_s {
 	 */
 	uint32_t bucket_count;
 
+	/**
+	 * The slots of a flat map
+	 */
+	hashmap_slot_t *slots;
+
+	/**
+	 * The log2 of the number of slots in a flat map
+	 */
+	uint32_t slot_log2;
+
 	/**
 	 * The number of entries in this map
 	 */
 	size_t entry_count;
 };
 
+/**
+ * Find the home slot for a hash in a flat hashmap
+ *
+ * The hash is mixed so that poorly distributed low bits still spread
+ * across the table.
+ */
+static inline uint32_t
+hashmap_slot_home(hashmap_t *hashmap, uint32_t hash)
+{
+	return (hash * 2654435769u) >> (32 - hashmap->slot_log2);
+}
+
+/**
+ * Place an entry known not to be present into a flat hashmap
+ *
+ * \param hashmap The hashmap to place the entry into
+ * \param entry The entry to place, its distance is ignored
+ */
+static void
+hashmap_slot_place(hashmap_t *hashmap, hashmap_slot_t entry)
+{
+	uint32_t mask = (1u << hashmap->slot_log2) - 1;
+	uint32_t slot = hashmap_slot_home(hashmap, entry.key_hash);
+	hashmap_slot_t temp;
+
+	entry.distance = 1;
+	while (hashmap->slots[slot].distance != 0) {
+		if (hashmap->slots[slot].distance < entry.distance) {
+			/* steal from the richer entry */
+			temp = hashmap->slots[slot];
+			hashmap->slots[slot] = entry;
+			entry = temp;
+		}
+		slot = (slot + 1) & mask;
+		entry.distance++;
+	}
+	hashmap->slots[slot] = entry;
+}
+
+/**
+ * Find the slot holding a key in a flat hashmap
+ *
+ * \return The slot or NULL if the key is not present
+ */
+static hashmap_slot_t *
+hashmap_slot_find(hashmap_t *hashmap, void *key, uint32_t hash)
+{
+	uint32_t mask = (1u << hashmap->slot_log2) - 1;
+	uint32_t slot = hashmap_slot_home(hashmap, hash);
+	uint32_t distance = 1;
+
+	/* an entry closer to its home than we would be ends the search */
+	while (hashmap->slots[slot].distance >= distance) {
+		if (hashmap->slots[slot].key_hash == hash &&
+		    hashmap->params->key_eq(key, hashmap->slots[slot].key)) {
+			return &hashmap->slots[slot];
+		}
+		slot = (slot + 1) & mask;
+		distance++;
+	}
+
+	return NULL;
+}
+
+/**
+ * Double the number of slots in a flat hashmap
+ *
+ * \return true on success, false if allocation failed
+ */
+static bool
+hashmap_slots_grow(hashmap_t *hashmap)
+{
+	hashmap_slot_t *old_slots = hashmap->slots;
+	uint32_t old_count = 1u << hashmap->slot_log2;
+	uint32_t slot;
+
+	if (hashmap->slot_log2 >= 31) {
+		return false;
+	}
+
+	hashmap->slots = calloc((size_t)old_count * 2, sizeof(hashmap_slot_t));
+	if (hashmap->slots == NULL) {
+		hashmap->slots = old_slots;
+		return false;
+	}
+	hashmap->slot_log2++;
+
+	for (slot = 0; slot < old_count; slot++) {
+		if (old_slots[slot].distance != 0) {
+			hashmap_slot_place(hashmap, old_slots[slot]);
+		}
+	}
+
+	free(old_slots);
+
+	return true;
+}
+
+/**
+ * Double the number of buckets in a chained hashmap
+ *
+ * Entries keep their hash so the chains are relinked without
+ * rehashing any keys.
+ *
+ * \return true on success, false if allocation failed
+ */
+static bool
+hashmap_buckets_grow(hashmap_t *hashmap)
+{
+	hashmap_entry_t **old_buckets = hashmap->buckets;
+	uint32_t old_count = hashmap->bucket_count;
+	uint32_t new_count = (old_count * 2) + 1;
+	hashmap_entry_t *entry, *next;
+	uint32_t bucket;
+
+	if (new_count <= old_count) {
+		return false;
+	}
+
+	hashmap->buckets = calloc(new_count, sizeof(hashmap_entry_t *));
+	if (hashmap->buckets == NULL) {
+		hashmap->buckets = old_buckets;
+		return false;
+	}
+	hashmap->bucket_count = new_count;
+
+	for (bucket = 0; bucket < old_count; bucket++) {
+		for (entry = old_buckets[bucket]; entry != NULL; entry = next) {
+			hashmap_entry_t **head;
+
+			next = entry->next;
+			head = &hashmap->buckets[entry->key_hash % new_count];
+
+			entry->prevptr = head;
+			entry->next = *head;
+			if (entry->next != NULL) {
+				entry->next->prevptr = &entry->next;
+			}
+			*head = entry;
+		}
+	}
+
+	free(old_buckets);
+
+	return true;
+}
+
 /* Exported function, documented in hashmap.h */
 hashmap_t *
 hashmap_create(hashmap_parameters_t *params)
@@ -72,8 +258,24 @@ hashmap_create(hashmap_parameters_t *params)
 	}
 
 	ret->params = params;
-	ret->bucket_count = DEFAULT_HASHMAP_BUCKETS;
 	ret->entry_count = 0;
+	ret->buckets = NULL;
+	ret->bucket_count = 0;
+	ret->slots = NULL;
+	ret->slot_log2 = 0;
+
+	if (params->flat) {
+		ret->slot_log2 = DEFAULT_HASHMAP_SLOTS_LOG2;
+		ret->slots = calloc(1u << ret->slot_log2,
+				    sizeof(hashmap_slot_t));
+		if (ret->slots == NULL) {
+			free(ret);
+			return NULL;
+		}
+		return ret;
+	}
+
+	ret->bucket_count = DEFAULT_HASHMAP_BUCKETS;
 	ret->buckets = malloc(ret->bucket_count * sizeof(hashmap_entry_t *));
 
 	if (ret->buckets == NULL) {
@@ -93,6 +295,22 @@ hashmap_destroy(hashmap_t *hashmap)
 	uint32_t bucket;
 	hashmap_entry_t *entry;
 
+	if (hashmap->slots != NULL) {
+		uint32_t slot;
+
+		for (slot = 0; slot < (1u << hashmap->slot_log2); slot++) {
+			if (hashmap->slots[slot].distance != 0) {
+				hashmap->params->value_destroy(
+					hashmap->slots[slot].value);
+				hashmap->params->key_destroy(
+					hashmap->slots[slot].key);
+			}
+		}
+		free(hashmap->slots);
+		free(hashmap);
+		return;
+	}
+
 	for (bucket = 0; bucket < hashmap->bucket_count; bucket++) {
 		for (entry = hashmap->buckets[bucket];
 		     entry != NULL;) {
@@ -113,7 +331,15 @@ void *
 hashmap_lookup(hashmap_t *hashmap, void *key)
 {
 	uint32_t hash = hashmap->params->key_hash(key);
-	hashmap_entry_t *entry = hashmap->buckets[hash % hashmap->bucket_count];
+	hashmap_entry_t *entry;
+
+	if (hashmap->slots != NULL) {
+		hashmap_slot_t *slot = hashmap_slot_find(hashmap, key, hash);
+
+		return (slot == NULL) ? NULL : slot->value;
+	}
+
+	entry = hashmap->buckets[hash % hashmap->bucket_count];
 
 	for(;entry != NULL; entry = entry->next) {
 		if (entry->key_hash == hash) {
@@ -126,35 +352,107 @@ hashmap_lookup(hashmap_t *hashmap, void *key)
 	return NULL;
 }
 
+/**
+ * Replace the key and value of an existing entry
+ *
+ * \param hashmap The hashmap holding the entry
+ * \param key The key being inserted
+ * \param entry_key Location of the entry's key
+ * \param entry_value Location of the entry's value
+ * \return The new value pointer, or NULL if allocation failed.
+ */
+static void *
+hashmap_replace(hashmap_t *hashmap,
+		void *key,
+		void **entry_key,
+		void **entry_value)
+{
+	void *new_key, *new_value;
+
+	new_key = hashmap->params->key_clone(key);
+	if (new_key == NULL) {
+		/* Allocation failed */
+		return NULL;
+	}
+	new_value = hashmap->params->value_alloc(new_key);
+	if (new_value == NULL) {
+		/* Allocation failed */
+		hashmap->params->key_destroy(new_key);
+		return NULL;
+	}
+	hashmap->params->value_destroy(*entry_value);
+	hashmap->params->key_destroy(*entry_key);
+	*entry_value = new_value;
+	*entry_key = new_key;
+	return new_value;
+}
+
+/**
+ * Insert into a flat hashmap
+ */
+static void *
+hashmap_slot_insert(hashmap_t *hashmap, void *key, uint32_t hash)
+{
+	hashmap_slot_t *found;
+	hashmap_slot_t entry;
+	size_t slot_count;
+
+	found = hashmap_slot_find(hashmap, key, hash);
+	if (found != NULL) {
+		/* This key is already here */
+		return hashmap_replace(hashmap, key, &found->key, &found->value);
+	}
+
+	slot_count = (size_t)1 << hashmap->slot_log2;
+	if (((hashmap->entry_count + 1) * 8) > (slot_count * HASHMAP_MAX_SLOT_LOAD)) {
+		/* Failing to grow is fine while there is still a free slot */
+		if ((hashmap_slots_grow(hashmap) == false) &&
+		    ((hashmap->entry_count + 1) >= slot_count)) {
+			return NULL;
+		}
+	}
+
+	entry.key = hashmap->params->key_clone(key);
+	if (entry.key == NULL) {
+		return NULL;
+	}
+	entry.key_hash = hash;
+
+	entry.value = hashmap->params->value_alloc(entry.key);
+	if (entry.value == NULL) {
+		hashmap->params->key_destroy(entry.key);
+		return NULL;
+	}
+
+	hashmap_slot_place(hashmap, entry);
+
+	hashmap->entry_count++;
+
+	return entry.value;
+}
+
 /* Exported function, documented in hashmap.h */
 void *
 hashmap_insert(hashmap_t *hashmap, void *key)
 {
 	uint32_t hash = hashmap->params->key_hash(key);
-	uint32_t bucket = hash % hashmap->bucket_count;
-	hashmap_entry_t *entry = hashmap->buckets[bucket];
-	void *new_key, *new_value;
+	uint32_t bucket;
+	hashmap_entry_t *entry;
+
+	if (hashmap->slots != NULL) {
+		return hashmap_slot_insert(hashmap, key, hash);
+	}
+
+	bucket = hash % hashmap->bucket_count;
+	entry = hashmap->buckets[bucket];
 
 	for(;entry != NULL; entry = entry->next) {
 		if (entry->key_hash == hash) {
 			if (hashmap->params->key_eq(key, entry->key)) {
 				/* This key is already here */
-				new_key = hashmap->params->key_clone(key);
-				if (new_key == NULL) {
-					/* Allocation failed */
-					return NULL;
-				}
-				new_value = hashmap->params->value_alloc(entry->key);
-				if (new_value == NULL) {
-					/* Allocation failed */
-					hashmap->params->key_destroy(new_key);
-					return NULL;
-				}
-				hashmap->params->value_destroy(entry->value);
-				hashmap->params->key_destroy(entry->key);
-				entry->value = new_value;
-				entry->key = new_key;
-				return entry->value;
+				return hashmap_replace(hashmap, key,
+						       &entry->key,
+						       &entry->value);
 			}
 		}
 	}
@@ -179,6 +477,14 @@ hashmap_insert(hashmap_t *hashmap, void *key)
 		goto err;
 	}
 
+	/* Grow once the chains get long. This is not fatal if it fails */
+	if (hashmap->entry_count >=
+	    (size_t)hashmap->bucket_count * HASHMAP_MAX_CHAIN_LOAD) {
+		if (hashmap_buckets_grow(hashmap)) {
+			bucket = hash % hashmap->bucket_count;
+		}
+	}
+
 	entry->prevptr = &(hashmap->buckets[bucket]);
 	entry->next = hashmap->buckets[bucket];
 	if (entry->next != NULL) {
@@ -201,13 +507,52 @@ err:
 	return NULL;
 }
 
+/**
+ * Remove from a flat hashmap
+ */
+static bool
+hashmap_slot_remove(hashmap_t *hashmap, void *key, uint32_t hash)
+{
+	uint32_t mask = (1u << hashmap->slot_log2) - 1;
+	hashmap_slot_t *found;
+	uint32_t slot, next;
+
+	found = hashmap_slot_find(hashmap, key, hash);
+	if (found == NULL) {
+		return false;
+	}
+
+	hashmap->params->value_destroy(found->value);
+	hashmap->params->key_destroy(found->key);
+
+	/* shift following displaced entries back towards their home */
+	slot = found - hashmap->slots;
+	next = (slot + 1) & mask;
+	while (hashmap->slots[next].distance > 1) {
+		hashmap->slots[slot] = hashmap->slots[next];
+		hashmap->slots[slot].distance--;
+		slot = next;
+		next = (next + 1) & mask;
+	}
+	hashmap->slots[slot].distance = 0;
+
+	hashmap->entry_count--;
+
+	return true;
+}
+
 /* Exported function, documented in hashmap.h */
 bool
 hashmap_remove(hashmap_t *hashmap, void *key)
 {
 	uint32_t hash = hashmap->params->key_hash(key);
-	
-	hashmap_entry_t *entry = hashmap->buckets[hash % hashmap->bucket_count];
+	hashmap_entry_t *entry;
+
+	if (hashmap->slots != NULL) {
+		return hashmap_slot_remove(hashmap, key, hash);
+	}
+
+	entry = hashmap->buckets[hash % hashmap->bucket_count];
 
 	for(;entry != NULL; entry = entry->next) {
 		if (entry->key_hash == hash) {
@@ -232,6 +577,21 @@ hashmap_remove(hashmap_t *hashmap, void *key)
 bool
 hashmap_iterate(hashmap_t *hashmap, hashmap_iteration_cb_t cb, void *ctx)
 {
+	if (hashmap->slots != NULL) {
+		for (uint32_t slot = 0;
+		     slot < (1u << hashmap->slot_log2);
+		     slot++) {
+			if (hashmap->slots[slot].distance == 0)
+				continue;
+			/* If the callback returns true, we early-exit */
+			if (cb(hashmap->slots[slot].key,
+			       hashmap->slots[slot].value,
+			       ctx))
+				return true;
+		}
+		return false;
+	}
+
 	for (uint32_t bucket = 0;
 	     bucket < hashmap->bucket_count;
 	     bucket++) {
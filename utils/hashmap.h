@@ -108,6 +108,16 @@ typedef struct {
 	 * A function which when called will destroy a value object
 	 */
 	hashmap_value_destroy_t value_destroy;
+
+	/**
+	 * Store entries in a flat open addressed table instead of
+	 * chains of separately allocated entries.
+	 *
+	 * The flat layout keeps each key, hash and value pointer
+	 * inline which makes lookups and iteration cheaper for large
+	 * maps. Value pointers remain stable in either layout.
+	 */
+	bool flat;
 } hashmap_parameters_t;
 
 
@@ -117,6 +127,9 @@ typedef struct {
  * The provided hashmap parameter table will be used for map operations
  * which need to allocate/free etc.
  *
+ * The map grows as entries are inserted to keep its load factor
+ * bounded.
+ *
  * \param params The hashmap parameters for this map
  */
 hashmap_t* hashmap_create(hashmap_parameters_t *params);
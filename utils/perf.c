@@ -0,0 +1,145 @@
+/*
+ * Copyright 2026 The NetSurf Developers
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Performance measurement (implementation).
+ */
+
+#include <string.h>
+#include <time.h>
+#include <nsutils/time.h>
+
+#include "utils/perf.h"
+
+/* exported interface documented in utils/perf.h */
+bool perf_enabled = false;
+
+/* exported interface documented in utils/perf.h */
+struct perf_stats perf_stats;
+
+/** Time of the last reset */
+static uint64_t perf_epoch;
+
+static const char *perf_phase_names[PERF_PHASE__COUNT] = {
+	[PERF_PHASE_FETCH] = "FETCH",
+	[PERF_PHASE_PARSE] = "PARSE",
+	[PERF_PHASE_BOX] = "BOX",
+	[PERF_PHASE_SELECT] = "SELECT",
+	[PERF_PHASE_LAYOUT] = "LAYOUT",
+	[PERF_PHASE_REDRAW] = "REDRAW",
+};
+
+static const char *perf_counter_names[PERF_COUNT__COUNT] = {
+	[PERF_COUNT_CACHE_HIT] = "CACHE_HIT",
+	[PERF_COUNT_CACHE_MISS] = "CACHE_MISS",
+	[PERF_COUNT_CACHE_REVALIDATE] = "CACHE_REVALIDATE",
+};
+
+static const char *perf_mark_names[PERF_MARK__COUNT] = {
+	[PERF_MARK_FIRST_LAYOUT] = "FIRST_LAYOUT",
+};
+
+
+/* exported interface documented in utils/perf.h */
+void perf_reset(bool enable)
+{
+	memset(&perf_stats, 0, sizeof(perf_stats));
+	perf_enabled = enable;
+	perf_epoch = perf_now();
+}
+
+
+/* exported interface documented in utils/perf.h */
+uint64_t perf_now(void)
+{
+#if defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0) {
+		return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+	}
+#endif
+	{
+		uint64_t ms = 0;
+
+		nsu_getmonotonic_ms(&ms);
+		return ms * 1000;
+	}
+}
+
+
+/* exported interface documented in utils/perf.h */
+void perf_end(enum perf_phase phase, uint64_t start)
+{
+	uint64_t now;
+
+	if (!perf_enabled || start == 0) {
+		/* measurement was not running when the phase began */
+		return;
+	}
+
+	now = perf_now();
+	if (now > start) {
+		perf_stats.phase[phase].time += now - start;
+	}
+	perf_stats.phase[phase].count++;
+}
+
+
+/* exported interface documented in utils/perf.h */
+void perf_mark(enum perf_mark mark)
+{
+	uint64_t now;
+
+	if (!perf_enabled || perf_stats.mark[mark] != 0) {
+		return;
+	}
+
+	now = perf_now();
+	/* a mark reached in the same microsecond as the reset is still set */
+	perf_stats.mark[mark] = (now > perf_epoch) ? now - perf_epoch : 1;
+}
+
+
+/* exported interface documented in utils/perf.h */
+const struct perf_stats *perf_get(void)
+{
+	return &perf_stats;
+}
+
+
+/* exported interface documented in utils/perf.h */
+const char *perf_phase_name(enum perf_phase phase)
+{
+	return perf_phase_names[phase];
+}
+
+
+/* exported interface documented in utils/perf.h */
+const char *perf_counter_name(enum perf_counter counter)
+{
+	return perf_counter_names[counter];
+}
+
+
+/* exported interface documented in utils/perf.h */
+const char *perf_mark_name(enum perf_mark mark)
+{
+	return perf_mark_names[mark];
+}
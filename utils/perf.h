@@ -0,0 +1,161 @@
+/*
+ * Copyright 2026 The NetSurf Developers
+ *
+ * This file is part of NetSurf, http://www.netsurf-browser.org/
+ *
+ * NetSurf is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; version 2 of the License.
+ *
+ * NetSurf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * \file
+ * Performance measurement (interface).
+ *
+ * Accumulates the time spent in each phase of loading and displaying
+ * content, along with some event counts, so the cost of a page load
+ * may be reported.  Nothing is measured until measurement is enabled
+ * with perf_reset().
+ */
+
+#ifndef NETSURF_UTILS_PERF_H
+#define NETSURF_UTILS_PERF_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/** Phases of content handling which are timed. */
+enum perf_phase {
+	PERF_PHASE_FETCH,	/**< Fetching, from start to completion */
+	PERF_PHASE_PARSE,	/**< Parsing source data */
+	PERF_PHASE_BOX,		/**< Box tree construction */
+	PERF_PHASE_SELECT,	/**< CSS selection, within box construction */
+	PERF_PHASE_LAYOUT,	/**< Layout, once per reflow */
+	PERF_PHASE_REDRAW,	/**< Redraw */
+	PERF_PHASE__COUNT
+};
+
+/** Events which are counted. */
+enum perf_counter {
+	PERF_COUNT_CACHE_HIT,	/**< Fresh object found in the cache */
+	PERF_COUNT_CACHE_MISS,	/**< No object found in the cache */
+	PERF_COUNT_CACHE_REVALIDATE, /**< Cached object needs validation */
+	PERF_COUNT__COUNT
+};
+
+/** Points in a page load whose time is recorded. */
+enum perf_mark {
+	PERF_MARK_FIRST_LAYOUT,	/**< First layout of a document completed */
+	PERF_MARK__COUNT
+};
+
+/** Accumulated measurements. */
+struct perf_stats {
+	struct {
+		uint64_t time;	/**< Total time in the phase, in us */
+		unsigned int count; /**< Number of times the phase ran */
+	} phase[PERF_PHASE__COUNT];
+	unsigned int counter[PERF_COUNT__COUNT];
+	/** Time of each mark since the reset, in us, or 0 if not reached */
+	uint64_t mark[PERF_MARK__COUNT];
+};
+
+/** Whether measurements are being made. */
+extern bool perf_enabled;
+
+/** Measurements made since the last reset. */
+extern struct perf_stats perf_stats;
+
+/**
+ * Discard all measurements and enable or disable measurement.
+ *
+ * \param enable true to start measuring
+ */
+void perf_reset(bool enable);
+
+/**
+ * Get the current time for measurement.
+ *
+ * \return monotonic time in microseconds
+ */
+uint64_t perf_now(void);
+
+/**
+ * Start timing a phase.
+ *
+ * \return start time to pass to perf_end(), or 0 if not measuring
+ */
+static inline uint64_t perf_begin(void)
+{
+	return perf_enabled ? perf_now() : 0;
+}
+
+/**
+ * Finish timing a phase.
+ *
+ * \param phase phase being timed
+ * \param start value returned by perf_begin() at the phase start
+ */
+void perf_end(enum perf_phase phase, uint64_t start);
+
+/**
+ * Count an event.
+ *
+ * \param counter counter to increment
+ */
+static inline void perf_count(enum perf_counter counter)
+{
+	if (perf_enabled) {
+		perf_stats.counter[counter]++;
+	}
+}
+
+/**
+ * Record that a point in loading has been reached.
+ *
+ * Only the first time each mark is reached after a reset is kept.
+ *
+ * \param mark point reached
+ */
+void perf_mark(enum perf_mark mark);
+
+/**
+ * Get the measurements made since the last reset.
+ *
+ * \return accumulated measurements
+ */
+const struct perf_stats *perf_get(void);
+
+/**
+ * Get the name of a phase.
+ *
+ * \param phase phase to name
+ * \return upper case name of the phase
+ */
+const char *perf_phase_name(enum perf_phase phase);
+
+/**
+ * Get the name of a counter.
+ *
+ * \param counter counter to name
+ * \return upper case name of the counter
+ */
+const char *perf_counter_name(enum perf_counter counter);
+
+/**
+ * Get the name of a mark.
+ *
+ * \param mark mark to name
+ * \return upper case name of the mark
+ */
+const char *perf_mark_name(enum perf_mark mark);
+
+#endif